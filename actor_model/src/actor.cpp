@@ -87,6 +87,7 @@ auto _actor_spawn(
       -> ResultUnion
     {
       std::vector<StatePtr> state_ptrs(actor_behaviours.size(), nullptr);
+      auto& cpu_stats = mailbox.get_cpu_stats();
 
       ResultUnion result;
 
@@ -96,10 +97,16 @@ auto _actor_spawn(
         // Wait for and obtain a reference to a message
         const Mailbox::ReceivedMessagePtr& received_message{mailbox.receive()};
 
-        if (received_message)
+        const auto* message = (
+          received_message? received_message->message() : nullptr
+        );
+
+        if (message)
         {
-          const auto& _message = received_message->ref();
-          const auto* message = flatbuffers::GetRoot<Message>(_message.data());
+          // Cycle counts are per-core, so a task which migrates between
+          // cores mid-message may be measured inaccurately
+          const auto is_sampled = cpu_stats.should_sample();
+          const auto start_ccount = is_sampled? get_cpu_cycle_count() : 0;
 
           auto idx = 0;
           for (const auto& actor_behaviour : actor_behaviours)
@@ -126,6 +133,11 @@ auto _actor_spawn(
               break;
             }
           }
+
+          if (is_sampled)
+          {
+            cpu_stats.record(*(message), get_cpu_cycle_count() - start_ccount);
+          }
         }
       }
 
@@ -133,7 +145,7 @@ auto _actor_spawn(
     }
   );
 
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   if (_initial_link_pid)
   {
     return node.spawn_link(
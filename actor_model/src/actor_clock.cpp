@@ -0,0 +1,48 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "actor_clock.h"
+
+#include "timestamp.h"
+
+namespace ActorModel {
+
+auto ActorClock::now() const
+  -> std::chrono::microseconds
+{
+  if (has_virtual_time)
+  {
+    return std::chrono::microseconds{virtual_microseconds.load()};
+  }
+
+  return utils::get_elapsed_microseconds();
+}
+
+auto ActorClock::set_virtual_time(const std::chrono::microseconds time)
+  -> void
+{
+  virtual_microseconds = time.count();
+  has_virtual_time = true;
+}
+
+auto ActorClock::is_virtual() const
+  -> bool
+{
+  return has_virtual_time;
+}
+
+auto get_default_clock()
+  -> const ActorClock&
+{
+  static const ActorClock default_clock;
+  return default_clock;
+}
+
+} // namespace ActorModel
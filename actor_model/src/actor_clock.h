@@ -0,0 +1,45 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ActorModel {
+
+// The time since boot, as a behaviour (or mailbox) should read it. Follows
+// the monotonic clock, until a virtual time is set (e.g. by a replay), after
+// which it only moves when set again.
+// Behaviours which need the time are handed a clock when they are created,
+// get_default_clock() unless they are to be replayed
+class ActorClock
+{
+public:
+  auto now() const
+    -> std::chrono::microseconds;
+
+  auto set_virtual_time(const std::chrono::microseconds time)
+    -> void;
+
+  auto is_virtual() const
+    -> bool;
+
+private:
+  std::atomic<bool> has_virtual_time{false};
+  std::atomic<int64_t> virtual_microseconds{0};
+};
+
+// Always follows the monotonic clock
+auto get_default_clock()
+  -> const ActorClock&;
+
+} // namespace ActorModel
@@ -0,0 +1,587 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "actor_coroutine.h"
+
+#include "actor_model.h"
+
+#include <new>
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "actor_coroutine";
+
+// Helper factory function
+auto _coroutine_spawn(
+  const CoroutineBehaviour&& _coroutine_behaviour,
+  const MaybePid& _initial_link_pid,
+  const ExecConfigCallback&& _exec_config_callback,
+  const size_t arena_size
+) -> Pid;
+
+CoroutineArena::CoroutineArena(const size_t _arena_size)
+: arena_buf(_arena_size? new uint8_t[_arena_size] : nullptr)
+, arena_size(_arena_size)
+{
+}
+
+auto CoroutineArena::allocate(const size_t size)
+  -> void*
+{
+  constexpr auto alignment = alignof(std::max_align_t);
+  const auto frame_size = (
+    (sizeof(FrameHeader) + size + alignment - 1) & ~(alignment - 1)
+  );
+
+  if (arena_buf and (used_size + frame_size <= arena_size))
+  {
+    auto* header = new (arena_buf.get() + used_size) FrameHeader{
+      this,
+      frame_size,
+      top_frame,
+      false
+    };
+
+    top_frame = used_size;
+    used_size += frame_size;
+
+    return (header + 1);
+  }
+
+  ESP_LOGD(TAG, "Arena full, allocating %zu byte frame from heap", size);
+  return allocate_heap(size);
+}
+
+auto CoroutineArena::get_used_size() const
+  -> size_t
+{
+  return used_size;
+}
+
+auto CoroutineArena::allocate_heap(const size_t size)
+  -> void*
+{
+  auto* header = new (::operator new(sizeof(FrameHeader) + size)) FrameHeader{
+    nullptr,
+    sizeof(FrameHeader) + size,
+    NoFrame,
+    false
+  };
+
+  return (header + 1);
+}
+
+auto CoroutineArena::deallocate(void* ptr)
+  -> void
+{
+  if (not ptr)
+  {
+    return;
+  }
+
+  auto* header = static_cast<FrameHeader*>(ptr) - 1;
+  if (header->arena)
+  {
+    header->arena->release(header);
+  }
+  else {
+    ::operator delete(header);
+  }
+}
+
+auto CoroutineArena::release(FrameHeader* header)
+  -> void
+{
+  header->released = true;
+
+  // Reclaim space from the top, including frames released out of order
+  while (top_frame != NoFrame)
+  {
+    auto* top_header = reinterpret_cast<FrameHeader*>(
+      arena_buf.get() + top_frame
+    );
+
+    if (not top_header->released)
+    {
+      break;
+    }
+
+    used_size = top_frame;
+    top_frame = top_header->previous;
+  }
+}
+
+CoroutineContext::CoroutineContext(const size_t arena_size)
+: arena(arena_size)
+{
+}
+
+auto CoroutineContext::deliver(const Message& message)
+  -> bool
+{
+  CoroutineTimeout coroutine_timeout;
+  if (matches(message, coroutine_timeout))
+  {
+    // Ignore timeouts which were cancelled after being sent
+    if (suspended and coroutine_timeout.seq == timeout_seq)
+    {
+      timeout_tref = NullTRef;
+      received = nullptr;
+      resume();
+      return true;
+    }
+
+    return false;
+  }
+
+  if (
+    suspended
+    and (awaiting_type.empty() or matches(message, awaiting_type))
+  )
+  {
+    cancel_timeout();
+    received = &message;
+    resume();
+    return true;
+  }
+
+  save(message);
+  return false;
+}
+
+auto CoroutineContext::take_saved(const MessageType type)
+  -> bool
+{
+  for (auto i = saved_messages.begin(); i != saved_messages.end(); ++i)
+  {
+    const auto* message = flatbuffers::GetRoot<Message>(i->data());
+    if (type.empty() or matches(*message, type))
+    {
+      // Keep the copy alive until the next co_await
+      received_saved = std::move(*i);
+      saved_messages.erase(i);
+
+      received = flatbuffers::GetRoot<Message>(received_saved.data());
+      return true;
+    }
+  }
+
+  return false;
+}
+
+auto CoroutineContext::suspend(
+  std::coroutine_handle<> handle,
+  const MessageType type,
+  const std::optional<Time> timeout
+) -> void
+{
+  suspended = handle;
+  awaiting_type = type;
+  received = nullptr;
+
+  if (timeout)
+  {
+    timeout_seq++;
+    timeout_tref = send_after(
+      *(timeout),
+      self,
+      CoroutineTimeout{timeout_seq}
+    );
+  }
+}
+
+auto CoroutineContext::take_received()
+  -> const Message*
+{
+  return received;
+}
+
+auto CoroutineContext::resume()
+  -> void
+{
+  auto handle = std::exchange(suspended, nullptr);
+  awaiting_type = {};
+
+  if (handle)
+  {
+    handle.resume();
+  }
+}
+
+auto CoroutineContext::cancel_timeout()
+  -> void
+{
+  if (timeout_tref != NullTRef)
+  {
+    cancel(timeout_tref);
+    timeout_tref = NullTRef;
+  }
+
+  // Any timeout already in the mailbox will no longer match
+  timeout_seq++;
+}
+
+auto CoroutineContext::save(const Message& message)
+  -> void
+{
+  // Copy, since the received message is released after this step
+  flatbuffers::FlatBufferBuilder fbb;
+
+  auto type_str = fbb.CreateString(message.type()->string_view());
+
+  const auto payload_size = message.payload()? message.payload()->size() : 0;
+  if (message.payload_alignment())
+  {
+    fbb.ForceVectorAlignment(
+      payload_size,
+      sizeof(uint8_t),
+      message.payload_alignment()
+    );
+  }
+
+  auto payload_bytes = fbb.CreateVector(
+    message.payload()? message.payload()->data() : nullptr,
+    payload_size
+  );
+
+  auto message_loc = CreateMessage(
+    fbb,
+    type_str,
+    message.timestamp(),
+    message.from_pid(),
+    message.payload_alignment(),
+    payload_bytes,
+    message.type_id()
+  );
+  FinishMessageBuffer(fbb, message_loc);
+
+  saved_messages.emplace_back(fbb.Release());
+}
+
+ActorCoroutine::ActorCoroutine(Handle _handle)
+: handle(_handle)
+{
+}
+
+ActorCoroutine::ActorCoroutine(ActorCoroutine&& other) noexcept
+: handle(std::exchange(other.handle, nullptr))
+{
+}
+
+ActorCoroutine::~ActorCoroutine()
+{
+  if (handle)
+  {
+    handle.destroy();
+  }
+}
+
+auto ActorCoroutine::operator=(ActorCoroutine&& other) noexcept
+  -> ActorCoroutine&
+{
+  if (this != &other)
+  {
+    if (handle)
+    {
+      handle.destroy();
+    }
+    handle = std::exchange(other.handle, nullptr);
+  }
+
+  return *this;
+}
+
+ActorCoroutine::operator bool() const
+{
+  return static_cast<bool>(handle);
+}
+
+auto ActorCoroutine::resume()
+  -> void
+{
+  if (handle and not handle.done())
+  {
+    handle.resume();
+  }
+}
+
+auto ActorCoroutine::done() const
+  -> bool
+{
+  return (not handle or handle.done());
+}
+
+auto ActorCoroutine::result() const
+  -> const ResultUnion&
+{
+  return handle.promise().result;
+}
+
+auto ActorCoroutine::await_ready() const noexcept
+  -> bool
+{
+  return (not handle or handle.done());
+}
+
+auto ActorCoroutine::await_suspend(std::coroutine_handle<> awaiting) noexcept
+  -> std::coroutine_handle<>
+{
+  // Start the nested coroutine, it continues the awaiting one when done
+  handle.promise().continuation = awaiting;
+  return handle;
+}
+
+auto ActorCoroutine::await_resume()
+  -> ResultUnion
+{
+  return handle? handle.promise().result : ResultUnion{};
+}
+
+ReceiveAwaiter::ReceiveAwaiter(
+  CoroutineContext& _context,
+  const MessageType _type,
+  const std::optional<Time> _timeout
+)
+: context(_context)
+, type(_type)
+, timeout(_timeout)
+{
+}
+
+auto ReceiveAwaiter::await_ready()
+  -> bool
+{
+  // Messages saved while awaiting something else are delivered first
+  return context.take_saved(type);
+}
+
+auto ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle)
+  -> void
+{
+  context.suspend(handle, type, timeout);
+}
+
+auto ReceiveAwaiter::await_resume()
+  -> const Message*
+{
+  return context.take_received();
+}
+
+SleepAwaiter::SleepAwaiter(CoroutineContext& _context, const Time _time)
+: context(_context)
+, time(_time)
+{
+}
+
+auto SleepAwaiter::await_ready()
+  -> bool
+{
+  return (time.count() <= 0);
+}
+
+auto SleepAwaiter::await_suspend(std::coroutine_handle<> handle)
+  -> void
+{
+  // Only the timeout itself matches, other messages are saved
+  context.suspend(handle, MessageTraits<CoroutineTimeout>::type, time);
+}
+
+auto SleepAwaiter::await_resume()
+  -> void
+{
+}
+
+auto receive(
+  CoroutineContext& context,
+  const MessageType type,
+  const std::optional<Time> timeout
+) -> ReceiveAwaiter
+{
+  return ReceiveAwaiter{context, type, timeout};
+}
+
+auto call(
+  CoroutineContext& context,
+  const Pid& pid,
+  const MessageType type,
+  const BufferView payload,
+  const MessageType reply_type,
+  const std::optional<Time> timeout
+) -> ReceiveAwaiter
+{
+  // The reply cannot be handled before this coroutine suspends,
+  // since both run from the same host task
+  send(pid, type, payload);
+
+  return ReceiveAwaiter{context, reply_type, timeout};
+}
+
+auto sleep(CoroutineContext& context, const Time time)
+  -> SleepAwaiter
+{
+  return SleepAwaiter{context, time};
+}
+
+auto spawn_coroutine(
+  const CoroutineBehaviour&& _coroutine_behaviour,
+  const ExecConfigCallback&& _exec_config_callback,
+  const size_t arena_size
+) -> Pid
+{
+  return _coroutine_spawn(
+    std::move(_coroutine_behaviour),
+    std::nullopt,
+    std::move(_exec_config_callback),
+    arena_size
+  );
+}
+
+auto spawn_coroutine_link(
+  const Pid& _initial_link_pid,
+  const CoroutineBehaviour&& _coroutine_behaviour,
+  const ExecConfigCallback&& _exec_config_callback,
+  const size_t arena_size
+) -> Pid
+{
+  return _coroutine_spawn(
+    std::move(_coroutine_behaviour),
+    _initial_link_pid,
+    std::move(_exec_config_callback),
+    arena_size
+  );
+}
+
+struct CoroutineState
+{
+  explicit CoroutineState(const size_t arena_size)
+  : context(arena_size)
+  {}
+
+  // The frame must be destroyed before the arena it was allocated from
+  CoroutineContext context;
+  ActorCoroutine coroutine;
+};
+
+auto _coroutine_spawn(
+  const CoroutineBehaviour&& _coroutine_behaviour,
+  const MaybePid& _initial_link_pid,
+  const ExecConfigCallback&& _exec_config_callback,
+  const size_t arena_size
+) -> Pid
+{
+  auto&& behaviour = (
+    [
+      coroutine_behaviour{std::move(_coroutine_behaviour)},
+      state{std::make_shared<CoroutineState>(arena_size)}
+    ]
+    (const Pid& pid, Mailbox& mailbox)
+      -> ResultUnion
+    {
+      auto& context = state->context;
+      auto& coroutine = state->coroutine;
+      auto& cpu_stats = mailbox.get_cpu_stats();
+
+      // Called from the host task, receive does not block
+      while (true)
+      {
+        const Mailbox::ReceivedMessagePtr& received_message{mailbox.receive()};
+        if (not received_message)
+        {
+          break;
+        }
+
+        const auto* message = received_message->message();
+        if (not message)
+        {
+          continue;
+        }
+
+        // Measured per message, as the host task runs each hosted process
+        // until its mailbox is drained
+        const auto is_sampled = cpu_stats.should_sample();
+        const auto start_ccount = is_sampled? get_cpu_cycle_count() : 0;
+
+        if (not coroutine)
+        {
+          if (matches<CoroutineStart>(*message))
+          {
+            // Run until the first co_await
+            context.self = pid;
+            coroutine = coroutine_behaviour(pid, context);
+            coroutine.resume();
+          }
+        }
+        else {
+          context.deliver(*message);
+        }
+
+        if (is_sampled)
+        {
+          cpu_stats.record(*message, get_cpu_cycle_count() - start_ccount);
+        }
+
+        if (coroutine and coroutine.done())
+        {
+          // Returning from the coroutine exits the process
+          const auto& result = coroutine.result();
+          if (result.type == Result::Error)
+          {
+            return result;
+          }
+
+          return {Result::Error, "normal"};
+        }
+      }
+
+      return {Result::Ok};
+    }
+  );
+
+  auto&& exec_config_callback = (
+    [user_exec_config_callback{std::move(_exec_config_callback)}]
+    (ProcessExecutionConfigBuilder& builder)
+    {
+      if (user_exec_config_callback)
+      {
+        user_exec_config_callback(builder);
+      }
+      builder.add_hosted(true);
+    }
+  );
+
+  auto& node = Process::get_calling_node();
+
+  Pid pid;
+  if (_initial_link_pid)
+  {
+    pid = node.spawn_link(
+      *(_initial_link_pid),
+      behaviour,
+      exec_config_callback
+    );
+  }
+  else {
+    pid = node.spawn(
+      behaviour,
+      exec_config_callback
+    );
+  }
+
+  if (not send(pid, CoroutineStart{}))
+  {
+    ESP_LOGE(TAG, "Unable to start coroutine %s", get_uuid_str(pid).c_str());
+  }
+
+  return pid;
+}
+
+} // namespace ActorModel
@@ -0,0 +1,368 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "behaviour.h"
+#include "node.h"
+#include "pid.h"
+#include "typed_message.h"
+
+#include "actor_model_generated.h"
+
+#include "delegate.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace ActorModel {
+
+constexpr size_t DefaultCoroutineArenaSize = 512;
+
+// Sent by spawn_coroutine to start the coroutine from the host task
+struct CoroutineStart {};
+
+template<>
+struct MessageTraits<CoroutineStart>
+{
+  static constexpr MessageType type = "coroutine_start";
+};
+
+// Sent (via send_after) to wake a coroutine from sleep or a receive timeout
+struct CoroutineTimeout
+{
+  uint32_t seq;
+};
+
+template<>
+struct MessageTraits<CoroutineTimeout>
+{
+  static constexpr MessageType type = "coroutine_timeout";
+};
+
+// Per-process storage for coroutine frames.
+// Nested coroutines are awaited one at a time, so frames are freed in
+// reverse order of allocation and a bump allocator is sufficient.
+// Frames which do not fit are allocated from the heap instead
+class CoroutineArena
+{
+public:
+  explicit CoroutineArena(const size_t _arena_size = DefaultCoroutineArenaSize);
+
+  auto allocate(const size_t size)
+    -> void*;
+
+  auto get_used_size() const
+    -> size_t;
+
+  static auto allocate_heap(const size_t size)
+    -> void*;
+
+  static auto deallocate(void* ptr)
+    -> void;
+
+protected:
+  struct alignas(std::max_align_t) FrameHeader
+  {
+    CoroutineArena* arena;
+    size_t size;
+    size_t previous;
+    bool released;
+  };
+
+  auto release(FrameHeader* header)
+    -> void;
+
+private:
+  static constexpr size_t NoFrame = static_cast<size_t>(-1);
+
+  std::unique_ptr<uint8_t[]> arena_buf;
+  size_t arena_size;
+  size_t used_size = 0;
+  size_t top_frame = NoFrame;
+};
+
+// Passed to a coroutine behaviour, tracks what it is currently awaiting.
+// A Message* obtained from an awaitable is valid until the next co_await
+class CoroutineContext
+{
+public:
+  using SavedMessages = std::deque<flatbuffers::DetachedBuffer>;
+
+  explicit CoroutineContext(const size_t arena_size = DefaultCoroutineArenaSize);
+
+  // Resume the suspended coroutine if it is waiting for this message,
+  // otherwise keep a copy of the message for a later receive
+  auto deliver(const Message& message)
+    -> bool;
+
+  auto take_saved(const MessageType type)
+    -> bool;
+
+  auto suspend(
+    std::coroutine_handle<> handle,
+    const MessageType type,
+    const std::optional<Time> timeout
+  ) -> void;
+
+  auto take_received()
+    -> const Message*;
+
+  Pid self = NullPid;
+  CoroutineArena arena;
+
+protected:
+  auto resume()
+    -> void;
+
+  auto cancel_timeout()
+    -> void;
+
+  auto save(const Message& message)
+    -> void;
+
+private:
+  std::coroutine_handle<> suspended;
+  MessageType awaiting_type;
+
+  const Message* received = nullptr;
+  flatbuffers::DetachedBuffer received_saved;
+  SavedMessages saved_messages;
+
+  TRef timeout_tref = NullTRef;
+  uint32_t timeout_seq = 0;
+};
+
+// Return type of coroutine behaviours, which is also awaitable so that
+// a behaviour can co_await nested coroutines taking the same context
+class ActorCoroutine
+{
+public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  struct FinalAwaiter
+  {
+    auto await_ready() const noexcept
+      -> bool
+    {
+      return false;
+    }
+
+    auto await_suspend(Handle handle) noexcept
+      -> std::coroutine_handle<>
+    {
+      // Continue the awaiting coroutine, if any
+      auto continuation = handle.promise().continuation;
+      return continuation? continuation : std::noop_coroutine();
+    }
+
+    auto await_resume() const noexcept
+      -> void
+    {}
+  };
+
+  struct promise_type
+  {
+    // Frames are allocated from the arena of the CoroutineContext parameter
+    template<typename... Args>
+    static auto operator new(
+      const size_t size,
+      CoroutineContext& context,
+      Args&&...
+    ) -> void*
+    {
+      return context.arena.allocate(size);
+    }
+
+    template<typename... Args>
+    static auto operator new(
+      const size_t size,
+      const Pid&,
+      CoroutineContext& context,
+      Args&&...
+    ) -> void*
+    {
+      return context.arena.allocate(size);
+    }
+
+    static auto operator new(const size_t size)
+      -> void*
+    {
+      return CoroutineArena::allocate_heap(size);
+    }
+
+    static auto operator delete(void* ptr)
+      -> void
+    {
+      CoroutineArena::deallocate(ptr);
+    }
+
+    auto get_return_object()
+      -> ActorCoroutine
+    {
+      return ActorCoroutine{Handle::from_promise(*this)};
+    }
+
+    // Started explicitly, by spawn_coroutine or when awaited
+    auto initial_suspend() noexcept
+      -> std::suspend_always
+    {
+      return {};
+    }
+
+    auto final_suspend() noexcept
+      -> FinalAwaiter
+    {
+      return {};
+    }
+
+    auto return_value(const ResultUnion& _result)
+      -> void
+    {
+      result = _result;
+    }
+
+    auto unhandled_exception()
+      -> void
+    {
+      result = ResultUnion{Result::Error, "unhandled_exception"};
+    }
+
+    ResultUnion result;
+    std::coroutine_handle<> continuation;
+  };
+
+  ActorCoroutine() = default;
+  explicit ActorCoroutine(Handle _handle);
+  ActorCoroutine(ActorCoroutine&& other) noexcept;
+  ActorCoroutine(const ActorCoroutine&) = delete;
+  ~ActorCoroutine();
+
+  auto operator=(ActorCoroutine&& other) noexcept
+    -> ActorCoroutine&;
+  auto operator=(const ActorCoroutine&)
+    -> ActorCoroutine& = delete;
+
+  explicit operator bool() const;
+
+  auto resume()
+    -> void;
+
+  auto done() const
+    -> bool;
+
+  auto result() const
+    -> const ResultUnion&;
+
+  // Awaitable:
+  auto await_ready() const noexcept
+    -> bool;
+
+  auto await_suspend(std::coroutine_handle<> awaiting) noexcept
+    -> std::coroutine_handle<>;
+
+  auto await_resume()
+    -> ResultUnion;
+
+private:
+  Handle handle;
+};
+
+using CoroutineBehaviour = delegate<ActorCoroutine(
+  const Pid&,
+  CoroutineContext&
+)>;
+
+class ReceiveAwaiter
+{
+public:
+  ReceiveAwaiter(
+    CoroutineContext& _context,
+    const MessageType _type,
+    const std::optional<Time> _timeout
+  );
+
+  auto await_ready()
+    -> bool;
+
+  auto await_suspend(std::coroutine_handle<> handle)
+    -> void;
+
+  auto await_resume()
+    -> const Message*;
+
+private:
+  CoroutineContext& context;
+  MessageType type;
+  std::optional<Time> timeout;
+};
+
+class SleepAwaiter
+{
+public:
+  SleepAwaiter(CoroutineContext& _context, const Time _time);
+
+  auto await_ready()
+    -> bool;
+
+  auto await_suspend(std::coroutine_handle<> handle)
+    -> void;
+
+  auto await_resume()
+    -> void;
+
+private:
+  CoroutineContext& context;
+  Time time;
+};
+
+// Wait for the next message, or the next message of a type (an empty type
+// matches any message). Returns nullptr only if the timeout expires first.
+// Messages of other types received meanwhile are kept, in order, for later
+auto receive(
+  CoroutineContext& context,
+  const MessageType type = {},
+  const std::optional<Time> timeout = std::nullopt
+) -> ReceiveAwaiter;
+
+// Send a request and wait for the reply message type
+auto call(
+  CoroutineContext& context,
+  const Pid& pid,
+  const MessageType type,
+  const BufferView payload,
+  const MessageType reply_type,
+  const std::optional<Time> timeout = std::nullopt
+) -> ReceiveAwaiter;
+
+auto sleep(CoroutineContext& context, const Time time)
+  -> SleepAwaiter;
+
+// Coroutine behaviours are run from the node's shared ProcessHost task,
+// rather than a task of their own
+auto spawn_coroutine(
+  const CoroutineBehaviour&& _coroutine_behaviour,
+  const ExecConfigCallback&& _exec_config_callback = nullptr,
+  const size_t arena_size = DefaultCoroutineArenaSize
+) -> Pid;
+
+auto spawn_coroutine_link(
+  const Pid& _initial_link_pid,
+  const CoroutineBehaviour&& _coroutine_behaviour,
+  const ExecConfigCallback&& _exec_config_callback = nullptr,
+  const size_t arena_size = DefaultCoroutineArenaSize
+) -> Pid;
+
+} // namespace ActorModel
@@ -15,7 +15,8 @@ namespace ActorModel {
 
 using Reason = Process::Reason;
 
-// free functions bound to default node
+// free functions bound to the calling process's node,
+// or the default node when called from outside any process
 
 // Generic behaviour convenience functions
 auto spawn(
@@ -23,7 +24,7 @@ auto spawn(
   const ExecConfigCallback&& _exec_config_callback
 ) -> Pid
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.spawn(
     std::move(_behaviour),
     std::move(_exec_config_callback)
@@ -36,7 +37,7 @@ auto spawn_link(
   const ExecConfigCallback&& _exec_config_callback
 ) -> Pid
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.spawn_link(
     _initial_link_pid,
     std::move(_behaviour),
@@ -50,7 +51,7 @@ auto process_flag(
   const bool flag_setting
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.process_flag(pid, flag, flag_setting);
 }
 
@@ -59,7 +60,7 @@ auto send(
   const Message& message
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.send(pid, message);
 }
 
@@ -69,7 +70,7 @@ auto send(
   const BufferView payload
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.send(pid, type, payload);
 }
 
@@ -79,19 +80,29 @@ auto send(
   const Buffer& payload_buf
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{payload_buf.data(), payload_buf.size()};
 
   return node.send(pid, type, payload);
 }
 
+auto send(
+  const Pid& pid,
+  const MessageType type,
+  const BufferViews payload_pieces
+) -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.send(pid, type, payload_pieces);
+}
+
 auto send(
   const Pid& pid,
   const MessageType type,
   const string_view payload_str
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     reinterpret_cast<const uint8_t*>(payload_str.data()),
     payload_str.size()
@@ -106,7 +117,7 @@ auto send(
   const string& payload_str
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     reinterpret_cast<const uint8_t*>(payload_str.data()),
     payload_str.size()
@@ -122,7 +133,7 @@ auto send(
   const flatbuffers::Vector<uint8_t>& payload_fbvec
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     payload_fbvec.data(),
     payload_fbvec.size()
@@ -137,7 +148,7 @@ auto send(
   const MessageFlatbuffer& payload_flatbuffer
 ) -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   auto payload = BufferView{
     payload_flatbuffer.data(),
     payload_flatbuffer.size()
@@ -146,13 +157,44 @@ auto send(
   return node.send(pid, type, payload);
 }
 
+auto send_typed(
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.send_typed(pid, type_id, value);
+}
+
+auto send_with_ttl(
+  const Pid& pid,
+  const TTL ttl,
+  const MessageType type,
+  const BufferView payload
+) -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.send_with_ttl(pid, ttl, type, payload);
+}
+
+auto coalesce(
+  const Pid& pid,
+  const MessageType type,
+  const bool coalesced
+) -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.coalesce(pid, type, coalesced);
+}
+
 auto send_after(
   const Time time,
   const Pid& pid,
   const Message& message
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.send_after(time, pid, message);
 }
 
@@ -163,7 +205,7 @@ auto send_after(
   const BufferView payload
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.send_after(time, pid, type, payload);
 }
 
@@ -174,7 +216,7 @@ auto send_after(
   const Buffer& payload_buf
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     reinterpret_cast<const uint8_t*>(payload_buf.data()),
     payload_buf.size()
@@ -190,7 +232,7 @@ auto send_after(
   const string_view payload_str
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     reinterpret_cast<const uint8_t*>(payload_str.data()),
     payload_str.size()
@@ -206,7 +248,7 @@ auto send_after(
   const string& payload_str
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     reinterpret_cast<const uint8_t*>(payload_str.data()),
     payload_str.size()
@@ -222,7 +264,7 @@ auto send_after(
   const MessageFlatbuffer& payload_flatbuffer
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   auto payload = BufferView{
     payload_flatbuffer.data(),
     payload_flatbuffer.size()
@@ -231,13 +273,24 @@ auto send_after(
   return node.send_after(time, pid, type, payload);
 }
 
+auto send_after_typed(
+  const Time time,
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> TRef
+{
+  auto& node = Process::get_calling_node();
+  return node.send_after_typed(time, pid, type_id, value);
+}
+
 auto send_interval(
   const Time time,
   const Pid& pid,
   const Message& message
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.send_interval(time, pid, message);
 }
 
@@ -248,7 +301,7 @@ auto send_interval(
   const BufferView payload
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.send_interval(time, pid, type, payload);
 }
 
@@ -259,7 +312,7 @@ auto send_interval(
   const Buffer& payload_buf
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     payload_buf.data(),
     payload_buf.size()
@@ -275,7 +328,7 @@ auto send_interval(
   const string_view payload_str
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   const auto payload = BufferView{
     reinterpret_cast<const uint8_t*>(payload_str.data()),
     payload_str.size()
@@ -291,7 +344,7 @@ auto send_interval(
   const MessageFlatbuffer& payload_flatbuffer
 ) -> TRef
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   auto payload = BufferView{
     payload_flatbuffer.data(),
     payload_flatbuffer.size()
@@ -300,52 +353,167 @@ auto send_interval(
   return node.send_interval(time, pid, type, payload);
 }
 
+auto send_interval_typed(
+  const Time time,
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> TRef
+{
+  auto& node = Process::get_calling_node();
+  return node.send_interval_typed(time, pid, type_id, value);
+}
+
 auto cancel(const TRef tref)
   -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.cancel(tref);
 }
 
 auto register_name(const Name name, const Pid& pid)
   -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.register_name(name, pid);
 }
 
 auto unregister(const Name name)
   -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.unregister(name);
 }
 
+auto register_global_name(const Name name, const Pid& pid)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.register_global_name(name, pid);
+}
+
 auto registered()
   -> const Node::NamedProcessRegistry
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.registered();
 }
 
 auto whereis(const Name name)
   -> MaybePid
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.whereis(name);
 }
 
 auto exit(const Pid& pid, const Pid& pid2, const Reason exit_reason)
   -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.exit(pid, pid2, exit_reason);
 }
 
+auto watch_socket(const Pid& pid, const int fd, const uint8_t interests)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.watch_socket(pid, fd, interests);
+}
+
+auto unwatch_socket(const int fd)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.unwatch_socket(fd);
+}
+
+auto open_channel(
+  const Pid& producer_pid,
+  const Pid& consumer_pid,
+  const size_t capacity
+) -> ChannelPtr
+{
+  auto& node = Process::get_calling_node();
+  return node.open_channel(producer_pid, consumer_pid, capacity);
+}
+
+auto get_channel(const ChannelId channel_id)
+  -> ChannelPtr
+{
+  auto& node = Process::get_calling_node();
+  return node.get_channel(channel_id);
+}
+
+auto close_channel(const ChannelId channel_id)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.close_channel(channel_id);
+}
+
+auto enable_snapshots(
+  const SnapshotStorage storage,
+  const std::string_view path,
+  const Time persist_interval
+) -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.enable_snapshots(storage, path, persist_interval);
+}
+
+auto save_snapshot(const Name key, const BufferView snapshot)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.save_snapshot(key, snapshot);
+}
+
+auto load_snapshot(const Name key)
+  -> SnapshotBuffer
+{
+  auto& node = Process::get_calling_node();
+  return node.load_snapshot(key);
+}
+
+auto erase_snapshot(const Name key)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.erase_snapshot(key);
+}
+
+auto persist_snapshots()
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.persist_snapshots();
+}
+
+auto trace(const Pid& pid, MessageTraceRecorder* recorder)
+  -> bool
+{
+  auto& node = Process::get_calling_node();
+  return node.trace(pid, recorder);
+}
+
+auto get_cpu_stats(const Pid& pid)
+  -> CpuStatsFlatbuffer
+{
+  auto& node = Process::get_calling_node();
+  return node.get_cpu_stats(pid);
+}
+
+auto get_cpu_stats()
+  -> CpuStatsFlatbuffer
+{
+  auto& node = Process::get_calling_node();
+  return node.get_cpu_stats();
+}
+
 auto module(const BufferView module_flatbuffer)
  -> bool
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.module(module_flatbuffer);
 }
 
@@ -355,7 +523,7 @@ auto apply(
   const BufferView args
 ) -> ResultUnion
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.apply(pid, function_name, args);
 }
 
@@ -366,7 +534,7 @@ auto apply(
   const BufferView args
 ) -> ResultUnion
 {
-  auto& node = Process::get_default_node();
+  auto& node = Process::get_calling_node();
   return node.apply(pid, module_name, function_name, args);
 }
 
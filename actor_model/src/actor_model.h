@@ -11,13 +11,22 @@
 #pragma once
 
 #include "actor.h"
+#include "actor_coroutine.h"
+#include "channel.h"
+#include "message_trace.h"
 #include "node.h"
 #include "process.h"
+#include "socket_reactor.h"
+#include "typed_message.h"
+#include "worker_pool.h"
 
 #include "actor_model_generated.h"
 
+#include <cstring>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
 
 namespace ActorModel {
 using Buffer = std::vector<uint8_t>;
@@ -63,6 +72,14 @@ auto send(
   const Buffer& payload_buf
 ) -> bool;
 
+// Gathers the pieces into one payload (e.g. a header and a body chunk),
+// without concatenating them first
+auto send(
+  const Pid& pid,
+  const MessageType type,
+  const BufferViews payload_pieces
+) -> bool;
+
 auto send(
   const Pid& pid,
   const MessageType type,
@@ -87,6 +104,62 @@ auto send(
   const MessageFlatbuffer& payload_flatbuffer
 ) -> bool;
 
+auto send_typed(
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> bool;
+
+// Dropped unseen if pid has not received it within ttl
+auto send_with_ttl(
+  const Pid& pid,
+  const TTL ttl,
+  const MessageType type,
+  const BufferView payload = {}
+) -> bool;
+
+// A message of a coalesced type is not queued for pid while another of the
+// same type is pending, e.g. for "tick" messages which are idempotent
+auto coalesce(
+  const Pid& pid,
+  const MessageType type,
+  const bool coalesced = true
+) -> bool;
+
+// Send a trivially-copyable value as a fixed-size typed record
+template<typename T, class /* SFINAE */ = std::enable_if_t<is_typed_message_v<T>>>
+inline
+auto send(
+  const Pid& pid,
+  const T& value
+) -> bool
+{
+  static_cast<void>(message_type_registered<T>);
+
+  return send_typed(
+    pid,
+    message_type_id<T>,
+    BufferView{
+      reinterpret_cast<const uint8_t*>(&value),
+      typed_message_payload_size<T>
+    }
+  );
+}
+
+// Send to the (cached) pid of a registered name,
+// fails without sending if the name is not registered
+template<typename... Args>
+inline
+auto send(
+  NameHandle& name_handle,
+  const MessageType type,
+  Args&&... args
+) -> bool
+{
+  const auto& pid = name_handle.pid();
+  return (pid and send(*(pid), type, std::forward<Args>(args)...));
+}
+
 auto send_after(
   const Time time,
   const Pid& pid,
@@ -128,6 +201,34 @@ auto send_after(
   const MessageFlatbuffer& payload_flatbuffer
 ) -> TRef;
 
+auto send_after_typed(
+  const Time time,
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> TRef;
+
+template<typename T, class /* SFINAE */ = std::enable_if_t<is_typed_message_v<T>>>
+inline
+auto send_after(
+  const Time time,
+  const Pid& pid,
+  const T& value
+) -> TRef
+{
+  static_cast<void>(message_type_registered<T>);
+
+  return send_after_typed(
+    time,
+    pid,
+    message_type_id<T>,
+    BufferView{
+      reinterpret_cast<const uint8_t*>(&value),
+      typed_message_payload_size<T>
+    }
+  );
+}
+
 auto send_interval(
   const Time time,
   const Pid& pid,
@@ -169,6 +270,34 @@ auto send_interval(
   const MessageFlatbuffer& payload_flatbuffer
 ) -> TRef;
 
+auto send_interval_typed(
+  const Time time,
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> TRef;
+
+template<typename T, class /* SFINAE */ = std::enable_if_t<is_typed_message_v<T>>>
+inline
+auto send_interval(
+  const Time time,
+  const Pid& pid,
+  const T& value
+) -> TRef
+{
+  static_cast<void>(message_type_registered<T>);
+
+  return send_interval_typed(
+    time,
+    pid,
+    message_type_id<T>,
+    BufferView{
+      reinterpret_cast<const uint8_t*>(&value),
+      typed_message_payload_size<T>
+    }
+  );
+}
+
 auto cancel(const TRef tref)
   -> bool;
 
@@ -181,12 +310,60 @@ auto register_name(const Name name, const Pid& pid)
 auto unregister(const Name name)
   -> bool;
 
+auto register_global_name(const Name name, const Pid& pid)
+  -> bool;
+
 auto registered()
   -> const Node::NamedProcessRegistry;
 
 auto whereis(const Name name)
   -> MaybePid;
 
+auto watch_socket(const Pid& pid, const int fd, const uint8_t interests)
+  -> bool;
+
+auto unwatch_socket(const int fd)
+  -> bool;
+
+auto open_channel(
+  const Pid& producer_pid,
+  const Pid& consumer_pid,
+  const size_t capacity
+) -> ChannelPtr;
+
+auto get_channel(const ChannelId channel_id)
+  -> ChannelPtr;
+
+auto close_channel(const ChannelId channel_id)
+  -> bool;
+
+auto enable_snapshots(
+  const SnapshotStorage storage,
+  const std::string_view path = "",
+  const Time persist_interval = Time{0}
+) -> bool;
+
+auto save_snapshot(const Name key, const BufferView snapshot)
+  -> bool;
+
+auto load_snapshot(const Name key)
+  -> SnapshotBuffer;
+
+auto erase_snapshot(const Name key)
+  -> bool;
+
+auto persist_snapshots()
+  -> bool;
+
+auto trace(const Pid& pid, MessageTraceRecorder* recorder)
+  -> bool;
+
+auto get_cpu_stats(const Pid& pid)
+  -> CpuStatsFlatbuffer;
+
+auto get_cpu_stats()
+  -> CpuStatsFlatbuffer;
+
 auto module(const BufferView module_flatbuffer)
  -> bool;
 
@@ -297,6 +474,51 @@ auto matches(
   return false;
 }
 
+// Match a typed message by its static type id,
+// or by type name if it was sent as a regular Message flatbuffer.
+// A typed record carries no timestamp or sender, so its Message has a
+// timestamp of 0 and no from_pid
+template<typename T, class /* SFINAE */ = std::enable_if_t<is_typed_message_v<T>>>
+inline
+auto matches(
+  const Message& message
+) -> bool
+{
+  // A process which only receives T must still be able to unpack it
+  static_cast<void>(message_type_registered<T>);
+
+  if (message.type_id() != NullMessageTypeId)
+  {
+    return (message.type_id() == message_type_id<T>);
+  }
+
+  return matches(message, MessageTraits<T>::type);
+}
+
+template<typename T, class /* SFINAE */ = std::enable_if_t<is_typed_message_v<T>>>
+inline
+auto matches(
+  const Message& message,
+  T& value
+) -> bool
+{
+  if (
+    matches<T>(message)
+    and message.payload()
+    and (message.payload()->size() == typed_message_payload_size<T>)
+  )
+  {
+    if constexpr (typed_message_payload_size<T> > 0)
+    {
+      memcpy(&value, message.payload()->data(), sizeof(T));
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
 template<typename TableT>
 inline
 auto matches(
@@ -0,0 +1,839 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "benchmarks.h"
+
+#include "actor.h"
+#include "actor_model.h"
+#include "mailbox.h"
+#include "distribution.h"
+#include "node.h"
+#include "worker_pool.h"
+
+#include "delay.h"
+#include "timestamp.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "benchmarks";
+
+// Long enough for any benchmark message, a timeout is counted as a failure
+constexpr size_t BenchmarkReceiveTimeoutMicroseconds = 1000000;
+constexpr size_t BenchmarkTaskStackSize = 3072;
+constexpr size_t BenchmarkMailboxSize = 4096;
+
+struct MailboxPingPongContext
+{
+  Mailbox* ping = nullptr;
+  Mailbox* pong = nullptr;
+  size_t round_trip_count = 0;
+  SemaphoreHandle_t done = nullptr;
+};
+
+struct MailboxProducerContext
+{
+  Mailbox* mailbox = nullptr;
+  size_t message_count = 0;
+  size_t payload_size = 0;
+  std::atomic<size_t> failures{0};
+  SemaphoreHandle_t done = nullptr;
+};
+
+// Children are spawned (linked) and killed one at a time by a process
+// which traps their exits
+struct ProcessSpawnContext
+{
+  size_t process_count = 0;
+  size_t spawned_count = 0;
+  size_t exited_count = 0;
+  size_t failures = 0;
+  SemaphoreHandle_t done = nullptr;
+};
+
+// Timer messages received by a process on the node they were sent from
+std::atomic<size_t> node_timer_deliveries{0};
+
+// A process on each node, the pong process replies to pings on the other node
+struct DistributionLoopbackContext
+{
+  Pid ping_pid = NullPid;
+  Pid pong_pid = NullPid;
+  std::vector<uint8_t> payload;
+  size_t round_trip_count = 0;
+  size_t completed_count = 0;
+  size_t failures = 0;
+  SemaphoreHandle_t done = nullptr;
+};
+
+constexpr uint16_t BenchmarkDistributionPortA = 4370;
+constexpr uint16_t BenchmarkDistributionPortB = 4371;
+
+void mailbox_echo_task(void* user_data = nullptr);
+void mailbox_producer_task(void* user_data = nullptr);
+
+auto benchmark_mailbox_placement(
+  const MemoryPlacement placement,
+  const size_t message_count,
+  const size_t payload_size
+) -> BenchmarkResult
+{
+  using utils::get_elapsed_microseconds;
+
+  BenchmarkResult result;
+
+  // Non-blocking, so a failure is counted rather than waited on
+  Mailbox mailbox(4096, 0, 0, 0, {}, placement);
+
+  const auto payload = std::vector<uint8_t>(payload_size, 0xa5);
+
+  const auto start = get_elapsed_microseconds();
+  for (size_t i = 0; i < message_count; ++i)
+  {
+    if (not mailbox.send("benchmark", payload))
+    {
+      result.failures++;
+      continue;
+    }
+
+    const auto& received_message = mailbox.receive();
+    if (not (received_message and received_message->message()))
+    {
+      result.failures++;
+      continue;
+    }
+
+    result.iterations++;
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  return result;
+}
+
+auto benchmark_mailbox_placements(
+  const size_t message_count,
+  const size_t payload_size
+) -> void
+{
+  for (const auto placement : EnumValuesMemoryPlacement())
+  {
+    const auto& result = benchmark_mailbox_placement(
+      placement,
+      message_count,
+      payload_size
+    );
+
+    ESP_LOGI(
+      TAG,
+      "Mailbox (%s): %zu messages of %zu bytes in %lld us, %.0f msg/s, %zu failed",
+      EnumNameMemoryPlacement(placement),
+      result.iterations,
+      payload_size,
+      static_cast<long long>(result.elapsed_microseconds),
+      result.get_rate_per_second(),
+      result.failures
+    );
+  }
+}
+
+auto benchmark_mailbox_ping_pong(
+  const MailboxBackend backend,
+  const size_t round_trip_count,
+  const size_t payload_size
+) -> BenchmarkResult
+{
+  using utils::get_elapsed_microseconds;
+
+  BenchmarkResult result;
+
+  Mailbox ping(
+    BenchmarkMailboxSize,
+    0,
+    BenchmarkReceiveTimeoutMicroseconds,
+    BenchmarkReceiveTimeoutMicroseconds,
+    {},
+    MemoryPlacement::any,
+    backend
+  );
+  Mailbox pong(
+    BenchmarkMailboxSize,
+    0,
+    BenchmarkReceiveTimeoutMicroseconds,
+    BenchmarkReceiveTimeoutMicroseconds,
+    {},
+    MemoryPlacement::any,
+    backend
+  );
+
+  MailboxPingPongContext context;
+  context.ping = &ping;
+  context.pong = &pong;
+  context.round_trip_count = round_trip_count;
+  context.done = xSemaphoreCreateBinary();
+
+  auto retval = xTaskCreate(
+    &mailbox_echo_task,
+    "mailbox_echo",
+    BenchmarkTaskStackSize,
+    &context,
+    uxTaskPriorityGet(nullptr),
+    nullptr
+  );
+
+  if (retval != pdPASS)
+  {
+    vSemaphoreDelete(context.done);
+    result.failures = round_trip_count;
+    return result;
+  }
+
+  const auto payload = std::vector<uint8_t>(payload_size, 0xa5);
+
+  const auto start = get_elapsed_microseconds();
+  for (size_t i = 0; i < round_trip_count; ++i)
+  {
+    if (not ping.send("ping", payload))
+    {
+      result.failures++;
+      continue;
+    }
+
+    const auto& received_message = pong.receive();
+    if (not (received_message and received_message->message()))
+    {
+      result.failures++;
+      continue;
+    }
+
+    result.iterations++;
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  // The echo task must be done with the mailboxes before they go away
+  xSemaphoreTake(context.done, portMAX_DELAY);
+  vSemaphoreDelete(context.done);
+
+  return result;
+}
+
+auto benchmark_mailbox_many_to_one(
+  const MailboxBackend backend,
+  const size_t producer_count,
+  const size_t message_count,
+  const size_t payload_size
+) -> BenchmarkResult
+{
+  using utils::get_elapsed_microseconds;
+
+  BenchmarkResult result;
+
+  Mailbox mailbox(
+    BenchmarkMailboxSize,
+    0,
+    BenchmarkReceiveTimeoutMicroseconds,
+    BenchmarkReceiveTimeoutMicroseconds,
+    {},
+    MemoryPlacement::any,
+    backend
+  );
+
+  MailboxProducerContext context;
+  context.mailbox = &mailbox;
+  context.message_count = message_count;
+  context.payload_size = payload_size;
+  context.done = xSemaphoreCreateCounting(producer_count, 0);
+
+  const auto start = get_elapsed_microseconds();
+
+  size_t started_count = 0;
+  for (size_t i = 0; i < producer_count; ++i)
+  {
+    auto retval = xTaskCreate(
+      &mailbox_producer_task,
+      "mailbox_producer",
+      BenchmarkTaskStackSize,
+      &context,
+      uxTaskPriorityGet(nullptr),
+      nullptr
+    );
+
+    if (retval == pdPASS)
+    {
+      started_count++;
+    }
+  }
+
+  const auto expected_count = started_count * message_count;
+  while ((result.iterations + context.failures) < expected_count)
+  {
+    const auto& received_message = mailbox.receive();
+    if (not (received_message and received_message->message()))
+    {
+      // Timed out, the producers have given up
+      break;
+    }
+
+    result.iterations++;
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  for (size_t i = 0; i < started_count; ++i)
+  {
+    xSemaphoreTake(context.done, portMAX_DELAY);
+  }
+  vSemaphoreDelete(context.done);
+
+  result.failures = (
+    (producer_count * message_count) - std::min(
+      result.iterations,
+      producer_count * message_count
+    )
+  );
+
+  return result;
+}
+
+auto benchmark_mailbox_backends(
+  const size_t message_count,
+  const size_t payload_size
+) -> void
+{
+  constexpr size_t producer_count = 4;
+
+  for (const auto backend : EnumValuesMailboxBackend())
+  {
+    const auto& ping_pong_result = benchmark_mailbox_ping_pong(
+      backend,
+      message_count,
+      payload_size
+    );
+
+    ESP_LOGI(
+      TAG,
+      "Mailbox ping-pong (%s): %zu round trips in %lld us, %.0f/s, %zu failed",
+      EnumNameMailboxBackend(backend),
+      ping_pong_result.iterations,
+      static_cast<long long>(ping_pong_result.elapsed_microseconds),
+      ping_pong_result.get_rate_per_second(),
+      ping_pong_result.failures
+    );
+
+    const auto& many_to_one_result = benchmark_mailbox_many_to_one(
+      backend,
+      producer_count,
+      message_count / producer_count,
+      payload_size
+    );
+
+    ESP_LOGI(
+      TAG,
+      "Mailbox %zu-to-1 (%s): %zu messages in %lld us, %.0f msg/s, %zu failed",
+      producer_count,
+      EnumNameMailboxBackend(backend),
+      many_to_one_result.iterations,
+      static_cast<long long>(many_to_one_result.elapsed_microseconds),
+      many_to_one_result.get_rate_per_second(),
+      many_to_one_result.failures
+    );
+  }
+}
+
+auto mailbox_echo_task(void* user_data)
+  -> void
+{
+  auto* context = static_cast<MailboxPingPongContext*>(user_data);
+
+  for (size_t i = 0; i < context->round_trip_count; ++i)
+  {
+    const auto& received_message = context->ping->receive();
+    const auto* message = (
+      received_message? received_message->message() : nullptr
+    );
+
+    if (message)
+    {
+      context->pong->send(*(message));
+    }
+  }
+
+  xSemaphoreGive(context->done);
+  vTaskDelete(nullptr);
+}
+
+auto mailbox_producer_task(void* user_data)
+  -> void
+{
+  auto* context = static_cast<MailboxProducerContext*>(user_data);
+
+  const auto payload = std::vector<uint8_t>(context->payload_size, 0xa5);
+
+  for (size_t i = 0; i < context->message_count; ++i)
+  {
+    // Back off while the mailbox is full, up to the receive timeout
+    constexpr TickType_t max_retries = pdMS_TO_TICKS(
+      BenchmarkReceiveTimeoutMicroseconds / 1000
+    );
+
+    auto did_send = false;
+    for (TickType_t retry = 0; not did_send and retry < max_retries; ++retry)
+    {
+      did_send = context->mailbox->send("many_to_one", payload);
+      if (not did_send)
+      {
+        vTaskDelay(1);
+      }
+    }
+
+    if (not did_send)
+    {
+      context->failures++;
+    }
+  }
+
+  xSemaphoreGive(context->done);
+  vTaskDelete(nullptr);
+}
+
+auto benchmark_idle_actor_behaviour(
+  const Pid& self,
+  StatePtr& state,
+  const Message& message
+) -> ResultUnion;
+
+auto benchmark_idle_actor_behaviour(
+  const Pid& self,
+  StatePtr& state,
+  const Message& message
+) -> ResultUnion
+{
+  return {Result::Ok};
+}
+
+auto benchmark_process_spawn(const size_t process_count)
+  -> BenchmarkResult
+{
+  using utils::get_elapsed_microseconds;
+
+  BenchmarkResult result;
+
+  ProcessSpawnContext context;
+  context.process_count = process_count;
+  context.done = xSemaphoreCreateBinary();
+
+  // Exit signals are delivered asynchronously, so the next child is only
+  // spawned once the previous one's EXIT message has arrived
+  auto watcher_behaviour = ActorBehaviour{
+    [&context](const Pid& self, StatePtr& state, const Message& message)
+      -> ResultUnion
+    {
+      if (matches(message, "kill"))
+      {
+        context.exited_count++;
+      }
+      else if (not matches(message, "spawn_next"))
+      {
+        return {Result::Unhandled};
+      }
+
+      if (context.spawned_count == context.process_count)
+      {
+        xSemaphoreGive(context.done);
+        return {Result::Ok};
+      }
+
+      context.spawned_count++;
+      const auto& pid = spawn_link(
+        self,
+        ActorBehaviour{benchmark_idle_actor_behaviour}
+      );
+
+      if (not exit(pid, pid, "kill"))
+      {
+        // No EXIT will follow
+        context.failures++;
+        send(self, "spawn_next");
+      }
+
+      return {Result::Ok};
+    }
+  };
+
+  const auto& watcher_pid = spawn(std::move(watcher_behaviour));
+  process_flag(watcher_pid, ProcessFlag::trap_exit, true);
+
+  const auto start = get_elapsed_microseconds();
+  if (send(watcher_pid, "spawn_next"))
+  {
+    // The watcher must be done with the context before it goes away
+    xSemaphoreTake(context.done, portMAX_DELAY);
+  }
+  else {
+    context.failures = process_count;
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  result.iterations = context.exited_count;
+  result.failures = context.failures;
+
+  exit(watcher_pid, watcher_pid, "kill");
+  vSemaphoreDelete(context.done);
+
+  return result;
+}
+
+auto benchmark_worker_pool_lease(
+  const size_t lease_count,
+  const size_t pool_size
+) -> BenchmarkResult
+{
+  using utils::get_elapsed_microseconds;
+
+  BenchmarkResult result;
+
+  // Spawned before timing starts
+  WorkerPool worker_pool(
+    ActorBehaviour{benchmark_idle_actor_behaviour},
+    pool_size,
+    pool_size
+  );
+
+  const auto start = get_elapsed_microseconds();
+  for (size_t i = 0; i < lease_count; ++i)
+  {
+    const auto& pid = worker_pool.lease();
+
+    if (not (pid and worker_pool.release(*(pid))))
+    {
+      result.failures++;
+      continue;
+    }
+
+    result.iterations++;
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  return result;
+}
+
+auto benchmark_worker_pool(
+  const size_t count,
+  const size_t pool_size
+) -> void
+{
+  const auto& spawn_result = benchmark_process_spawn(count);
+
+  ESP_LOGI(
+    TAG,
+    "Spawn: %zu processes in %lld us, %.1f us each, %zu failed",
+    spawn_result.iterations,
+    static_cast<long long>(spawn_result.elapsed_microseconds),
+    spawn_result.iterations?
+      (1.0 * spawn_result.elapsed_microseconds / spawn_result.iterations) : 0.0,
+    spawn_result.failures
+  );
+
+  const auto& lease_result = benchmark_worker_pool_lease(count, pool_size);
+
+  ESP_LOGI(
+    TAG,
+    "Lease (pool of %zu): %zu leases in %lld us, %.1f us each, %zu failed",
+    pool_size,
+    lease_result.iterations,
+    static_cast<long long>(lease_result.elapsed_microseconds),
+    lease_result.iterations?
+      (1.0 * lease_result.elapsed_microseconds / lease_result.iterations) : 0.0,
+    lease_result.failures
+  );
+}
+
+auto benchmark_node_timer_actor_behaviour(
+  const Pid& self,
+  StatePtr& state,
+  const Message& message
+) -> ResultUnion;
+
+auto benchmark_node_timer_actor_behaviour(
+  const Pid& self,
+  StatePtr& state,
+  const Message& message
+) -> ResultUnion
+{
+  // The payload is the id of the node which started the timer
+  auto node_id = NullNodeId;
+  if (message.payload()->size() == sizeof(node_id))
+  {
+    std::memcpy(&node_id, message.payload()->data(), sizeof(node_id));
+    if (node_id == get_pid_node_id(self))
+    {
+      node_timer_deliveries++;
+    }
+  }
+
+  return {Result::Ok};
+}
+
+auto benchmark_node_timers(const size_t timer_count)
+  -> BenchmarkResult
+{
+  using namespace std::chrono_literals;
+  using utils::get_elapsed_microseconds;
+  using utils::timeout;
+
+  BenchmarkResult result;
+
+  node_timer_deliveries = 0;
+
+  Node node_a;
+  Node node_b;
+  auto nodes = std::array<Node*, 2>{&node_a, &node_b};
+  auto pids = std::array<Pid, 2>{};
+
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    pids[i] = nodes[i]->spawn(
+      ActorBehaviour{benchmark_node_timer_actor_behaviour},
+      nullptr
+    );
+  }
+
+  // Both nodes number their timers from 1, so each tref is started twice
+  const auto start = get_elapsed_microseconds();
+  for (size_t i = 0; i < timer_count; ++i)
+  {
+    for (size_t n = 0; n < nodes.size(); ++n)
+    {
+      const auto node_id = nodes[n]->get_node_id();
+      auto tref = nodes[n]->send_after(
+        10ms,
+        pids[n],
+        "node_timer",
+        BufferView{reinterpret_cast<const uint8_t*>(&node_id), sizeof(node_id)}
+      );
+
+      if (tref == NullTRef)
+      {
+        result.failures++;
+      }
+    }
+  }
+
+  const auto expected_deliveries = (timer_count * nodes.size()) - result.failures;
+  for (size_t wait_count = 0; wait_count < 100; ++wait_count)
+  {
+    if (node_timer_deliveries >= expected_deliveries)
+    {
+      break;
+    }
+
+    vTaskDelay(timeout(10ms));
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  result.iterations = node_timer_deliveries;
+  result.failures += (expected_deliveries - std::min(
+    expected_deliveries,
+    result.iterations
+  ));
+
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    if (not nodes[i]->exit(pids[i], pids[i], "kill"))
+    {
+      result.failures++;
+    }
+  }
+
+  // Exit signals are processed on the timer task, before the nodes are gone
+  vTaskDelay(timeout(100ms));
+
+  ESP_LOGI(
+    TAG,
+    "Node timers: %zu of %zu delivered to their own node in %lld us",
+    result.iterations,
+    timer_count * nodes.size(),
+    static_cast<long long>(result.elapsed_microseconds)
+  );
+
+  return result;
+}
+
+auto benchmark_distribution_loopback(
+  const size_t round_trip_count,
+  const size_t payload_size
+) -> BenchmarkResult
+{
+  using namespace std::chrono_literals;
+  using utils::get_elapsed_microseconds;
+  using utils::timeout;
+
+  BenchmarkResult result;
+
+  if (payload_size > Distribution::get_max_record_size())
+  {
+    result.failures = round_trip_count;
+    return result;
+  }
+
+  DistributionLoopbackContext context;
+  context.round_trip_count = round_trip_count;
+  context.payload.resize(payload_size);
+  for (size_t i = 0; i < payload_size; ++i)
+  {
+    context.payload[i] = static_cast<uint8_t>(i);
+  }
+  context.done = xSemaphoreCreateBinary();
+
+  // A payload which was reassembled out of order (or truncated) is a failure
+  const auto is_intact = [&context](const Message& message)
+  {
+    return (
+      message.payload()
+      and message.payload()->size() == context.payload.size()
+      and std::equal(
+        context.payload.begin(),
+        context.payload.end(),
+        message.payload()->begin()
+      )
+    );
+  };
+
+  // Both behaviours send with the free functions, which must route through
+  // the node each process was spawned on to reach the other node
+  auto ping_behaviour = ActorBehaviour{
+    [&context, is_intact](const Pid& self, StatePtr& state, const Message& message)
+      -> ResultUnion
+    {
+      if (not matches(message, "pong"))
+      {
+        return {Result::Unhandled};
+      }
+
+      if (not is_intact(message))
+      {
+        context.failures++;
+      }
+
+      context.completed_count++;
+      if (context.completed_count == context.round_trip_count)
+      {
+        xSemaphoreGive(context.done);
+      }
+      else if (not send(context.pong_pid, "ping", context.payload))
+      {
+        context.failures += (context.round_trip_count - context.completed_count);
+        xSemaphoreGive(context.done);
+      }
+
+      return {Result::Ok};
+    }
+  };
+
+  auto pong_behaviour = ActorBehaviour{
+    [&context, is_intact](const Pid& self, StatePtr& state, const Message& message)
+      -> ResultUnion
+    {
+      if (not matches(message, "ping"))
+      {
+        return {Result::Unhandled};
+      }
+
+      if (
+        not is_intact(message)
+        or not send(context.ping_pid, "pong", context.payload)
+      )
+      {
+        context.failures += (context.round_trip_count - context.completed_count);
+        xSemaphoreGive(context.done);
+      }
+
+      return {Result::Ok};
+    }
+  };
+
+  Node node_a;
+  Node node_b;
+
+  if (
+    not node_a.start_distribution(BenchmarkDistributionPortA)
+    or not node_b.start_distribution(BenchmarkDistributionPortB)
+    or not node_a.connect_node("127.0.0.1", BenchmarkDistributionPortB)
+  )
+  {
+    ESP_LOGE(TAG, "Distribution loopback: could not start distribution");
+    vSemaphoreDelete(context.done);
+    result.failures = round_trip_count;
+    return result;
+  }
+
+  context.ping_pid = node_a.spawn(std::move(ping_behaviour), nullptr);
+  context.pong_pid = node_b.spawn(std::move(pong_behaviour), nullptr);
+
+  // The first ping is only accepted once the nodes are connected
+  auto did_send = false;
+  for (size_t wait_count = 0; wait_count < 100 and not did_send; ++wait_count)
+  {
+    did_send = node_a.send(
+      context.pong_pid,
+      "ping",
+      BufferView{context.payload.data(), context.payload.size()}
+    );
+
+    if (not did_send)
+    {
+      vTaskDelay(timeout(10ms));
+    }
+  }
+
+  const auto start = get_elapsed_microseconds();
+  if (not did_send)
+  {
+    context.failures = round_trip_count;
+  }
+  else if (xSemaphoreTake(context.done, timeout(10s)) != pdTRUE)
+  {
+    ESP_LOGE(TAG, "Distribution loopback: timed out");
+    context.failures += (round_trip_count - context.completed_count);
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  result.iterations = context.completed_count;
+  result.failures = context.failures;
+
+  node_a.exit(context.ping_pid, context.ping_pid, "kill");
+  node_b.exit(context.pong_pid, context.pong_pid, "kill");
+
+  // Exit signals are processed on the timer task, before the nodes are gone
+  vTaskDelay(timeout(100ms));
+  vSemaphoreDelete(context.done);
+
+  ESP_LOGI(
+    TAG,
+    "Distribution loopback: %zu round trips of %zu bytes in %lld us, %zu failed",
+    result.iterations,
+    payload_size,
+    static_cast<long long>(result.elapsed_microseconds),
+    result.failures
+  );
+
+  return result;
+}
+
+} // namespace ActorModel
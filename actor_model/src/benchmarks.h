@@ -0,0 +1,100 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "memory_placement.h"
+
+#include "actor_model_generated.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ActorModel {
+
+struct BenchmarkResult
+{
+  size_t iterations = 0;
+  size_t failures = 0;
+  int64_t elapsed_microseconds = 0;
+
+  auto get_rate_per_second() const
+    -> double
+  {
+    return elapsed_microseconds?
+      (iterations * 1000000.0 / elapsed_microseconds) : 0.0;
+  }
+};
+
+// Send and receive messages through a mailbox whose ringbuffer storage
+// is placed in the given region, from the calling task
+auto benchmark_mailbox_placement(
+  const MemoryPlacement placement,
+  const size_t message_count = 1000,
+  const size_t payload_size = 64
+) -> BenchmarkResult;
+
+// Log results for each MemoryPlacement
+auto benchmark_mailbox_placements(
+  const size_t message_count = 1000,
+  const size_t payload_size = 64
+) -> void;
+
+// Round trips between the calling task and an echo task, through a pair of
+// mailboxes using the given backend
+auto benchmark_mailbox_ping_pong(
+  const MailboxBackend backend,
+  const size_t round_trip_count = 1000,
+  const size_t payload_size = 64
+) -> BenchmarkResult;
+
+// Several producer tasks sending to one mailbox, received by the calling task
+auto benchmark_mailbox_many_to_one(
+  const MailboxBackend backend,
+  const size_t producer_count = 4,
+  const size_t message_count = 250,
+  const size_t payload_size = 64
+) -> BenchmarkResult;
+
+// Log ping-pong and many-to-one results for each MailboxBackend
+auto benchmark_mailbox_backends(
+  const size_t message_count = 1000,
+  const size_t payload_size = 64
+) -> void;
+
+// Spawn a process and kill it, waiting for its EXIT before the next one
+auto benchmark_process_spawn(const size_t process_count = 100)
+  -> BenchmarkResult;
+
+// Lease a worker from a pre-spawned pool and release it, from the calling task
+auto benchmark_worker_pool_lease(
+  const size_t lease_count = 100,
+  const size_t pool_size = 4
+) -> BenchmarkResult;
+
+// Log spawn vs. lease latency
+auto benchmark_worker_pool(
+  const size_t count = 100,
+  const size_t pool_size = 4
+) -> void;
+
+// Timers started on two nodes at once, counted as delivered only to the
+// process on the node which started them
+auto benchmark_node_timers(const size_t timer_count = 10)
+  -> BenchmarkResult;
+
+// Two nodes connected over loopback UDP, a process on each echoes a payload
+// large enough to be fragmented back to the other, with the free functions
+auto benchmark_distribution_loopback(
+  const size_t round_trip_count = 20,
+  const size_t payload_size = 4096
+) -> BenchmarkResult;
+
+} // namespace ActorModel
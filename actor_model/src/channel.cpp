@@ -0,0 +1,247 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "channel.h"
+
+#include "node.h"
+
+#include <cinttypes>
+#include <cstring>
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "channel";
+
+// Record size marking unused space at the end of the storage,
+// the next record follows at the start
+constexpr uint32_t ChannelPaddingMarker = std::numeric_limits<uint32_t>::max();
+
+constexpr auto get_channel_stride(const size_t record_size)
+  -> uint32_t
+{
+  // Keep records 8-byte aligned, for flatbuffers with 64-bit fields
+  constexpr auto alignment = alignof(uint64_t);
+  return (
+    (alignment + record_size + alignment - 1)
+    & ~(alignment - 1)
+  );
+}
+
+constexpr auto get_channel_capacity(const size_t size)
+  -> uint32_t
+{
+  uint32_t capacity = alignof(uint64_t);
+  while (capacity < size)
+  {
+    capacity <<= 1;
+  }
+
+  return capacity;
+}
+
+Channel::Channel(
+  Node& _node,
+  const ChannelId _channel_id,
+  const Pid& _producer_pid,
+  const Pid& _consumer_pid,
+  const size_t _capacity,
+  const MemoryPlacement placement
+)
+: node(_node)
+, channel_id(_channel_id)
+, producer_pid(_producer_pid)
+, consumer_pid(_consumer_pid)
+, capacity(get_channel_capacity(_capacity))
+{
+  storage = static_cast<uint8_t*>(placement_malloc(capacity, placement));
+  if (not storage)
+  {
+    ESP_LOGE(TAG, "Unable to allocate %" PRIu32 " bytes", capacity);
+    closed = true;
+  }
+}
+
+Channel::~Channel()
+{
+  placement_free(storage);
+}
+
+auto Channel::is_open() const
+  -> bool
+{
+  return not closed;
+}
+
+auto Channel::push(const BufferView record)
+  -> bool
+{
+  return (push(BufferViews{&record, 1}) == 1);
+}
+
+auto Channel::push(const BufferViews records)
+  -> size_t
+{
+  if (closed)
+  {
+    return 0;
+  }
+
+  const auto start_write = write_index.load(std::memory_order_relaxed);
+  const auto read = read_index.load(std::memory_order_acquire);
+
+  auto write = start_write;
+  size_t pushed_count = 0;
+
+  for (const auto& record : records)
+  {
+    const auto stride = get_channel_stride(record.size());
+    const auto offset = write & (capacity - 1);
+
+    // Records are contiguous, skip to the start if it would wrap
+    const auto padding = (offset + stride > capacity)? (capacity - offset) : 0;
+
+    if ((write - read) + padding + stride > capacity)
+    {
+      break;
+    }
+
+    if (padding)
+    {
+      memcpy(storage + offset, &ChannelPaddingMarker, sizeof(uint32_t));
+      write += padding;
+    }
+
+    const auto record_size = static_cast<uint32_t>(record.size());
+    auto* header = storage + (write & (capacity - 1));
+    memcpy(header, &record_size, sizeof(uint32_t));
+    memcpy(header + alignof(uint64_t), record.data(), record.size());
+
+    write += stride;
+    pushed_count++;
+  }
+
+  if (pushed_count)
+  {
+    // Publish the whole batch at once
+    write_index.store(write);
+
+    // Only wake the consumer if it may have seen the channel empty.
+    // Otherwise it is still popping, and will see this batch when it
+    // checks write_index again after freeing what it has popped
+    if (read_index.load() == start_write)
+    {
+      static_cast<void>(message_type_registered<ChannelReadable>);
+
+      const auto channel_readable = ChannelReadable{channel_id};
+      node.send_typed(
+        consumer_pid,
+        message_type_id<ChannelReadable>,
+        BufferView{
+          reinterpret_cast<const uint8_t*>(&channel_readable),
+          typed_message_payload_size<ChannelReadable>
+        }
+      );
+    }
+  }
+
+  return pushed_count;
+}
+
+auto Channel::pop(const RecordCallback& callback, const size_t max_records)
+  -> size_t
+{
+  if (not storage)
+  {
+    return 0;
+  }
+
+  auto read = read_index.load(std::memory_order_relaxed);
+  size_t popped_count = 0;
+
+  while (popped_count < max_records)
+  {
+    const auto write = write_index.load();
+    if (read == write)
+    {
+      break;
+    }
+
+    while (read != write and popped_count < max_records)
+    {
+      const auto offset = read & (capacity - 1);
+      const auto* header = storage + offset;
+
+      uint32_t record_size = 0;
+      memcpy(&record_size, header, sizeof(uint32_t));
+
+      if (record_size == ChannelPaddingMarker)
+      {
+        read += (capacity - offset);
+        continue;
+      }
+
+      callback(BufferView{header + alignof(uint64_t), record_size});
+
+      read += get_channel_stride(record_size);
+      popped_count++;
+    }
+
+    // Free the whole batch at once, then check for more
+    read_index.store(read);
+  }
+
+  return popped_count;
+}
+
+auto Channel::empty() const
+  -> bool
+{
+  return (read_index.load() == write_index.load());
+}
+
+auto Channel::get_max_record_size() const
+  -> size_t
+{
+  // Padding to the end of the storage is needed before a record which
+  // would wrap, which always fits in an empty channel only if the record
+  // takes at most half of it
+  const auto max_stride = (capacity / 2);
+  const auto prefix_size = get_channel_stride(0);
+
+  return (max_stride > prefix_size)? (max_stride - prefix_size) : 0;
+}
+
+auto Channel::close()
+  -> void
+{
+  closed = true;
+}
+
+auto Channel::get_channel_id() const
+  -> ChannelId
+{
+  return channel_id;
+}
+
+auto Channel::get_producer_pid() const
+  -> const Pid&
+{
+  return producer_pid;
+}
+
+auto Channel::get_consumer_pid() const
+  -> const Pid&
+{
+  return consumer_pid;
+}
+
+} // namespace ActorModel
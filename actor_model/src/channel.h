@@ -0,0 +1,139 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "mailbox.h"
+#include "memory_placement.h"
+#include "pid.h"
+#include "typed_message.h"
+
+#include "delegate.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace ActorModel {
+
+class Node;
+
+using ChannelId = uint32_t;
+
+constexpr ChannelId NullChannelId = 0;
+
+// Sent to the consumer when its channel goes from empty to non-empty
+struct ChannelReadable
+{
+  ChannelId channel_id;
+};
+
+template<>
+struct MessageTraits<ChannelReadable>
+{
+  static constexpr MessageType type = "channel_readable";
+};
+
+// Sent to both sides when the channel is closed, e.g. as one side exited
+struct ChannelClosed
+{
+  ChannelId channel_id;
+};
+
+template<>
+struct MessageTraits<ChannelClosed>
+{
+  static constexpr MessageType type = "channel_closed";
+};
+
+// Bounded ring of variable-size records from one producer process to one
+// consumer process on the same node, for high-rate streams which would
+// otherwise pay for a Message flatbuffer per item.
+// Records are length-prefixed only, and a batch is published (or freed)
+// with a single atomic store. The consumer only receives a "channel_readable"
+// message when the channel goes from empty to non-empty, so it should pop
+// until pop() returns fewer than max_records
+class Channel
+{
+public:
+  using RecordCallback = delegate<void(const BufferView)>;
+
+  explicit Channel(
+    Node& _node,
+    const ChannelId _channel_id,
+    const Pid& _producer_pid,
+    const Pid& _consumer_pid,
+    const size_t _capacity,
+    const MemoryPlacement placement = MemoryPlacement::any
+  );
+  ~Channel();
+
+  Channel(const Channel&) = delete;
+  Channel& operator=(const Channel&) = delete;
+
+  auto is_open() const
+    -> bool;
+
+  // Producer: false/0 if closed, or once a record does not fit
+  auto push(const BufferView record)
+    -> bool;
+
+  auto push(const BufferViews records)
+    -> size_t;
+
+  // Consumer: records are only valid during the callback
+  auto pop(
+    const RecordCallback& callback,
+    const size_t max_records = std::numeric_limits<size_t>::max()
+  ) -> size_t;
+
+  auto empty() const
+    -> bool;
+
+  // Larger records never fit, even once the channel is empty
+  auto get_max_record_size() const
+    -> size_t;
+
+  // Remaining records can still be popped
+  auto close()
+    -> void;
+
+  auto get_channel_id() const
+    -> ChannelId;
+
+  auto get_producer_pid() const
+    -> const Pid&;
+
+  auto get_consumer_pid() const
+    -> const Pid&;
+
+private:
+  Node& node;
+
+  const ChannelId channel_id;
+  const Pid producer_pid;
+  const Pid consumer_pid;
+
+  uint8_t* storage = nullptr;
+
+  // Power of two, so the indices can wrap around at 2^32
+  uint32_t capacity = 0;
+
+  // Only written by the producer and consumer respectively
+  std::atomic<uint32_t> write_index{0};
+  std::atomic<uint32_t> read_index{0};
+
+  std::atomic<bool> closed{false};
+};
+
+using ChannelPtr = std::shared_ptr<Channel>;
+
+} // namespace ActorModel
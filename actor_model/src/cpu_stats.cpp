@@ -0,0 +1,183 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "cpu_stats.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+#include "esp_cpu.h"
+
+namespace ActorModel {
+
+auto get_cpu_stats_bucket(const uint32_t cycles)
+  -> size_t;
+
+auto get_cpu_cycle_count()
+  -> uint32_t
+{
+  return esp_cpu_get_cycle_count();
+}
+
+auto get_cpu_stats_bucket(const uint32_t cycles)
+  -> size_t
+{
+  const auto log2_cycles = static_cast<uint32_t>(std::bit_width(cycles));
+  if (log2_cycles <= CpuStatsHistogramMinLog2)
+  {
+    return 0;
+  }
+
+  return std::min<size_t>(
+    log2_cycles - CpuStatsHistogramMinLog2,
+    CpuStatsHistogramBuckets - 1
+  );
+}
+
+CpuStats::CpuStats(const uint32_t _sample_interval)
+: sample_interval(_sample_interval)
+{
+  spinlock_initialize(&entries_mutex);
+}
+
+auto CpuStats::should_sample()
+  -> bool
+{
+  message_count++;
+  return (sample_interval and (message_count % sample_interval) == 0);
+}
+
+auto CpuStats::record(const Message& message, const uint32_t cycles)
+  -> void
+{
+  // Only the owning process records, so only it allocates
+  if (not entries)
+  {
+    auto allocated_entries = std::make_unique<Entries>();
+
+    portENTER_CRITICAL(&entries_mutex);
+    entries = std::move(allocated_entries);
+    portEXIT_CRITICAL(&entries_mutex);
+  }
+
+  const auto type = (
+    message.type()? message.type()->string_view() : MessageType{}
+  );
+  const auto type_id = (
+    message.type_id()? message.type_id() : get_message_type_id(type)
+  );
+
+  portENTER_CRITICAL(&entries_mutex);
+
+  auto* entry = &(entries->back());
+  for (auto& existing_entry : *(entries))
+  {
+    if (existing_entry.type_id == type_id)
+    {
+      entry = &(existing_entry);
+      break;
+    }
+
+    if (existing_entry.type_id == NullMessageTypeId)
+    {
+      // First use of this entry, the last one is kept for "other"
+      if (&(existing_entry) != &(entries->back()))
+      {
+        existing_entry.type_id = type_id;
+        memcpy(
+          existing_entry.type,
+          type.data(),
+          std::min(type.size(), sizeof(existing_entry.type) - 1)
+        );
+        entry = &(existing_entry);
+      }
+      break;
+    }
+  }
+
+  entry->count++;
+  entry->total_cycles += cycles;
+  entry->max_cycles = std::max(entry->max_cycles, cycles);
+  entry->histogram[get_cpu_stats_bucket(cycles)]++;
+
+  portEXIT_CRITICAL(&entries_mutex);
+}
+
+auto CpuStats::set_sample_interval(const uint32_t _sample_interval)
+  -> void
+{
+  sample_interval = _sample_interval;
+}
+
+auto CpuStats::get_sample_interval() const
+  -> uint32_t
+{
+  return sample_interval;
+}
+
+auto CpuStats::get_message_count() const
+  -> uint32_t
+{
+  return message_count;
+}
+
+auto CpuStats::serialize(flatbuffers::FlatBufferBuilder& fbb, const Pid& pid)
+  -> flatbuffers::Offset<ProcessCpuStats>
+{
+  // Copy under the lock, build after it
+  Entries copied_entries;
+  auto has_entries = false;
+
+  portENTER_CRITICAL(&entries_mutex);
+  if (entries)
+  {
+    copied_entries = *(entries);
+    has_entries = true;
+  }
+  portEXIT_CRITICAL(&entries_mutex);
+
+  std::vector<flatbuffers::Offset<MessageTypeCpuStats>> entry_offsets;
+
+  if (has_entries)
+  {
+    for (const auto& entry : copied_entries)
+    {
+      if (not entry.count)
+      {
+        continue;
+      }
+
+      entry_offsets.emplace_back(CreateMessageTypeCpuStats(
+        fbb,
+        fbb.CreateString(
+          (entry.type_id != NullMessageTypeId)? entry.type : "other"
+        ),
+        entry.type_id,
+        entry.count,
+        entry.total_cycles,
+        entry.max_cycles,
+        fbb.CreateVector(entry.histogram.data(), entry.histogram.size())
+      ));
+    }
+  }
+
+  return CreateProcessCpuStats(
+    fbb,
+    &pid,
+    message_count,
+    sample_interval,
+    fbb.CreateVector(entry_offsets),
+    CpuStatsHistogramMinLog2
+  );
+}
+
+} // namespace ActorModel
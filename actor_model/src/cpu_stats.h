@@ -0,0 +1,88 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "pid.h"
+#include "typed_message.h"
+
+#include "actor_model_generated.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include "freertos/FreeRTOS.h"
+
+namespace ActorModel {
+
+// Message types beyond this are accumulated in a last entry, "other"
+constexpr size_t CpuStatsMaxMessageTypes = 8;
+constexpr size_t CpuStatsMaxTypeLength = 24;
+
+// Invocations are counted by log2(cycles), the first bucket holding those
+// under 2^CpuStatsHistogramMinLog2 cycles and the last those above
+constexpr size_t CpuStatsHistogramBuckets = 12;
+constexpr uint32_t CpuStatsHistogramMinLog2 = 10;
+
+// The running core's cycle counter, as measured for CpuStats::record
+auto get_cpu_cycle_count()
+  -> uint32_t;
+
+struct CpuStatsEntry
+{
+  MessageTypeId type_id = NullMessageTypeId;
+  char type[CpuStatsMaxTypeLength] = {0};
+  uint32_t count = 0;
+  uint64_t total_cycles = 0;
+  uint32_t max_cycles = 0;
+  std::array<uint32_t, CpuStatsHistogramBuckets> histogram{};
+};
+
+// CPU cycles spent by a process' behaviours, per message type. Recorded by
+// the owning process' task for every sample_interval-th message, and read
+// by any task. Entries are fixed-size and allocated on the first sample,
+// so recording takes a short critical section and never allocates again
+class CpuStats
+{
+public:
+  using Entries = std::array<CpuStatsEntry, CpuStatsMaxMessageTypes>;
+
+  explicit CpuStats(const uint32_t _sample_interval = 1);
+
+  // Counts each received message, true if it should be measured
+  auto should_sample()
+    -> bool;
+
+  auto record(const Message& message, const uint32_t cycles)
+    -> void;
+
+  // 0 disables measuring
+  auto set_sample_interval(const uint32_t _sample_interval)
+    -> void;
+
+  auto get_sample_interval() const
+    -> uint32_t;
+
+  auto get_message_count() const
+    -> uint32_t;
+
+  auto serialize(flatbuffers::FlatBufferBuilder& fbb, const Pid& pid)
+    -> flatbuffers::Offset<ProcessCpuStats>;
+
+private:
+  uint32_t sample_interval;
+  uint32_t message_count = 0;
+
+  std::unique_ptr<Entries> entries;
+  portMUX_TYPE entries_mutex;
+};
+
+} // namespace ActorModel
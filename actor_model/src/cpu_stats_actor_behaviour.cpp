@@ -0,0 +1,169 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "cpu_stats_actor_behaviour.h"
+
+#include "actor_model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "cpu_stats";
+
+constexpr auto CpuStatsExportInterval = std::chrono::milliseconds{
+  ACTOR_MODEL_CPU_STATS_EXPORT_INTERVAL_MS
+};
+
+struct CpuStatsActorState
+{
+  CpuStatsActorState()
+  {
+  }
+
+  TRef export_timer_ref = NullTRef;
+};
+
+auto export_cpu_stats(const NodeCpuStats& node_cpu_stats)
+  -> void;
+
+auto format_cpu_stats_histogram(
+  const flatbuffers::Vector<uint32_t>* histogram,
+  char* buf,
+  const size_t buf_size
+) -> const char*;
+
+auto format_cpu_stats_histogram(
+  const flatbuffers::Vector<uint32_t>* histogram,
+  char* buf,
+  const size_t buf_size
+) -> const char*
+{
+  buf[0] = 0;
+
+  size_t offset = 0;
+  if (histogram)
+  {
+    for (const auto bucket_count : *(histogram))
+    {
+      const auto ret = snprintf(
+        buf + offset,
+        buf_size - offset,
+        offset? " %" PRIu32 : "%" PRIu32,
+        bucket_count
+      );
+
+      if (ret < 0 or static_cast<size_t>(ret) >= buf_size - offset)
+      {
+        break;
+      }
+      offset += ret;
+    }
+  }
+
+  return buf;
+}
+
+auto export_cpu_stats(const NodeCpuStats& node_cpu_stats)
+  -> void
+{
+  if (not node_cpu_stats.processes())
+  {
+    return;
+  }
+
+  const auto cycles_per_microsecond = std::max<uint32_t>(
+    esp_rom_get_cpu_ticks_per_us(),
+    1
+  );
+
+  // Up to 10 digits and a space per bucket
+  char histogram_buf[CpuStatsHistogramBuckets * 11 + 1];
+
+  for (const auto* process_cpu_stats : *(node_cpu_stats.processes()))
+  {
+    if (
+      not process_cpu_stats->pid()
+      or not process_cpu_stats->message_types()
+    )
+    {
+      continue;
+    }
+
+    for (const auto* message_type_cpu_stats : *(process_cpu_stats->message_types()))
+    {
+      ESP_LOGI(
+        TAG,
+        "%s '%s': count=%" PRIu32 " total=%" PRIu64 "us max=%" PRIu32 "us"
+        " histogram(2^%" PRIu32 "..)=[%s]",
+        get_uuid_str(*(process_cpu_stats->pid())).c_str(),
+        message_type_cpu_stats->type()?
+          message_type_cpu_stats->type()->c_str() : "",
+        message_type_cpu_stats->count(),
+        message_type_cpu_stats->total_cycles() / cycles_per_microsecond,
+        message_type_cpu_stats->max_cycles() / cycles_per_microsecond,
+        process_cpu_stats->histogram_min_log2(),
+        format_cpu_stats_histogram(
+          message_type_cpu_stats->histogram(),
+          histogram_buf,
+          sizeof(histogram_buf)
+        )
+      );
+    }
+  }
+}
+
+auto cpu_stats_actor_behaviour(
+  const Pid& self,
+  StatePtr& _state,
+  const Message& message
+) -> ResultUnion
+{
+  if (not _state)
+  {
+    _state = std::make_shared<CpuStatsActorState>();
+
+    auto& state = *(std::static_pointer_cast<CpuStatsActorState>(_state));
+    state.export_timer_ref = send_interval(
+      CpuStatsExportInterval,
+      self,
+      "cpu_stats_export"
+    );
+  }
+
+  if (
+    CpuStatsRequest cpu_stats_request;
+    matches(message, cpu_stats_request)
+  )
+  {
+    const auto& node_cpu_stats = get_cpu_stats();
+    send(cpu_stats_request.reply_pid, "cpu_stats", node_cpu_stats);
+
+    return {Result::Ok};
+  }
+
+  if (matches(message, "cpu_stats_export"))
+  {
+    const auto& node_cpu_stats = get_cpu_stats();
+    export_cpu_stats(*(flatbuffers::GetRoot<NodeCpuStats>(node_cpu_stats.data())));
+
+    return {Result::Ok};
+  }
+
+  return {Result::Unhandled};
+}
+
+} // namespace ActorModel
@@ -0,0 +1,1148 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "distribution.h"
+
+#include "node.h"
+#include "timestamp.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lwip/netdb.h"
+
+#include "esp_log.h"
+
+#include <fcntl.h>
+
+namespace ActorModel {
+
+constexpr char TAG[] = "distribution";
+
+// Conservative estimates of the flatbuffer overhead, used for batching
+constexpr size_t FrameOverhead = 64;
+constexpr size_t EnvelopeOverhead = 64;
+
+// Each fragment of a record fills a frame of its own
+constexpr size_t FragmentSize = (
+  ACTOR_MODEL_DISTRIBUTION_MAX_FRAME_SIZE - FrameOverhead - EnvelopeOverhead
+);
+
+void distribution_task(void* user_data = nullptr);
+
+auto _node_change_callback(void* change_ptr, uint32_t)
+  -> void;
+
+auto _node_connected_callback(void* distribution_ptr, uint32_t node_id)
+  -> void;
+
+auto _node_down_callback(void* distribution_ptr, uint32_t node_id)
+  -> void;
+
+auto generate_session()
+  -> uint32_t;
+
+auto get_deadline_message(std::vector<uint8_t>& record)
+  -> Message*;
+
+auto set_deadline_remaining(std::vector<uint8_t>& record)
+  -> void;
+
+auto set_deadline_from_remaining(std::vector<uint8_t>& record)
+  -> void;
+
+auto same_address(const struct sockaddr_in& lhs, const struct sockaddr_in& rhs)
+  -> bool;
+
+auto generate_session()
+  -> uint32_t
+{
+  // Any non-zero random value will do
+  return generate_node_id();
+}
+
+// nullptr unless the record is a Message with a deadline
+auto get_deadline_message(std::vector<uint8_t>& record)
+  -> Message*
+{
+  if (
+    record.empty()
+    or is_typed_message_record(BufferView{record.data(), record.size()})
+  )
+  {
+    return nullptr;
+  }
+
+  auto* message = flatbuffers::GetMutableRoot<Message>(record.data());
+  return (message and message->deadline())? message : nullptr;
+}
+
+// Deadlines are on each node's own monotonic clock, so a deadline is sent
+// to another node as the microseconds remaining until it
+auto set_deadline_remaining(std::vector<uint8_t>& record)
+  -> void
+{
+  auto* message = get_deadline_message(record);
+  if (message)
+  {
+    const auto now = static_cast<uint64_t>(
+      utils::get_elapsed_microseconds().count()
+    );
+
+    // Already passed, but it must stay non-zero to be a deadline
+    message->mutate_deadline(
+      (message->deadline() > now)? (message->deadline() - now) : 1
+    );
+  }
+}
+
+auto set_deadline_from_remaining(std::vector<uint8_t>& record)
+  -> void
+{
+  auto* message = get_deadline_message(record);
+  if (message)
+  {
+    const auto now = static_cast<uint64_t>(
+      utils::get_elapsed_microseconds().count()
+    );
+    message->mutate_deadline(now + message->deadline());
+  }
+}
+
+auto same_address(const struct sockaddr_in& lhs, const struct sockaddr_in& rhs)
+  -> bool
+{
+  return (
+    lhs.sin_addr.s_addr == rhs.sin_addr.s_addr
+    and lhs.sin_port == rhs.sin_port
+  );
+}
+
+auto _node_change_callback(void* change_ptr, uint32_t)
+  -> void
+{
+  std::unique_ptr<Distribution::NodeChange> change{
+    static_cast<Distribution::NodeChange*>(change_ptr)
+  };
+  change->distribution->_apply_node_change(*(change));
+}
+
+auto _node_connected_callback(void* distribution_ptr, uint32_t node_id)
+  -> void
+{
+  static_cast<Distribution*>(distribution_ptr)->_node_connected(node_id);
+}
+
+auto _node_down_callback(void* distribution_ptr, uint32_t node_id)
+  -> void
+{
+  static_cast<Distribution*>(distribution_ptr)->_node_down(node_id);
+}
+
+Distribution::Distribution(
+  Node& _node,
+  const uint16_t port,
+  const size_t task_stack_size,
+  const int task_prio
+)
+: node(_node)
+, peers_mutex(xSemaphoreCreateMutex())
+{
+  if (not peers_mutex)
+  {
+    ESP_LOGE(TAG, "Unable to create peers mutex");
+    return;
+  }
+
+  sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sockfd < 0)
+  {
+    ESP_LOGE(TAG, "Unable to create socket");
+    return;
+  }
+
+  struct sockaddr_in sock_addr;
+  memset(&sock_addr, 0, sizeof(sock_addr));
+  sock_addr.sin_family = AF_INET;
+  sock_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  sock_addr.sin_port = htons(port);
+
+  auto ret = bind(
+    sockfd,
+    reinterpret_cast<struct sockaddr*>(&sock_addr),
+    sizeof(sock_addr)
+  );
+
+  if (ret == 0)
+  {
+    // Received frames are drained until the socket would block
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    ret = fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+  }
+
+  if (ret != 0)
+  {
+    ESP_LOGE(TAG, "Unable to bind socket to port %u", port);
+    close(sockfd);
+    sockfd = -1;
+    return;
+  }
+
+  auto* task_user_data = this;
+
+  auto retval = xTaskCreate(
+    &distribution_task,
+    "distribution",
+    task_stack_size,
+    task_user_data,
+    task_prio,
+    &impl
+  );
+
+  if (retval != pdPASS)
+  {
+    ESP_LOGE(TAG, "Unable to start distribution task");
+    impl = nullptr;
+  }
+}
+
+Distribution::~Distribution()
+{
+  if (impl)
+  {
+    vTaskDelete(impl);
+  }
+
+  if (sockfd >= 0)
+  {
+    close(sockfd);
+  }
+
+  if (peers_mutex)
+  {
+    vSemaphoreDelete(peers_mutex);
+  }
+}
+
+auto Distribution::is_started() const
+  -> bool
+{
+  return (impl != nullptr);
+}
+
+auto Distribution::connect(const std::string_view host, const uint16_t port)
+  -> bool
+{
+  if (not is_started())
+  {
+    return false;
+  }
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  struct addrinfo* addr_info = nullptr;
+  auto ret = getaddrinfo(std::string{host}.c_str(), nullptr, &hints, &addr_info);
+  if (ret != 0 or not addr_info)
+  {
+    ESP_LOGE(
+      TAG,
+      "Unable to resolve '%.*s'",
+      static_cast<int>(host.size()),
+      host.data()
+    );
+    return false;
+  }
+
+  struct sockaddr_in addr;
+  memcpy(&addr, addr_info->ai_addr, sizeof(addr));
+  addr.sin_port = htons(port);
+  freeaddrinfo(addr_info);
+
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+
+  auto pending_iter = std::find_if(
+    pending_addresses.begin(),
+    pending_addresses.end(),
+    [&addr](const PendingAddress& pending_address) -> bool
+    {
+      return same_address(pending_address.addr, addr);
+    }
+  );
+
+  if (pending_iter == pending_addresses.end())
+  {
+    pending_iter = pending_addresses.emplace(
+      pending_addresses.end(),
+      PendingAddress{addr, generate_session()}
+    );
+  }
+
+  // Announce ourselves now, the hello is repeated until the node replies
+  Peer hello;
+  hello.addr = addr;
+  hello.session = pending_iter->session;
+  send_frame(hello, 0, {}, xTaskGetTickCount());
+
+  xSemaphoreGive(peers_mutex);
+
+  return true;
+}
+
+auto Distribution::is_connected(const NodeId node_id)
+  -> bool
+{
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+  auto connected = (peers.find(node_id) != peers.end());
+  xSemaphoreGive(peers_mutex);
+
+  return connected;
+}
+
+auto Distribution::send_record(const Pid& to_pid, const BufferView record)
+  -> bool
+{
+  auto remote_record = std::vector<uint8_t>{record.begin(), record.end()};
+  set_deadline_remaining(remote_record);
+
+  return enqueue(
+    get_pid_node_id(to_pid),
+    PendingEnvelope{
+      DistributionEnvelopeKind::message,
+      to_pid,
+      NullPid,
+      {},
+      std::move(remote_record)
+    }
+  );
+}
+
+auto Distribution::get_max_record_size()
+  -> size_t
+{
+  return (FragmentSize * ACTOR_MODEL_DISTRIBUTION_WINDOW_SIZE);
+}
+
+auto Distribution::exit(
+  const Pid& from_pid,
+  const Pid& to_pid,
+  const std::string_view reason
+) -> bool
+{
+  return enqueue(
+    get_pid_node_id(to_pid),
+    PendingEnvelope{
+      DistributionEnvelopeKind::exit,
+      to_pid,
+      from_pid,
+      std::string{reason},
+      {}
+    }
+  );
+}
+
+auto Distribution::link(const Pid& from_pid, const Pid& to_pid)
+  -> bool
+{
+  return enqueue(
+    get_pid_node_id(to_pid),
+    PendingEnvelope{DistributionEnvelopeKind::link, to_pid, from_pid, {}, {}}
+  );
+}
+
+auto Distribution::unlink(const Pid& from_pid, const Pid& to_pid)
+  -> bool
+{
+  return enqueue(
+    get_pid_node_id(to_pid),
+    PendingEnvelope{DistributionEnvelopeKind::unlink, to_pid, from_pid, {}, {}}
+  );
+}
+
+auto Distribution::register_name(const std::string_view name, const Pid& pid)
+  -> bool
+{
+  return broadcast(
+    PendingEnvelope{
+      DistributionEnvelopeKind::register_name,
+      NullPid,
+      pid,
+      std::string{name},
+      {}
+    }
+  );
+}
+
+auto Distribution::unregister_name(const std::string_view name, const Pid& pid)
+  -> bool
+{
+  return broadcast(
+    PendingEnvelope{
+      DistributionEnvelopeKind::unregister_name,
+      NullPid,
+      pid,
+      std::string{name},
+      {}
+    }
+  );
+}
+
+auto Distribution::enqueue(const NodeId node_id, PendingEnvelope&& envelope)
+  -> bool
+{
+  const auto envelope_size = (
+    envelope.record.size() + envelope.name.size() + EnvelopeOverhead
+  );
+
+  if (FrameOverhead + envelope_size > ACTOR_MODEL_DISTRIBUTION_MAX_FRAME_SIZE)
+  {
+    return enqueue_fragments(node_id, std::move(envelope));
+  }
+
+  auto queued = false;
+
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+
+  const auto& peer_iter = peers.find(node_id);
+  if (peer_iter != peers.end())
+  {
+    auto& peer = peer_iter->second;
+
+    // Send the current batch first, if this envelope would not fit in it
+    const auto batch_size = FrameOverhead + peer.pending_size + envelope_size;
+    if (batch_size > ACTOR_MODEL_DISTRIBUTION_MAX_FRAME_SIZE)
+    {
+      flush(peer, xTaskGetTickCount());
+    }
+
+    // If the send window is full, the batch could not be sent
+    if (
+      FrameOverhead + peer.pending_size + envelope_size
+      <= ACTOR_MODEL_DISTRIBUTION_MAX_FRAME_SIZE
+    )
+    {
+      peer.pending.emplace_back(std::move(envelope));
+      peer.pending_size += envelope_size;
+      queued = true;
+    }
+    else {
+      ESP_LOGW(TAG, "Send window full for node %08" PRIx32, node_id);
+    }
+  }
+
+  xSemaphoreGive(peers_mutex);
+
+  return queued;
+}
+
+auto Distribution::enqueue_fragments(
+  const NodeId node_id,
+  PendingEnvelope&& envelope
+) -> bool
+{
+  // Names and exit reasons are never split, only message records
+  if (
+    envelope.kind != DistributionEnvelopeKind::message
+    or not envelope.name.empty()
+    or envelope.record.size() > get_max_record_size()
+  )
+  {
+    ESP_LOGE(
+      TAG,
+      "Message too large to send (%zu bytes, at most %zu)",
+      envelope.record.size() + envelope.name.size(),
+      get_max_record_size()
+    );
+    return false;
+  }
+
+  const auto fragment_count = (
+    (envelope.record.size() + FragmentSize - 1) / FragmentSize
+  );
+
+  auto queued = false;
+
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+
+  const auto& peer_iter = peers.find(node_id);
+  if (peer_iter != peers.end())
+  {
+    auto& peer = peer_iter->second;
+    const auto now_ticks = xTaskGetTickCount();
+
+    // Send the current batch first, the fragments must be in consecutive
+    // frames and all of them must fit in the send window
+    flush(peer, now_ticks);
+
+    if (
+      peer.pending.empty()
+      and peer.unacked.size() + fragment_count
+        <= ACTOR_MODEL_DISTRIBUTION_WINDOW_SIZE
+    )
+    {
+      const auto* record_data = envelope.record.data();
+      const auto record_size = envelope.record.size();
+
+      for (size_t offset = 0; offset < record_size; offset += FragmentSize)
+      {
+        const auto fragment_size = std::min(FragmentSize, record_size - offset);
+
+        peer.pending.emplace_back(
+          PendingEnvelope{
+            envelope.kind,
+            envelope.to_pid,
+            envelope.from_pid,
+            {},
+            std::vector<uint8_t>{
+              record_data + offset,
+              record_data + offset + fragment_size
+            },
+            (offset + fragment_size < record_size)
+          }
+        );
+        peer.pending_size = EnvelopeOverhead + fragment_size;
+
+        flush(peer, now_ticks);
+      }
+
+      queued = true;
+    }
+    else {
+      ESP_LOGW(TAG, "Send window full for node %08" PRIx32, node_id);
+    }
+  }
+
+  xSemaphoreGive(peers_mutex);
+
+  return queued;
+}
+
+auto Distribution::broadcast(const PendingEnvelope& envelope)
+  -> bool
+{
+  std::vector<NodeId> node_ids;
+
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+  for (const auto& peer_iter : peers)
+  {
+    node_ids.emplace_back(peer_iter.first);
+  }
+  xSemaphoreGive(peers_mutex);
+
+  auto queued = true;
+  for (const auto node_id : node_ids)
+  {
+    auto envelope_copy = envelope;
+    queued = (enqueue(node_id, std::move(envelope_copy)) and queued);
+  }
+
+  return queued;
+}
+
+auto Distribution::find_or_add_peer(
+  const NodeId node_id,
+  const struct sockaddr_in& addr
+) -> Distribution::Peer&
+{
+  auto& peer = peers[node_id];
+  const auto is_new_peer = (peer.node_id == NullNodeId);
+  if (is_new_peer)
+  {
+    peer.node_id = node_id;
+    peer.session = generate_session();
+    peer.ack_pending = true;
+    peer.last_received_ticks = xTaskGetTickCount();
+  }
+
+  // Follow the node if its address changes
+  peer.addr = addr;
+
+  // Stop sending hellos to an address once the node there has replied,
+  // continuing in the session the hellos were sent in
+  for (
+    auto i = pending_addresses.begin(), end = pending_addresses.end();
+    i != end;
+  )
+  {
+    if (same_address(i->addr, addr))
+    {
+      if (is_new_peer)
+      {
+        peer.session = i->session;
+      }
+
+      i = pending_addresses.erase(i);
+      end = pending_addresses.end();
+    }
+    else {
+      ++i;
+    }
+  }
+
+  return peer;
+}
+
+auto Distribution::restart_peer(Peer& peer)
+  -> void
+{
+  // Envelopes for the previous incarnation of the node are dropped, but
+  // our session is kept, so the peer does not reset in turn
+  peer.next_seq = 1;
+  peer.pending.clear();
+  peer.pending_size = 0;
+  peer.unacked.clear();
+
+  peer.received_session = 0;
+  peer.received_seq = 0;
+  peer.ack_pending = true;
+}
+
+auto Distribution::pend_node_change(NodeChange&& change)
+  -> bool
+{
+  auto* pended_change = new NodeChange{std::move(change)};
+  pended_change->distribution = this;
+
+  auto ret = xTimerPendFunctionCall(
+    _node_change_callback,
+    pended_change,
+    0,
+    portMAX_DELAY
+  );
+
+  if (ret != pdPASS)
+  {
+    ESP_LOGE(TAG, "Unable to pend node change");
+    delete pended_change;
+    return false;
+  }
+
+  return true;
+}
+
+auto Distribution::pend_node_event(
+  const PendedFunction_t callback,
+  const NodeId node_id
+) -> bool
+{
+  auto ret = xTimerPendFunctionCall(callback, this, node_id, portMAX_DELAY);
+  if (ret != pdPASS)
+  {
+    ESP_LOGE(TAG, "Unable to pend event for node %08" PRIx32, node_id);
+    return false;
+  }
+
+  return true;
+}
+
+auto Distribution::flush(Peer& peer, const TickType_t now_ticks)
+  -> bool
+{
+  if (
+    peer.pending.empty()
+    or peer.unacked.size() >= ACTOR_MODEL_DISTRIBUTION_WINDOW_SIZE
+  )
+  {
+    return false;
+  }
+
+  auto seq = peer.next_seq++;
+  auto did_send = send_frame(peer, seq, std::move(peer.pending), now_ticks);
+
+  peer.pending.clear();
+  peer.pending_size = 0;
+
+  return did_send;
+}
+
+auto Distribution::send_frame(
+  Peer& peer,
+  const uint32_t seq,
+  std::vector<PendingEnvelope>&& envelopes,
+  const TickType_t now_ticks
+) -> bool
+{
+  flatbuffers::FlatBufferBuilder fbb(FrameOverhead + peer.pending_size);
+
+  std::vector<flatbuffers::Offset<DistributionEnvelope>> envelope_offsets;
+  envelope_offsets.reserve(envelopes.size());
+
+  for (const auto& envelope : envelopes)
+  {
+    flatbuffers::Offset<flatbuffers::String> name_str;
+    if (not envelope.name.empty())
+    {
+      name_str = fbb.CreateString(envelope.name);
+    }
+
+    // Keep records aligned as they would be in a mailbox
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> record_bytes;
+    if (not envelope.record.empty())
+    {
+      fbb.ForceVectorAlignment(
+        envelope.record.size(),
+        sizeof(uint8_t),
+        sizeof(uint64_t)
+      );
+      record_bytes = fbb.CreateVector(envelope.record);
+    }
+
+    envelope_offsets.emplace_back(
+      CreateDistributionEnvelope(
+        fbb,
+        envelope.kind,
+        &envelope.to_pid,
+        &envelope.from_pid,
+        name_str,
+        record_bytes,
+        envelope.more_fragments
+      )
+    );
+  }
+
+  auto envelopes_vec = fbb.CreateVector(envelope_offsets);
+
+  auto frame_offset = CreateDistributionFrame(
+    fbb,
+    node.get_node_id(),
+    peer.session,
+    seq,
+    peer.received_seq,
+    envelopes_vec
+  );
+
+  fbb.Finish(frame_offset);
+
+  auto ret = sendto(
+    sockfd,
+    fbb.GetBufferPointer(),
+    fbb.GetSize(),
+    0,
+    reinterpret_cast<const struct sockaddr*>(&peer.addr),
+    sizeof(peer.addr)
+  );
+
+  peer.ack_pending = false;
+  peer.last_sent_ticks = now_ticks;
+
+  // Sequenced frames are kept (and retransmitted) until acknowledged
+  if (seq)
+  {
+    peer.unacked.emplace_back(SentFrame{seq, fbb.Release(), now_ticks});
+  }
+
+  return (ret >= 0);
+}
+
+auto Distribution::receive_frames()
+  -> void
+{
+  ssize_t bytes_read = 0;
+
+  do {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    bytes_read = recvfrom(
+      sockfd,
+      recv_buf,
+      sizeof(recv_buf),
+      0,
+      reinterpret_cast<struct sockaddr*>(&addr),
+      &addr_len
+    );
+
+    if (bytes_read > 0)
+    {
+      handle_frame(
+        BufferView{recv_buf, static_cast<size_t>(bytes_read)},
+        addr
+      );
+    }
+  }
+  while (bytes_read > 0);
+}
+
+auto Distribution::handle_frame(
+  const BufferView frame_buf,
+  const struct sockaddr_in& addr
+) -> void
+{
+  flatbuffers::Verifier verifier(frame_buf.data(), frame_buf.size());
+  if (not verifier.VerifyBuffer<DistributionFrame>(nullptr))
+  {
+    ESP_LOGW(TAG, "Dropped invalid frame (%zu bytes)", frame_buf.size());
+    return;
+  }
+
+  const auto* frame = flatbuffers::GetRoot<DistributionFrame>(
+    frame_buf.data()
+  );
+
+  const auto from_node = frame->from_node();
+  if (from_node == NullNodeId or from_node == node.get_node_id())
+  {
+    return;
+  }
+
+  auto is_new_peer = false;
+  auto is_restarted_peer = false;
+  auto is_deliverable = false;
+
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+
+  is_new_peer = (peers.find(from_node) == peers.end());
+  auto& peer = find_or_add_peer(from_node, addr);
+  peer.last_received_ticks = xTaskGetTickCount();
+
+  if (frame->session() and frame->session() != peer.received_session)
+  {
+    // The node restarted (or timed us out), so links to it are broken
+    is_restarted_peer = (peer.received_session != 0);
+    if (is_restarted_peer)
+    {
+      restart_peer(peer);
+      received_fragments.erase(from_node);
+    }
+
+    peer.received_session = frame->session();
+    peer.received_seq = 0;
+  }
+
+  // Acknowledgements are cumulative
+  while (
+    not peer.unacked.empty()
+    and peer.unacked.front().seq <= frame->ack()
+  )
+  {
+    peer.unacked.pop_front();
+  }
+
+  if (frame->seq())
+  {
+    // Frames are only accepted in order, anything else is retransmitted
+    is_deliverable = (frame->seq() == peer.received_seq + 1);
+    if (is_deliverable)
+    {
+      peer.received_seq = frame->seq();
+    }
+
+    peer.ack_pending = true;
+  }
+  else if (is_new_peer)
+  {
+    // Reply to a hello
+    peer.ack_pending = true;
+  }
+
+  xSemaphoreGive(peers_mutex);
+
+  if (is_restarted_peer)
+  {
+    pend_node_event(_node_down_callback, from_node);
+  }
+
+  if (is_new_peer or is_restarted_peer)
+  {
+    ESP_LOGI(TAG, "Node %08" PRIx32 " connected", from_node);
+    pend_node_event(_node_connected_callback, from_node);
+  }
+
+  if (is_deliverable and frame->envelopes())
+  {
+    for (const auto* envelope : *(frame->envelopes()))
+    {
+      if (envelope)
+      {
+        deliver(from_node, *(envelope));
+      }
+    }
+  }
+}
+
+auto Distribution::deliver(
+  const NodeId from_node,
+  const DistributionEnvelope& envelope
+) -> void
+{
+  const auto& to_pid = envelope.to_pid()? *(envelope.to_pid()) : NullPid;
+  const auto& from_pid = envelope.from_pid()? *(envelope.from_pid()) : NullPid;
+  const auto name = envelope.name()?
+    envelope.name()->string_view() : std::string_view{};
+
+  switch (envelope.kind())
+  {
+  case DistributionEnvelopeKind::message:
+    if (envelope.record() and envelope.record()->size() > 0)
+    {
+      const auto record = BufferView{
+        envelope.record()->data(),
+        envelope.record()->size()
+      };
+
+      // Fragments arrive in consecutive frames, so are appended in order
+      const auto& fragments_iter = received_fragments.find(from_node);
+      if (
+        envelope.more_fragments()
+        or fragments_iter != received_fragments.end()
+      )
+      {
+        auto& fragments = received_fragments[from_node];
+        fragments.insert(fragments.end(), record.begin(), record.end());
+
+        if (not envelope.more_fragments())
+        {
+          const auto reassembled = std::move(fragments);
+          received_fragments.erase(from_node);
+
+          deliver_record(
+            to_pid,
+            BufferView{reassembled.data(), reassembled.size()}
+          );
+        }
+      }
+      else {
+        deliver_record(to_pid, record);
+      }
+    }
+    break;
+
+  case DistributionEnvelopeKind::exit:
+    // Processed on the timer service task, as a signal
+    node.exit(from_pid, to_pid, name);
+    break;
+
+  case DistributionEnvelopeKind::link:
+  case DistributionEnvelopeKind::unlink:
+  case DistributionEnvelopeKind::register_name:
+  case DistributionEnvelopeKind::unregister_name:
+    pend_node_change(
+      NodeChange{nullptr, envelope.kind(), to_pid, from_pid, std::string{name}}
+    );
+    break;
+  }
+}
+
+auto Distribution::deliver_record(const Pid& to_pid, const BufferView record)
+  -> void
+{
+  // Only a record with a deadline is copied, to set it on this node
+  flatbuffers::Verifier verifier(record.data(), record.size());
+  if (
+    not is_typed_message_record(record)
+    and verifier.VerifyBuffer<Message>(nullptr)
+    and flatbuffers::GetRoot<Message>(record.data())->deadline()
+  )
+  {
+    auto local_record = std::vector<uint8_t>{record.begin(), record.end()};
+    set_deadline_from_remaining(local_record);
+
+    node.send_record(
+      to_pid,
+      BufferView{local_record.data(), local_record.size()}
+    );
+  }
+  else {
+    node.send_record(to_pid, record);
+  }
+}
+
+auto Distribution::_apply_node_change(const NodeChange& change)
+  -> void
+{
+  switch (change.kind)
+  {
+  case DistributionEnvelopeKind::link:
+    if (not node.add_remote_link(change.to_pid, change.from_pid))
+    {
+      // The linked process has already exited
+      exit(change.to_pid, change.from_pid, "noproc");
+    }
+    break;
+
+  case DistributionEnvelopeKind::unlink:
+    node.remove_remote_link(change.to_pid, change.from_pid);
+    break;
+
+  case DistributionEnvelopeKind::register_name:
+    node.register_remote_name(change.name, change.from_pid);
+    break;
+
+  case DistributionEnvelopeKind::unregister_name:
+    node.unregister_remote_name(change.name, change.from_pid);
+    break;
+
+  case DistributionEnvelopeKind::message:
+  case DistributionEnvelopeKind::exit:
+    break;
+  }
+}
+
+auto Distribution::_node_connected(const NodeId node_id)
+  -> void
+{
+  // Share the names registered globally on this node
+  for (auto& global_name : node.get_global_names())
+  {
+    enqueue(
+      node_id,
+      PendingEnvelope{
+        DistributionEnvelopeKind::register_name,
+        NullPid,
+        global_name.second,
+        std::move(global_name.first),
+        {}
+      }
+    );
+  }
+}
+
+auto Distribution::_node_down(const NodeId node_id)
+  -> void
+{
+  node.node_down(node_id);
+}
+
+auto Distribution::service_peers()
+  -> void
+{
+  constexpr auto retransmit_ticks = pdMS_TO_TICKS(
+    ACTOR_MODEL_DISTRIBUTION_RETRANSMIT_MS
+  );
+  constexpr auto heartbeat_ticks = pdMS_TO_TICKS(
+    ACTOR_MODEL_DISTRIBUTION_HEARTBEAT_MS
+  );
+  constexpr auto peer_timeout_ticks = pdMS_TO_TICKS(
+    ACTOR_MODEL_DISTRIBUTION_PEER_TIMEOUT_MS
+  );
+
+  const auto now_ticks = xTaskGetTickCount();
+  std::vector<NodeId> down_node_ids;
+
+  xSemaphoreTake(peers_mutex, portMAX_DELAY);
+
+  // Keep trying to reach nodes which have not replied (or went down)
+  if ((now_ticks - last_hello_ticks) > heartbeat_ticks)
+  {
+    for (const auto& pending_address : pending_addresses)
+    {
+      Peer hello;
+      hello.addr = pending_address.addr;
+      hello.session = pending_address.session;
+      send_frame(hello, 0, {}, now_ticks);
+    }
+    last_hello_ticks = now_ticks;
+  }
+
+  for (auto& peer_iter : peers)
+  {
+    auto& peer = peer_iter.second;
+
+    if ((now_ticks - peer.last_received_ticks) > peer_timeout_ticks)
+    {
+      down_node_ids.emplace_back(peer.node_id);
+      continue;
+    }
+
+    // Go-back-N: resend everything unacknowledged
+    if (
+      not peer.unacked.empty()
+      and (now_ticks - peer.unacked.front().sent_ticks) > retransmit_ticks
+    )
+    {
+      for (auto& sent_frame : peer.unacked)
+      {
+        sendto(
+          sockfd,
+          sent_frame.buf.data(),
+          sent_frame.buf.size(),
+          0,
+          reinterpret_cast<const struct sockaddr*>(&peer.addr),
+          sizeof(peer.addr)
+        );
+        sent_frame.sent_ticks = now_ticks;
+      }
+      peer.last_sent_ticks = now_ticks;
+    }
+
+    flush(peer, now_ticks);
+
+    // Acknowledge received frames, or keep the connection alive
+    if (
+      peer.ack_pending
+      or (now_ticks - peer.last_sent_ticks) > heartbeat_ticks
+    )
+    {
+      send_frame(peer, 0, {}, now_ticks);
+    }
+  }
+
+  // A new session tells the node to reset, if it is still up
+  for (const auto node_id : down_node_ids)
+  {
+    const auto& peer_iter = peers.find(node_id);
+    pending_addresses.emplace_back(
+      PendingAddress{peer_iter->second.addr, generate_session()}
+    );
+    peers.erase(peer_iter);
+    received_fragments.erase(node_id);
+  }
+
+  xSemaphoreGive(peers_mutex);
+
+  for (const auto node_id : down_node_ids)
+  {
+    ESP_LOGW(TAG, "Node %08" PRIx32 " down", node_id);
+    pend_node_event(_node_down_callback, node_id);
+  }
+}
+
+auto Distribution::_execute()
+  -> void
+{
+  while (true)
+  {
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(sockfd, &read_fds);
+
+    // Pending envelopes are batched for (at most) one flush interval
+    struct timeval select_timeout;
+    select_timeout.tv_sec = 0;
+    select_timeout.tv_usec = ACTOR_MODEL_DISTRIBUTION_FLUSH_INTERVAL_MS * 1000;
+
+    auto ret = select(sockfd + 1, &read_fds, nullptr, nullptr, &select_timeout);
+    if (ret > 0 and FD_ISSET(sockfd, &read_fds))
+    {
+      receive_frames();
+    }
+
+    service_peers();
+  }
+}
+
+auto distribution_task(void* user_data)
+  -> void
+{
+  auto* distribution = static_cast<Distribution*>(user_data);
+
+  if (distribution != nullptr)
+  {
+    distribution->_execute();
+  }
+}
+
+} // namespace ActorModel
@@ -0,0 +1,235 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "pid.h"
+
+#include "actor_model_generated.h"
+
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "lwip/sockets.h"
+
+namespace ActorModel {
+
+class Node;
+
+// Connects Nodes (in this or other processes/devices) over UDP.
+// Sends to Pids of a connected node are batched into frames, which are
+// sequenced, acknowledged and retransmitted until acknowledged.
+// Nodes which stop responding are considered down, and linked local
+// processes receive exit signals with reason "noconnection".
+// A message too large for one frame is sent as fragments, one per frame, so
+// it can be at most ACTOR_MODEL_DISTRIBUTION_WINDOW_SIZE frames long.
+// Links, names and node down/up are applied to the Node on the timer
+// service task (which also processes exit signals), not the distribution task
+class Distribution
+{
+public:
+  using BufferView = std::span<const uint8_t>;
+
+  struct PendingEnvelope
+  {
+    DistributionEnvelopeKind kind;
+    Pid to_pid;
+    Pid from_pid;
+    std::string name;
+    std::vector<uint8_t> record;
+    bool more_fragments = false;
+  };
+
+  struct SentFrame
+  {
+    uint32_t seq;
+    flatbuffers::DetachedBuffer buf;
+    TickType_t sent_ticks;
+  };
+
+  struct Peer
+  {
+    NodeId node_id = NullNodeId;
+    struct sockaddr_in addr;
+
+    // Outgoing. The session is kept for as long as the peer is, and only
+    // a new session (after a timeout) tells the peer to reset
+    uint32_t session = 0;
+    uint32_t next_seq = 1;
+    std::vector<PendingEnvelope> pending;
+    size_t pending_size = 0;
+    std::deque<SentFrame> unacked;
+    TickType_t last_sent_ticks = 0;
+
+    // Incoming
+    uint32_t received_session = 0;
+    uint32_t received_seq = 0;
+    bool ack_pending = false;
+    TickType_t last_received_ticks = 0;
+  };
+
+  using Peers = std::unordered_map<NodeId, Peer>;
+
+  // Fragments received so far of the record each node is sending
+  using ReceivedFragments = std::unordered_map<NodeId, std::vector<uint8_t>>;
+
+  // Sent hellos until the node there replies, in the session it is then
+  // connected with
+  struct PendingAddress
+  {
+    struct sockaddr_in addr;
+    uint32_t session;
+  };
+
+  using PendingAddresses = std::vector<PendingAddress>;
+
+  // Received from a peer, and applied to the node on the timer service task
+  struct NodeChange
+  {
+    Distribution* distribution;
+    DistributionEnvelopeKind kind;
+    Pid to_pid;
+    Pid from_pid;
+    std::string name;
+  };
+
+  explicit Distribution(
+    Node& _node,
+    const uint16_t port,
+    const size_t task_stack_size,
+    const int task_prio
+  );
+  ~Distribution();
+
+  auto is_started() const
+    -> bool;
+
+  // Start contacting a node, its NodeId is learned from its reply
+  auto connect(const std::string_view host, const uint16_t port)
+    -> bool;
+
+  auto is_connected(const NodeId node_id)
+    -> bool;
+
+  auto send_record(const Pid& to_pid, const BufferView record)
+    -> bool;
+
+  // The largest record send_record accepts, when the send window is empty
+  static auto get_max_record_size()
+    -> size_t;
+
+  auto exit(const Pid& from_pid, const Pid& to_pid, const std::string_view reason)
+    -> bool;
+
+  auto link(const Pid& from_pid, const Pid& to_pid)
+    -> bool;
+
+  auto unlink(const Pid& from_pid, const Pid& to_pid)
+    -> bool;
+
+  // Publish a name registered on this node to all connected nodes
+  auto register_name(const std::string_view name, const Pid& pid)
+    -> bool;
+
+  auto unregister_name(const std::string_view name, const Pid& pid)
+    -> bool;
+
+  auto _execute()
+    -> void;
+
+  // Called on the timer service task
+  auto _apply_node_change(const NodeChange& change)
+    -> void;
+
+  auto _node_connected(const NodeId node_id)
+    -> void;
+
+  auto _node_down(const NodeId node_id)
+    -> void;
+
+protected:
+  auto enqueue(const NodeId node_id, PendingEnvelope&& envelope)
+    -> bool;
+
+  auto enqueue_fragments(const NodeId node_id, PendingEnvelope&& envelope)
+    -> bool;
+
+  auto broadcast(const PendingEnvelope& envelope)
+    -> bool;
+
+  auto find_or_add_peer(const NodeId node_id, const struct sockaddr_in& addr)
+    -> Peer&;
+
+  // The peer restarted, so resend from seq 1 (in the same session) and
+  // expect its new session from seq 1
+  auto restart_peer(Peer& peer)
+    -> void;
+
+  auto pend_node_change(NodeChange&& change)
+    -> bool;
+
+  auto pend_node_event(
+    const PendedFunction_t callback,
+    const NodeId node_id
+  ) -> bool;
+
+  auto flush(Peer& peer, const TickType_t now_ticks)
+    -> bool;
+
+  auto send_frame(
+    Peer& peer,
+    const uint32_t seq,
+    std::vector<PendingEnvelope>&& envelopes,
+    const TickType_t now_ticks
+  ) -> bool;
+
+  auto receive_frames()
+    -> void;
+
+  auto handle_frame(const BufferView frame_buf, const struct sockaddr_in& addr)
+    -> void;
+
+  auto deliver(const NodeId from_node, const DistributionEnvelope& envelope)
+    -> void;
+
+  auto deliver_record(const Pid& to_pid, const BufferView record)
+    -> void;
+
+  auto service_peers()
+    -> void;
+
+  Node& node;
+
+private:
+  int sockfd = -1;
+  SemaphoreHandle_t peers_mutex = nullptr;
+  TaskHandle_t impl = nullptr;
+
+  Peers peers;
+  PendingAddresses pending_addresses;
+
+  // Only used on the distribution task
+  ReceivedFragments received_fragments;
+  TickType_t last_hello_ticks = 0;
+
+  alignas(uint64_t) uint8_t recv_buf[ACTOR_MODEL_DISTRIBUTION_MAX_FRAME_SIZE];
+};
+
+} // namespace ActorModel
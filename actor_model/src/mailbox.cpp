@@ -10,10 +10,16 @@
 
 #include "mailbox.h"
 
+#include "message_trace.h"
+
 #include "delay.h"
+#include "timestamp.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 
 namespace ActorModel {
@@ -24,20 +30,121 @@ using UUID::uuidgen;
 
 Mailbox::AddressRegistry Mailbox::address_registry;
 
+// Written to the ringbuffer when messages start spilling over, so a receiver
+// blocked on the ringbuffer wakes up and knows to check overflow segments
+constexpr char OverflowDoorbellIdentifier[] = "Ovf!";
+
+// Message table fields besides type and payload, for sizing the builder
+constexpr size_t MessageOverheadSize = 128;
+
+// Precedes each record in an overflow segment
+struct OverflowRecordHeader
+{
+  uint32_t size;
+  uint32_t reserved;
+};
+
+// Copy head, then each of the pieces, then tail into place one after another
+auto gather_record(
+  uint8_t* dest,
+  const BufferView head,
+  const BufferViews pieces,
+  const BufferView tail
+) -> void;
+
+auto gather_record(
+  uint8_t* dest,
+  const BufferView head,
+  const BufferViews pieces,
+  const BufferView tail
+) -> void
+{
+  if (not head.empty())
+  {
+    memcpy(dest, head.data(), head.size());
+    dest += head.size();
+  }
+
+  for (const auto& piece : pieces)
+  {
+    if (not piece.empty())
+    {
+      memcpy(dest, piece.data(), piece.size());
+      dest += piece.size();
+    }
+  }
+
+  if (not tail.empty())
+  {
+    memcpy(dest, tail.data(), tail.size());
+  }
+}
+
+constexpr auto get_overflow_stride(const size_t record_size)
+  -> size_t
+{
+  // Keep records 8-byte aligned, for flatbuffers with 64-bit fields
+  constexpr auto alignment = alignof(uint64_t);
+  return (
+    (sizeof(OverflowRecordHeader) + record_size + alignment - 1)
+    & ~(alignment - 1)
+  );
+}
+
 Mailbox::Mailbox(
   const size_t _mailbox_size,
   const size_t _send_timeout_microseconds,
   const size_t _receive_timeout_microseconds,
-  const size_t _receive_lock_timeout_microseconds
+  const size_t _receive_lock_timeout_microseconds,
+  const MailboxOverflowConfig& _overflow_config,
+  const MemoryPlacement _placement,
+  const MailboxBackend _backend
 )
 : address(uuidgen())
 , mailbox_size(_mailbox_size)
 , send_timeout_ticks(pdMS_TO_TICKS(_send_timeout_microseconds / 1000))
 , receive_timeout_ticks(pdMS_TO_TICKS(_receive_timeout_microseconds / 1000))
 , receive_lock_timeout_ticks(pdMS_TO_TICKS(_receive_lock_timeout_microseconds / 1000))
-, impl{xRingbufferCreate(mailbox_size, RINGBUF_TYPE_NOSPLIT)}
-, receive_semaphore(xSemaphoreCreateBinary())
+, impl(nullptr)
+, receive_semaphore(
+    (_backend == MailboxBackend::ringbuffer)? xSemaphoreCreateBinary() : nullptr
+  )
+, overflow_config(_overflow_config)
+, next_segment_size(_overflow_config.segment_size)
 {
+  if (_backend == MailboxBackend::mpsc)
+  {
+    mpsc_queue = std::make_unique<MpscQueue>(mailbox_size, _placement);
+    if (not mpsc_queue->is_valid())
+    {
+      mpsc_queue.reset();
+    }
+  }
+  else if (_placement == MemoryPlacement::any)
+  {
+    impl = xRingbufferCreate(mailbox_size, RINGBUF_TYPE_NOSPLIT);
+  }
+  else {
+    // Only the storage is placed, the control structure stays internal
+    const auto storage_size = (mailbox_size + 3) & ~static_cast<size_t>(3);
+    static_ringbuffer = static_cast<StaticRingbuffer_t*>(
+      placement_malloc(sizeof(StaticRingbuffer_t), MemoryPlacement::internal)
+    );
+    ringbuffer_storage = static_cast<uint8_t*>(
+      placement_malloc(storage_size, _placement)
+    );
+
+    if (static_ringbuffer and ringbuffer_storage)
+    {
+      impl = xRingbufferCreateStatic(
+        storage_size,
+        RINGBUF_TYPE_NOSPLIT,
+        ringbuffer_storage,
+        static_ringbuffer
+      );
+    }
+  }
+
   // Semaphore to indicate safe-to-receive
   if (receive_semaphore)
   {
@@ -47,6 +154,12 @@ Mailbox::Mailbox(
 
   // Create extra mutex for SMP safety
   spinlock_initialize(&receive_multicore_mutex);
+  coalesced_types_mutex = xSemaphoreCreateMutex();
+
+  if (overflow_config.growth_policy != MailboxGrowthPolicy::fixed)
+  {
+    overflow_mutex = xSemaphoreCreateMutex();
+  }
 
   address_registry.insert({address, this});
 }
@@ -74,13 +187,81 @@ Mailbox::~Mailbox()
 
     portEXIT_CRITICAL(&receive_multicore_mutex);
   }
+
+  // Safe to free once vRingbufferDelete has been called
+  placement_free(ringbuffer_storage);
+  placement_free(static_ringbuffer);
+
+  for (auto& segment : overflow_segments)
+  {
+    heap_caps_free(segment.data);
+  }
+
+  if (overflow_mutex)
+  {
+    vSemaphoreDelete(overflow_mutex);
+  }
+
+  if (coalesced_types_mutex)
+  {
+    vSemaphoreDelete(coalesced_types_mutex);
+  }
 }
 
 auto Mailbox::create_message(
   const MessageType type,
   const BufferView payload,
   const size_t payload_alignment,
-  const Pid* from_pid
+  const Pid* from_pid,
+  const uint64_t deadline
+) -> flatbuffers::DetachedBuffer
+{
+  return create_message(
+    type,
+    BufferViews{&payload, 1},
+    payload_alignment,
+    from_pid,
+    deadline
+  );
+}
+
+auto Mailbox::create_message(
+  const MessageType type,
+  const BufferViews payload_pieces,
+  const size_t payload_alignment,
+  const Pid* from_pid,
+  const uint64_t deadline
+) -> flatbuffers::DetachedBuffer
+{
+  size_t payload_size = 0;
+  for (const auto& payload_piece : payload_pieces)
+  {
+    payload_size += payload_piece.size();
+  }
+
+  uint8_t* payload_data = nullptr;
+  auto message = create_message_envelope(
+    type,
+    payload_size,
+    payload_data,
+    payload_alignment,
+    from_pid,
+    deadline
+  );
+
+  // Gather the pieces directly into the payload vector
+  gather_record(payload_data, {}, payload_pieces, {});
+
+  return message;
+}
+
+auto Mailbox::create_message_envelope(
+  const MessageType type,
+  const size_t payload_size,
+  uint8_t*& payload_data,
+  const size_t payload_alignment,
+  const Pid* from_pid,
+  const uint64_t deadline
 ) -> flatbuffers::DetachedBuffer
 {
   using std::chrono::microseconds;
@@ -93,8 +274,10 @@ auto Mailbox::create_message(
     now.time_since_epoch()
   ).count();
 
-  // Serialize and send
-  flatbuffers::FlatBufferBuilder fbb;
+  // Serialize, sized up front so the builder never grows (and copies)
+  flatbuffers::FlatBufferBuilder fbb(
+    MessageOverheadSize + type.size() + payload_alignment + payload_size
+  );
 
   auto type_str = fbb.CreateString(type);
 
@@ -102,13 +285,22 @@ auto Mailbox::create_message(
   if (payload_alignment)
   {
     fbb.ForceVectorAlignment(
-      payload.size(),
+      payload_size,
       sizeof(uint8_t),
       payload_alignment
     );
   }
 
-  auto payload_bytes = fbb.CreateVector(payload.data(), payload.size());
+  auto payload_bytes = fbb.CreateUninitializedVector(
+    payload_size,
+    &payload_data
+  );
+
+  // The builder writes back to front, so the payload offset from the end of
+  // the buffer is already final
+  const auto payload_offset_from_end = (
+    fbb.GetSize() - (payload_data - fbb.GetCurrentBufferPointer())
+  );
 
   auto message_loc = CreateMessage(
     fbb,
@@ -116,10 +308,32 @@ auto Mailbox::create_message(
     epoch_microseconds,
     from_pid,
     payload_alignment,
-    payload_bytes
+    payload_bytes,
+    NullMessageTypeId,
+    deadline
   );
   FinishMessageBuffer(fbb, message_loc);
 
+  auto message = fbb.Release();
+  payload_data = message.data() + (message.size() - payload_offset_from_end);
+
+  return message;
+}
+
+auto Mailbox::create_typed_message(
+  const MessageTypeId type_id,
+  const BufferView value
+) -> flatbuffers::DetachedBuffer
+{
+  TypedMessageHeader header;
+  header.type_id = type_id;
+  memcpy(header.identifier, TypedMessageIdentifier, sizeof(header.identifier));
+
+  // Serialize the raw record only (no tables), builder writes back-to-front
+  flatbuffers::FlatBufferBuilder fbb(sizeof(header) + value.size());
+  fbb.PushBytes(value.data(), value.size());
+  fbb.PushBytes(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+
   return fbb.Release();
 }
 
@@ -135,7 +349,8 @@ auto Mailbox::send(const Message& message)
         message.payload()->size()
       },
       message.payload_alignment(),
-      message.from_pid()
+      message.from_pid(),
+      message.deadline()
     );
   }
 
@@ -146,116 +361,1067 @@ auto Mailbox::send(
   const MessageType type,
   const BufferView payload,
   const size_t payload_alignment,
-  const Pid* from_pid
+  const Pid* from_pid,
+  const uint64_t deadline
 )
   -> bool
 {
-  if (impl)
+  return send(
+    type,
+    BufferViews{&payload, 1},
+    payload_alignment,
+    from_pid,
+    deadline
+  );
+}
+
+auto Mailbox::send(
+  const MessageType type,
+  const BufferViews payload_pieces,
+  const size_t payload_alignment,
+  const Pid* from_pid,
+  const uint64_t deadline
+)
+  -> bool
+{
+  if (impl or mpsc_queue)
   {
-    const auto& message = create_message(
+    size_t payload_size = 0;
+    for (const auto& payload_piece : payload_pieces)
+    {
+      payload_size += payload_piece.size();
+    }
+
+    // Only the envelope is serialized here, the payload pieces are gathered
+    // straight into the reserved record, so they are copied exactly once
+    uint8_t* payload_data = nullptr;
+    auto message = create_message_envelope(
       type,
-      payload,
+      payload_size,
+      payload_data,
       payload_alignment,
-      from_pid
+      from_pid,
+      deadline
     );
 
+    const auto envelope_head = BufferView{
+      message.data(),
+      static_cast<size_t>(payload_data - message.data())
+    };
+    const auto envelope_tail = BufferView{
+      payload_data + payload_size,
+      message.size() - envelope_head.size() - payload_size
+    };
+
+    // This message replaces a pending one of a coalesced type
+    auto coalesced_type_id = NullMessageTypeId;
+    if (has_coalesced_types)
+    {
+      coalesced_type_id = get_message_type_id(type);
+      const auto did_supersede = supersede(
+        coalesced_type_id,
+        envelope_head,
+        payload_pieces,
+        envelope_tail
+      );
+
+      if (did_supersede)
+      {
+        coalesced_count++;
+        return true;
+      }
+    }
+
     // Manually check that message will fit before attempting to send
-    if (message.size() < xRingbufferGetCurFreeSize(impl))
+    // Once spilling over, keep using overflow so messages stay in order
+    if (mpsc_queue)
+    {
+      if (overflow_count == 0)
+      {
+        auto* record = mpsc_queue->reserve(message.size());
+        if (record)
+        {
+          gather_record(record, envelope_head, payload_pieces, envelope_tail);
+          mpsc_queue->commit(record);
+
+          return true;
+        }
+      }
+    }
+    else if (
+      overflow_count == 0
+      and message.size() < xRingbufferGetCurFreeSize(impl)
+    )
     {
-      auto retval = xRingbufferSend(
+      // Reserve space in the ringbuffer and write the message in-place
+      void* record = nullptr;
+      auto retval = xRingbufferSendAcquire(
         impl,
-        message.data(),
+        &record,
         message.size(),
         send_timeout_ticks
       );
 
-      if (retval == pdTRUE)
+      if (retval == pdTRUE and record)
       {
-        return true;
+        gather_record(
+          static_cast<uint8_t*>(record),
+          envelope_head,
+          payload_pieces,
+          envelope_tail
+        );
+
+        return (xRingbufferSendComplete(impl, record) == pdTRUE);
       }
     }
+
+    // Spilling over needs the message in one piece
+    gather_record(payload_data, {}, payload_pieces, {});
+
+    auto did_send = send_overflow(BufferView{message.data(), message.size()});
+    if (not did_send and coalesced_type_id != NullMessageTypeId)
+    {
+      // Sent as well, if a newer message superseded this one meanwhile
+      did_send = requeue_superseding(coalesced_type_id);
+    }
+
+    return did_send;
   }
 
   return false;
 }
 
-auto Mailbox::receive(bool verify)
-  -> Mailbox::ReceivedMessagePtr
+auto Mailbox::send_typed(
+  const MessageTypeId type_id,
+  const BufferView value
+) -> bool
 {
-  if (impl)
+  if (impl or mpsc_queue)
   {
-    // Extract an item from the ringbuffer
-    size_t size = std::numeric_limits<size_t>::max();
-    auto* flatbuf = xRingbufferReceive(impl, &size, receive_timeout_ticks);
+    const auto record_size = sizeof(TypedMessageHeader) + value.size();
 
-    if (flatbuf and size != std::numeric_limits<size_t>::max())
+    TypedMessageHeader header;
+    header.type_id = type_id;
+    memcpy(header.identifier, TypedMessageIdentifier, sizeof(header.identifier));
+
+    const auto header_bytes = BufferView{
+      reinterpret_cast<const uint8_t*>(&header),
+      sizeof(header)
+    };
+
+    // This record replaces a pending one of a coalesced type
+    if (
+      has_coalesced_types
+      and supersede(type_id, header_bytes, BufferViews{&value, 1})
+    )
     {
-      if (xSemaphoreTake(receive_semaphore, receive_lock_timeout_ticks) == pdTRUE)
+      coalesced_count++;
+      return true;
+    }
+
+    // Manually check that message will fit before attempting to send
+    if (mpsc_queue)
+    {
+      if (overflow_count == 0 and mpsc_queue->push(header_bytes, value))
       {
-        const auto message = BufferView{
-          reinterpret_cast<const uint8_t*>(flatbuf),
-          size
-        };
-        return std::make_unique<ReceivedMessage>(*this, message, verify);
-      }
-      else {
-        ESP_LOGW(
-          get_uuid_str(address).c_str(),
-          "Unable to acquire receive semaphore in Mailbox::receive"
-        );
+        return true;
       }
     }
     else if (
-      receive_timeout_ticks > 0
-      and receive_timeout_ticks < portMAX_DELAY
+      overflow_count == 0
+      and record_size < xRingbufferGetCurFreeSize(impl)
     )
     {
-      ESP_LOGE(
-        get_uuid_str(address).c_str(),
-        "Invalid Message flatbuffer in Mailbox::receive"
+      // Reserve space in the ringbuffer and write the record in-place
+      void* record = nullptr;
+      auto retval = xRingbufferSendAcquire(
+        impl,
+        &record,
+        record_size,
+        send_timeout_ticks
       );
+
+      if (retval == pdTRUE and record)
+      {
+        memcpy(record, &header, sizeof(header));
+
+        if (not value.empty())
+        {
+          memcpy(
+            static_cast<uint8_t*>(record) + sizeof(TypedMessageHeader),
+            value.data(),
+            value.size()
+          );
+        }
+
+        return (xRingbufferSendComplete(impl, record) == pdTRUE);
+      }
+    }
+
+    auto did_send = send_overflow(header_bytes, value);
+    if (not did_send and has_coalesced_types)
+    {
+      // Sent as well, if a newer record superseded this one meanwhile
+      did_send = requeue_superseding(type_id);
     }
+
+    return did_send;
   }
 
-  return nullptr;
+  return false;
 }
 
-auto Mailbox::receive_raw()
-  -> BufferView
+auto Mailbox::send_record(const BufferView record)
+  -> bool
 {
-  BufferView message;
+  if (is_typed_message_record(record))
+  {
+    const auto* header = reinterpret_cast<const TypedMessageHeader*>(
+      record.data()
+    );
 
-  if (impl)
+    return send_typed(
+      header->type_id,
+      record.subspan(sizeof(TypedMessageHeader))
+    );
+  }
+
+  const auto* message = flatbuffers::GetRoot<Message>(record.data());
+  if (message)
   {
-    // Extract an item from the ringbuffer
-    size_t size = std::numeric_limits<size_t>::max();
-    auto* flatbuf = xRingbufferReceive(impl, &size, receive_timeout_ticks);
+    return send(*(message));
+  }
 
-    if (flatbuf and size != std::numeric_limits<size_t>::max())
+  return false;
+}
+
+auto Mailbox::enqueue_record(const BufferView record)
+  -> bool
+{
+  if (not (impl or mpsc_queue))
+  {
+    return false;
+  }
+
+  // Once spilling over, keep using overflow so records stay in order
+  if (overflow_count == 0)
+  {
+    if (mpsc_queue)
     {
-      message = BufferView{reinterpret_cast<const uint8_t*>(flatbuf), size};
+      if (mpsc_queue->push(record))
+      {
+        return true;
+      }
+    }
+    else if (
+      record.size() < xRingbufferGetCurFreeSize(impl)
+      and xRingbufferSend(
+        impl,
+        record.data(),
+        record.size(),
+        send_timeout_ticks
+      ) == pdTRUE
+    )
+    {
+      return true;
     }
   }
 
-  return message;
+  return send_overflow(record);
 }
 
-auto Mailbox::release(const BufferView message)
-  -> bool
+auto Mailbox::receive(bool verify)
+  -> Mailbox::ReceivedMessagePtr
+{
+  while (true)
+  {
+    auto message = receive_next();
+    if (message.empty())
+    {
+      return nullptr;
+    }
+
+    // Received, so the next message of a coalesced type will be queued.
+    // The newest message sent since is received in this one's place
+    if (
+      has_coalesced_types
+      and uncoalesce(get_record_type_id(message), &coalesced_received)
+    )
+    {
+      coalesced_replaced = message;
+      message = BufferView{coalesced_received.data(), coalesced_received.size()};
+    }
+
+    if (not is_expired(message))
+    {
+      return make_received_message(message, verify);
+    }
+
+    // Drop it unseen, and wait for the next message
+    expired_count++;
+    release(message);
+  }
+}
+
+auto Mailbox::receive_next()
+  -> BufferView
 {
+  if (mpsc_queue)
+  {
+    return receive_next_mpsc();
+  }
+
   if (impl)
   {
-    xSemaphoreGive(receive_semaphore);
+    // Spilled-over messages are queued behind everything in the ringbuffer,
+    // so only wait on the ringbuffer if there are none
+    auto check_overflow = false;
+    auto ring_timeout_ticks = (overflow_count > 0)? 0 : receive_timeout_ticks;
 
-    // Return the memory to the ringbuffer
-    vRingbufferReturnItem(
-      impl,
-      reinterpret_cast<char*>(const_cast<unsigned char*>(message.data()))
-    );
-    return true;
+    while (not check_overflow)
+    {
+      // Extract an item from the ringbuffer
+      size_t size = std::numeric_limits<size_t>::max();
+      auto* flatbuf = xRingbufferReceive(impl, &size, ring_timeout_ticks);
+
+      if (flatbuf and size != std::numeric_limits<size_t>::max())
+      {
+        if (is_overflow_doorbell(flatbuf, size))
+        {
+          vRingbufferReturnItem(impl, flatbuf);
+
+          // The doorbell may be stale if overflow was already drained
+          check_overflow = (overflow_count > 0);
+          continue;
+        }
+
+        if (xSemaphoreTake(receive_semaphore, receive_lock_timeout_ticks) == pdTRUE)
+        {
+          return BufferView{
+            reinterpret_cast<const uint8_t*>(flatbuf),
+            size
+          };
+        }
+        else {
+          ESP_LOGW(
+            get_uuid_str(address).c_str(),
+            "Unable to acquire receive semaphore in Mailbox::receive"
+          );
+        }
+      }
+      else if (overflow_count > 0)
+      {
+        check_overflow = true;
+      }
+      else if (
+        receive_timeout_ticks > 0
+        and receive_timeout_ticks < portMAX_DELAY
+      )
+      {
+        ESP_LOGE(
+          get_uuid_str(address).c_str(),
+          "Invalid Message flatbuffer in Mailbox::receive"
+        );
+      }
+
+      if (not check_overflow)
+      {
+        break;
+      }
+    }
+
+    if (check_overflow)
+    {
+      return receive_overflow();
+    }
   }
 
-  return false;
+  return {};
+}
+
+auto Mailbox::receive_next_mpsc()
+  -> BufferView
+{
+  // Spilled-over messages are queued behind everything in the queue,
+  // so only wait on the queue if there are none
+  auto queue_timeout_ticks = (overflow_count > 0)? 0 : receive_timeout_ticks;
+
+  while (true)
+  {
+    const auto record = mpsc_queue->receive(queue_timeout_ticks);
+    if (record.empty())
+    {
+      break;
+    }
+
+    if (is_overflow_doorbell(record.data(), record.size()))
+    {
+      mpsc_queue->pop(record);
+
+      // The doorbell may be stale if overflow was already drained
+      if (overflow_count > 0)
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    // No receive semaphore, records are only popped by this task
+    return record;
+  }
+
+  if (overflow_count > 0)
+  {
+    return receive_overflow();
+  }
+
+  return {};
+}
+
+auto Mailbox::make_received_message(const BufferView message, const bool verify)
+  -> Mailbox::ReceivedMessagePtr
+{
+  auto* current_recorder = recorder.load();
+  if (current_recorder)
+  {
+    current_recorder->record(recorded_pid, message);
+  }
+
+  return std::make_unique<ReceivedMessage>(*this, message, verify);
+}
+
+auto Mailbox::set_recorder(
+  MessageTraceRecorder* _recorder,
+  const Pid& _recorded_pid
+) -> void
+{
+  recorded_pid = _recorded_pid;
+  recorder.store(_recorder);
+}
+
+auto Mailbox::set_coalesced(const MessageType type, const bool coalesced)
+  -> void
+{
+  const auto type_id = get_message_type_id(type);
+
+  xSemaphoreTake(coalesced_types_mutex, portMAX_DELAY);
+
+  auto coalesced_type_iter = std::find_if(
+    coalesced_types.begin(),
+    coalesced_types.end(),
+    [type_id](const CoalescedType& coalesced_type)
+    {
+      return (coalesced_type.type_id == type_id);
+    }
+  );
+
+  if (coalesced and coalesced_type_iter == coalesced_types.end())
+  {
+    coalesced_types.emplace_back(CoalescedType{type_id, false, {}});
+  }
+  else if (not coalesced and coalesced_type_iter != coalesced_types.end())
+  {
+    coalesced_types.erase(coalesced_type_iter);
+  }
+
+  has_coalesced_types = not coalesced_types.empty();
+
+  xSemaphoreGive(coalesced_types_mutex);
+}
+
+auto Mailbox::set_clock(const ActorClock* _clock)
+  -> void
+{
+  clock.store(_clock);
+}
+
+auto Mailbox::get_expired_count() const
+  -> size_t
+{
+  return expired_count;
+}
+
+auto Mailbox::get_coalesced_count() const
+  -> size_t
+{
+  return coalesced_count;
+}
+
+auto Mailbox::get_dropped_superseding_count() const
+  -> size_t
+{
+  return dropped_superseding_count;
+}
+
+auto Mailbox::get_cpu_stats()
+  -> CpuStats&
+{
+  return cpu_stats;
+}
+
+auto Mailbox::is_expired(const BufferView message) const
+  -> bool
+{
+  // Typed records have no deadline
+  if (is_typed_message_record(message))
+  {
+    return false;
+  }
+
+  const auto* root = flatbuffers::GetRoot<Message>(message.data());
+  if (not (root and root->deadline()))
+  {
+    return false;
+  }
+
+  // Same clock as the deadline was computed from, see Node::send_with_ttl,
+  // unless a replay is driving the time
+  const auto* current_clock = clock.load();
+  const auto now = (
+    current_clock? current_clock->now() : utils::get_elapsed_microseconds()
+  ).count();
+  return (static_cast<uint64_t>(now) > root->deadline());
+}
+
+auto Mailbox::supersede(
+  const MessageTypeId type_id,
+  const BufferView head,
+  const BufferViews pieces,
+  const BufferView tail
+) -> bool
+{
+  auto did_supersede = false;
+
+  xSemaphoreTake(coalesced_types_mutex, portMAX_DELAY);
+
+  for (auto& coalesced_type : coalesced_types)
+  {
+    if (coalesced_type.type_id == type_id)
+    {
+      if (coalesced_type.is_pending)
+      {
+        // Re-uses the capacity of the record it replaces
+        auto& record = coalesced_type.superseding_record;
+        record.clear();
+        record.insert(record.end(), head.begin(), head.end());
+        for (const auto& piece : pieces)
+        {
+          record.insert(record.end(), piece.begin(), piece.end());
+        }
+        record.insert(record.end(), tail.begin(), tail.end());
+
+        did_supersede = true;
+      }
+
+      coalesced_type.is_pending = true;
+      break;
+    }
+  }
+
+  xSemaphoreGive(coalesced_types_mutex);
+
+  return did_supersede;
+}
+
+auto Mailbox::uncoalesce(
+  const MessageTypeId type_id,
+  std::vector<uint8_t>* superseding_record
+) -> bool
+{
+  auto did_take = false;
+
+  xSemaphoreTake(coalesced_types_mutex, portMAX_DELAY);
+
+  for (auto& coalesced_type : coalesced_types)
+  {
+    if (coalesced_type.type_id == type_id)
+    {
+      coalesced_type.is_pending = false;
+
+      if (superseding_record and not coalesced_type.superseding_record.empty())
+      {
+        // The previous buffer is kept for the next superseding record
+        superseding_record->swap(coalesced_type.superseding_record);
+        coalesced_type.superseding_record.clear();
+        did_take = true;
+      }
+      break;
+    }
+  }
+
+  xSemaphoreGive(coalesced_types_mutex);
+
+  return did_take;
+}
+
+auto Mailbox::requeue_superseding(const MessageTypeId type_id)
+  -> bool
+{
+  std::vector<uint8_t> record;
+
+  while (true)
+  {
+    xSemaphoreTake(coalesced_types_mutex, portMAX_DELAY);
+
+    for (auto& coalesced_type : coalesced_types)
+    {
+      if (coalesced_type.type_id == type_id)
+      {
+        record.swap(coalesced_type.superseding_record);
+        coalesced_type.superseding_record.clear();
+
+        // Nothing is queued for this type (nor will be), so the next
+        // message must not wait to supersede it
+        if (record.empty())
+        {
+          coalesced_type.is_pending = false;
+        }
+        break;
+      }
+    }
+
+    xSemaphoreGive(coalesced_types_mutex);
+
+    if (record.empty())
+    {
+      return false;
+    }
+
+    // Still pending, so any newer record supersedes this one once queued
+    if (send_overflow(BufferView{record.data(), record.size()}))
+    {
+      return true;
+    }
+
+    // Its sender was told it was sent, so it is counted instead
+    dropped_superseding_count++;
+    ESP_LOGE(
+      get_uuid_str(address).c_str(),
+      "Unable to queue superseding message (%zu bytes)",
+      record.size()
+    );
+
+    record.clear();
+  }
+}
+
+auto Mailbox::get_record_type_id(const BufferView message) const
+  -> MessageTypeId
+{
+  if (is_typed_message_record(message))
+  {
+    return reinterpret_cast<const TypedMessageHeader*>(message.data())->type_id;
+  }
+
+  const auto* root = flatbuffers::GetRoot<Message>(message.data());
+  if (root and root->type())
+  {
+    return get_message_type_id(root->type()->string_view());
+  }
+
+  return NullMessageTypeId;
+}
+
+auto Mailbox::add_to_queue_set(const QueueSetHandle_t queue_set)
+  -> bool
+{
+  if (impl and queue_set)
+  {
+    return (xRingbufferAddToQueueSetRead(impl, queue_set) == pdTRUE);
+  }
+
+  return false;
+}
+
+auto Mailbox::remove_from_queue_set(const QueueSetHandle_t queue_set)
+  -> bool
+{
+  if (impl and queue_set)
+  {
+    return (xRingbufferRemoveFromQueueSetRead(impl, queue_set) == pdTRUE);
+  }
+
+  return false;
+}
+
+auto Mailbox::is_queue_set_member(const QueueSetMemberHandle_t member)
+  -> bool
+{
+  if (impl and member)
+  {
+    return (xRingbufferCanRead(impl, member) == pdTRUE);
+  }
+
+  return false;
+}
+
+auto Mailbox::receive_raw()
+  -> BufferView
+{
+  BufferView message;
+
+  if (impl)
+  {
+    // Extract an item from the ringbuffer
+    size_t size = std::numeric_limits<size_t>::max();
+    auto* flatbuf = xRingbufferReceive(impl, &size, receive_timeout_ticks);
+
+    if (flatbuf and size != std::numeric_limits<size_t>::max())
+    {
+      message = BufferView{reinterpret_cast<const uint8_t*>(flatbuf), size};
+    }
+  }
+
+  return message;
+}
+
+auto Mailbox::release(const BufferView message)
+  -> bool
+{
+  // A superseding record stands in for the queued record it replaced
+  if (
+    not coalesced_replaced.empty()
+    and message.data() == coalesced_received.data()
+  )
+  {
+    const auto replaced = coalesced_replaced;
+    coalesced_replaced = {};
+
+    return release(replaced);
+  }
+
+  if (overflow_received and message.data() == overflow_received)
+  {
+    release_overflow(message);
+    if (receive_semaphore)
+    {
+      xSemaphoreGive(receive_semaphore);
+    }
+    return true;
+  }
+
+  if (mpsc_queue)
+  {
+    mpsc_queue->pop(message);
+    return true;
+  }
+
+  if (impl)
+  {
+    xSemaphoreGive(receive_semaphore);
+
+    // Return the memory to the ringbuffer
+    vRingbufferReturnItem(
+      impl,
+      reinterpret_cast<char*>(const_cast<unsigned char*>(message.data()))
+    );
+    return true;
+  }
+
+  return false;
+}
+
+auto Mailbox::send_overflow(const BufferView head, const BufferView tail)
+  -> bool
+{
+  if (
+    overflow_config.growth_policy == MailboxGrowthPolicy::fixed
+    or not overflow_mutex
+  )
+  {
+    return false;
+  }
+
+  const auto record_size = head.size() + tail.size();
+  const auto stride = get_overflow_stride(record_size);
+
+  if (xSemaphoreTake(overflow_mutex, send_timeout_ticks) != pdTRUE)
+  {
+    return false;
+  }
+
+  // Add a segment if the record does not fit in the last one
+  if (
+    overflow_segments.empty()
+    or (
+      overflow_segments.back().capacity - overflow_segments.back().write_offset
+      < stride
+    )
+  )
+  {
+    const auto segment_size = std::max(next_segment_size, stride);
+    if (
+      overflow_allocated_size + segment_size
+      <= overflow_config.max_overflow_size
+    )
+    {
+      auto* data = static_cast<uint8_t*>(
+        heap_caps_malloc(
+          segment_size,
+          overflow_config.spiram? MALLOC_CAP_SPIRAM : MALLOC_CAP_DEFAULT
+        )
+      );
+
+      // Fall back to internal RAM if there is no (free) SPIRAM
+      if (not data and overflow_config.spiram)
+      {
+        data = static_cast<uint8_t*>(
+          heap_caps_malloc(segment_size, MALLOC_CAP_DEFAULT)
+        );
+      }
+
+      if (data)
+      {
+        overflow_segments.push_back(OverflowSegment{data, segment_size});
+        overflow_allocated_size += segment_size;
+
+        if (overflow_config.growth_policy == MailboxGrowthPolicy::doubling)
+        {
+          next_segment_size = std::min(
+            next_segment_size * 2,
+            overflow_config.max_overflow_size
+          );
+        }
+      }
+    }
+  }
+
+  auto did_send = false;
+  if (not overflow_segments.empty())
+  {
+    auto& segment = overflow_segments.back();
+    if (segment.capacity - segment.write_offset >= stride)
+    {
+      auto* record = segment.data + segment.write_offset;
+
+      const auto header = OverflowRecordHeader{
+        static_cast<uint32_t>(record_size),
+        0
+      };
+      memcpy(record, &header, sizeof(header));
+      record += sizeof(header);
+
+      memcpy(record, head.data(), head.size());
+      if (not tail.empty())
+      {
+        memcpy(record + head.size(), tail.data(), tail.size());
+      }
+
+      segment.write_offset += stride;
+      did_send = true;
+
+      if (overflow_count++ == 0)
+      {
+        // Best effort, a full ringbuffer will be drained before blocking
+        TypedMessageHeader doorbell;
+        doorbell.type_id = NullMessageTypeId;
+        memcpy(
+          doorbell.identifier,
+          OverflowDoorbellIdentifier,
+          sizeof(doorbell.identifier)
+        );
+
+        const auto doorbell_bytes = BufferView{
+          reinterpret_cast<const uint8_t*>(&doorbell),
+          sizeof(doorbell)
+        };
+
+        if (mpsc_queue)
+        {
+          mpsc_queue->push(doorbell_bytes);
+        }
+        else {
+          xRingbufferSend(
+            impl,
+            doorbell_bytes.data(),
+            doorbell_bytes.size(),
+            0
+          );
+        }
+      }
+    }
+  }
+
+  xSemaphoreGive(overflow_mutex);
+
+  return did_send;
+}
+
+auto Mailbox::receive_overflow()
+  -> BufferView
+{
+  BufferView message;
+
+  // Acquire first, the front record is only consumed when it is released
+  if (
+    receive_semaphore
+    and xSemaphoreTake(receive_semaphore, receive_lock_timeout_ticks) != pdTRUE
+  )
+  {
+    ESP_LOGW(
+      get_uuid_str(address).c_str(),
+      "Unable to acquire receive semaphore in Mailbox::receive"
+    );
+    return message;
+  }
+
+  xSemaphoreTake(overflow_mutex, portMAX_DELAY);
+
+  if (not overflow_segments.empty())
+  {
+    const auto& segment = overflow_segments.front();
+    if (segment.read_offset < segment.write_offset)
+    {
+      const auto* record = segment.data + segment.read_offset;
+
+      OverflowRecordHeader header;
+      memcpy(&header, record, sizeof(header));
+
+      message = BufferView{record + sizeof(header), header.size};
+      overflow_received = message.data();
+    }
+  }
+
+  xSemaphoreGive(overflow_mutex);
+
+  if (message.empty() and receive_semaphore)
+  {
+    xSemaphoreGive(receive_semaphore);
+  }
+
+  return message;
+}
+
+auto Mailbox::release_overflow(const BufferView message)
+  -> bool
+{
+  xSemaphoreTake(overflow_mutex, portMAX_DELAY);
+
+  auto& segment = overflow_segments.front();
+  segment.read_offset += get_overflow_stride(message.size());
+  overflow_received = nullptr;
+  overflow_count--;
+
+  // Give drained segments back to the heap immediately
+  if (segment.read_offset >= segment.write_offset)
+  {
+    overflow_allocated_size -= segment.capacity;
+    heap_caps_free(segment.data);
+    overflow_segments.pop_front();
+  }
+
+  if (overflow_segments.empty())
+  {
+    next_segment_size = overflow_config.segment_size;
+  }
+
+  xSemaphoreGive(overflow_mutex);
+
+  return true;
+}
+
+auto Mailbox::is_overflow_doorbell(const void* item, const size_t size) const
+  -> bool
+{
+  return (
+    size == sizeof(TypedMessageHeader)
+    and memcmp(
+      static_cast<const TypedMessageHeader*>(item)->identifier,
+      OverflowDoorbellIdentifier,
+      sizeof(TypedMessageHeader::identifier)
+    ) == 0
+  );
+}
+
+auto Mailbox::get_typed_message_envelope(const BufferView record)
+  -> const Message*
+{
+  const auto* header = reinterpret_cast<const TypedMessageHeader*>(
+    record.data()
+  );
+  const auto value = record.subspan(sizeof(TypedMessageHeader));
+
+  auto envelope_iter = typed_message_envelopes.find(header->type_id);
+  if (envelope_iter == typed_message_envelopes.end())
+  {
+    const auto* info = get_message_type_info(header->type_id);
+    if (not info)
+    {
+      ESP_LOGE(
+        get_uuid_str(address).c_str(),
+        "Unregistered message type id %u in Mailbox::receive",
+        header->type_id
+      );
+      return nullptr;
+    }
+
+    // Build the envelope once per type, with a zeroed payload of fixed size
+    flatbuffers::FlatBufferBuilder fbb;
+
+    auto type_str = fbb.CreateString(info->type);
+
+    if (info->payload_alignment)
+    {
+      fbb.ForceVectorAlignment(
+        info->payload_size,
+        sizeof(uint8_t),
+        info->payload_alignment
+      );
+    }
+
+    uint8_t* payload_data = nullptr;
+    auto payload_bytes = fbb.CreateUninitializedVector(
+      info->payload_size,
+      &payload_data
+    );
+    if (info->payload_size)
+    {
+      memset(payload_data, 0, info->payload_size);
+    }
+
+    // Typed records are not timestamped, and have no sender
+    auto message_loc = CreateMessage(
+      fbb,
+      type_str,
+      0, // timestamp
+      nullptr, // from_pid
+      info->payload_alignment,
+      payload_bytes,
+      header->type_id
+    );
+    FinishMessageBuffer(fbb, message_loc);
+
+    envelope_iter = typed_message_envelopes.emplace(
+      header->type_id,
+      fbb.Release()
+    ).first;
+  }
+
+  auto* message = flatbuffers::GetMutableRoot<Message>(
+    envelope_iter->second.data()
+  );
+
+  auto* payload = message->mutable_payload();
+  if (payload->size() != value.size())
+  {
+    ESP_LOGE(
+      get_uuid_str(address).c_str(),
+      "Typed message '%s' size mismatch (%zu != %u)",
+      message->type()->c_str(),
+      value.size(),
+      payload->size()
+    );
+    return nullptr;
+  }
+
+  // Refresh the envelope in-place with the received value
+  if (not value.empty())
+  {
+    memcpy(payload->data(), value.data(), value.size());
+  }
+
+  return message;
 }
 
 } // namespace ActorModel
@@ -10,26 +10,48 @@
 
 #pragma once
 
+#include "actor_clock.h"
+#include "cpu_stats.h"
+#include "memory_placement.h"
+#include "mpsc_queue.h"
 #include "pid.h"
 #include "received_message.h"
+#include "typed_message.h"
 #include "uuid.h"
 
 #include "actor_model_generated.h"
 
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <span>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/ringbuf.h"
 #include "freertos/semphr.h"
 
 namespace ActorModel {
 using MessageType = std::string_view;
 using BufferView = std::span<const uint8_t>;
+using BufferViews = std::span<const BufferView>;
 
+class MessageTraceRecorder;
 class ReceivedMessage;
 
+// Messages which do not fit in the ringbuffer are appended to heap-allocated
+// segments instead (unless the policy is fixed), up to max_overflow_size
+struct MailboxOverflowConfig
+{
+  MailboxGrowthPolicy growth_policy = MailboxGrowthPolicy::fixed;
+  size_t segment_size = 2048;
+  size_t max_overflow_size = 0;
+  bool spiram = false;
+};
+
 class Mailbox
 {
   friend class ReceivedMessage;
@@ -45,11 +67,40 @@ public:
     UUID::UUIDEqualFunc
   >;
 
+  using TypedMessageEnvelopes = std::unordered_map<
+    MessageTypeId,
+    flatbuffers::DetachedBuffer
+  >;
+
+  struct OverflowSegment
+  {
+    uint8_t* data = nullptr;
+    size_t capacity = 0;
+    size_t write_offset = 0;
+    size_t read_offset = 0;
+  };
+
+  using OverflowSegments = std::deque<OverflowSegment>;
+
+  struct CoalescedType
+  {
+    MessageTypeId type_id = NullMessageTypeId;
+    bool is_pending = false;
+
+    // The newest record sent while one was pending, received in its place
+    std::vector<uint8_t> superseding_record;
+  };
+
+  using CoalescedTypes = std::vector<CoalescedType>;
+
   explicit Mailbox(
     const size_t _mailbox_size = 2048,
     const size_t _send_timeout_microseconds = 0,
     const size_t _receive_timeout_microseconds = 0,
-    const size_t _receive_lock_timeout_microseconds = 0
+    const size_t _receive_lock_timeout_microseconds = 0,
+    const MailboxOverflowConfig& _overflow_config = {},
+    const MemoryPlacement _placement = MemoryPlacement::any,
+    const MailboxBackend _backend = MailboxBackend::ringbuffer
   );
   ~Mailbox();
 
@@ -57,7 +108,33 @@ public:
     const MessageType type,
     const BufferView payload,
     const size_t payload_alignment = sizeof(uint64_t),
-    const Pid* from_pid = nullptr
+    const Pid* from_pid = nullptr,
+    const uint64_t deadline = 0
+  ) -> flatbuffers::DetachedBuffer;
+
+  // The payload is the pieces concatenated, gathered in a single copy
+  static auto create_message(
+    const MessageType type,
+    const BufferViews payload_pieces,
+    const size_t payload_alignment = sizeof(uint64_t),
+    const Pid* from_pid = nullptr,
+    const uint64_t deadline = 0
+  ) -> flatbuffers::DetachedBuffer;
+
+  // Without the payload, which is left for the caller to fill in (in place,
+  // or wherever the message is copied to) at payload_data
+  static auto create_message_envelope(
+    const MessageType type,
+    const size_t payload_size,
+    uint8_t*& payload_data,
+    const size_t payload_alignment = sizeof(uint64_t),
+    const Pid* from_pid = nullptr,
+    const uint64_t deadline = 0
+  ) -> flatbuffers::DetachedBuffer;
+
+  static auto create_typed_message(
+    const MessageTypeId type_id,
+    const BufferView value
   ) -> flatbuffers::DetachedBuffer;
 
   auto send(const Message& message)
@@ -67,12 +144,79 @@ public:
     const MessageType type,
     const BufferView payload,
     const size_t payload_alignment = sizeof(uint64_t),
-    const Pid* from_pid = nullptr
+    const Pid* from_pid = nullptr,
+    const uint64_t deadline = 0
+  ) -> bool;
+
+  auto send(
+    const MessageType type,
+    const BufferViews payload_pieces,
+    const size_t payload_alignment = sizeof(uint64_t),
+    const Pid* from_pid = nullptr,
+    const uint64_t deadline = 0
+  ) -> bool;
+
+  // Write a typed record directly into the ringbuffer, without a builder
+  auto send_typed(
+    const MessageTypeId type_id,
+    const BufferView value
   ) -> bool;
 
+  // Send a pre-serialized record, either a Message flatbuffer or typed record
+  auto send_record(const BufferView record)
+    -> bool;
+
+  // Queue a record as it is, without a new envelope (so its timestamp,
+  // sender and deadline are kept) and without coalescing
+  auto enqueue_record(const BufferView record)
+    -> bool;
+
   auto receive(bool verify = false)
     -> ReceivedMessagePtr;
 
+  // Allow one task to wait on several mailboxes (see ProcessHost)
+  auto add_to_queue_set(const QueueSetHandle_t queue_set)
+    -> bool;
+
+  auto remove_from_queue_set(const QueueSetHandle_t queue_set)
+    -> bool;
+
+  auto is_queue_set_member(const QueueSetMemberHandle_t member)
+    -> bool;
+
+  // Record each received message for pid, until set to nullptr
+  auto set_recorder(MessageTraceRecorder* _recorder, const Pid& _recorded_pid)
+    -> void;
+
+  // While a message of a coalesced type is queued and not yet received,
+  // another of the same type replaces it instead of being queued behind it.
+  // The queued record is left in place (and so keeps its position), but the
+  // newest one is received instead, from a copy held by the mailbox.
+  // Each replaced message is counted
+  auto set_coalesced(const MessageType type, const bool coalesced = true)
+    -> void;
+
+  // Deadlines are checked against clock (the monotonic clock if nullptr),
+  // which must outlive the mailbox
+  auto set_clock(const ActorClock* _clock)
+    -> void;
+
+  // Messages dropped at receive because their deadline had passed
+  auto get_expired_count() const
+    -> size_t;
+
+  auto get_coalesced_count() const
+    -> size_t;
+
+  // Messages which superseded a pending one, but could not be queued when
+  // the one they superseded failed to be
+  auto get_dropped_superseding_count() const
+    -> size_t;
+
+  // Measured by the behaviour loop which receives from this mailbox
+  auto get_cpu_stats()
+    -> CpuStats&;
+
   const Address address;
 
 private:
@@ -82,16 +226,110 @@ private:
   size_t receive_lock_timeout_ticks;
   RingbufHandle_t impl;
   SemaphoreHandle_t receive_semaphore = nullptr;
+
+  // Only set when the ringbuffer storage has a placement other than any
+  StaticRingbuffer_t* static_ringbuffer = nullptr;
+  uint8_t* ringbuffer_storage = nullptr;
   portMUX_TYPE receive_multicore_mutex;
 
+  // Used instead of the ringbuffer (and receive semaphore) when the backend
+  // is mpsc. A mailbox then has a single receiving task, and can not be
+  // added to a queue set
+  std::unique_ptr<MpscQueue> mpsc_queue;
+
+  // Re-usable Message flatbuffers which typed records are unpacked into
+  TypedMessageEnvelopes typed_message_envelopes;
+
+  // Spill-over storage, used while the ringbuffer is full
+  MailboxOverflowConfig overflow_config;
+  OverflowSegments overflow_segments;
+  SemaphoreHandle_t overflow_mutex = nullptr;
+  std::atomic<size_t> overflow_count{0};
+  size_t overflow_allocated_size = 0;
+  size_t next_segment_size = 0;
+  const uint8_t* overflow_received = nullptr;
+
+  std::atomic<MessageTraceRecorder*> recorder{nullptr};
+  Pid recorded_pid = NullPid;
+
+  CoalescedTypes coalesced_types;
+  SemaphoreHandle_t coalesced_types_mutex = nullptr;
+  std::atomic<bool> has_coalesced_types{false};
+
+  // The superseding record being received, and the queued record it
+  // replaced, which is released along with it
+  std::vector<uint8_t> coalesced_received;
+  BufferView coalesced_replaced;
+
+  std::atomic<const ActorClock*> clock{nullptr};
+  std::atomic<size_t> expired_count{0};
+  std::atomic<size_t> coalesced_count{0};
+  std::atomic<size_t> dropped_superseding_count{0};
+
+  CpuStats cpu_stats;
+
 protected:
   auto release(const BufferView message)
     -> bool;
 
+  auto get_typed_message_envelope(const BufferView record)
+    -> const Message*;
+
 private:
   auto receive_raw()
     -> BufferView;
 
+  // Acquires the receive semaphore, which is given back on release
+  auto receive_next()
+    -> BufferView;
+
+  auto receive_next_mpsc()
+    -> BufferView;
+
+  auto is_expired(const BufferView message) const
+    -> bool;
+
+  // True if a message of this (coalesced) type is already pending, which
+  // the record (head, pieces and tail) then supersedes. Otherwise marks it
+  // pending, for the record to be queued
+  auto supersede(
+    const MessageTypeId type_id,
+    const BufferView head,
+    const BufferViews pieces,
+    const BufferView tail = {}
+  ) -> bool;
+
+  // Marks a message of this type no longer pending, and takes the record
+  // which superseded it, if any
+  auto uncoalesce(
+    const MessageTypeId type_id,
+    std::vector<uint8_t>* superseding_record = nullptr
+  ) -> bool;
+
+  // After the pending message of this type failed to be queued, queue the
+  // newest record which superseded it (if any) in its place. Otherwise the
+  // type is no longer pending. True if a superseding record was queued
+  auto requeue_superseding(const MessageTypeId type_id)
+    -> bool;
+
+  auto get_record_type_id(const BufferView message) const
+    -> MessageTypeId;
+
+  auto make_received_message(const BufferView message, const bool verify)
+    -> ReceivedMessagePtr;
+
+  auto send_overflow(const BufferView head, const BufferView tail = {})
+    -> bool;
+
+  auto receive_overflow()
+    -> BufferView;
+
+  auto release_overflow(const BufferView message)
+    -> bool;
+
+  auto is_overflow_doorbell(const void* item, const size_t size) const
+    -> bool;
+
 //static methods:
   static auto send(const Address& address, const Message& message)
     -> bool;
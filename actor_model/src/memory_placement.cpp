@@ -0,0 +1,98 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "memory_placement.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "memory_placement";
+
+auto get_heap_caps(const MemoryPlacement placement)
+  -> uint32_t
+{
+  switch (placement)
+  {
+    case MemoryPlacement::internal:
+      return (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    case MemoryPlacement::spiram:
+      return (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    case MemoryPlacement::any:
+    default:
+      return MALLOC_CAP_DEFAULT;
+  }
+}
+
+auto placement_malloc(const size_t size, const MemoryPlacement placement)
+  -> void*
+{
+  auto* ptr = heap_caps_malloc(size, get_heap_caps(placement));
+
+  // Internal RAM is required (e.g. for DMA or task control blocks), not
+  // preferred, so it is never substituted
+  if (not ptr and placement == MemoryPlacement::spiram)
+  {
+    ESP_LOGD(
+      TAG,
+      "Unable to allocate %zu bytes in %s, using default heap",
+      size,
+      EnumNameMemoryPlacement(placement)
+    );
+    ptr = heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+  }
+
+  return ptr;
+}
+
+auto placement_free(void* ptr)
+  -> void
+{
+  heap_caps_free(ptr);
+}
+
+PlacementAllocator::PlacementAllocator(const MemoryPlacement _placement)
+: placement(_placement)
+{
+}
+
+auto PlacementAllocator::allocate(size_t size)
+  -> uint8_t*
+{
+  return static_cast<uint8_t*>(placement_malloc(size, placement));
+}
+
+auto PlacementAllocator::deallocate(uint8_t* p, size_t size)
+  -> void
+{
+  placement_free(p);
+}
+
+auto get_placement_allocator(const MemoryPlacement placement)
+  -> PlacementAllocator&
+{
+  static PlacementAllocator any_allocator{MemoryPlacement::any};
+  static PlacementAllocator internal_allocator{MemoryPlacement::internal};
+  static PlacementAllocator spiram_allocator{MemoryPlacement::spiram};
+
+  switch (placement)
+  {
+    case MemoryPlacement::internal:
+      return internal_allocator;
+    case MemoryPlacement::spiram:
+      return spiram_allocator;
+    case MemoryPlacement::any:
+    default:
+      return any_allocator;
+  }
+}
+
+} // namespace ActorModel
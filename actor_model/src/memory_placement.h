@@ -0,0 +1,96 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "actor_model_generated.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ActorModel {
+
+auto get_heap_caps(const MemoryPlacement placement)
+  -> uint32_t;
+
+// Allocate in the requested region. Falls back to the default heap for
+// spiram, but nullptr if internal RAM can not be allocated
+auto placement_malloc(const size_t size, const MemoryPlacement placement)
+  -> void*;
+
+auto placement_free(void* ptr)
+  -> void;
+
+// For flatbuffers::FlatBufferBuilder, e.g. fbb(1024, &get_placement_allocator(...))
+class PlacementAllocator
+: public flatbuffers::Allocator
+{
+public:
+  explicit PlacementAllocator(const MemoryPlacement _placement);
+
+  auto allocate(size_t size)
+    -> uint8_t* override;
+
+  auto deallocate(uint8_t* p, size_t size)
+    -> void override;
+
+  const MemoryPlacement placement;
+};
+
+// Static instances, which outlive any DetachedBuffer referring to them
+auto get_placement_allocator(const MemoryPlacement placement)
+  -> PlacementAllocator&;
+
+// For std containers, e.g. std::basic_string<char, traits, PlacementStdAllocator<...>>
+template<typename T, MemoryPlacement Placement>
+struct PlacementStdAllocator
+{
+  using value_type = T;
+
+  template<typename U>
+  struct rebind
+  {
+    using other = PlacementStdAllocator<U, Placement>;
+  };
+
+  PlacementStdAllocator() = default;
+
+  template<typename U>
+  PlacementStdAllocator(const PlacementStdAllocator<U, Placement>&)
+  {}
+
+  auto allocate(const size_t n)
+    -> T*
+  {
+    return static_cast<T*>(placement_malloc(n * sizeof(T), Placement));
+  }
+
+  auto deallocate(T* p, const size_t n)
+    -> void
+  {
+    placement_free(p);
+  }
+
+  template<typename U>
+  auto operator==(const PlacementStdAllocator<U, Placement>&) const
+    -> bool
+  {
+    return true;
+  }
+
+  template<typename U>
+  auto operator!=(const PlacementStdAllocator<U, Placement>&) const
+    -> bool
+  {
+    return false;
+  }
+};
+
+} // namespace ActorModel
@@ -0,0 +1,511 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "message_trace.h"
+
+#include "mailbox.h"
+#include "received_message.h"
+
+#include "timestamp.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "message_trace";
+
+constexpr size_t MessageTraceAlignment = sizeof(uint64_t);
+
+using std::chrono::microseconds;
+using utils::get_elapsed_microseconds;
+
+void message_trace_task(void* user_data = nullptr);
+
+auto get_trace_padding(const size_t size)
+  -> size_t;
+
+auto get_trace_padding(const size_t size)
+  -> size_t
+{
+  return (MessageTraceAlignment - (size % MessageTraceAlignment))
+    % MessageTraceAlignment;
+}
+
+MessageTraceRecorder::MessageTraceRecorder(
+  const std::string_view path,
+  const size_t _buffer_size,
+  const size_t task_stack_size,
+  const int task_prio
+)
+: file(fopen(std::string{path}.c_str(), "wb"))
+, file_mutex(xSemaphoreCreateMutex())
+, buffer_mutex(xSemaphoreCreateMutex())
+, buffer_size(_buffer_size)
+, start_time(get_elapsed_microseconds())
+{
+  if (not file)
+  {
+    ESP_LOGE(
+      TAG,
+      "Unable to open '%.*s' for recording",
+      static_cast<int>(path.size()),
+      path.data()
+    );
+    return;
+  }
+
+  MessageTraceFileHeader file_header;
+  memcpy(file_header.identifier, MessageTraceIdentifier, sizeof(file_header.identifier));
+  file_header.version = MessageTraceVersion;
+  file_header.start_time_microseconds = start_time.count();
+
+  if (fwrite(&file_header, sizeof(file_header), 1, file) != 1)
+  {
+    ESP_LOGE(TAG, "Unable to write trace header");
+    fclose(file);
+    file = nullptr;
+    return;
+  }
+
+  pending_buffer.reserve(buffer_size);
+  write_buffer.reserve(buffer_size);
+
+  auto* task_user_data = this;
+
+  auto retval = xTaskCreate(
+    &message_trace_task,
+    "message_trace",
+    task_stack_size,
+    task_user_data,
+    task_prio,
+    &impl
+  );
+
+  if (retval != pdPASS)
+  {
+    ESP_LOGE(TAG, "Unable to start message trace task");
+    impl = nullptr;
+  }
+}
+
+MessageTraceRecorder::~MessageTraceRecorder()
+{
+  if (impl)
+  {
+    // Not while the task is writing
+    xSemaphoreTake(file_mutex, portMAX_DELAY);
+    vTaskDelete(impl);
+    impl = nullptr;
+    xSemaphoreGive(file_mutex);
+  }
+
+  if (file)
+  {
+    if (file_mutex and buffer_mutex)
+    {
+      write_pending();
+    }
+
+    fclose(file);
+  }
+
+  if (file_mutex)
+  {
+    vSemaphoreDelete(file_mutex);
+  }
+
+  if (buffer_mutex)
+  {
+    vSemaphoreDelete(buffer_mutex);
+  }
+}
+
+auto MessageTraceRecorder::is_open() const
+  -> bool
+{
+  return (
+    file != nullptr
+    and file_mutex != nullptr
+    and buffer_mutex != nullptr
+    and impl != nullptr
+  );
+}
+
+auto MessageTraceRecorder::record(const Pid& pid, const BufferView record)
+  -> bool
+{
+  if (not is_open())
+  {
+    return false;
+  }
+
+  MessageTraceEntryHeader entry_header;
+  entry_header.timestamp_microseconds = (
+    get_elapsed_microseconds() - start_time
+  ).count();
+  entry_header.pid_ab = pid.ab();
+  entry_header.pid_cd = pid.cd();
+  entry_header.record_size = record.size();
+  entry_header.reserved = 0;
+
+  constexpr uint8_t padding[MessageTraceAlignment] = {0};
+  const auto padding_size = get_trace_padding(record.size());
+
+  const auto* entry_header_bytes = reinterpret_cast<const uint8_t*>(
+    &entry_header
+  );
+  const auto entry_size = sizeof(entry_header) + record.size() + padding_size;
+
+  xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+
+  auto did_record = (pending_buffer.size() + entry_size <= buffer_size);
+  if (did_record)
+  {
+    pending_buffer.insert(
+      pending_buffer.end(),
+      entry_header_bytes,
+      entry_header_bytes + sizeof(entry_header)
+    );
+    pending_buffer.insert(pending_buffer.end(), record.begin(), record.end());
+    pending_buffer.insert(
+      pending_buffer.end(),
+      padding,
+      padding + padding_size
+    );
+
+    recorded_count++;
+  }
+  else {
+    dropped_count++;
+  }
+
+  xSemaphoreGive(buffer_mutex);
+
+  if (did_record)
+  {
+    xTaskNotifyGive(impl);
+  }
+  else {
+    ESP_LOGD(
+      TAG,
+      "Trace buffer full, dropped message (%zu bytes)",
+      record.size()
+    );
+  }
+
+  return did_record;
+}
+
+auto MessageTraceRecorder::write_pending()
+  -> bool
+{
+  xSemaphoreTake(file_mutex, portMAX_DELAY);
+
+  xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+  std::swap(pending_buffer, write_buffer);
+  xSemaphoreGive(buffer_mutex);
+
+  auto did_write = (
+    fwrite(write_buffer.data(), 1, write_buffer.size(), file)
+      == write_buffer.size()
+  );
+
+  if (not did_write)
+  {
+    ESP_LOGE(TAG, "Unable to write trace (%zu bytes)", write_buffer.size());
+  }
+
+  write_buffer.clear();
+
+  xSemaphoreGive(file_mutex);
+
+  return did_write;
+}
+
+auto MessageTraceRecorder::flush()
+  -> bool
+{
+  if (not is_open())
+  {
+    return false;
+  }
+
+  auto did_write = write_pending();
+
+  xSemaphoreTake(file_mutex, portMAX_DELAY);
+  auto ret = fflush(file);
+  xSemaphoreGive(file_mutex);
+
+  return (did_write and ret == 0);
+}
+
+auto MessageTraceRecorder::get_recorded_count() const
+  -> size_t
+{
+  return recorded_count;
+}
+
+auto MessageTraceRecorder::get_dropped_count() const
+  -> size_t
+{
+  return dropped_count;
+}
+
+MessageTraceReader::MessageTraceReader(const std::string_view path)
+: file(fopen(std::string{path}.c_str(), "rb"))
+{
+  if (not file)
+  {
+    ESP_LOGE(
+      TAG,
+      "Unable to open trace '%.*s'",
+      static_cast<int>(path.size()),
+      path.data()
+    );
+    return;
+  }
+
+  const auto end_position = (
+    (fseek(file, 0, SEEK_END) == 0)? ftell(file) : -1
+  );
+  if (end_position >= 0)
+  {
+    file_size = end_position;
+  }
+  rewind(file);
+
+  MessageTraceFileHeader file_header;
+  if (
+    fread(&file_header, sizeof(file_header), 1, file) != 1
+    or memcmp(
+      file_header.identifier,
+      MessageTraceIdentifier,
+      sizeof(file_header.identifier)
+    ) != 0
+    or file_header.version != MessageTraceVersion
+  )
+  {
+    ESP_LOGE(TAG, "Invalid trace header");
+    fclose(file);
+    file = nullptr;
+    return;
+  }
+
+  start_time = microseconds{file_header.start_time_microseconds};
+}
+
+MessageTraceReader::~MessageTraceReader()
+{
+  if (file)
+  {
+    fclose(file);
+  }
+}
+
+auto MessageTraceReader::is_open() const
+  -> bool
+{
+  return (file != nullptr);
+}
+
+auto MessageTraceReader::next()
+  -> std::optional<MessageTraceEntry>
+{
+  if (not file)
+  {
+    return std::nullopt;
+  }
+
+  MessageTraceEntryHeader entry_header;
+  if (fread(&entry_header, sizeof(entry_header), 1, file) != 1)
+  {
+    // End of trace
+    return std::nullopt;
+  }
+
+  // Never allocate more than the rest of the file could hold
+  const auto padding_size = get_trace_padding(entry_header.record_size);
+  const auto position = ftell(file);
+  const size_t remaining_size = (
+    (position >= 0 and static_cast<size_t>(position) <= file_size)?
+      (file_size - static_cast<size_t>(position)) : 0
+  );
+
+  if (
+    static_cast<uint64_t>(entry_header.record_size) + padding_size
+      > remaining_size
+  )
+  {
+    ESP_LOGE(
+      TAG,
+      "Truncated trace entry (%u bytes, %zu remaining)",
+      static_cast<unsigned>(entry_header.record_size),
+      remaining_size
+    );
+    return std::nullopt;
+  }
+
+  MessageTraceEntry entry{
+    microseconds{entry_header.timestamp_microseconds},
+    Pid{entry_header.pid_ab, entry_header.pid_cd},
+    std::vector<uint8_t>(entry_header.record_size)
+  };
+
+  if (
+    fread(entry.record.data(), 1, entry.record.size(), file)
+      != entry.record.size()
+    or fseek(file, padding_size, SEEK_CUR) != 0
+  )
+  {
+    ESP_LOGE(TAG, "Truncated trace entry");
+    return std::nullopt;
+  }
+
+  return entry;
+}
+
+auto MessageTraceReader::get_start_time() const
+  -> microseconds
+{
+  return start_time;
+}
+
+MessageTraceReplayer::MessageTraceReplayer(
+  const std::string_view _path,
+  const size_t _mailbox_size
+)
+: path(_path)
+, mailbox_size(_mailbox_size)
+{
+}
+
+auto MessageTraceReplayer::replay(
+  const ActorBehaviour& actor_behaviour,
+  const MaybePid& pid
+) -> MessageTraceReplayResult
+{
+  MessageTraceReplayResult result;
+
+  MessageTraceReader reader(path);
+  if (not reader.is_open())
+  {
+    return result;
+  }
+
+  // Deliver through a mailbox, as the recorded process received them
+  Mailbox mailbox(mailbox_size);
+  mailbox.set_clock(&clock);
+  StatePtr state;
+
+  auto start_time = std::optional<microseconds>{};
+
+  while (auto entry = reader.next())
+  {
+    if (pid and not compare_uuids(*(pid), entry->pid))
+    {
+      continue;
+    }
+
+    // Advance the virtual clock to when the message was delivered
+    const auto delivered_time = reader.get_start_time() + entry->timestamp;
+    if (not start_time)
+    {
+      start_time = delivered_time;
+    }
+    clock.set_virtual_time(delivered_time);
+
+    if (not mailbox.enqueue_record(BufferView{entry->record}))
+    {
+      result.error_count++;
+      continue;
+    }
+
+    const auto expired_count = mailbox.get_expired_count();
+    const auto& received_message = mailbox.receive();
+    const auto* message = (
+      received_message? received_message->message() : nullptr
+    );
+
+    if (not message)
+    {
+      if (mailbox.get_expired_count() > expired_count)
+      {
+        result.expired_count++;
+      }
+      else {
+        result.error_count++;
+      }
+      continue;
+    }
+
+    const auto behaviour_start = get_elapsed_microseconds();
+    const auto& behaviour_result = actor_behaviour(entry->pid, state, *(message));
+    const auto message_duration = get_elapsed_microseconds() - behaviour_start;
+
+    result.replayed_count++;
+    result.behaviour_duration += message_duration;
+    result.max_message_duration = std::max(
+      result.max_message_duration,
+      message_duration
+    );
+
+    if (behaviour_result.type == Result::Unhandled)
+    {
+      result.unhandled_count++;
+    }
+    else if (behaviour_result.type == Result::Error)
+    {
+      // The process would have exited here
+      result.error_count++;
+      break;
+    }
+  }
+
+  if (start_time)
+  {
+    result.virtual_duration = clock.now() - *(start_time);
+  }
+
+  return result;
+}
+
+auto MessageTraceReplayer::get_clock()
+  -> const ActorClock&
+{
+  return clock;
+}
+
+auto MessageTraceReplayer::get_virtual_time() const
+  -> microseconds
+{
+  return clock.now();
+}
+
+auto message_trace_task(void* user_data)
+  -> void
+{
+  auto* recorder = static_cast<MessageTraceRecorder*>(user_data);
+
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (recorder != nullptr)
+    {
+      recorder->write_pending();
+    }
+  }
+}
+
+} // namespace ActorModel
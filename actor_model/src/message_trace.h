@@ -0,0 +1,195 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "actor_clock.h"
+#include "behaviour.h"
+#include "pid.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+namespace ActorModel {
+
+using BufferView = std::span<const uint8_t>;
+
+constexpr char MessageTraceIdentifier[4] = {'T', 'r', 'c', '!'};
+constexpr uint32_t MessageTraceVersion = 2;
+
+// A trace file is a MessageTraceFileHeader, followed by entries of a
+// MessageTraceEntryHeader and the record bytes, padded to 8 bytes.
+// Records are as delivered from the mailbox, i.e. a Message flatbuffer
+// or a typed message record
+struct MessageTraceFileHeader
+{
+  char identifier[4];
+  uint32_t version;
+  // Microseconds since boot when the recorder was created, so entry times
+  // are on the same clock as recorded message deadlines
+  uint64_t start_time_microseconds;
+};
+
+static_assert(sizeof(MessageTraceFileHeader) == 16);
+
+struct MessageTraceEntryHeader
+{
+  // Since the recorder was created
+  uint64_t timestamp_microseconds;
+  uint64_t pid_ab;
+  uint64_t pid_cd;
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(MessageTraceEntryHeader) == 32);
+
+struct MessageTraceEntry
+{
+  std::chrono::microseconds timestamp;
+  Pid pid;
+  std::vector<uint8_t> record;
+};
+
+// Appends the messages received by traced processes (see Node::trace) to
+// a file. One recorder may be shared by several processes.
+// Entries are copied to a buffer of up to buffer_size bytes on the
+// receiving process, and written to the file by the recorder's own task.
+// Entries that do not fit while the task catches up are dropped
+class MessageTraceRecorder
+{
+public:
+  explicit MessageTraceRecorder(
+    const std::string_view path,
+    const size_t _buffer_size = 8192,
+    const size_t task_stack_size = 3072,
+    const int task_prio = 1
+  );
+  ~MessageTraceRecorder();
+
+  auto is_open() const
+    -> bool;
+
+  auto record(const Pid& pid, const BufferView record)
+    -> bool;
+
+  // Write the buffered entries, then flush the file
+  auto flush()
+    -> bool;
+
+  auto get_recorded_count() const
+    -> size_t;
+
+  auto get_dropped_count() const
+    -> size_t;
+
+  // Called on the recorder task
+  auto write_pending()
+    -> bool;
+
+private:
+  FILE* file = nullptr;
+  SemaphoreHandle_t file_mutex = nullptr;
+  SemaphoreHandle_t buffer_mutex = nullptr;
+  TaskHandle_t impl = nullptr;
+
+  // Entries are appended to pending_buffer, which is swapped with the
+  // (empty) write_buffer to write it without holding buffer_mutex
+  size_t buffer_size;
+  std::vector<uint8_t> pending_buffer;
+  std::vector<uint8_t> write_buffer;
+
+  std::chrono::microseconds start_time;
+  size_t recorded_count = 0;
+  size_t dropped_count = 0;
+};
+
+class MessageTraceReader
+{
+public:
+  explicit MessageTraceReader(const std::string_view path);
+  ~MessageTraceReader();
+
+  auto is_open() const
+    -> bool;
+
+  auto next()
+    -> std::optional<MessageTraceEntry>;
+
+  // Since boot, on the recording node
+  auto get_start_time() const
+    -> std::chrono::microseconds;
+
+private:
+  FILE* file = nullptr;
+  size_t file_size = 0;
+  std::chrono::microseconds start_time{0};
+};
+
+struct MessageTraceReplayResult
+{
+  size_t replayed_count = 0;
+  size_t unhandled_count = 0;
+  size_t error_count = 0;
+  // Dropped unseen, their deadline had passed at the recorded time
+  size_t expired_count = 0;
+
+  // Trace time covered, and time spent in the behaviour
+  std::chrono::microseconds virtual_duration{0};
+  std::chrono::microseconds behaviour_duration{0};
+  std::chrono::microseconds max_message_duration{0};
+};
+
+// Feeds a recorded trace through a behaviour, in order and without delay.
+// Records are queued as they were received, so they keep their recorded
+// timestamp, sender and deadline.
+// Before each message, the replayer's clock is set to when it was received
+// (on the recording node's clock), and deadlines are checked against it.
+// A behaviour created with get_clock() sees the same time, so a replay
+// runs as fast as the behaviour allows and is repeatable
+class MessageTraceReplayer
+{
+public:
+  explicit MessageTraceReplayer(
+    const std::string_view _path,
+    const size_t _mailbox_size = 16384
+  );
+
+  // Only replay messages recorded for pid, if set.
+  // The behaviour sees the recorded pid as self
+  auto replay(
+    const ActorBehaviour& actor_behaviour,
+    const MaybePid& pid = std::nullopt
+  ) -> MessageTraceReplayResult;
+
+  // To hand to the replayed behaviour
+  auto get_clock()
+    -> const ActorClock&;
+
+  auto get_virtual_time() const
+    -> std::chrono::microseconds;
+
+private:
+  std::string path;
+  size_t mailbox_size;
+
+  ActorClock clock;
+};
+
+} // namespace ActorModel
@@ -0,0 +1,300 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "mpsc_queue.h"
+
+#include <cinttypes>
+#include <cstring>
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "mpsc_queue";
+
+// Storage is zeroed until a record is committed, and zeroed again when it
+// is popped, so a header which has been reserved but not yet written reads
+// as empty
+enum MpscRecordState : uint32_t
+{
+  MpscRecordEmpty = 0,
+  MpscRecordCommitted = 1,
+  // Unused space at the end of the storage, the record follows at the start
+  MpscRecordPadding = 2,
+};
+
+struct MpscRecordHeader
+{
+  uint32_t state;
+  uint32_t size;
+};
+
+static_assert(sizeof(MpscRecordHeader) == 8, "Unexpected record header size");
+
+constexpr auto get_mpsc_stride(const size_t record_size)
+  -> uint32_t
+{
+  // Keep records 8-byte aligned, for flatbuffers with 64-bit fields
+  constexpr auto alignment = alignof(uint64_t);
+  return (
+    (sizeof(MpscRecordHeader) + record_size + alignment - 1)
+    & ~(alignment - 1)
+  );
+}
+
+constexpr auto get_mpsc_capacity(const size_t size)
+  -> uint32_t
+{
+  uint32_t capacity = sizeof(MpscRecordHeader);
+  while (capacity < size)
+  {
+    capacity <<= 1;
+  }
+
+  return capacity;
+}
+
+auto load_record_state(MpscRecordHeader* header)
+  -> uint32_t;
+
+auto store_record_state(MpscRecordHeader* header, const uint32_t state)
+  -> void;
+
+auto load_record_state(MpscRecordHeader* header)
+  -> uint32_t
+{
+  return std::atomic_ref<uint32_t>(header->state).load();
+}
+
+auto store_record_state(MpscRecordHeader* header, const uint32_t state)
+  -> void
+{
+  std::atomic_ref<uint32_t>(header->state).store(state);
+}
+
+MpscQueue::MpscQueue(
+  const size_t _capacity,
+  const MemoryPlacement placement
+)
+: capacity(get_mpsc_capacity(_capacity))
+{
+  storage = static_cast<uint8_t*>(placement_malloc(capacity, placement));
+  if (not storage)
+  {
+    ESP_LOGE(TAG, "Unable to allocate %" PRIu32 " bytes", capacity);
+    return;
+  }
+
+  memset(storage, 0, capacity);
+}
+
+MpscQueue::~MpscQueue()
+{
+  placement_free(storage);
+}
+
+auto MpscQueue::is_valid() const
+  -> bool
+{
+  return (storage != nullptr);
+}
+
+auto MpscQueue::reserve(const size_t size)
+  -> uint8_t*
+{
+  const auto stride = get_mpsc_stride(size);
+  if (not storage or stride > capacity)
+  {
+    return nullptr;
+  }
+
+  auto write = write_index.load(std::memory_order_relaxed);
+  uint32_t padding = 0;
+
+  while (true)
+  {
+    const auto read = read_index.load(std::memory_order_acquire);
+    const auto offset = write & (capacity - 1);
+
+    // Records are contiguous, skip to the start if it would wrap
+    padding = (offset + stride > capacity)? (capacity - offset) : 0;
+
+    if ((write - read) + padding + stride > capacity)
+    {
+      return nullptr;
+    }
+
+    if (
+      write_index.compare_exchange_weak(
+        write,
+        write + padding + stride,
+        std::memory_order_acq_rel,
+        std::memory_order_relaxed
+      )
+    )
+    {
+      break;
+    }
+  }
+
+  if (padding)
+  {
+    auto* padding_header = reinterpret_cast<MpscRecordHeader*>(
+      storage + (write & (capacity - 1))
+    );
+    padding_header->size = padding;
+    store_record_state(padding_header, MpscRecordPadding);
+
+    write += padding;
+  }
+
+  auto* header = reinterpret_cast<MpscRecordHeader*>(
+    storage + (write & (capacity - 1))
+  );
+  header->size = size;
+
+  return reinterpret_cast<uint8_t*>(header) + sizeof(MpscRecordHeader);
+}
+
+auto MpscQueue::commit(uint8_t* record)
+  -> void
+{
+  auto* header = reinterpret_cast<MpscRecordHeader*>(
+    record - sizeof(MpscRecordHeader)
+  );
+  store_record_state(header, MpscRecordCommitted);
+
+  // Only one producer wakes the consumer
+  if (receiver_waiting.exchange(false))
+  {
+    auto* task = receiver_task.load();
+    if (task)
+    {
+      xTaskNotifyGive(task);
+    }
+  }
+}
+
+auto MpscQueue::push(const BufferView head, const BufferView tail)
+  -> bool
+{
+  auto* record = reserve(head.size() + tail.size());
+  if (not record)
+  {
+    return false;
+  }
+
+  memcpy(record, head.data(), head.size());
+  if (not tail.empty())
+  {
+    memcpy(record + head.size(), tail.data(), tail.size());
+  }
+
+  commit(record);
+  return true;
+}
+
+auto MpscQueue::receive(const TickType_t timeout_ticks)
+  -> BufferView
+{
+  auto record = peek();
+  if (not record.empty() or timeout_ticks == 0)
+  {
+    return record;
+  }
+
+  receiver_task = xTaskGetCurrentTaskHandle();
+
+  // A stale notification wakes the loop without a record, so each wait is
+  // only for the ticks remaining of timeout_ticks
+  TimeOut_t timeout_state;
+  vTaskSetTimeOutState(&timeout_state);
+  auto remaining_ticks = timeout_ticks;
+
+  while (true)
+  {
+    // Check again after announcing the wait, so a commit is never missed
+    receiver_waiting = true;
+
+    record = peek();
+    if (not record.empty())
+    {
+      receiver_waiting = false;
+      return record;
+    }
+
+    if (
+      xTaskCheckForTimeOut(&timeout_state, &remaining_ticks) == pdTRUE
+      or ulTaskNotifyTake(pdTRUE, remaining_ticks) == 0
+    )
+    {
+      receiver_waiting = false;
+      return peek();
+    }
+  }
+}
+
+auto MpscQueue::peek()
+  -> BufferView
+{
+  if (not storage)
+  {
+    return {};
+  }
+
+  while (true)
+  {
+    const auto read = read_index.load(std::memory_order_relaxed);
+    if (read == write_index.load(std::memory_order_acquire))
+    {
+      return {};
+    }
+
+    auto* header = reinterpret_cast<MpscRecordHeader*>(
+      storage + (read & (capacity - 1))
+    );
+
+    const auto state = load_record_state(header);
+    if (state == MpscRecordCommitted)
+    {
+      return BufferView{
+        reinterpret_cast<const uint8_t*>(header) + sizeof(MpscRecordHeader),
+        header->size
+      };
+    }
+    else if (state == MpscRecordPadding)
+    {
+      const auto padding = header->size;
+      memset(header, 0, padding);
+      read_index.store(read + padding, std::memory_order_release);
+      continue;
+    }
+
+    // Reserved, but the producer has not committed it yet
+    return {};
+  }
+}
+
+auto MpscQueue::pop(const BufferView record)
+  -> void
+{
+  auto* header = const_cast<uint8_t*>(record.data()) - sizeof(MpscRecordHeader);
+  const auto stride = get_mpsc_stride(record.size());
+
+  // Zeroed before it can be reserved again
+  memset(header, 0, stride);
+
+  read_index.store(
+    read_index.load(std::memory_order_relaxed) + stride,
+    std::memory_order_release
+  );
+}
+
+} // namespace ActorModel
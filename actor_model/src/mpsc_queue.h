@@ -0,0 +1,85 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "memory_placement.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace ActorModel {
+
+using BufferView = std::span<const uint8_t>;
+
+// Bounded queue of variable-size records, for many producer tasks and a
+// single consumer task. Producers claim space with a compare-and-swap on
+// the write index, and publish a record by setting its header state, so
+// neither side takes a lock. The consumer sleeps on a task notification,
+// which a producer only sends if the consumer is waiting.
+//
+// Records stay in place until popped, and must be popped in order
+class MpscQueue
+{
+public:
+  explicit MpscQueue(
+    const size_t _capacity,
+    const MemoryPlacement placement = MemoryPlacement::any
+  );
+  ~MpscQueue();
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  auto is_valid() const
+    -> bool;
+
+  // Producers: reserve space for a record, fill it, then commit it.
+  // Returns nullptr (without waiting) if the record does not fit
+  auto reserve(const size_t size)
+    -> uint8_t*;
+
+  auto commit(uint8_t* record)
+    -> void;
+
+  auto push(const BufferView head, const BufferView tail = {})
+    -> bool;
+
+  // Consumer: the oldest committed record, waiting up to timeout_ticks
+  auto receive(const TickType_t timeout_ticks)
+    -> BufferView;
+
+  auto peek()
+    -> BufferView;
+
+  // Frees the record returned by receive/peek
+  auto pop(const BufferView record)
+    -> void;
+
+private:
+  uint8_t* storage = nullptr;
+
+  // Power of two, so the indices can wrap around at 2^32
+  uint32_t capacity = 0;
+
+  // Bytes ever reserved by producers, and released by the consumer
+  std::atomic<uint32_t> write_index{0};
+  std::atomic<uint32_t> read_index{0};
+
+  std::atomic<TaskHandle_t> receiver_task{nullptr};
+  std::atomic<bool> receiver_waiting{false};
+};
+
+} // namespace ActorModel
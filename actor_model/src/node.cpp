@@ -12,43 +12,145 @@
 
 #include "actor.h"
 #include "delay.h"
+#include "distribution.h"
+#include "memory_placement.h"
+#include "process_host.h"
+#include "socket_reactor.h"
+#include "timestamp.h"
 #include "uuid.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "esp_log.h"
+#include "esp_system.h"
 
 namespace ActorModel {
 
 using namespace std::chrono_literals;
 using utils::timeout;
 
-using UUID::uuidgen;
-
 auto _timer_callback(TimerHandle_t timer_handle)
   -> void;
 
 auto _signal_timer_callback(TimerHandle_t timer_handle)
   -> void;
 
+auto _snapshot_shutdown_handler()
+  -> void;
+
+// Nodes with snapshots enabled, persisted by the shutdown handler
+auto get_snapshot_nodes()
+  -> std::vector<Node*>&;
+
+auto get_snapshot_nodes_mutex()
+  -> SemaphoreHandle_t;
+
 auto _timer_callback(TimerHandle_t timer_handle)
   -> void
 {
-  auto& node = Process::get_default_node();
-  auto tref = reinterpret_cast<TRef>(pvTimerGetTimerID(timer_handle));
-  node.timer_callback(tref);
+  auto* timer_context = static_cast<TimerContext*>(
+    pvTimerGetTimerID(timer_handle)
+  );
+  timer_context->node->timer_callback(timer_context->ref);
 }
 
 auto _signal_timer_callback(TimerHandle_t timer_handle)
   -> void
 {
-  auto& node = Process::get_default_node();
-  auto signal_ref = reinterpret_cast<SignalRef>(
+  auto* timer_context = static_cast<TimerContext*>(
     pvTimerGetTimerID(timer_handle)
   );
-  node.signal_timer_callback(signal_ref);
+  timer_context->node->signal_timer_callback(timer_context->ref);
 }
 
-Node::Node()
+auto _snapshot_shutdown_handler()
+  -> void
 {
+  auto& snapshot_nodes = get_snapshot_nodes();
+  auto snapshot_nodes_mutex = get_snapshot_nodes_mutex();
+
+  if (xSemaphoreTake(snapshot_nodes_mutex, timeout(1s)) == pdTRUE)
+  {
+    for (auto* node : snapshot_nodes)
+    {
+      node->persist_snapshots();
+    }
+
+    xSemaphoreGive(snapshot_nodes_mutex);
+  }
+}
+
+auto get_snapshot_nodes()
+  -> std::vector<Node*>&
+{
+  static std::vector<Node*> snapshot_nodes;
+  return snapshot_nodes;
+}
+
+auto get_snapshot_nodes_mutex()
+  -> SemaphoreHandle_t
+{
+  static SemaphoreHandle_t snapshot_nodes_mutex = xSemaphoreCreateMutex();
+  return snapshot_nodes_mutex;
+}
+
+Node::Node(const NodeId _node_id)
+: node_id((_node_id != NullNodeId)? _node_id : generate_node_id())
+, global_names_mutex(xSemaphoreCreateMutex())
+{
+}
+
+Node::~Node()
+{
+  if (snapshot_store)
+  {
+    auto& snapshot_nodes = get_snapshot_nodes();
+    auto snapshot_nodes_mutex = get_snapshot_nodes_mutex();
+
+    xSemaphoreTake(snapshot_nodes_mutex, portMAX_DELAY);
+    snapshot_nodes.erase(
+      std::remove(snapshot_nodes.begin(), snapshot_nodes.end(), this),
+      snapshot_nodes.end()
+    );
+    xSemaphoreGive(snapshot_nodes_mutex);
+  }
+
+  // Stopped first, as it uses the global names
+  distribution.reset();
+
+  if (global_names_mutex)
+  {
+    vSemaphoreDelete(global_names_mutex);
+  }
+}
+
+auto Node::get_node_id() const
+  -> NodeId
+{
+  return node_id;
+}
+
+auto Node::start_distribution(const uint16_t port)
+  -> bool
+{
+  if (not distribution)
+  {
+    distribution = std::make_unique<Distribution>(
+      *this,
+      port,
+      ACTOR_MODEL_DISTRIBUTION_TASK_STACK_SIZE,
+      ACTOR_MODEL_DISTRIBUTION_TASK_PRIO
+    );
+  }
+
+  return distribution->is_started();
+}
+
+auto Node::connect_node(const std::string_view host, const uint16_t port)
+  -> bool
+{
+  return (distribution and distribution->connect(host, port));
 }
 
 // Generic behaviour convenience functions
@@ -83,8 +185,9 @@ auto Node::_spawn(
   const ExecConfigCallback&& _exec_config_callback
 ) -> Pid
 {
-  auto pid = uuidgen();
+  auto pid = make_pid(node_id);
 
+  reap_task_memory();
 
   flatbuffers::FlatBufferBuilder execution_config_fbb;
   {
@@ -110,14 +213,32 @@ auto Node::_spawn(
         pid,
         std::move(_behaviour),
         *(execution_config),
-        _initial_link_pid
+        _initial_link_pid,
+        {},
+        this
       }
     }
   );
 
   if (inserted.second)
   {
-    return pid;
+    auto& process = *(inserted.first->second);
+    if (process.started)
+    {
+      return pid;
+    }
+
+    // e.g. its task stack could not be allocated, it never ran so it has
+    // no exit to signal to its links
+    ESP_LOGE("Node", "Could not start Pid %s", get_uuid_str(pid).c_str());
+    const auto links = process.links;
+    for (const auto& pid2 : links)
+    {
+      process.unlink(pid2);
+    }
+    process_registry.erase(inserted.first);
+
+    return NullPid;
   }
   else {
     printf("Could not spawn Pid\n");
@@ -159,6 +280,18 @@ auto Node::send(
     }
   }
 
+  if (is_remote(pid) and message.type() and message.payload())
+  {
+    const auto& message_buf = Mailbox::create_message(
+      message.type()->string_view(),
+      BufferView{message.payload()->data(), message.payload()->size()},
+      message.payload_alignment(),
+      message.from_pid(),
+      message.deadline()
+    );
+    return send_remote(pid, BufferView{message_buf.data(), message_buf.size()});
+  }
+
   return false;
 }
 
@@ -177,30 +310,128 @@ auto Node::send(
     }
   }
 
+  if (is_remote(pid))
+  {
+    const auto& message_buf = Mailbox::create_message(type, payload);
+    return send_remote(pid, BufferView{message_buf.data(), message_buf.size()});
+  }
+
+  return false;
+}
+
+auto Node::send(
+  const Pid& pid,
+  const MessageType type,
+  const BufferViews payload_pieces
+) -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (process_iter != process_registry.end())
+  {
+    if (process_iter->second)
+    {
+      return process_iter->second->send(type, payload_pieces);
+    }
+  }
+
+  if (is_remote(pid))
+  {
+    const auto& message_buf = Mailbox::create_message(type, payload_pieces);
+    return send_remote(pid, BufferView{message_buf.data(), message_buf.size()});
+  }
+
   return false;
 }
 
-auto Node::send_after(
-  const Time time,
+auto Node::send_typed(
   const Pid& pid,
-  const Message& message
-) -> TRef
+  const MessageTypeId type_id,
+  const BufferView value
+) -> bool
 {
-  auto is_recurring = false;
   const auto& process_iter = process_registry.find(pid);
   if (process_iter != process_registry.end())
   {
     if (process_iter->second)
     {
-      auto&& message_buf = Mailbox::create_message(
-        message.type()->string_view(),
-        BufferView{message.payload()->data(), message.payload()->size()},
-        message.payload_alignment()
-      );
-      return start_timer(time, pid, std::move(message_buf), is_recurring);
+      return process_iter->second->send_typed(type_id, value);
     }
   }
 
+  if (is_remote(pid))
+  {
+    const auto& message_buf = Mailbox::create_typed_message(type_id, value);
+    return send_remote(pid, BufferView{message_buf.data(), message_buf.size()});
+  }
+
+  return false;
+}
+
+auto Node::send_with_ttl(
+  const Pid& pid,
+  const TTL ttl,
+  const MessageType type,
+  const BufferView payload
+) -> bool
+{
+  using std::chrono::microseconds;
+  using std::chrono::duration_cast;
+  using utils::get_elapsed_microseconds;
+
+  // Monotonic, unlike the system time which may be set (or jump) later
+  const auto deadline = (
+    get_elapsed_microseconds() + duration_cast<microseconds>(ttl)
+  ).count();
+
+  const auto& message_buf = Mailbox::create_message(
+    type,
+    payload,
+    sizeof(uint64_t),
+    nullptr,
+    deadline
+  );
+
+  // Local or remote, the deadline travels with the message (see
+  // Distribution for how it is sent to another node)
+  return send_record(pid, BufferView{message_buf.data(), message_buf.size()});
+}
+
+auto Node::coalesce(
+  const Pid& pid,
+  const MessageType type,
+  const bool coalesced
+) -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter != process_registry.end()
+    and process_iter->second
+  )
+  {
+    process_iter->second->mailbox.set_coalesced(type, coalesced);
+    return true;
+  }
+
+  return false;
+}
+
+auto Node::send_after(
+  const Time time,
+  const Pid& pid,
+  const Message& message
+) -> TRef
+{
+  auto is_recurring = false;
+  if (is_reachable(pid))
+  {
+    auto&& message_buf = Mailbox::create_message(
+      message.type()->string_view(),
+      BufferView{message.payload()->data(), message.payload()->size()},
+      message.payload_alignment()
+    );
+    return start_timer(time, pid, std::move(message_buf), is_recurring);
+  }
+
   return false;
 }
 
@@ -212,14 +443,27 @@ auto Node::send_after(
 ) -> TRef
 {
   auto is_recurring = false;
-  const auto& process_iter = process_registry.find(pid);
-  if (process_iter != process_registry.end())
+  if (is_reachable(pid))
   {
-    if (process_iter->second)
-    {
-      auto&& message_buf = Mailbox::create_message(type, payload);
-      return start_timer(time, pid, std::move(message_buf), is_recurring);
-    }
+    auto&& message_buf = Mailbox::create_message(type, payload);
+    return start_timer(time, pid, std::move(message_buf), is_recurring);
+  }
+
+  return false;
+}
+
+auto Node::send_after_typed(
+  const Time time,
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> TRef
+{
+  auto is_recurring = false;
+  if (is_reachable(pid))
+  {
+    auto&& message_buf = Mailbox::create_typed_message(type_id, value);
+    return start_timer(time, pid, std::move(message_buf), is_recurring);
   }
 
   return false;
@@ -232,18 +476,14 @@ auto Node::send_interval(
 ) -> TRef
 {
   auto is_recurring = true;
-  const auto& process_iter = process_registry.find(pid);
-  if (process_iter != process_registry.end())
+  if (is_reachable(pid))
   {
-    if (process_iter->second)
-    {
-      auto&& message_buf = Mailbox::create_message(
-        message.type()->string_view(),
-        BufferView{message.payload()->data(), message.payload()->size()},
-        message.payload_alignment()
-      );
-      return start_timer(time, pid, std::move(message_buf), is_recurring);
-    }
+    auto&& message_buf = Mailbox::create_message(
+      message.type()->string_view(),
+      BufferView{message.payload()->data(), message.payload()->size()},
+      message.payload_alignment()
+    );
+    return start_timer(time, pid, std::move(message_buf), is_recurring);
   }
 
   return false;
@@ -257,14 +497,27 @@ auto Node::send_interval(
 ) -> TRef
 {
   auto is_recurring = true;
-  const auto& process_iter = process_registry.find(pid);
-  if (process_iter != process_registry.end())
+  if (is_reachable(pid))
   {
-    if (process_iter->second)
-    {
-      auto&& message_buf = Mailbox::create_message(type, payload);
-      return start_timer(time, pid, std::move(message_buf), is_recurring);
-    }
+    auto&& message_buf = Mailbox::create_message(type, payload);
+    return start_timer(time, pid, std::move(message_buf), is_recurring);
+  }
+
+  return false;
+}
+
+auto Node::send_interval_typed(
+  const Time time,
+  const Pid& pid,
+  const MessageTypeId type_id,
+  const BufferView value
+) -> TRef
+{
+  auto is_recurring = true;
+  if (is_reachable(pid))
+  {
+    auto&& message_buf = Mailbox::create_typed_message(type_id, value);
+    return start_timer(time, pid, std::move(message_buf), is_recurring);
   }
 
   return false;
@@ -279,11 +532,12 @@ auto Node::start_timer(
 {
   auto tref = next_tref++;
   auto timer_name = "tref_" + std::to_string(tref);
+  auto timer_context = std::make_unique<TimerContext>(TimerContext{this, tref});
   auto timer_handle = xTimerCreate(
     timer_name.c_str(),
     timeout(time),
     is_recurring,
-    reinterpret_cast<void*>(tref),
+    timer_context.get(),
     _timer_callback
   );
 
@@ -295,7 +549,8 @@ auto Node::start_timer(
         pid,
         std::move(message_buf),
         is_recurring,
-        timer_handle
+        timer_handle,
+        std::move(timer_context)
       }
     );
 
@@ -333,11 +588,14 @@ auto Node::signal(
   auto signal_ref = next_signal_ref++;
   auto signal_timer_name = "signal_" + std::to_string(signal_ref);
   bool non_recurring = false;
+  auto timer_context = std::make_unique<TimerContext>(
+    TimerContext{this, signal_ref}
+  );
   auto timer_handle = xTimerCreate(
     signal_timer_name.c_str(),
     1, // minimum number of ticks is 1
     non_recurring,
-    reinterpret_cast<void*>(signal_ref),
+    timer_context.get(),
     _signal_timer_callback
   );
 
@@ -349,7 +607,8 @@ auto Node::signal(
         pid,
         std::move(signal_buf),
         non_recurring,
-        timer_handle
+        timer_handle,
+        std::move(timer_context)
       }
     );
 
@@ -381,10 +640,24 @@ auto Node::cancel(const TRef tref)
   auto timed_message = timed_messages.find(tref);
   if (timed_message != timed_messages.end())
   {
-    const auto* message = flatbuffers::GetRoot<Message>(
-      timed_message->second.buf.data()
-    );
-    ESP_LOGW("Node", "Cancel timer for %s", message->type()->c_str());
+    const auto& _message = timed_message->second.buf;
+    if (is_typed_message_record(BufferView{_message.data(), _message.size()}))
+    {
+      const auto* header = reinterpret_cast<const TypedMessageHeader*>(
+        _message.data()
+      );
+      const auto* info = get_message_type_info(header->type_id);
+      ESP_LOGW(
+        "Node",
+        "Cancel timer for %.*s",
+        static_cast<int>(info? info->type.size() : 0),
+        info? info->type.data() : ""
+      );
+    }
+    else {
+      const auto* message = flatbuffers::GetRoot<Message>(_message.data());
+      ESP_LOGW("Node", "Cancel timer for %s", message->type()->c_str());
+    }
 
     if (timed_message->second.timer_handle)
     {
@@ -463,6 +736,12 @@ auto Node::cancel_signal(const SignalRef signal_ref)
 auto Node::exit(const Pid& pid, const Pid& pid2, const Reason exit_reason)
   -> bool
 {
+  // Signals to remote processes are delivered by their node
+  if (is_remote(pid2))
+  {
+    return distribution->exit(pid, pid2, exit_reason);
+  }
+
   flatbuffers::FlatBufferBuilder fbb;
 
   auto exit_reason_str = fbb.CreateString(exit_reason);
@@ -486,22 +765,14 @@ auto Node::timer_callback(const TRef tref)
   if (timed_message != timed_messages.end())
   {
     const auto& pid = timed_message->second.pid;
-    const auto& process_iter = process_registry.find(pid);
     const auto& _message = timed_message->second.buf;
 
-    // Enqueue the message to the process' mailbox
-    if (
-      process_iter != process_registry.end()
-      and process_iter->second
-    )
-    {
-      const auto* message = flatbuffers::GetRoot<Message>(_message.data());
-      if (message)
-      {
-        process_iter->second->send(*(message));
-        did_send_message = true;
-      }
-    }
+    // Enqueue the message to the process' mailbox (or its node)
+    // Timed records may be Message flatbuffers or typed records
+    did_send_message = send_record(
+      pid,
+      BufferView{_message.data(), _message.size()}
+    );
 
     if (not timed_message->second.is_recurring)
     {
@@ -604,15 +875,289 @@ auto Node::register_name(const Name name, const Pid& pid)
   -> bool
 {
   named_process_registry[string{name}] = pid;
+  names_generation++;
   return true;
 }
 
 auto Node::unregister(const Name name)
   -> bool
 {
-  auto erased = named_process_registry.erase(string{name});
+  const auto& pid_iter = named_process_registry.find(string{name});
+  if (pid_iter == named_process_registry.end())
+  {
+    return false;
+  }
 
-  return (erased == 1);
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  auto was_global = (global_names.erase(pid_iter->first) == 1);
+  xSemaphoreGive(global_names_mutex);
+
+  if (was_global and distribution)
+  {
+    distribution->unregister_name(name, pid_iter->second);
+  }
+
+  named_process_registry.erase(pid_iter);
+  names_generation++;
+
+  return true;
+}
+
+auto Node::register_global_name(const Name name, const Pid& pid)
+  -> bool
+{
+  register_name(name, pid);
+
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  global_names.emplace(name);
+  xSemaphoreGive(global_names_mutex);
+
+  // Nodes which connect later are sent all global names when they do
+  if (distribution)
+  {
+    distribution->register_name(name, pid);
+  }
+
+  return true;
+}
+
+auto Node::is_remote(const Pid& pid)
+  -> bool
+{
+  const auto pid_node_id = get_pid_node_id(pid);
+  return (
+    distribution
+    and pid_node_id != node_id
+    and pid_node_id != NullNodeId
+    and distribution->is_connected(pid_node_id)
+  );
+}
+
+auto Node::is_reachable(const Pid& pid)
+  -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter != process_registry.end()
+    and process_iter->second
+  )
+  {
+    return true;
+  }
+
+  return is_remote(pid);
+}
+
+auto Node::send_record(const Pid& pid, const BufferView record)
+  -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter != process_registry.end()
+    and process_iter->second
+  )
+  {
+    return process_iter->second->send_record(record);
+  }
+
+  return send_remote(pid, record);
+}
+
+auto Node::send_remote(const Pid& pid, const BufferView record)
+  -> bool
+{
+  return (is_remote(pid) and distribution->send_record(pid, record));
+}
+
+auto Node::add_remote_link(const Pid& pid, const Pid& remote_pid)
+  -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter != process_registry.end()
+    and process_iter->second
+  )
+  {
+    process_iter->second->links.emplace(remote_pid);
+    return true;
+  }
+
+  return false;
+}
+
+auto Node::remove_remote_link(const Pid& pid, const Pid& remote_pid)
+  -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter != process_registry.end()
+    and process_iter->second
+  )
+  {
+    return (process_iter->second->links.erase(remote_pid) == 1);
+  }
+
+  return false;
+}
+
+auto Node::register_remote_name(const Name name, const Pid& remote_pid)
+  -> bool
+{
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  remote_named_process_registry[string{name}] = remote_pid;
+  xSemaphoreGive(global_names_mutex);
+
+  names_generation++;
+  return true;
+}
+
+auto Node::unregister_remote_name(const Name name, const Pid& remote_pid)
+  -> bool
+{
+  auto erased = false;
+
+  // Only if the name has not since been registered to another process
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  const auto& pid_iter = remote_named_process_registry.find(string{name});
+  if (
+    pid_iter != remote_named_process_registry.end()
+    and compare_uuids(pid_iter->second, remote_pid)
+  )
+  {
+    remote_named_process_registry.erase(pid_iter);
+    erased = true;
+  }
+  xSemaphoreGive(global_names_mutex);
+
+  if (erased)
+  {
+    names_generation++;
+  }
+
+  return erased;
+}
+
+auto Node::node_down(const NodeId remote_node_id)
+  -> void
+{
+  // Links to processes of the node are broken, as if they had exited
+  for (const auto& process_iter : process_registry)
+  {
+    if (not process_iter.second)
+    {
+      continue;
+    }
+
+    for (const auto& pid2 : process_iter.second->links)
+    {
+      if (get_pid_node_id(pid2) == remote_node_id)
+      {
+        exit(pid2, process_iter.first, "noconnection");
+      }
+    }
+  }
+
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  for (
+    auto i = remote_named_process_registry.begin(),
+      end = remote_named_process_registry.end();
+    i != end;
+  )
+  {
+    if (get_pid_node_id(i->second) == remote_node_id)
+    {
+      i = remote_named_process_registry.erase(i);
+      end = remote_named_process_registry.end();
+      names_generation++;
+    }
+    else {
+      ++i;
+    }
+  }
+  xSemaphoreGive(global_names_mutex);
+}
+
+auto Node::get_global_names()
+  -> std::vector<std::pair<string, Pid>>
+{
+  std::vector<std::pair<string, Pid>> global_name_pids;
+
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  for (const auto& name : global_names)
+  {
+    const auto& pid_iter = named_process_registry.find(name);
+    if (pid_iter != named_process_registry.end())
+    {
+      global_name_pids.emplace_back(name, pid_iter->second);
+    }
+  }
+  xSemaphoreGive(global_names_mutex);
+
+  return global_name_pids;
+}
+
+auto Node::get_process_host()
+  -> ProcessHost&
+{
+  if (not process_host)
+  {
+    process_host = std::make_unique<ProcessHost>(
+      *this,
+      ACTOR_MODEL_PROCESS_HOST_QUEUE_SET_LENGTH,
+      ACTOR_MODEL_PROCESS_HOST_TASK_STACK_SIZE,
+      ACTOR_MODEL_PROCESS_HOST_TASK_PRIO
+    );
+  }
+
+  return *(process_host);
+}
+
+auto Node::get_socket_reactor()
+  -> SocketReactor&
+{
+  if (not socket_reactor)
+  {
+    socket_reactor = std::make_unique<SocketReactor>(
+      *this,
+      ACTOR_MODEL_SOCKET_REACTOR_TASK_STACK_SIZE,
+      ACTOR_MODEL_SOCKET_REACTOR_TASK_PRIO
+    );
+  }
+
+  return *(socket_reactor);
+}
+
+auto Node::release_task_memory(void* task_stack, void* task_buffer)
+  -> void
+{
+  released_task_memory.emplace_back(
+    ReleasedTaskMemory{task_stack, task_buffer, xTaskGetTickCount()}
+  );
+}
+
+auto Node::reap_task_memory()
+  -> void
+{
+  // Allow time for the idle task to finish cleaning up deleted tasks
+  constexpr auto reap_delay_ticks = pdMS_TO_TICKS(1000);
+  const auto now_ticks = xTaskGetTickCount();
+
+  for (
+    auto i = released_task_memory.begin(), end = released_task_memory.end();
+    i != end;
+  )
+  {
+    if ((now_ticks - i->released_ticks) > reap_delay_ticks)
+    {
+      placement_free(i->task_stack);
+      placement_free(i->task_buffer);
+      i = released_task_memory.erase(i);
+      end = released_task_memory.end();
+    }
+    else {
+      ++i;
+    }
+  }
 }
 
 auto Node::terminate(const Pid& pid)
@@ -654,7 +1199,38 @@ auto Node::terminate(const Pid& pid)
   {
     if (compare_uuids(i->second, pid))
     {
+      xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+      auto was_global = (global_names.erase(i->first) == 1);
+      xSemaphoreGive(global_names_mutex);
+
+      if (was_global and distribution)
+      {
+        distribution->unregister_name(i->first, pid);
+      }
+
       i = named_process_registry.erase(i);
+      names_generation++;
+    }
+    else {
+      ++i;
+    }
+  }
+
+  // Close the channels this process was either side of
+  for (auto i = channels.begin(), end = channels.end(); i != end;)
+  {
+    const auto& channel = i->second;
+    const auto is_producer = compare_uuids(channel->get_producer_pid(), pid);
+
+    if (is_producer or compare_uuids(channel->get_consumer_pid(), pid))
+    {
+      channel->close();
+      notify_channel_closed(
+        is_producer? channel->get_consumer_pid() : channel->get_producer_pid(),
+        i->first
+      );
+
+      i = channels.erase(i);
     }
     else {
       ++i;
@@ -682,7 +1258,240 @@ auto Node::whereis(const Name name)
     return pid_iter->second;
   }
 
-  return std::nullopt;
+  // Names registered globally by connected nodes
+  MaybePid remote_pid;
+
+  xSemaphoreTake(global_names_mutex, portMAX_DELAY);
+  const auto& remote_pid_iter = remote_named_process_registry.find(
+    string{name}
+  );
+  if (remote_pid_iter != remote_named_process_registry.end())
+  {
+    remote_pid = remote_pid_iter->second;
+  }
+  xSemaphoreGive(global_names_mutex);
+
+  return remote_pid;
+}
+
+auto Node::get_names_generation() const
+  -> NamesGeneration
+{
+  return names_generation.load();
+}
+
+auto Node::watch_socket(const Pid& pid, const int fd, const uint8_t interests)
+  -> bool
+{
+  return get_socket_reactor().watch(pid, fd, interests);
+}
+
+auto Node::unwatch_socket(const int fd)
+  -> bool
+{
+  return (socket_reactor and socket_reactor->unwatch(fd));
+}
+
+auto Node::open_channel(
+  const Pid& producer_pid,
+  const Pid& consumer_pid,
+  const size_t capacity
+) -> ChannelPtr
+{
+  if (
+    process_registry.find(producer_pid) == process_registry.end()
+    or process_registry.find(consumer_pid) == process_registry.end()
+  )
+  {
+    ESP_LOGW("Node", "Channels are only supported between local processes");
+    return nullptr;
+  }
+
+  const auto channel_id = next_channel_id++;
+
+  auto channel = std::make_shared<Channel>(
+    *this,
+    channel_id,
+    producer_pid,
+    consumer_pid,
+    capacity
+  );
+
+  if (not channel->is_open())
+  {
+    return nullptr;
+  }
+
+  channels.emplace(channel_id, channel);
+  return channel;
+}
+
+auto Node::get_channel(const ChannelId channel_id)
+  -> ChannelPtr
+{
+  const auto& channel_iter = channels.find(channel_id);
+  if (channel_iter != channels.end())
+  {
+    return channel_iter->second;
+  }
+
+  return nullptr;
+}
+
+auto Node::close_channel(const ChannelId channel_id)
+  -> bool
+{
+  const auto& channel_iter = channels.find(channel_id);
+  if (channel_iter == channels.end())
+  {
+    return false;
+  }
+
+  // Either side may still hold the channel, e.g. to drain it
+  auto channel = channel_iter->second;
+  channels.erase(channel_iter);
+
+  channel->close();
+  notify_channel_closed(channel->get_producer_pid(), channel_id);
+  notify_channel_closed(channel->get_consumer_pid(), channel_id);
+
+  return true;
+}
+
+auto Node::notify_channel_closed(const Pid& pid, const ChannelId channel_id)
+  -> bool
+{
+  static_cast<void>(message_type_registered<ChannelClosed>);
+
+  const auto channel_closed = ChannelClosed{channel_id};
+  return send_typed(
+    pid,
+    message_type_id<ChannelClosed>,
+    BufferView{
+      reinterpret_cast<const uint8_t*>(&channel_closed),
+      typed_message_payload_size<ChannelClosed>
+    }
+  );
+}
+
+auto Node::enable_snapshots(
+  const SnapshotStorage storage,
+  const std::string_view path,
+  const Time persist_interval
+) -> bool
+{
+  if (snapshot_store)
+  {
+    return false;
+  }
+
+  snapshot_store = std::make_unique<SnapshotStore>(
+    storage,
+    path,
+    persist_interval,
+    ACTOR_MODEL_SNAPSHOT_TASK_STACK_SIZE,
+    ACTOR_MODEL_SNAPSHOT_TASK_PRIO
+  );
+
+  auto snapshot_nodes_mutex = get_snapshot_nodes_mutex();
+  xSemaphoreTake(snapshot_nodes_mutex, portMAX_DELAY);
+  get_snapshot_nodes().emplace_back(this);
+  xSemaphoreGive(snapshot_nodes_mutex);
+
+  // Already registered is fine, e.g. by another node
+  auto err = esp_register_shutdown_handler(&_snapshot_shutdown_handler);
+  if (err != ESP_OK and err != ESP_ERR_INVALID_STATE)
+  {
+    ESP_LOGW("Node", "Snapshots will not be persisted on restart");
+  }
+
+  return true;
+}
+
+auto Node::save_snapshot(const Name key, const BufferView snapshot)
+  -> bool
+{
+  return (snapshot_store and snapshot_store->save(key, snapshot));
+}
+
+auto Node::load_snapshot(const Name key)
+  -> SnapshotBuffer
+{
+  return snapshot_store? snapshot_store->load(key) : SnapshotBuffer{};
+}
+
+auto Node::erase_snapshot(const Name key)
+  -> bool
+{
+  return (snapshot_store and snapshot_store->erase(key));
+}
+
+auto Node::persist_snapshots()
+  -> bool
+{
+  return (snapshot_store and snapshot_store->persist());
+}
+
+auto Node::trace(const Pid& pid, MessageTraceRecorder* recorder)
+  -> bool
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter != process_registry.end()
+    and process_iter->second
+  )
+  {
+    process_iter->second->mailbox.set_recorder(recorder, pid);
+    return true;
+  }
+
+  return false;
+}
+
+auto Node::get_cpu_stats(const Pid& pid)
+  -> CpuStatsFlatbuffer
+{
+  const auto& process_iter = process_registry.find(pid);
+  if (
+    process_iter == process_registry.end()
+    or not process_iter->second
+  )
+  {
+    return {};
+  }
+
+  flatbuffers::FlatBufferBuilder fbb;
+  fbb.Finish(process_iter->second->mailbox.get_cpu_stats().serialize(fbb, pid));
+
+  return fbb.Release();
+}
+
+auto Node::get_cpu_stats()
+  -> CpuStatsFlatbuffer
+{
+  flatbuffers::FlatBufferBuilder fbb;
+
+  std::vector<flatbuffers::Offset<ProcessCpuStats>> process_cpu_stats_offsets;
+  process_cpu_stats_offsets.reserve(process_registry.size());
+
+  for (const auto& process_iter : process_registry)
+  {
+    if (process_iter.second)
+    {
+      process_cpu_stats_offsets.emplace_back(
+        process_iter.second->mailbox.get_cpu_stats().serialize(
+          fbb,
+          process_iter.first
+        )
+      );
+    }
+  }
+
+  fbb.Finish(
+    CreateNodeCpuStats(fbb, fbb.CreateVector(process_cpu_stats_offsets))
+  );
+
+  return fbb.Release();
 }
 
 auto Node::module(const BufferView module_flatbuffer)
@@ -771,4 +1580,32 @@ auto Node::apply(
   return {Result::Error, "badmatch"};
 }
 
+NameHandle::NameHandle(const Name _name, Node* const _node)
+: name(_name)
+, node(_node)
+{
+}
+
+auto NameHandle::pid()
+  -> MaybePid
+{
+  auto& current_node = node? (*node) : Process::get_calling_node();
+
+  // Only look up the name (and hash a string) after registrations change
+  const auto generation = current_node.get_names_generation();
+  if (generation != cached_generation)
+  {
+    cached_pid = current_node.whereis(name);
+    cached_generation = generation;
+  }
+
+  return cached_pid;
+}
+
+auto NameHandle::get_name() const
+  -> Name
+{
+  return name;
+}
+
 } // namespace ActorModel
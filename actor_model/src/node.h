@@ -10,40 +10,70 @@
 
 #pragma once
 
+#include "channel.h"
 #include "pid.h"
 #include "process.h"
+#include "snapshot_store.h"
 
 #include "actor_model_generated.h"
 
 #include "delegate.hpp"
 
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <set>
 #include <string_view>
 #include <unordered_map>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/timers.h"
 
 namespace ActorModel {
 
+class Distribution;
+class MessageTraceRecorder;
+class ProcessHost;
+class SocketReactor;
+
 using ExecConfigCallback = delegate<void(ProcessExecutionConfigBuilder&)>;
 using Time = std::chrono::milliseconds;
 
 using TRef = size_t;
 using SignalRef = size_t;
-using TTL = int;
+using TTL = std::chrono::milliseconds;
 using Reason = std::string_view;
 using Name = std::string_view;
+using NamesGeneration = uint32_t;
 
 using ModuleFlatbuffer = std::vector<uint8_t>;
 
 using FunctionFlatbuffer = flatbuffers::DetachedBuffer;
 using FunctionMutableFlatbuffer = std::vector<uint8_t>;
 
+using CpuStatsFlatbuffer = flatbuffers::DetachedBuffer;
+
 constexpr TRef NullTRef = 0;
 constexpr SignalRef NullSignalRef = 0;
 
+struct ReleasedTaskMemory
+{
+  void* task_stack;
+  void* task_buffer;
+  TickType_t released_ticks;
+};
+
+class Node;
+
+// The ID of a node's FreeRTOS timer, which fire on the timer service task
+// whichever node started them
+struct TimerContext
+{
+  Node* node;
+  size_t ref;
+};
+
 class TimedBufferDelivery
 {
 public:
@@ -51,12 +81,14 @@ public:
     const Pid& _pid,
     flatbuffers::DetachedBuffer&& _buf,
     const bool _is_recurring,
-    const TimerHandle_t _timer_handle
+    const TimerHandle_t _timer_handle,
+    std::unique_ptr<TimerContext>&& _timer_context
   )
   : pid(_pid)
   , buf(std::move(_buf))
   , is_recurring(_is_recurring)
   , timer_handle(_timer_handle)
+  , timer_context(std::move(_timer_context))
   {
   }
 
@@ -64,12 +96,16 @@ public:
   flatbuffers::DetachedBuffer buf;
   bool is_recurring;
   TimerHandle_t timer_handle;
+  std::unique_ptr<TimerContext> timer_context;
 };
 
 class Process;
 class Node
 {
   friend class Process;
+  friend class Distribution;
+  friend class ProcessHost;
+  friend class SocketReactor;
 
 public:
   // type aliases:
@@ -84,6 +120,7 @@ public:
     UUID::UUIDEqualFunc
   >;
   using NamedProcessRegistry = std::unordered_map<string, Pid>;
+  using GlobalNames = std::set<string>;
 
   using ModuleRegistry = std::unordered_map<
     string,
@@ -94,11 +131,28 @@ public:
     FunctionMutableFlatbuffer
   >;
 
+  using ChannelRegistry = std::unordered_map<ChannelId, ChannelPtr>;
+
+  using ReleasedTaskMemoryList = std::vector<ReleasedTaskMemory>;
+
   using TimedMessages = std::unordered_map<TRef, TimedBufferDelivery>;
   using TimedSignals = std::unordered_map<SignalRef, TimedBufferDelivery>;
 
   // public constructors/destructors:
-  Node();
+  explicit Node(const NodeId _node_id = NullNodeId);
+  ~Node();
+
+  auto get_node_id() const
+    -> NodeId;
+
+  // Listen for other nodes, Pids of connected nodes can then be sent to.
+  // Messages to them are fragmented as needed, up to
+  // Distribution::get_max_record_size(), larger sends fail
+  auto start_distribution(const uint16_t port)
+    -> bool;
+
+  auto connect_node(const std::string_view host, const uint16_t port)
+    -> bool;
 
   // Generic behaviour convenience functions
   auto spawn(
@@ -129,6 +183,30 @@ public:
     const BufferView payload
   ) -> bool;
 
+  auto send(
+    const Pid& pid,
+    const MessageType type,
+    const BufferViews payload_pieces
+  ) -> bool;
+
+  auto send_typed(
+    const Pid& pid,
+    const MessageTypeId type_id,
+    const BufferView value
+  ) -> bool;
+
+  // Dropped by the receiving mailbox if not received within ttl
+  auto send_with_ttl(
+    const Pid& pid,
+    const TTL ttl,
+    const MessageType type,
+    const BufferView payload
+  ) -> bool;
+
+  // See Mailbox::set_coalesced, only for processes on this node
+  auto coalesce(const Pid& pid, const MessageType type, const bool coalesced)
+    -> bool;
+
   auto send_after(
     const Time time,
     const Pid& pid,
@@ -142,6 +220,13 @@ public:
     const BufferView payload
   ) -> TRef;
 
+  auto send_after_typed(
+    const Time time,
+    const Pid& pid,
+    const MessageTypeId type_id,
+    const BufferView value
+  ) -> TRef;
+
   auto send_interval(
     const Time time,
     const Pid& pid,
@@ -155,6 +240,13 @@ public:
     const BufferView payload
   ) -> TRef;
 
+  auto send_interval_typed(
+    const Time time,
+    const Pid& pid,
+    const MessageTypeId type_id,
+    const BufferView value
+  ) -> TRef;
+
   auto cancel(const TRef tref)
     -> bool;
 
@@ -170,12 +262,76 @@ public:
   auto unregister(const Name name)
     -> bool;
 
+  // Register a name which is also visible to whereis on connected nodes
+  auto register_global_name(const Name name, const Pid& pid)
+    -> bool;
+
   auto registered()
     -> const NamedProcessRegistry;
 
   auto whereis(const Name name)
     -> MaybePid;
 
+  // Incremented whenever named_process_registry changes
+  auto get_names_generation() const
+    -> NamesGeneration;
+
+  // Send pid a message when fd is ready (once, see SocketReactor)
+  auto watch_socket(const Pid& pid, const int fd, const uint8_t interests)
+    -> bool;
+
+  auto unwatch_socket(const int fd)
+    -> bool;
+
+  // Stream records from producer_pid to consumer_pid, both on this node,
+  // without a Message per record. Closed when either process exits
+  auto open_channel(
+    const Pid& producer_pid,
+    const Pid& consumer_pid,
+    const size_t capacity
+  ) -> ChannelPtr;
+
+  auto get_channel(const ChannelId channel_id)
+    -> ChannelPtr;
+
+  auto close_channel(const ChannelId channel_id)
+    -> bool;
+
+  // Restore snapshots persisted by a previous boot, which are then persisted
+  // at most once per persist_interval, and before restarting
+  auto enable_snapshots(
+    const SnapshotStorage storage,
+    const std::string_view path,
+    const Time persist_interval
+  ) -> bool;
+
+  // Save the state of a process by a key which is stable across reboots
+  auto save_snapshot(const Name key, const BufferView snapshot)
+    -> bool;
+
+  // Empty if snapshots are not enabled, or none was saved for key
+  auto load_snapshot(const Name key)
+    -> SnapshotBuffer;
+
+  auto erase_snapshot(const Name key)
+    -> bool;
+
+  auto persist_snapshots()
+    -> bool;
+
+  // Record the messages received by pid (until recorder is nullptr),
+  // the recorder must outlive the recording
+  auto trace(const Pid& pid, MessageTraceRecorder* recorder)
+    -> bool;
+
+  // A ProcessCpuStats flatbuffer, empty if pid is not on this node
+  auto get_cpu_stats(const Pid& pid)
+    -> CpuStatsFlatbuffer;
+
+  // A NodeCpuStats flatbuffer, of every process on this node
+  auto get_cpu_stats()
+    -> CpuStatsFlatbuffer;
+
   auto module(const BufferView module_flatbuffer)
    -> bool;
 
@@ -214,6 +370,41 @@ protected:
   auto process_signal(const Pid& pid, const Signal& sig)
     -> bool;
 
+  // Spawned by a connected node
+  auto is_remote(const Pid& pid)
+    -> bool;
+
+  // Local, or remote
+  auto is_reachable(const Pid& pid)
+    -> bool;
+
+  auto send_record(const Pid& pid, const BufferView record)
+    -> bool;
+
+  // Route to the node which spawned pid, if it is not this node
+  auto send_remote(const Pid& pid, const BufferView record)
+    -> bool;
+
+  auto add_remote_link(const Pid& pid, const Pid& remote_pid)
+    -> bool;
+
+  auto remove_remote_link(const Pid& pid, const Pid& remote_pid)
+    -> bool;
+
+  auto register_remote_name(const Name name, const Pid& remote_pid)
+    -> bool;
+
+  auto unregister_remote_name(const Name name, const Pid& remote_pid)
+    -> bool;
+
+  // Exit processes linked to the node, and forget its names
+  auto node_down(const NodeId remote_node_id)
+    -> void;
+
+  // Names registered globally on this node, and their pids
+  auto get_global_names()
+    -> std::vector<std::pair<string, Pid>>;
+
   auto start_timer(
     const Time time,
     const Pid& pid,
@@ -221,8 +412,33 @@ protected:
     const bool is_recurring = false
   ) -> TRef;
 
+  // Started on first use by a hosted process
+  auto get_process_host()
+    -> ProcessHost&;
+
+  // Started on first use by watch_socket
+  auto get_socket_reactor()
+    -> SocketReactor&;
+
+  auto notify_channel_closed(const Pid& pid, const ChannelId channel_id)
+    -> bool;
+
+  // Statically allocated task memory cannot be freed by the task itself
+  auto release_task_memory(void* task_stack, void* task_buffer)
+    -> void;
+
+  auto reap_task_memory()
+    -> void;
+
+  const NodeId node_id;
+
   ProcessRegistry process_registry;
   NamedProcessRegistry named_process_registry;
+  NamedProcessRegistry remote_named_process_registry;
+  GlobalNames global_names;
+  // Guards the remote and global names, which connected nodes change
+  SemaphoreHandle_t global_names_mutex = nullptr;
+  std::atomic<NamesGeneration> names_generation{1};
 
   ModuleRegistry module_registry;
   FunctionRegistry function_registry;
@@ -232,7 +448,38 @@ protected:
 
   TimedSignals timed_signals;
   SignalRef next_signal_ref = 1;
+
+  ChannelRegistry channels;
+  ChannelId next_channel_id = 1;
+
+  std::unique_ptr<ProcessHost> process_host;
+  std::unique_ptr<Distribution> distribution;
+  std::unique_ptr<SocketReactor> socket_reactor;
+  std::unique_ptr<SnapshotStore> snapshot_store;
+
+  ReleasedTaskMemoryList released_task_memory;
+private:
+};
+
+// Caches the result of whereis(name), so sending to a well-known process
+// costs no string operations unless a name has been (un)registered since
+class NameHandle
+{
+public:
+  explicit NameHandle(const Name _name, Node* const _node = nullptr);
+
+  auto pid()
+    -> MaybePid;
+
+  auto get_name() const
+    -> Name;
+
 private:
+  const std::string name;
+  Node* const node = nullptr;
+
+  MaybePid cached_pid;
+  NamesGeneration cached_generation = 0;
 };
 
 } // namespace ActorModel
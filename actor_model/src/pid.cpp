@@ -12,4 +12,34 @@
 
 namespace ActorModel {
 
+using UUID::uuidgen;
+
+auto make_pid(const NodeId node_id)
+  -> Pid
+{
+  auto pid = uuidgen();
+
+  // Replace the low (random) bits, the remaining 90 random bits are unique
+  constexpr uint64_t node_id_mask = 0xffffffffull;
+  return Pid{pid.ab(), (pid.cd() & ~node_id_mask) | node_id};
+}
+
+auto get_pid_node_id(const Pid& pid)
+  -> NodeId
+{
+  return static_cast<NodeId>(pid.cd() & 0xffffffffull);
+}
+
+auto generate_node_id()
+  -> NodeId
+{
+  auto node_id = NullNodeId;
+  while (node_id == NullNodeId)
+  {
+    node_id = get_pid_node_id(uuidgen());
+  }
+
+  return node_id;
+}
+
 } // namespace ActorModel
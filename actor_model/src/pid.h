@@ -12,6 +12,7 @@
 
 #include "uuid.h"
 
+#include <cstdint>
 #include <optional>
 
 namespace ActorModel {
@@ -21,4 +22,19 @@ using MaybePid = std::optional<Pid>;
 
 static Pid& NullPid = UUID::NullUUID;
 
+// Pids carry the id of the node which spawned them, in the low bits of
+// the UUID's node field, so any Pid can be routed to its node
+using NodeId = uint32_t;
+
+constexpr NodeId NullNodeId = 0;
+
+auto make_pid(const NodeId node_id)
+  -> Pid;
+
+auto get_pid_node_id(const Pid& pid)
+  -> NodeId;
+
+auto generate_node_id()
+  -> NodeId;
+
 } // namespace ActorModel
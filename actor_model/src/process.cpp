@@ -10,6 +10,10 @@
 
 #include "process.h"
 
+#include "distribution.h"
+#include "memory_placement.h"
+#include "process_host.h"
+
 #include "delay.h"
 #include <chrono>
 
@@ -24,6 +28,10 @@ using namespace std::chrono_literals;
 
 static Node default_node;
 
+// The process whose behaviour is running on this task, hosted processes
+// share a task so this is swapped around each _execute()
+static thread_local Process* calling_process = nullptr;
+
 flatbuffers::FlatBufferBuilder Process::_default_execution_config_fbb;
 const ProcessExecutionConfig* Process::_default_execution_config = nullptr;
 
@@ -42,14 +50,28 @@ Process::Process(
 , mailbox(
     execution_config.mailbox_size(),
     execution_config.send_timeout_microseconds(),
-    execution_config.receive_timeout_microseconds(),
-    execution_config.receive_lock_timeout_microseconds()
+    // Hosted processes share a task, so must never block on receive
+    execution_config.hosted()? 0 : execution_config.receive_timeout_microseconds(),
+    execution_config.receive_lock_timeout_microseconds(),
+    MailboxOverflowConfig{
+      execution_config.mailbox_growth_policy(),
+      execution_config.mailbox_segment_size(),
+      execution_config.mailbox_max_overflow_size(),
+      execution_config.mailbox_overflow_spiram()
+    },
+    execution_config.mailbox_placement(),
+    execution_config.hosted()?
+      MailboxBackend::ringbuffer : execution_config.mailbox_backend()
   )
 , behaviour(_behaviour)
 , current_node(_current_node)
 , started(false)
+, hosted(execution_config.hosted())
 {
   dictionary.ancestors = _ancestors;
+  mailbox.get_cpu_stats().set_sample_interval(
+    execution_config.cpu_stats_sample_interval()
+  );
 
   if (initial_link_pid)
   {
@@ -58,6 +80,13 @@ Process::Process(
     link(*initial_link_pid);
   }
 
+  if (hosted)
+  {
+    // Run from the node's shared ProcessHost task, when messages arrive
+    started = get_current_node().get_process_host().adopt(pid, mailbox);
+    return;
+  }
+
   auto pid_str = get_uuid_str(pid);
   auto task_name = pid_str.c_str();
 
@@ -65,18 +94,66 @@ Process::Process(
   const auto task_stack_size = execution_config.task_stack_size();
   auto* task_user_data = this;
 
-  auto retval = xTaskCreate(
-    &process_task,
-    task_name,
-    task_stack_size,
-    task_user_data,
-    task_prio,
-    &impl
-  );
-
-  if (retval == pdPASS)
+  auto stack_placement = execution_config.stack_placement();
+  if (stack_placement == MemoryPlacement::any)
   {
-    started = true;
+    auto retval = xTaskCreate(
+      &process_task,
+      task_name,
+      task_stack_size,
+      task_user_data,
+      task_prio,
+      &impl
+    );
+
+    started = (retval == pdPASS);
+  }
+  else {
+#ifndef CONFIG_SPIRAM_ALLOW_STACK_EXTERNAL_MEMORY
+    if (stack_placement == MemoryPlacement::spiram)
+    {
+      ESP_LOGW(
+        pid_str.c_str(),
+        "SPIRAM task stacks are not enabled, using internal RAM"
+      );
+      stack_placement = MemoryPlacement::internal;
+    }
+#endif // CONFIG_SPIRAM_ALLOW_STACK_EXTERNAL_MEMORY
+
+    // The task control block must always be in internal RAM
+    task_stack = static_cast<StackType_t*>(
+      placement_malloc(task_stack_size, stack_placement)
+    );
+    task_buffer = static_cast<StaticTask_t*>(
+      placement_malloc(sizeof(StaticTask_t), MemoryPlacement::internal)
+    );
+
+    if (task_stack and task_buffer)
+    {
+      impl = xTaskCreateStatic(
+        &process_task,
+        task_name,
+        task_stack_size,
+        task_user_data,
+        task_prio,
+        task_stack,
+        task_buffer
+      );
+    }
+    else {
+      ESP_LOGE(
+        pid_str.c_str(),
+        "Unable to allocate task stack (%s) or control block (internal)",
+        EnumNameMemoryPlacement(stack_placement)
+      );
+
+      placement_free(task_stack);
+      placement_free(task_buffer);
+      task_stack = nullptr;
+      task_buffer = nullptr;
+    }
+
+    started = (impl != nullptr);
   }
 }
 
@@ -91,6 +168,18 @@ Process::~Process()
     node.exit(pid, pid2, exit_reason);
   }
 
+  // Stop waiting on this mailbox before it is deleted
+  if (hosted)
+  {
+    node.get_process_host().release(mailbox);
+  }
+
+  // The task may be deleting itself, so its memory is freed later
+  if (task_stack or task_buffer)
+  {
+    node.release_task_memory(task_stack, task_buffer);
+  }
+
   // Stop the actor's execution context
   if (impl)
   {
@@ -145,6 +234,52 @@ auto Process::send(const MessageType type, const BufferView payload)
   return did_send;
 }
 
+auto Process::send(const MessageType type, const BufferViews payload_pieces)
+  -> bool
+{
+  auto did_send = mailbox.send(type, payload_pieces);
+  if (not did_send)
+  {
+    ESP_LOGE(
+      get_uuid_str(pid).c_str(),
+      "Unable to send message (%zu payload pieces)",
+      payload_pieces.size()
+    );
+  }
+  return did_send;
+}
+
+auto Process::send_typed(const MessageTypeId type_id, const BufferView value)
+  -> bool
+{
+  auto did_send = mailbox.send_typed(type_id, value);
+  if (not did_send)
+  {
+    ESP_LOGE(
+      get_uuid_str(pid).c_str(),
+      "Unable to send typed message (type id %u, size %zu)",
+      type_id,
+      value.size()
+    );
+  }
+  return did_send;
+}
+
+auto Process::send_record(const BufferView record)
+  -> bool
+{
+  auto did_send = mailbox.send_record(record);
+  if (not did_send)
+  {
+    ESP_LOGE(
+      get_uuid_str(pid).c_str(),
+      "Unable to send message (record size %zu)",
+      record.size()
+    );
+  }
+  return did_send;
+}
+
 auto Process::link(const Pid& pid2)
   -> bool
 {
@@ -166,6 +301,13 @@ auto Process::link(const Pid& pid2)
     }
   }
 
+  // The remote node creates the link from them to us
+  if (node.is_remote(pid2) and node.distribution->link(pid, pid2))
+  {
+    links.emplace(pid2);
+    return true;
+  }
+
   return false;
 }
 
@@ -190,6 +332,11 @@ auto Process::unlink(const Pid& pid2)
     }
   }
 
+  if (node.is_remote(pid2))
+  {
+    return (node.distribution->unlink(pid, pid2) and erased_ours);
+  }
+
   return false;
 }
 
@@ -224,6 +371,12 @@ auto Process::get_default_node()
   return default_node;
 }
 
+auto Process::get_calling_node()
+  -> Node&
+{
+  return calling_process? calling_process->get_current_node() : default_node;
+}
+
 auto Process::get_default_execution_config()
   -> const ProcessExecutionConfig&
 {
@@ -246,7 +399,12 @@ auto Process::get_default_execution_config()
 auto Process::_execute()
   -> ResultUnion
 {
+  auto* const previous_calling_process = calling_process;
+  calling_process = this;
+
   auto result = behaviour(pid, mailbox);
+  calling_process = previous_calling_process;
+
   if (result.type == Result::Error)
   {
     exit(result.reason);
@@ -102,6 +102,12 @@ protected:
     -> bool;
   auto send(const MessageType type, const BufferView payload)
     -> bool;
+  auto send(const MessageType type, const BufferViews payload_pieces)
+    -> bool;
+  auto send_typed(const MessageTypeId type_id, const BufferView value)
+    -> bool;
+  auto send_record(const BufferView record)
+    -> bool;
 
   const Pid pid;
 
@@ -124,6 +130,11 @@ protected:
 private:
   TaskHandle_t impl = nullptr;
   bool started = false;
+  bool hosted = false;
+
+  // Only set when the stack has a placement other than any
+  StackType_t* task_stack = nullptr;
+  StaticTask_t* task_buffer = nullptr;
 
   static flatbuffers::FlatBufferBuilder _default_execution_config_fbb;
   static const ProcessExecutionConfig* _default_execution_config;
@@ -133,6 +144,11 @@ public:
   static auto get_default_node()
     -> Node&;
 
+  // The node of the process running on the calling task,
+  // or the default node when called from outside any process
+  static auto get_calling_node()
+    -> Node&;
+
   static auto get_default_execution_config()
     -> const ProcessExecutionConfig&;
 };
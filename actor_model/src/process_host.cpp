@@ -0,0 +1,196 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "process_host.h"
+
+#include "mailbox.h"
+#include "node.h"
+#include "process.h"
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "process_host";
+
+void process_host_task(void* user_data = nullptr);
+
+ProcessHost::ProcessHost(
+  Node& _node,
+  const size_t _queue_set_length,
+  const size_t task_stack_size,
+  const int task_prio
+)
+: node(_node)
+, queue_set_length(_queue_set_length)
+, queue_set(xQueueCreateSet(_queue_set_length))
+, hosted_mailboxes_mutex(xSemaphoreCreateMutex())
+{
+  if (not queue_set or not hosted_mailboxes_mutex)
+  {
+    ESP_LOGE(TAG, "Unable to create queue set for hosted processes");
+    return;
+  }
+
+  auto* task_user_data = this;
+
+  auto retval = xTaskCreate(
+    &process_host_task,
+    "process_host",
+    task_stack_size,
+    task_user_data,
+    task_prio,
+    &impl
+  );
+
+  if (retval != pdPASS)
+  {
+    ESP_LOGE(TAG, "Unable to start process host task");
+  }
+}
+
+ProcessHost::~ProcessHost()
+{
+  if (impl)
+  {
+    vTaskDelete(impl);
+  }
+
+  if (hosted_mailboxes_mutex)
+  {
+    vSemaphoreDelete(hosted_mailboxes_mutex);
+  }
+
+  if (queue_set)
+  {
+    vQueueDelete(queue_set);
+  }
+}
+
+auto ProcessHost::adopt(const Pid& pid, Mailbox& mailbox)
+  -> bool
+{
+  if (not impl)
+  {
+    return false;
+  }
+
+  xSemaphoreTake(hosted_mailboxes_mutex, portMAX_DELAY);
+
+  // Each hosted mailbox can have at most one pending event in the queue set
+  auto adopted = false;
+  if (hosted_mailboxes.size() < queue_set_length)
+  {
+    adopted = mailbox.add_to_queue_set(queue_set);
+    if (adopted)
+    {
+      hosted_mailboxes.emplace(&mailbox, pid);
+    }
+  }
+
+  xSemaphoreGive(hosted_mailboxes_mutex);
+
+  if (not adopted)
+  {
+    ESP_LOGE(
+      TAG,
+      "Unable to host Pid %s (%zu of %zu hosted)",
+      get_uuid_str(pid).c_str(),
+      hosted_mailboxes.size(),
+      queue_set_length
+    );
+  }
+
+  return adopted;
+}
+
+auto ProcessHost::release(Mailbox& mailbox)
+  -> bool
+{
+  xSemaphoreTake(hosted_mailboxes_mutex, portMAX_DELAY);
+
+  auto erased = hosted_mailboxes.erase(&mailbox);
+  auto removed = (erased and mailbox.remove_from_queue_set(queue_set));
+
+  xSemaphoreGive(hosted_mailboxes_mutex);
+
+  if (erased and not removed)
+  {
+    // Pending events for this mailbox are ignored by find_hosted_pid
+    ESP_LOGW(TAG, "Released a hosted mailbox which was not empty");
+  }
+
+  return erased;
+}
+
+auto ProcessHost::find_hosted_pid(const QueueSetMemberHandle_t member)
+  -> MaybePid
+{
+  MaybePid hosted_pid;
+
+  xSemaphoreTake(hosted_mailboxes_mutex, portMAX_DELAY);
+
+  for (const auto& hosted_mailbox_iter : hosted_mailboxes)
+  {
+    if (hosted_mailbox_iter.first->is_queue_set_member(member))
+    {
+      hosted_pid = hosted_mailbox_iter.second;
+      break;
+    }
+  }
+
+  xSemaphoreGive(hosted_mailboxes_mutex);
+
+  return hosted_pid;
+}
+
+auto ProcessHost::_execute()
+  -> void
+{
+  while (true)
+  {
+    // Wait for any hosted mailbox to become readable
+    auto member = xQueueSelectFromSet(queue_set, portMAX_DELAY);
+    if (not member)
+    {
+      continue;
+    }
+
+    const auto& hosted_pid = find_hosted_pid(member);
+    if (not hosted_pid)
+    {
+      continue;
+    }
+
+    const auto& process_iter = node.process_registry.find(*hosted_pid);
+    if (
+      process_iter != node.process_registry.end()
+      and process_iter->second
+    )
+    {
+      // Runs the behaviour until the mailbox is drained,
+      // the process is terminated here if it returns an error
+      process_iter->second->_execute();
+    }
+  }
+}
+
+auto process_host_task(void* user_data)
+  -> void
+{
+  auto* process_host = static_cast<ProcessHost*>(user_data);
+
+  if (process_host != nullptr)
+  {
+    process_host->_execute();
+  }
+}
+
+} // namespace ActorModel
@@ -0,0 +1,68 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "pid.h"
+
+#include <unordered_map>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+namespace ActorModel {
+
+class Mailbox;
+class Node;
+
+// Single FreeRTOS task which runs the behaviours of "hosted" processes
+// (ProcessExecutionConfig.hosted), instead of one task per process.
+// Hosted behaviours must not block: they are called whenever their mailbox
+// becomes readable, drain it, and return
+class ProcessHost
+{
+public:
+  using HostedMailboxes = std::unordered_map<Mailbox*, Pid>;
+
+  explicit ProcessHost(
+    Node& _node,
+    const size_t _queue_set_length,
+    const size_t task_stack_size,
+    const int task_prio
+  );
+  ~ProcessHost();
+
+  auto adopt(const Pid& pid, Mailbox& mailbox)
+    -> bool;
+
+  auto release(Mailbox& mailbox)
+    -> bool;
+
+  auto _execute()
+    -> void;
+
+protected:
+  auto find_hosted_pid(const QueueSetMemberHandle_t member)
+    -> MaybePid;
+
+  Node& node;
+
+  HostedMailboxes hosted_mailboxes;
+  size_t queue_set_length;
+
+private:
+  QueueSetHandle_t queue_set = nullptr;
+  SemaphoreHandle_t hosted_mailboxes_mutex = nullptr;
+  TaskHandle_t impl = nullptr;
+};
+
+} // namespace ActorModel
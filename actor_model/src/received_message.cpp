@@ -10,6 +10,8 @@
 
 #include "received_message.h"
 
+#include "typed_message.h"
+
 namespace ActorModel {
 
 ReceivedMessage::ReceivedMessage(
@@ -23,8 +25,21 @@ ReceivedMessage::ReceivedMessage(
 {
   if (verify)
   {
-    flatbuffers::Verifier verifier(message.data(), message.size());
-    verified = VerifyMessageBuffer(verifier);
+    if (is_typed_message_record(message))
+    {
+      const auto* header = reinterpret_cast<const TypedMessageHeader*>(
+        message.data()
+      );
+      const auto* info = get_message_type_info(header->type_id);
+      verified = (
+        info
+        and (message.size() == sizeof(TypedMessageHeader) + info->payload_size)
+      );
+    }
+    else {
+      flatbuffers::Verifier verifier(message.data(), message.size());
+      verified = VerifyMessageBuffer(verifier);
+    }
   }
 }
 
@@ -45,4 +60,21 @@ auto ReceivedMessage::ref()
   return {};
 }
 
+auto ReceivedMessage::message()
+  -> const Message*
+{
+  const auto& _message = ref();
+  if (_message.empty())
+  {
+    return nullptr;
+  }
+
+  if (is_typed_message_record(_message))
+  {
+    return mailbox.get_typed_message_envelope(_message);
+  }
+
+  return flatbuffers::GetRoot<Message>(_message.data());
+}
+
 } // namespace ActorModel
@@ -38,6 +38,10 @@ public:
   auto ref()
     -> BufferView;
 
+  // Resolve the record as a Message, unpacking typed records if needed
+  auto message()
+    -> const Message*;
+
 protected:
   Mailbox& mailbox;
   const BufferView message;
@@ -0,0 +1,494 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "snapshot_store.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "snapshot_store";
+
+constexpr size_t SnapshotRtcMemorySize = ACTOR_MODEL_SNAPSHOT_RTC_MEMORY_SIZE;
+
+// Not cleared on reset, validated by the header crc instead
+RTC_NOINIT_ATTR uint64_t rtc_snapshot_memory[
+  SnapshotRtcMemorySize / sizeof(uint64_t)
+];
+
+auto get_snapshot_crc(const BufferView buf)
+  -> uint32_t;
+
+auto _snapshot_persist_timer_callback(TimerHandle_t timer_handle)
+  -> void;
+
+void snapshot_persist_task(void* user_data = nullptr);
+
+auto get_snapshot_crc(const BufferView buf)
+  -> uint32_t
+{
+  return esp_rom_crc32_le(0, buf.data(), buf.size());
+}
+
+auto _snapshot_persist_timer_callback(TimerHandle_t timer_handle)
+  -> void
+{
+  auto* snapshot_store = static_cast<SnapshotStore*>(
+    pvTimerGetTimerID(timer_handle)
+  );
+  snapshot_store->request_persist();
+}
+
+SnapshotStore::SnapshotStore(
+  const SnapshotStorage _storage,
+  const std::string_view _path,
+  const std::chrono::milliseconds _persist_interval,
+  const size_t task_stack_size,
+  const int task_prio
+)
+: storage(_storage)
+, path(_path)
+, persist_interval(_persist_interval)
+, snapshots_mutex(xSemaphoreCreateMutex())
+{
+  if (not snapshots_mutex)
+  {
+    ESP_LOGE(TAG, "Unable to create snapshot store");
+    return;
+  }
+
+  // The period is set each time the timer is started
+  auto is_recurring = false;
+  persist_timer = xTimerCreate(
+    "snapshots",
+    1,
+    is_recurring,
+    this,
+    _snapshot_persist_timer_callback
+  );
+
+  auto* task_user_data = this;
+
+  auto retval = xTaskCreate(
+    &snapshot_persist_task,
+    "snapshots",
+    task_stack_size,
+    task_user_data,
+    task_prio,
+    &impl
+  );
+
+  if (retval != pdPASS)
+  {
+    impl = nullptr;
+  }
+
+  if (not (persist_timer and impl))
+  {
+    ESP_LOGW(TAG, "Snapshots will be persisted on every change");
+  }
+
+  restore();
+  persisted_ticks = xTaskGetTickCount();
+}
+
+SnapshotStore::~SnapshotStore()
+{
+  if (persist_timer)
+  {
+    xTimerDelete(persist_timer, portMAX_DELAY);
+  }
+
+  if (impl)
+  {
+    // Not while the task is persisting
+    xSemaphoreTake(snapshots_mutex, portMAX_DELAY);
+    vTaskDelete(impl);
+    impl = nullptr;
+    xSemaphoreGive(snapshots_mutex);
+  }
+
+  if (snapshots_mutex)
+  {
+    vSemaphoreDelete(snapshots_mutex);
+  }
+}
+
+auto SnapshotStore::save(const std::string_view key, const BufferView snapshot)
+  -> bool
+{
+  if (not snapshots_mutex)
+  {
+    return false;
+  }
+
+  xSemaphoreTake(snapshots_mutex, portMAX_DELAY);
+
+  auto& stored_snapshot = snapshots[std::string{key}];
+  stored_snapshot.assign(snapshot.begin(), snapshot.end());
+
+  auto did_persist = mark_dirty();
+
+  xSemaphoreGive(snapshots_mutex);
+
+  return did_persist;
+}
+
+auto SnapshotStore::load(const std::string_view key)
+  -> SnapshotBuffer
+{
+  SnapshotBuffer snapshot;
+
+  if (snapshots_mutex)
+  {
+    xSemaphoreTake(snapshots_mutex, portMAX_DELAY);
+
+    const auto& snapshot_iter = snapshots.find(std::string{key});
+    if (snapshot_iter != snapshots.end())
+    {
+      snapshot = snapshot_iter->second;
+    }
+
+    xSemaphoreGive(snapshots_mutex);
+  }
+
+  return snapshot;
+}
+
+auto SnapshotStore::erase(const std::string_view key)
+  -> bool
+{
+  if (not snapshots_mutex)
+  {
+    return false;
+  }
+
+  xSemaphoreTake(snapshots_mutex, portMAX_DELAY);
+
+  // Otherwise an erased snapshot would be restored after a restart
+  auto erased = snapshots.erase(std::string{key});
+  if (erased)
+  {
+    mark_dirty();
+  }
+
+  xSemaphoreGive(snapshots_mutex);
+
+  return (erased == 1);
+}
+
+auto SnapshotStore::persist()
+  -> bool
+{
+  if (not snapshots_mutex)
+  {
+    return false;
+  }
+
+  xSemaphoreTake(snapshots_mutex, portMAX_DELAY);
+  auto did_persist = _persist();
+  xSemaphoreGive(snapshots_mutex);
+
+  return did_persist;
+}
+
+auto SnapshotStore::get_storage() const
+  -> SnapshotStorage
+{
+  return storage;
+}
+
+auto SnapshotStore::request_persist()
+  -> void
+{
+  if (impl)
+  {
+    xTaskNotifyGive(impl);
+  }
+}
+
+auto SnapshotStore::_execute()
+  -> void
+{
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    persist();
+  }
+}
+
+auto SnapshotStore::mark_dirty()
+  -> bool
+{
+  is_dirty = true;
+
+  // Rate-limit writes, the latest snapshots are persisted by the timer
+  const auto persist_interval_ticks = pdMS_TO_TICKS(persist_interval.count());
+  const auto elapsed_ticks = xTaskGetTickCount() - persisted_ticks;
+  if (
+    elapsed_ticks >= persist_interval_ticks
+    or not (persist_timer and impl)
+  )
+  {
+    return _persist();
+  }
+
+  // Already started by an earlier change
+  if (xTimerIsTimerActive(persist_timer) == pdFALSE)
+  {
+    // Starts the timer, which cannot be for 0 ticks
+    const auto remaining_ticks = std::max<TickType_t>(
+      persist_interval_ticks - elapsed_ticks,
+      1
+    );
+    if (xTimerChangePeriod(persist_timer, remaining_ticks, 0) != pdPASS)
+    {
+      ESP_LOGW(TAG, "Unable to start snapshot persist timer");
+    }
+  }
+
+  return true;
+}
+
+auto SnapshotStore::restore()
+  -> bool
+{
+  if (storage == SnapshotStorage::rtc_memory)
+  {
+    return restore(BufferView{
+      reinterpret_cast<const uint8_t*>(rtc_snapshot_memory),
+      sizeof(rtc_snapshot_memory)
+    });
+  }
+
+  // Fall back to the temporary file, if interrupted while replacing
+  for (const auto& restore_path : {path, path + ".tmp"})
+  {
+    auto* file = fopen(restore_path.c_str(), "rb");
+    if (not file)
+    {
+      continue;
+    }
+
+    std::vector<uint8_t> persisted;
+
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+      const auto file_size = ftell(file);
+      if (file_size > 0 and fseek(file, 0, SEEK_SET) == 0)
+      {
+        persisted.resize(file_size);
+        if (fread(persisted.data(), 1, persisted.size(), file) != persisted.size())
+        {
+          persisted.clear();
+        }
+      }
+    }
+    fclose(file);
+
+    if (restore(BufferView{persisted}))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+auto SnapshotStore::restore(const BufferView persisted)
+  -> bool
+{
+  if (persisted.size() < sizeof(SnapshotHeader))
+  {
+    return false;
+  }
+
+  SnapshotHeader header;
+  memcpy(&header, persisted.data(), sizeof(header));
+
+  if (
+    memcmp(header.identifier, SnapshotIdentifier, sizeof(header.identifier)) != 0
+    or header.version != SnapshotVersion
+    or header.size > persisted.size() - sizeof(header)
+  )
+  {
+    // e.g. RTC memory after power-on
+    ESP_LOGI(TAG, "No snapshots to restore");
+    return false;
+  }
+
+  const auto snapshots_buf = persisted.subspan(sizeof(header), header.size);
+  if (get_snapshot_crc(snapshots_buf) != header.crc)
+  {
+    ESP_LOGW(TAG, "Discarding corrupt snapshots");
+    return false;
+  }
+
+  flatbuffers::Verifier verifier(snapshots_buf.data(), snapshots_buf.size());
+  if (not verifier.VerifyBuffer<Snapshots>(nullptr))
+  {
+    ESP_LOGW(TAG, "Discarding invalid snapshots");
+    return false;
+  }
+
+  const auto* persisted_snapshots = flatbuffers::GetRoot<Snapshots>(
+    snapshots_buf.data()
+  );
+
+  if (persisted_snapshots->snapshots())
+  {
+    for (const auto* snapshot : *(persisted_snapshots->snapshots()))
+    {
+      auto& stored_snapshot = snapshots[snapshot->key()->str()];
+      if (snapshot->data())
+      {
+        stored_snapshot.assign(
+          snapshot->data()->begin(),
+          snapshot->data()->end()
+        );
+      }
+    }
+  }
+
+  ESP_LOGI(TAG, "Restored %zu snapshots", snapshots.size());
+  return true;
+}
+
+auto SnapshotStore::_persist()
+  -> bool
+{
+  if (not is_dirty)
+  {
+    return true;
+  }
+
+  flatbuffers::FlatBufferBuilder fbb;
+
+  std::vector<flatbuffers::Offset<Snapshot>> snapshot_offsets;
+  snapshot_offsets.reserve(snapshots.size());
+
+  for (const auto& snapshot_iter : snapshots)
+  {
+    snapshot_offsets.emplace_back(CreateSnapshot(
+      fbb,
+      fbb.CreateString(snapshot_iter.first),
+      fbb.CreateVector(snapshot_iter.second)
+    ));
+  }
+
+  fbb.Finish(CreateSnapshots(fbb, fbb.CreateVector(snapshot_offsets)));
+
+  const auto snapshots_buf = BufferView{
+    fbb.GetBufferPointer(),
+    fbb.GetSize()
+  };
+
+  SnapshotHeader header;
+  memcpy(header.identifier, SnapshotIdentifier, sizeof(header.identifier));
+  header.version = SnapshotVersion;
+  header.size = static_cast<uint32_t>(snapshots_buf.size());
+  header.crc = get_snapshot_crc(snapshots_buf);
+
+  std::vector<uint8_t> persisted(sizeof(header) + snapshots_buf.size());
+  memcpy(persisted.data(), &header, sizeof(header));
+  memcpy(
+    persisted.data() + sizeof(header),
+    snapshots_buf.data(),
+    snapshots_buf.size()
+  );
+
+  const auto did_persist = (
+    (storage == SnapshotStorage::rtc_memory)?
+      write_rtc_memory(BufferView{persisted})
+      : write_file(BufferView{persisted})
+  );
+
+  if (did_persist)
+  {
+    is_dirty = false;
+    persisted_ticks = xTaskGetTickCount();
+  }
+
+  return did_persist;
+}
+
+auto SnapshotStore::write_rtc_memory(const BufferView persisted)
+  -> bool
+{
+  if (persisted.size() > sizeof(rtc_snapshot_memory))
+  {
+    ESP_LOGE(
+      TAG,
+      "Snapshots (%zu bytes) exceed RTC memory (%zu bytes)",
+      persisted.size(),
+      sizeof(rtc_snapshot_memory)
+    );
+    return false;
+  }
+
+  // A reset part-way through leaves a crc mismatch, not a partial restore
+  memcpy(rtc_snapshot_memory, persisted.data(), persisted.size());
+  return true;
+}
+
+auto SnapshotStore::write_file(const BufferView persisted)
+  -> bool
+{
+  // Replace the previous snapshots only once these are fully written
+  const auto tmp_path = path + ".tmp";
+
+  auto* file = fopen(tmp_path.c_str(), "wb");
+  if (not file)
+  {
+    ESP_LOGE(TAG, "Unable to open '%s' for snapshots", tmp_path.c_str());
+    return false;
+  }
+
+  auto did_write = (
+    fwrite(persisted.data(), 1, persisted.size(), file) == persisted.size()
+  );
+  did_write = ((fclose(file) == 0) and did_write);
+
+  if (not did_write)
+  {
+    ESP_LOGE(TAG, "Unable to write snapshots (%zu bytes)", persisted.size());
+    return false;
+  }
+
+  // FATFS cannot rename over an existing file
+  remove(path.c_str());
+  if (rename(tmp_path.c_str(), path.c_str()) != 0)
+  {
+    ESP_LOGE(TAG, "Unable to replace '%s'", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+auto snapshot_persist_task(void* user_data)
+  -> void
+{
+  auto* snapshot_store = static_cast<SnapshotStore*>(user_data);
+
+  if (snapshot_store != nullptr)
+  {
+    snapshot_store->_execute();
+  }
+}
+
+} // namespace ActorModel
@@ -0,0 +1,138 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "actor_model_generated.h"
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+namespace ActorModel {
+
+using BufferView = std::span<const uint8_t>;
+using SnapshotBuffer = std::vector<uint8_t>;
+
+enum class SnapshotStorage : uint8_t
+{
+  // Survives software resets and panics, but not power loss
+  rtc_memory,
+  // Survives power loss, at the cost of a flash write per persist
+  file,
+};
+
+constexpr char SnapshotIdentifier[4] = {'S', 'n', 'p', '!'};
+constexpr uint32_t SnapshotVersion = 1;
+
+// Persisted snapshots are a SnapshotHeader, followed by a Snapshots
+// flatbuffer of size bytes
+struct SnapshotHeader
+{
+  char identifier[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t crc;
+};
+
+static_assert(sizeof(SnapshotHeader) == 16);
+
+// Keeps the latest snapshot of each opted-in process' state, by a key
+// which is stable across reboots (unlike its Pid), and persists them
+// to RTC memory or a file so a respawned process can load its state
+// instead of rebuilding it. Snapshot contents are opaque, typically a
+// flatbuffer serialized by the behaviour
+class SnapshotStore
+{
+public:
+  using Snapshots = std::unordered_map<std::string, SnapshotBuffer>;
+
+  // Snapshots persisted by a previous boot are restored, and changes are
+  // persisted at most once per persist_interval (0 for on every change).
+  // A timer started on the first change since the last persist wakes the
+  // store's own task to persist them, keeping file writes off the timer
+  // service task
+  explicit SnapshotStore(
+    const SnapshotStorage _storage,
+    const std::string_view _path,
+    const std::chrono::milliseconds _persist_interval,
+    const size_t task_stack_size,
+    const int task_prio
+  );
+  ~SnapshotStore();
+
+  auto save(const std::string_view key, const BufferView snapshot)
+    -> bool;
+
+  // Empty if there is no snapshot for key
+  auto load(const std::string_view key)
+    -> SnapshotBuffer;
+
+  auto erase(const std::string_view key)
+    -> bool;
+
+  // Write any unpersisted snapshots, e.g. before restarting
+  auto persist()
+    -> bool;
+
+  auto get_storage() const
+    -> SnapshotStorage;
+
+  // Wake the store's task to persist, e.g. from the timer service task
+  auto request_persist()
+    -> void;
+
+  auto _execute()
+    -> void;
+
+protected:
+  // Persist now if the interval has passed, otherwise once it has
+  auto mark_dirty()
+    -> bool;
+
+  auto restore()
+    -> bool;
+
+  auto restore(const BufferView persisted)
+    -> bool;
+
+  auto _persist()
+    -> bool;
+
+  auto write_rtc_memory(const BufferView persisted)
+    -> bool;
+
+  auto write_file(const BufferView persisted)
+    -> bool;
+
+private:
+  const SnapshotStorage storage;
+  const std::string path;
+  const std::chrono::milliseconds persist_interval;
+
+  Snapshots snapshots;
+  SemaphoreHandle_t snapshots_mutex = nullptr;
+
+  bool is_dirty = false;
+  TickType_t persisted_ticks = 0;
+  TimerHandle_t persist_timer = nullptr;
+  TaskHandle_t impl = nullptr;
+};
+
+} // namespace ActorModel
@@ -0,0 +1,369 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "socket_reactor.h"
+
+#include "node.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "lwip/sockets.h"
+
+#include "esp_log.h"
+#include "esp_vfs_eventfd.h"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace ActorModel {
+
+constexpr char TAG[] = "socket_reactor";
+
+void socket_reactor_task(void* user_data = nullptr);
+
+template<typename T>
+auto send_socket_event(Node& node, const Pid& pid, const T& event)
+  -> bool;
+
+template<typename T>
+auto send_socket_event(Node& node, const Pid& pid, const T& event)
+  -> bool
+{
+  static_cast<void>(message_type_registered<T>);
+
+  return node.send_typed(
+    pid,
+    message_type_id<T>,
+    BufferView{
+      reinterpret_cast<const uint8_t*>(&event),
+      typed_message_payload_size<T>
+    }
+  );
+}
+
+SocketReactor::SocketReactor(
+  Node& _node,
+  const size_t task_stack_size,
+  const int task_prio
+)
+: node(_node)
+, watches_mutex(xSemaphoreCreateMutex())
+{
+  // Already registered is fine, e.g. by the application
+  esp_vfs_eventfd_config_t eventfd_config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  auto err = esp_vfs_eventfd_register(&eventfd_config);
+  if (err != ESP_OK and err != ESP_ERR_INVALID_STATE)
+  {
+    ESP_LOGE(TAG, "Unable to register eventfd: %d", err);
+    return;
+  }
+
+  wake_fd = eventfd(0, 0);
+  if (wake_fd < 0 or not watches_mutex)
+  {
+    ESP_LOGE(TAG, "Unable to create socket reactor");
+    return;
+  }
+
+  auto* task_user_data = this;
+
+  auto retval = xTaskCreate(
+    &socket_reactor_task,
+    "socket_reactor",
+    task_stack_size,
+    task_user_data,
+    task_prio,
+    &impl
+  );
+
+  if (retval != pdPASS)
+  {
+    ESP_LOGE(TAG, "Unable to start socket reactor task");
+    impl = nullptr;
+  }
+}
+
+SocketReactor::~SocketReactor()
+{
+  if (impl)
+  {
+    vTaskDelete(impl);
+  }
+
+  if (wake_fd >= 0)
+  {
+    close(wake_fd);
+  }
+
+  if (watches_mutex)
+  {
+    vSemaphoreDelete(watches_mutex);
+  }
+}
+
+auto SocketReactor::watch(const Pid& pid, const int fd, const uint8_t interests)
+  -> bool
+{
+  if (not impl or fd < 0 or fd >= FD_SETSIZE)
+  {
+    return false;
+  }
+
+  xSemaphoreTake(watches_mutex, portMAX_DELAY);
+
+  // Interests are added to any still pending for the same process
+  auto& watch = watches[fd];
+  if (not compare_uuids(watch.pid, pid))
+  {
+    watch = Watch{pid, 0};
+  }
+  watch.interests |= interests;
+
+  xSemaphoreGive(watches_mutex);
+
+  wake();
+  return true;
+}
+
+auto SocketReactor::unwatch(const int fd)
+  -> bool
+{
+  xSemaphoreTake(watches_mutex, portMAX_DELAY);
+  auto erased = watches.erase(fd);
+  xSemaphoreGive(watches_mutex);
+
+  // Must not be selected on after the caller closes it
+  if (erased)
+  {
+    wake();
+  }
+
+  return (erased == 1);
+}
+
+auto SocketReactor::wake()
+  -> void
+{
+  uint64_t count = 1;
+  write(wake_fd, &count, sizeof(count));
+}
+
+auto SocketReactor::notify(const Pid& pid, const int fd, const uint8_t events)
+  -> uint8_t
+{
+  uint8_t unsent_events = 0;
+
+  if (
+    (events & SocketInterestAcceptable)
+    and not send_socket_event(node, pid, SocketAcceptable{fd})
+  )
+  {
+    unsent_events |= SocketInterestAcceptable;
+  }
+
+  if (
+    (events & SocketInterestReadable)
+    and not send_socket_event(node, pid, SocketReadable{fd})
+  )
+  {
+    unsent_events |= SocketInterestReadable;
+  }
+
+  if (
+    (events & SocketInterestWritable)
+    and not send_socket_event(node, pid, SocketWritable{fd})
+  )
+  {
+    unsent_events |= SocketInterestWritable;
+  }
+
+  return unsent_events;
+}
+
+auto SocketReactor::rearm(
+  const Pid& pid,
+  const int fd,
+  const uint8_t events
+) -> bool
+{
+  auto did_rearm = false;
+
+  xSemaphoreTake(watches_mutex, portMAX_DELAY);
+
+  // Unless the socket was unwatched, or watched by another process, since
+  auto watch_iter = watches.find(fd);
+  if (
+    watch_iter != watches.end()
+    and compare_uuids(watch_iter->second.pid, pid)
+  )
+  {
+    watch_iter->second.interests |= events;
+    did_rearm = true;
+  }
+
+  xSemaphoreGive(watches_mutex);
+
+  return did_rearm;
+}
+
+auto SocketReactor::_execute()
+  -> void
+{
+  struct ReadyWatch
+  {
+    int fd;
+    Pid pid;
+    uint8_t events;
+  };
+
+  std::vector<ReadyWatch> ready_watches;
+
+  while (true)
+  {
+    fd_set read_fds;
+    fd_set write_fds;
+    FD_ZERO(&read_fds);
+    FD_ZERO(&write_fds);
+
+    FD_SET(wake_fd, &read_fds);
+    auto max_fd = wake_fd;
+
+    xSemaphoreTake(watches_mutex, portMAX_DELAY);
+    for (const auto& watch_iter : watches)
+    {
+      const auto fd = watch_iter.first;
+      const auto interests = watch_iter.second.interests;
+
+      if (interests & (SocketInterestReadable | SocketInterestAcceptable))
+      {
+        FD_SET(fd, &read_fds);
+        max_fd = std::max(max_fd, fd);
+      }
+
+      if (interests & SocketInterestWritable)
+      {
+        FD_SET(fd, &write_fds);
+        max_fd = std::max(max_fd, fd);
+      }
+    }
+    xSemaphoreGive(watches_mutex);
+
+    // Sleep until a socket is ready, or the watches change
+    auto ret = select(max_fd + 1, &read_fds, &write_fds, nullptr, nullptr);
+    if (ret < 0)
+    {
+      if (errno == EBADF)
+      {
+        // A watched socket was closed without being unwatched
+        xSemaphoreTake(watches_mutex, portMAX_DELAY);
+        for (auto i = watches.begin(), end = watches.end(); i != end;)
+        {
+          if (fcntl(i->first, F_GETFL) == -1)
+          {
+            ESP_LOGW(TAG, "Unwatched closed socket %d", i->first);
+            i = watches.erase(i);
+          }
+          else {
+            ++i;
+          }
+        }
+        xSemaphoreGive(watches_mutex);
+      }
+
+      continue;
+    }
+
+    if (FD_ISSET(wake_fd, &read_fds))
+    {
+      uint64_t count = 0;
+      read(wake_fd, &count, sizeof(count));
+    }
+
+    // Disarm the interests which fired, before notifying
+    ready_watches.clear();
+
+    xSemaphoreTake(watches_mutex, portMAX_DELAY);
+    for (auto& watch_iter : watches)
+    {
+      const auto fd = watch_iter.first;
+      auto& watch = watch_iter.second;
+
+      uint8_t events = 0;
+      if (FD_ISSET(fd, &read_fds))
+      {
+        events |= (
+          watch.interests
+          & (SocketInterestReadable | SocketInterestAcceptable)
+        );
+      }
+
+      if (FD_ISSET(fd, &write_fds))
+      {
+        events |= (watch.interests & SocketInterestWritable);
+      }
+
+      if (events)
+      {
+        watch.interests &= ~events;
+        ready_watches.emplace_back(ReadyWatch{fd, watch.pid, events});
+      }
+    }
+    xSemaphoreGive(watches_mutex);
+
+    auto did_rearm = false;
+    for (const auto& ready_watch : ready_watches)
+    {
+      const auto unsent_events = notify(
+        ready_watch.pid,
+        ready_watch.fd,
+        ready_watch.events
+      );
+
+      if (unsent_events)
+      {
+        if (node.is_reachable(ready_watch.pid))
+        {
+          // e.g. a full mailbox, retried on the next select pass
+          did_rearm = (
+            rearm(ready_watch.pid, ready_watch.fd, unsent_events)
+            or did_rearm
+          );
+        }
+        else {
+          // The watching process has exited
+          ESP_LOGW(TAG, "Unwatched socket %d of exited process", ready_watch.fd);
+          unwatch(ready_watch.fd);
+        }
+      }
+    }
+
+    // Give the watching processes time to receive, as the sockets are
+    // still ready and select() will return immediately
+    if (did_rearm)
+    {
+      vTaskDelay(1);
+    }
+  }
+}
+
+auto socket_reactor_task(void* user_data)
+  -> void
+{
+  auto* socket_reactor = static_cast<SocketReactor*>(user_data);
+
+  if (socket_reactor != nullptr)
+  {
+    socket_reactor->_execute();
+  }
+}
+
+} // namespace ActorModel
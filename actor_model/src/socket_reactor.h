@@ -0,0 +1,124 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "pid.h"
+#include "typed_message.h"
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+namespace ActorModel {
+
+class Node;
+
+enum SocketInterest : uint8_t
+{
+  SocketInterestReadable = (1 << 0),
+  SocketInterestWritable = (1 << 1),
+  // Readable, for a listening socket
+  SocketInterestAcceptable = (1 << 2),
+};
+
+// Sent to the watching process when a watched socket becomes ready
+struct SocketReadable
+{
+  int fd;
+};
+
+template<>
+struct MessageTraits<SocketReadable>
+{
+  static constexpr MessageType type = "readable";
+};
+
+struct SocketWritable
+{
+  int fd;
+};
+
+template<>
+struct MessageTraits<SocketWritable>
+{
+  static constexpr MessageType type = "writable";
+};
+
+struct SocketAcceptable
+{
+  int fd;
+};
+
+template<>
+struct MessageTraits<SocketAcceptable>
+{
+  static constexpr MessageType type = "acceptable";
+};
+
+// Single FreeRTOS task which select()s over the sockets watched by all
+// processes, and sends them "readable"/"writable"/"acceptable" messages.
+// Interest is one-shot: once an event is sent, the process must watch
+// the socket again (after draining it) to receive the next one
+class SocketReactor
+{
+public:
+  struct Watch
+  {
+    Pid pid;
+    uint8_t interests;
+  };
+
+  using Watches = std::unordered_map<int, Watch>;
+
+  explicit SocketReactor(
+    Node& _node,
+    const size_t task_stack_size,
+    const int task_prio
+  );
+  ~SocketReactor();
+
+  auto watch(const Pid& pid, const int fd, const uint8_t interests)
+    -> bool;
+
+  auto unwatch(const int fd)
+    -> bool;
+
+  auto _execute()
+    -> void;
+
+protected:
+  auto wake()
+    -> void;
+
+  // The events which could not be sent
+  auto notify(const Pid& pid, const int fd, const uint8_t events)
+    -> uint8_t;
+
+  // Restores interest in events, if pid still watches fd
+  auto rearm(const Pid& pid, const int fd, const uint8_t events)
+    -> bool;
+
+  Node& node;
+
+private:
+  Watches watches;
+  SemaphoreHandle_t watches_mutex = nullptr;
+
+  // Written to interrupt select() when watches change
+  int wake_fd = -1;
+
+  TaskHandle_t impl = nullptr;
+};
+
+} // namespace ActorModel
@@ -0,0 +1,98 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "typed_message.h"
+
+#include <unordered_map>
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "typed_message";
+
+using TypedMessageRegistry = std::unordered_map<
+  MessageTypeId,
+  TypedMessageInfo
+>;
+
+// Constructed on first use, since registration happens during static init
+static auto get_typed_message_registry()
+  -> TypedMessageRegistry&
+{
+  static TypedMessageRegistry typed_message_registry;
+  return typed_message_registry;
+}
+
+auto register_message_type(
+  const MessageType type,
+  const size_t payload_size,
+  const size_t payload_alignment
+) -> bool
+{
+  auto& typed_message_registry = get_typed_message_registry();
+  const auto type_id = get_message_type_id(type);
+
+  const auto& inserted = typed_message_registry.emplace(
+    type_id,
+    TypedMessageInfo{type, payload_size, payload_alignment}
+  );
+
+  if (not inserted.second)
+  {
+    const auto& existing = inserted.first->second;
+    if (
+      existing.type != type
+      or existing.payload_size != payload_size
+    )
+    {
+      ESP_LOGE(
+        TAG,
+        "Message type id collision for '%.*s' (already '%.*s')",
+        static_cast<int>(type.size()),
+        type.data(),
+        static_cast<int>(existing.type.size()),
+        existing.type.data()
+      );
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+auto get_message_type_info(const MessageTypeId type_id)
+  -> const TypedMessageInfo*
+{
+  const auto& typed_message_registry = get_typed_message_registry();
+
+  const auto& info_iter = typed_message_registry.find(type_id);
+  if (info_iter != typed_message_registry.end())
+  {
+    return &(info_iter->second);
+  }
+
+  return nullptr;
+}
+
+auto is_typed_message_record(const BufferView record)
+  -> bool
+{
+  return (
+    record.size() >= sizeof(TypedMessageHeader)
+    and flatbuffers::BufferHasIdentifier(
+      record.data(),
+      TypedMessageIdentifier
+    )
+  );
+}
+
+} // namespace ActorModel
@@ -0,0 +1,117 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "actor_model_generated.h"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+namespace ActorModel {
+using MessageType = std::string_view;
+using MessageTypeId = uint32_t;
+using BufferView = std::span<const uint8_t>;
+
+constexpr MessageTypeId NullMessageTypeId = 0;
+
+// Typed records place this in the same slot as a flatbuffer file identifier,
+// so they can be told apart from Message flatbuffers ("Act!") in a mailbox
+constexpr char TypedMessageIdentifier[] = "Typ!";
+
+// Specialize for each trivially-copyable type to be sent as a typed message:
+//
+// struct Tick {};
+// template<> struct MessageTraits<Tick>
+// {
+//   static constexpr MessageType type = "tick";
+// };
+template<typename T>
+struct MessageTraits;
+
+// Fixed-size header preceding the raw value bytes of a typed record, which
+// (unlike a Message flatbuffer) has no timestamp or from_pid
+struct TypedMessageHeader
+{
+  MessageTypeId type_id;
+  char identifier[flatbuffers::kFileIdentifierLength];
+};
+
+static_assert(sizeof(TypedMessageHeader) == 8, "Unexpected typed header size");
+
+struct TypedMessageInfo
+{
+  MessageType type;
+  size_t payload_size = 0;
+  size_t payload_alignment = sizeof(uint8_t);
+};
+
+// 32-bit FNV-1a hash of the type name, never equal to NullMessageTypeId
+constexpr auto get_message_type_id(const MessageType type)
+  -> MessageTypeId
+{
+  MessageTypeId hash = 2166136261u;
+  for (const auto c : type)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+
+  return (hash == NullMessageTypeId)? 1 : hash;
+}
+
+template<typename T, class = void>
+struct is_typed_message
+: std::false_type
+{};
+
+template<typename T>
+struct is_typed_message<T, std::void_t<decltype(MessageTraits<T>::type)>>
+: std::bool_constant<std::is_trivially_copyable_v<T>>
+{};
+
+template<typename T>
+constexpr bool is_typed_message_v = is_typed_message<T>::value;
+
+// Empty tag types (e.g. struct Tick {}) carry no payload bytes at all
+template<typename T>
+constexpr size_t typed_message_payload_size = (
+  std::is_empty_v<T>? 0 : sizeof(T)
+);
+
+template<typename T>
+constexpr MessageTypeId message_type_id = get_message_type_id(
+  MessageTraits<T>::type
+);
+
+auto register_message_type(
+  const MessageType type,
+  const size_t payload_size,
+  const size_t payload_alignment
+) -> bool;
+
+auto get_message_type_info(const MessageTypeId type_id)
+  -> const TypedMessageInfo*;
+
+auto is_typed_message_record(const BufferView record)
+  -> bool;
+
+// Instantiated (and registered during static init) by any use of send<T>
+// or matches<T>
+template<typename T>
+inline const bool message_type_registered = register_message_type(
+  MessageTraits<T>::type,
+  typed_message_payload_size<T>,
+  alignof(T)
+);
+
+} // namespace ActorModel
@@ -0,0 +1,266 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "worker_pool.h"
+
+#include "actor.h"
+#include "actor_model.h"
+
+#include <algorithm>
+
+#include "esp_log.h"
+
+namespace ActorModel {
+
+constexpr char TAG[] = "worker_pool";
+
+WorkerPool::WorkerPool(
+  const ActorBehaviour&& _actor_behaviour,
+  const size_t _min_workers,
+  const size_t _max_workers,
+  const ExecConfigCallback&& _exec_config_callback
+)
+: actor_behaviour(std::move(_actor_behaviour))
+, exec_config_callback(std::move(_exec_config_callback))
+, min_workers(_min_workers)
+, max_workers(std::max(_min_workers, _max_workers))
+, workers_mutex(xSemaphoreCreateMutex())
+{
+  idle_workers.reserve(max_workers);
+
+  // Pay the spawn cost up front
+  for (size_t i = 0; i < min_workers; ++i)
+  {
+    idle_workers.emplace_back(spawn_worker());
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  for (const auto& pid : idle_workers)
+  {
+    exit_worker(pid);
+  }
+
+  for (const auto& pid : leased_workers)
+  {
+    exit_worker(pid);
+  }
+
+  if (workers_mutex)
+  {
+    vSemaphoreDelete(workers_mutex);
+  }
+}
+
+auto WorkerPool::lease()
+  -> MaybePid
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+
+  auto pid = MaybePid{};
+  if (not idle_workers.empty())
+  {
+    pid = idle_workers.back();
+    idle_workers.pop_back();
+
+    leased_workers.emplace(*(pid));
+  }
+  else if ((leased_workers.size() + spawning_count) < max_workers)
+  {
+    // Spawning waits for the new task, other leases and releases need not
+    spawning_count++;
+    xSemaphoreGive(workers_mutex);
+
+    pid = spawn_worker();
+
+    xSemaphoreTake(workers_mutex, portMAX_DELAY);
+    spawning_count--;
+
+    leased_workers.emplace(*(pid));
+  }
+
+  xSemaphoreGive(workers_mutex);
+
+  if (not pid)
+  {
+    ESP_LOGW(TAG, "No worker available (%zu leased)", get_leased_count());
+  }
+
+  return pid;
+}
+
+auto WorkerPool::release(const Pid& pid)
+  -> bool
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+
+  if (leased_workers.erase(pid) == 0)
+  {
+    xSemaphoreGive(workers_mutex);
+    return false;
+  }
+
+  // Queued behind any messages sent during the lease
+  auto did_reset = send(pid, WorkerResetMessageType);
+
+  auto is_returned = false;
+  if (
+    did_reset
+    and (idle_workers.size() + leased_workers.size()) < max_workers
+  )
+  {
+    idle_workers.emplace_back(pid);
+    is_returned = true;
+  }
+
+  xSemaphoreGive(workers_mutex);
+
+  if (not is_returned)
+  {
+    // The pool was shrunk during the lease, or the worker is gone
+    exit_worker(pid);
+  }
+
+  return is_returned;
+}
+
+auto WorkerPool::resize(const size_t _min_workers, const size_t _max_workers)
+  -> void
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+
+  min_workers = _min_workers;
+  max_workers = std::max(_min_workers, _max_workers);
+
+  const auto worker_count = (
+    idle_workers.size() + leased_workers.size() + spawning_count
+  );
+  const auto spawn_count = (
+    (worker_count < min_workers)? (min_workers - worker_count) : 0
+  );
+  spawning_count += spawn_count;
+
+  _trim(max_workers);
+
+  xSemaphoreGive(workers_mutex);
+
+  // Spawned without workers_mutex held, as in lease()
+  WorkerList spawned_workers;
+  spawned_workers.reserve(spawn_count);
+  for (size_t i = 0; i < spawn_count; ++i)
+  {
+    spawned_workers.emplace_back(spawn_worker());
+  }
+
+  if (spawn_count > 0)
+  {
+    xSemaphoreTake(workers_mutex, portMAX_DELAY);
+    spawning_count -= spawn_count;
+    idle_workers.insert(
+      idle_workers.end(),
+      spawned_workers.begin(),
+      spawned_workers.end()
+    );
+    xSemaphoreGive(workers_mutex);
+  }
+}
+
+auto WorkerPool::trim()
+  -> size_t
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+  auto trimmed_count = _trim(min_workers);
+  xSemaphoreGive(workers_mutex);
+
+  return trimmed_count;
+}
+
+auto WorkerPool::_trim(const size_t worker_count)
+  -> size_t
+{
+  size_t trimmed_count = 0;
+
+  // Least recently used first
+  while (
+    not idle_workers.empty()
+    and (idle_workers.size() + leased_workers.size()) > worker_count
+  )
+  {
+    exit_worker(idle_workers.front());
+    idle_workers.erase(idle_workers.begin());
+    trimmed_count++;
+  }
+
+  return trimmed_count;
+}
+
+auto WorkerPool::get_worker_count() const
+  -> size_t
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+  auto worker_count = idle_workers.size() + leased_workers.size();
+  xSemaphoreGive(workers_mutex);
+
+  return worker_count;
+}
+
+auto WorkerPool::get_idle_count() const
+  -> size_t
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+  auto idle_count = idle_workers.size();
+  xSemaphoreGive(workers_mutex);
+
+  return idle_count;
+}
+
+auto WorkerPool::get_leased_count() const
+  -> size_t
+{
+  xSemaphoreTake(workers_mutex, portMAX_DELAY);
+  auto leased_count = leased_workers.size();
+  xSemaphoreGive(workers_mutex);
+
+  return leased_count;
+}
+
+auto WorkerPool::spawn_worker()
+  -> Pid
+{
+  auto worker_behaviour = ActorBehaviour{
+    [actor_behaviour{actor_behaviour}]
+    (const Pid& self, StatePtr& state, const Message& message)
+      -> ResultUnion
+    {
+      if (matches(message, WorkerResetMessageType))
+      {
+        state.reset();
+        return {Result::Ok};
+      }
+
+      return actor_behaviour(self, state, message);
+    }
+  };
+
+  return spawn(
+    std::move(worker_behaviour),
+    ExecConfigCallback{exec_config_callback}
+  );
+}
+
+auto WorkerPool::exit_worker(const Pid& pid)
+  -> void
+{
+  // Workers may trap exits, they are not reused so kill unconditionally
+  exit(pid, pid, "kill");
+}
+
+} // namespace ActorModel
@@ -0,0 +1,106 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "behaviour.h"
+#include "node.h"
+#include "pid.h"
+
+#include <unordered_set>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace ActorModel {
+
+// Sent to a worker when it is released, its behaviour state is discarded
+// so the next lease starts fresh
+constexpr char WorkerResetMessageType[] = "worker_reset";
+
+// A set of processes pre-spawned with the same behaviour, which are leased
+// out (e.g. per request or per connection) and returned instead of being
+// spawned and exited each time.
+// The pool grows on demand up to max_workers, and trim() exits idle
+// workers down to min_workers
+class WorkerPool
+{
+public:
+  using WorkerList = std::vector<Pid>;
+  using LeasedWorkers = std::unordered_set<
+    Pid,
+    UUID::UUIDHashFunc,
+    UUID::UUIDEqualFunc
+  >;
+
+  explicit WorkerPool(
+    const ActorBehaviour&& _actor_behaviour,
+    const size_t _min_workers,
+    const size_t _max_workers,
+    const ExecConfigCallback&& _exec_config_callback = nullptr
+  );
+  ~WorkerPool();
+
+  // An idle worker, or a newly spawned one if all are leased and the pool
+  // is below max_workers
+  auto lease()
+    -> MaybePid;
+
+  // The worker's state is reset before it handles the next lease's messages.
+  // A worker which can not be reset (e.g. it has exited) leaves the pool
+  auto release(const Pid& pid)
+    -> bool;
+
+  // Spawns up to the new min_workers, idle workers above max_workers exit
+  auto resize(const size_t _min_workers, const size_t _max_workers)
+    -> void;
+
+  // Exit idle workers above min_workers, returns the number exited
+  auto trim()
+    -> size_t;
+
+  auto get_worker_count() const
+    -> size_t;
+
+  auto get_idle_count() const
+    -> size_t;
+
+  auto get_leased_count() const
+    -> size_t;
+
+protected:
+  auto spawn_worker()
+    -> Pid;
+
+  auto exit_worker(const Pid& pid)
+    -> void;
+
+  // Must be called with workers_mutex held
+  auto _trim(const size_t worker_count)
+    -> size_t;
+
+private:
+  ActorBehaviour actor_behaviour;
+  ExecConfigCallback exec_config_callback;
+
+  size_t min_workers;
+  size_t max_workers;
+
+  // Most recently released first, its stack is most likely still cached
+  WorkerList idle_workers;
+  LeasedWorkers leased_workers;
+  SemaphoreHandle_t workers_mutex = nullptr;
+
+  // Counted towards max_workers while spawned without workers_mutex held
+  size_t spawning_count = 0;
+};
+
+} // namespace ActorModel
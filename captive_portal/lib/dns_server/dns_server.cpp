@@ -70,6 +70,12 @@ auto DNSServer::stop()
   }
 }
 
+auto DNSServer::get_sockfd() const
+  -> int
+{
+  return sockfd;
+}
+
 auto DNSServer::process_next_request()
   -> bool
 {
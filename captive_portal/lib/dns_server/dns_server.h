@@ -28,6 +28,9 @@ public:
   auto process_next_request()
     -> bool;
 
+  auto get_sockfd() const
+    -> int;
+
 protected:
   auto request_includes_only_one_question()
     -> bool;
@@ -31,7 +31,6 @@ constexpr char TAG[] = "dns_server";
 struct DNSServerActorState
 {
   DNSServer dns_server;
-  TRef tick_timer_ref = NullTRef;
   bool started = false;
 };
 
@@ -58,11 +57,8 @@ auto dns_server_actor_behaviour(
 
       printf("DNS server started\n");
 
-      if (not state.tick_timer_ref)
-      {
-        // Re-trigger ourselves periodically (timer will be cancelled later)
-        state.tick_timer_ref = send_interval(200ms, self, "tick");
-      }
+      // Wait for the first query
+      watch_socket(self, state.dns_server.get_sockfd(), SocketInterestReadable);
     }
 
     return {Result::Ok};
@@ -71,28 +67,28 @@ auto dns_server_actor_behaviour(
   if (matches(message, "dns_server_stop"))
   {
     printf("DNS server stopping\n");
-    if (state.tick_timer_ref)
-    {
-      cancel(state.tick_timer_ref);
-      state.tick_timer_ref = NullTRef;
-    }
-
     if (state.started)
     {
+      unwatch_socket(state.dns_server.get_sockfd());
       state.dns_server.stop();
       state.started = false;
     }
     return {Result::Ok};
   }
 
-  if (matches(message, "tick"))
+  if (
+    SocketReadable readable;
+    matches(message, readable)
+    and state.started
+    and readable.fd == state.dns_server.get_sockfd()
+  )
   {
-    if (state.tick_timer_ref)
-    {
-      auto handled_request = state.dns_server.process_next_request();
+    auto handled_request = state.dns_server.process_next_request();
 
-      return {Result::Ok, EventTerminationAction::ContinueProcessing};
-    }
+    // Any further queued queries fire again immediately
+    watch_socket(self, state.dns_server.get_sockfd(), SocketInterestReadable);
+
+    return {Result::Ok, EventTerminationAction::ContinueProcessing};
   }
 
   return {Result::Unhandled};
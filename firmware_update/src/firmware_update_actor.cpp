@@ -64,17 +64,16 @@ struct FirmwareUpdateActorState
   // Cancellable timer
   TRef tick_timer_ref = NullTRef;
 
-  // Download file state
-  FILE* current_download_file_fp = nullptr;
+  // Registered actors which requests are sent to
+  NameHandle request_manager_actor_handle{"request_manager"};
+  NameHandle auth_actor_handle{"auth"};
+
+  // Download file state, the file is written by the request manager
   string current_download_file_path;
   string current_download_file_checksum;
   bool did_update_any_files = false;
 
-  // ESP-IDF OTA
-  esp_ota_handle_t ota_handle = 0;
-  const esp_partition_t* ota_partition = nullptr;
-  bool ota_flash_started = false;
-  bool ota_flash_valid = true;
+  // ESP-IDF OTA, the image is written to the partition by the request manager
   ssize_t ota_bytes_written = 0;
   string ota_checksum_hex_str;
 
@@ -93,6 +92,9 @@ struct FirmwareUpdateActorState
 
 constexpr char TAG[] = "firmware_update";
 
+// Progress is reported to this actor every so often while flashing
+constexpr uint32_t ota_progress_interval_bytes = 64 * 1024;
+
 auto firmware_update_actor_behaviour(
   const Pid& self,
   StatePtr& _state,
@@ -176,54 +178,18 @@ auto firmware_update_actor_behaviour(
     return {Result::Ok};
   }
 
-  // Check for firmware image chunk, write it to flash
+  // Firmware image written to flash so far, and in total once finished
   if (
-    const Response* response = nullptr;
-    matches(
-      message,
-      "response_chunk",
-      response,
+    const ResponseProgress* progress = nullptr;
+    matches(message, "response_progress", progress)
+    and progress->request_id()
+    and compare_uuids(
+      *(progress->request_id()),
       state.download_image_request_intent_id
     )
   )
   {
-    // Initialize OTA session if not already started
-    if (not state.ota_flash_started)
-    {
-      state.ota_partition = get_next_ota_partition();
-
-      auto ret = esp_ota_begin(state.ota_partition, 0, &(state.ota_handle));
-      state.ota_bytes_written = 0;
-      state.ota_flash_started = (ret == ESP_OK);
-      state.ota_flash_valid = true;
-    }
-
-    if (
-      state.ota_partition
-      and state.ota_flash_started
-      and state.ota_flash_valid
-    )
-    {
-      auto ret = esp_ota_write(
-        state.ota_handle,
-        response->body()->data(),
-        response->body()->size()
-      );
-
-      if (ret == ESP_OK)
-      {
-        state.ota_bytes_written += response->body()->size();
-      }
-      else {
-        // Invalidate current OTA session
-        state.ota_flash_started = false;
-        state.ota_flash_valid = false;
-        ESP_LOGE(TAG, "esp_ota_write failed, err: %d", ret);
-      }
-    }
-    else {
-      ESP_LOGE(TAG, "Invalid state");
-    }
+    state.ota_bytes_written = static_cast<ssize_t>(progress->bytes_written());
 
     return {Result::Ok};
   }
@@ -254,144 +220,52 @@ auto firmware_update_actor_behaviour(
     )
   )
   {
-    if (
-      state.ota_partition
-      and state.ota_flash_started
-      and state.ota_flash_valid
-    )
+    // The request manager has already completed the OTA write (esp_ota_end)
+    const auto* ota_partition = get_next_ota_partition();
+    if (ota_partition and state.ota_bytes_written > 0)
     {
-      auto ret = esp_ota_end(state.ota_handle);
-      state.ota_handle = 0;
+      auto checksum_verified = false;
 
-      if (ret == ESP_OK)
+      if (not state.ota_checksum_hex_str.empty())
       {
-        auto checksum_verified = false;
-
-        if (not state.ota_checksum_hex_str.empty())
-        {
-          auto md5sum = checksum_partition_md5(
-            state.ota_partition,
-            state.ota_bytes_written
-          );
-          auto md5sum_hex_str = get_md5sum_hex_str(md5sum);
-
-          checksum_verified = (md5sum_hex_str == state.ota_checksum_hex_str);
-        }
-
-        if (checksum_verified)
-        {
-          ret = esp_ota_set_boot_partition(state.ota_partition);
-          if (ret == ESP_OK)
-          {
-            ESP_LOGW(
-              TAG,
-              "Flashed successfully to partition '%s', rebooting\n",
-              state.ota_partition->label
-            );
-
-            reboot();
-          }
-          else {
-            ESP_LOGE(TAG, "Could not set OTA boot partition after flashing");
-          }
-        }
-        else {
-          ESP_LOGE(TAG, "Firmware update checksum validation failed");
-
-          // Invalidate current OTA session
-          state.ota_flash_started = false;
-          state.ota_flash_valid = false;
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Firmware update esp_ota_end failed");
-
-        // Invalidate current OTA session
-        state.ota_flash_started = false;
-        state.ota_flash_valid = false;
-      }
-    }
-
-    state.download_image_request_intent_id = NullUUID;
-    state.download_image_request_in_progress = false;
-
-    return {Result::Ok};
-  }
-
-  // Check for file chunk, write it to filesystem
-  if (
-    const Response* response = nullptr;
-    matches(
-      message,
-      "response_chunk",
-      response,
-      state.download_file_request_intent_id
-    )
-  )
-  {
-    // Open the destination file if it is not already open
-    if (not state.current_download_file_path.empty())
-    {
-      if (state.current_download_file_fp == nullptr)
-      {
-        state.current_download_file_fp = fopen(
-          state.current_download_file_path.c_str(),
-          "w"
+        auto md5sum = checksum_partition_md5(
+          ota_partition,
+          state.ota_bytes_written
         );
+        auto md5sum_hex_str = get_md5sum_hex_str(md5sum);
 
-        if (state.current_download_file_fp == nullptr)
-        {
-          ESP_LOGE(TAG, "Could not open file for writing: %s", state.current_download_file_path.c_str());
-        }
+        checksum_verified = (md5sum_hex_str == state.ota_checksum_hex_str);
       }
 
-      if (state.current_download_file_fp != nullptr)
+      if (checksum_verified)
       {
-        auto chunk_len = response->body()->size();
-        auto bytes_written = fwrite(
-          response->body()->data(),
-          sizeof(char),
-          chunk_len,
-          state.current_download_file_fp
-        );
-
-        if (bytes_written == chunk_len)
+        auto ret = esp_ota_set_boot_partition(ota_partition);
+        if (ret == ESP_OK)
         {
-        }
-        else {
           ESP_LOGW(
             TAG,
-            "Invalid write %d bytes from file %s",
-            bytes_written,
-            state.current_download_file_path.c_str()
+            "Flashed successfully to partition '%s', rebooting\n",
+            ota_partition->label
           );
 
-          // Close file pointer before deleting file
-          fclose(state.current_download_file_fp);
-          state.current_download_file_fp = nullptr;
-
-          // Attempt to delete the file from the filesystem
-          auto did_delete = (
-            remove(state.current_download_file_path.c_str()) == 0
-          );
-          if (not did_delete)
-          {
-            ESP_LOGW(
-              TAG,
-              "Could not delete (possibly) corrupt file %s",
-              state.current_download_file_path.c_str()
-            );
-          }
+          reboot();
+        }
+        else {
+          ESP_LOGE(TAG, "Could not set OTA boot partition after flashing");
         }
       }
       else {
-        ESP_LOGW(TAG, "File not open for writing: %s", state.current_download_file_path.c_str());
+        ESP_LOGE(TAG, "Firmware update checksum validation failed");
       }
     }
     else {
-      ESP_LOGW(TAG, "Received chunk for unexpected file");
+      ESP_LOGE(TAG, "Firmware update image was not written");
     }
 
+    state.ota_bytes_written = 0;
+    state.download_image_request_intent_id = NullUUID;
+    state.download_image_request_in_progress = false;
+
     return {Result::Ok};
   }
 
@@ -405,29 +279,7 @@ auto firmware_update_actor_behaviour(
     )
   )
   {
-    if (not state.current_download_file_path.empty())
-    {
-      // Close file pointer if it is open
-      if (state.current_download_file_fp != nullptr)
-      {
-        fclose(state.current_download_file_fp);
-        state.current_download_file_fp = nullptr;
-      }
-
-      // Attempt to delete the file from the filesystem
-      auto did_delete = (
-        remove(state.current_download_file_path.c_str()) == 0
-      );
-      if (not did_delete)
-      {
-        ESP_LOGW(
-          TAG,
-          "Could not delete (possibly) corrupt file %s",
-          state.current_download_file_path.c_str()
-        );
-      }
-    }
-
+    // The request manager has already deleted the partially written file
     ESP_LOGE(TAG, "Firmware update file download request failed");
 
     return {Result::Ok};
@@ -444,13 +296,6 @@ auto firmware_update_actor_behaviour(
     )
   )
   {
-    // Close file pointer if it is still open
-    if (state.current_download_file_fp != nullptr)
-    {
-      fclose(state.current_download_file_fp);
-      state.current_download_file_fp = nullptr;
-    }
-
     // If a checksum was specified, verify it (delete file on failure)
     if (not state.current_download_file_checksum.empty())
     {
@@ -554,19 +399,17 @@ auto firmware_update_actor_behaviour(
 
     if (state.authenticated)
     {
-      auto request_manager_actor_pid = *(whereis("request_manager"));
       state.firmware_update_check_request_in_progress = true;
 
       send(
-        request_manager_actor_pid,
+        state.request_manager_actor_handle,
         "request",
         state.firmware_update_check_request_intent_mutable_buf
       );
     }
     else {
       printf("not authenticated for firmware update check, requesting re-auth\n");
-      auto auth_actor_pid = *(whereis("auth"));
-      send(auth_actor_pid, "auth");
+      send(state.auth_actor_handle, "auth");
     }
 
     return {Result::Ok};
@@ -640,7 +483,14 @@ auto firmware_update_actor_behaviour(
                   {{"Authorization", string{"Bearer "} + state.access_token}},
                   {},
                   self,
-                  ResponseFilter::PartialResponseChunks
+                  ResponseFilter::FullResponseBody,
+                  "",
+                  "",
+                  "",
+                  false,
+                  false,
+                  ResponseSinkType::File,
+                  file->path()->string_view()
                 );
 
                 state.current_download_file_path = file->path()->str();
@@ -655,9 +505,8 @@ auto firmware_update_actor_behaviour(
 
                 state.download_file_request_in_progress = true;
 
-                auto request_manager_actor_pid = *(whereis("request_manager"));
                 send(
-                  request_manager_actor_pid,
+                  state.request_manager_actor_handle,
                   "request",
                   download_file_request_intent_buffer
                 );
@@ -688,7 +537,16 @@ auto firmware_update_actor_behaviour(
                 {{"Authorization", string{"Bearer "} + state.access_token}},
                 {},
                 self,
-                ResponseFilter::PartialResponseChunks
+                ResponseFilter::FullResponseBody,
+                "",
+                "",
+                "",
+                false,
+                false,
+                ResponseSinkType::OtaPartition,
+                "",
+                0,
+                ota_progress_interval_bytes
               );
 
               state.download_image_request_intent_id = get_request_intent_id(
@@ -697,9 +555,8 @@ auto firmware_update_actor_behaviour(
 
               state.download_image_request_in_progress = true;
 
-              auto request_manager_actor_pid = *(whereis("request_manager"));
               send(
-                request_manager_actor_pid,
+                state.request_manager_actor_handle,
                 "request",
                 download_image_request_intent_buffer
               );
@@ -46,6 +46,9 @@ struct SpreadsheetInsertRowActorState
   bool insert_row_request_in_progress = false;
   string access_token_str;
   TRef tick_timer_ref = NullTRef;
+
+  NameHandle request_manager_actor_handle{"request_manager"};
+  NameHandle auth_actor_handle{"auth"};
 };
 
 auto spreadsheet_insert_row_actor_behaviour(
@@ -138,9 +141,8 @@ auto spreadsheet_insert_row_actor_behaviour(
       // Resend any failed requests
       else {
         ESP_LOGE(TAG, "Fatal error (%d), resending: '%.*s'\n", response->code(), response->body()->size(), response->body()->data());
-        auto request_manager_actor_pid = *(whereis("request_manager"));
         send(
-          request_manager_actor_pid,
+          state.request_manager_actor_handle,
           "request",
           state.insert_row_request_intent_mutable_buf
         );
@@ -165,8 +167,7 @@ auto spreadsheet_insert_row_actor_behaviour(
     {
       if (response->code() == 401)
       {
-        auto auth_actor_pid = *(whereis("auth"));
-        send(auth_actor_pid, "auth");
+        send(state.auth_actor_handle, "auth");
       }
 
       return {Result::Ok};
@@ -223,9 +224,8 @@ auto spreadsheet_insert_row_actor_behaviour(
           set_request_body(state.insert_row_request_intent_mutable_buf, body);
 
           state.insert_row_request_in_progress = true;
-          auto request_manager_actor_pid = *(whereis("request_manager"));
           send(
-            request_manager_actor_pid,
+            state.request_manager_actor_handle,
             "request",
             state.insert_row_request_intent_mutable_buf
           );
@@ -96,6 +96,9 @@ struct VisualizationQueryActorState
 
   TRef tick_timer_ref = NullTRef;
 
+  NameHandle request_manager_actor_handle{"request_manager"};
+  NameHandle auth_actor_handle{"auth"};
+
   auto has_column_ids_for_query(
     const QueryIntent* query
   ) -> bool
@@ -195,8 +198,6 @@ auto visualization_query_actor_behaviour(
       and not state.access_token_str.empty()
     )
     {
-      auto request_manager_actor_pid = *(whereis("request_manager"));
-
       // Update the request intent with arguments from the query
       update_request_intent_for_query_intent(
         state.current_columns_request_intent_mutable_buf,
@@ -212,7 +213,7 @@ auto visualization_query_actor_behaviour(
 
       // Send the request intent message to the request manager actor
       send(
-        request_manager_actor_pid,
+        state.request_manager_actor_handle,
         "request",
         state.current_columns_request_intent_mutable_buf
       );
@@ -304,9 +305,8 @@ auto visualization_query_actor_behaviour(
     )
     {
       // Check if 'access_token' query arg is present now, re-send
-      auto request_manager_actor_pid = *(whereis("request_manager"));
       send(
-        request_manager_actor_pid,
+        state.request_manager_actor_handle,
         "request",
         state.current_query_request_intent_mutable_buf
       );
@@ -353,9 +353,8 @@ auto visualization_query_actor_behaviour(
     )
     {
       // Check if 'access_token' query arg is present now, re-send
-      auto request_manager_actor_pid = *(whereis("request_manager"));
       send(
-        request_manager_actor_pid,
+        state.request_manager_actor_handle,
         "request",
         state.current_columns_request_intent_mutable_buf
       );
@@ -380,8 +379,7 @@ auto visualization_query_actor_behaviour(
   {
     if (response->code() == 401)
     {
-      auto auth_actor_pid = *(whereis("auth"));
-      send(auth_actor_pid, "auth");
+      send(state.auth_actor_handle, "auth");
     }
 
     return {Result::Ok};
@@ -394,8 +392,7 @@ auto visualization_query_actor_behaviour(
   {
     if (response->code() == 401)
     {
-      auto auth_actor_pid = *(whereis("auth"));
-      send(auth_actor_pid, "auth");
+      send(state.auth_actor_handle, "auth");
     }
 
     return {Result::Ok};
@@ -450,8 +447,6 @@ auto visualization_query_actor_behaviour(
             );
             if (did_update_all_ids)
             {
-              auto request_manager_actor_pid = *(whereis("request_manager"));
-
               // Update the request intent with arguments from the query
               update_request_intent_for_query_intent(
                 state.current_query_request_intent_mutable_buf,
@@ -460,7 +455,7 @@ auto visualization_query_actor_behaviour(
 
               // Send the request intent message to the request manager actor
               send(
-                request_manager_actor_pid,
+                state.request_manager_actor_handle,
                 "request",
                 state.current_query_request_intent_mutable_buf
               );
@@ -65,7 +65,6 @@ struct HTTPServerActorState
   string send_data;
 
   char recv_buf[HTTP_SERVER_RECV_BUF_LEN];
-  TRef tick_timer_ref = NullTRef;
 
   MutableHTTPConfigurationFlatbuffer http_server_config_mutable_buf;
 };
@@ -122,11 +121,9 @@ auto http_server_actor_behaviour(
               if (ret == 0)
               {
                 ESP_LOGI(TAG, "OK");
-                if (not state.tick_timer_ref)
-                {
-                  // Re-trigger ourselves periodically (timer will be cancelled later)
-                  state.tick_timer_ref = send_interval(200ms, self, "tick");
-                }
+
+                // Wait for the first connection
+                watch_socket(self, state.sockfd, SocketInterestAcceptable);
 
                 return {Result::Ok};
               }
@@ -153,20 +150,16 @@ auto http_server_actor_behaviour(
 
   if (matches(message, "http_server_stop"))
   {
-    if (state.tick_timer_ref)
-    {
-      cancel(state.tick_timer_ref);
-      state.tick_timer_ref = NullTRef;
-    }
-
     if (state.client_sockfd > 0)
     {
+      unwatch_socket(state.client_sockfd);
       close(state.client_sockfd);
       state.client_sockfd = -1;
     }
 
     if (state.sockfd > 0)
     {
+      unwatch_socket(state.sockfd);
       close(state.sockfd);
       state.sockfd = -1;
     }
@@ -174,92 +167,102 @@ auto http_server_actor_behaviour(
     return {Result::Ok};
   }
 
-  if (matches(message, "tick"))
+  if (
+    SocketAcceptable acceptable;
+    matches(message, acceptable)
+    and acceptable.fd == state.sockfd
+  )
   {
-    if (state.tick_timer_ref)
+    // Only one client connection is serviced at a time,
+    // the listening socket is watched again once it is closed
+    if (state.client_sockfd < 0)
     {
-      // Check for a new client connection if we are not already servicing one
-      if (state.client_sockfd < 0)
+      socklen_t addr_len = sizeof(state.sock_addr);
+      state.client_sockfd = accept(
+        state.sockfd,
+        reinterpret_cast<struct sockaddr *>(&state.sock_addr),
+        &addr_len
+      );
+
+      if (state.client_sockfd > -1)
       {
-        socklen_t addr_len = 0;
-        state.client_sockfd = accept(
-          state.sockfd,
-          reinterpret_cast<struct sockaddr *>(&state.sock_addr),
-          &addr_len
-        );
+        ESP_LOGI(TAG, "HTTP server accepted new connection");
 
-        if (state.client_sockfd > -1)
-        {
-          ESP_LOGI(TAG, "HTTP server accepted new connection");
-        }
-        else if ((state.client_sockfd == -1) and (errno == EWOULDBLOCK))
+        // Set client socket non-blocking, readiness is signalled by the reactor
+        int flags = fcntl(state.client_sockfd, F_GETFL, 0);
+        fcntl(state.client_sockfd, F_SETFL, flags | O_NONBLOCK);
+
+        watch_socket(self, state.client_sockfd, SocketInterestReadable);
+      }
+      else {
+        if (errno != EWOULDBLOCK)
         {
-          // No connections to accept, normal in non-blocking mode
-          return {Result::Ok, EventTerminationAction::ContinueProcessing};
-        }
-        else {
           ESP_LOGE(TAG, "HTTP server accept new connection failed, errno: %d", errno);
         }
+
+        watch_socket(self, state.sockfd, SocketInterestAcceptable);
       }
+    }
 
-      // Service the active client connection
-      if (state.client_sockfd > -1)
+    return {Result::Ok};
+  }
+
+  if (
+    SocketReadable readable;
+    matches(message, readable)
+    and readable.fd == state.client_sockfd
+  )
+  {
+    // Service the active client connection
+    memset(state.recv_buf, 0, HTTP_SERVER_RECV_BUF_LEN);
+    auto bytes_read = recv(
+      state.client_sockfd,
+      state.recv_buf,
+      HTTP_SERVER_RECV_BUF_LEN - 1,
+      0
+    );
+    if (bytes_read > 0)
+    {
+      ESP_LOGI(TAG, "HTTP server request: %s", state.recv_buf);
+      if (
+        strstr(state.recv_buf, "GET ")
+        && strstr(state.recv_buf, " HTTP/1.1")
+      )
       {
-        memset(state.recv_buf, 0, HTTP_SERVER_RECV_BUF_LEN);
-        auto bytes_read = recv(
+        ESP_LOGI(TAG, "HTTP get matched message");
+        ESP_LOGI(TAG, "HTTP write message");
+        auto bytes_written = write(
           state.client_sockfd,
-          state.recv_buf,
-          HTTP_SERVER_RECV_BUF_LEN - 1,
-          0
+          state.send_data.data(),
+          state.send_data.size()
         );
-        if (bytes_read > 0)
+        if (bytes_written > 0)
         {
-          ESP_LOGI(TAG, "HTTP server request: %s", state.recv_buf);
-          if (
-            strstr(state.recv_buf, "GET ")
-            && strstr(state.recv_buf, " HTTP/1.1")
-          )
-          {
-            ESP_LOGI(TAG, "HTTP get matched message");
-            ESP_LOGI(TAG, "HTTP write message");
-            auto bytes_written = write(
-              state.client_sockfd,
-              state.send_data.data(),
-              state.send_data.size()
-            );
-            if (bytes_written > 0)
-            {
-              ESP_LOGI(TAG, "OK");
-              return {Result::Ok};
-            }
-            else {
-              ESP_LOGI(TAG, "error");
-            }
-          }
-        }
-        else if ((bytes_read == -1) and (errno == EWOULDBLOCK))
-        {
-          // This is OK, no connections to service
-          return {Result::Ok, EventTerminationAction::ContinueProcessing};
+          ESP_LOGI(TAG, "OK");
         }
         else {
-          // Close the socket, if no data could be received
-          if (state.client_sockfd > -1)
-          {
-            close(state.client_sockfd);
-            state.client_sockfd = -1;
-          }
-
-          return {Result::Ok, EventTerminationAction::ContinueProcessing};
+          ESP_LOGI(TAG, "error");
         }
       }
-      else {
-        ESP_LOGE(TAG, "HTTP server socket not in accepted state");
-      }
 
-      printf("error in tick\n");
-      return {Result::Error};
+      watch_socket(self, state.client_sockfd, SocketInterestReadable);
     }
+    else if ((bytes_read == -1) and (errno == EWOULDBLOCK))
+    {
+      // Spurious wakeup, wait for more data
+      watch_socket(self, state.client_sockfd, SocketInterestReadable);
+    }
+    else {
+      // Close the socket if the client disconnected, or no data could be
+      // received, then wait for the next connection
+      unwatch_socket(state.client_sockfd);
+      close(state.client_sockfd);
+      state.client_sockfd = -1;
+
+      watch_socket(self, state.sockfd, SocketInterestAcceptable);
+    }
+
+    return {Result::Ok};
   }
 
   return {Result::Unhandled};
@@ -0,0 +1,197 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "content_decoder.h"
+
+#include "http_utils.h"
+
+#include <algorithm>
+
+#include "esp_log.h"
+
+namespace Requests {
+
+constexpr char TAG[] = "content_decoder";
+
+// For windows of 512 bytes to 32kB (deflate itself never uses 256 bytes)
+constexpr int MinInflateWindowBits = 9;
+constexpr int MaxInflateWindowBits = MAX_WBITS;
+
+// Added to the window bits to detect a gzip or zlib header
+constexpr int InflateAutoDetectHeader = 32;
+
+ContentDecoder::ContentDecoder(
+  const string_view _content_encoding,
+  const int _window_bits
+)
+  : window_bits(std::clamp(
+      (_window_bits > 0)? _window_bits : REQUESTS_INFLATE_WINDOW_BITS,
+      MinInflateWindowBits,
+      MaxInflateWindowBits
+    ))
+  , is_deflate(equals_ignore_case(_content_encoding, "deflate"))
+  , output_buffer(ContentDecoderOutputChunkSize, '\0')
+{
+  failed = not init(false);
+}
+
+ContentDecoder::~ContentDecoder()
+{
+  if (initialized)
+  {
+    inflateEnd(&stream);
+  }
+}
+
+auto ContentDecoder::is_supported(const string_view content_encoding)
+  -> bool
+{
+  return (
+    equals_ignore_case(content_encoding, "gzip")
+    or equals_ignore_case(content_encoding, "x-gzip")
+    or equals_ignore_case(content_encoding, "deflate")
+  );
+}
+
+auto ContentDecoder::init(const bool raw_deflate)
+  -> bool
+{
+  if (initialized)
+  {
+    inflateEnd(&stream);
+    initialized = false;
+  }
+
+  stream = z_stream{};
+
+  // The window is only allocated once the first block is inflated
+  auto result = inflateInit2(
+    &stream,
+    raw_deflate? -window_bits : (window_bits + InflateAutoDetectHeader)
+  );
+  if (result != Z_OK)
+  {
+    ESP_LOGE(TAG, "inflateInit2 failed: %d", result);
+    return false;
+  }
+
+  initialized = true;
+  return true;
+}
+
+auto ContentDecoder::decode(
+  const string_view chunk,
+  Callback&& _callback
+) -> bool
+{
+  if (failed)
+  {
+    return false;
+  }
+
+  const auto is_first_chunk = (compressed_size == 0);
+  compressed_size += chunk.size();
+
+  // Anything after the end of the encoded body is ignored
+  if (finished)
+  {
+    return true;
+  }
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(chunk.data()));
+  stream.avail_in = chunk.size();
+
+  do
+  {
+    stream.next_out = reinterpret_cast<Bytef*>(output_buffer.data());
+    stream.avail_out = output_buffer.size();
+
+    auto result = inflate(&stream, Z_NO_FLUSH);
+
+    // Some servers send "deflate" without the zlib header it should have
+    if (
+      result == Z_DATA_ERROR
+      and is_deflate
+      and is_first_chunk
+      and decompressed_size == 0
+    )
+    {
+      is_deflate = false;
+      if (not init(true))
+      {
+        failed = true;
+        return false;
+      }
+
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(chunk.data()));
+      stream.avail_in = chunk.size();
+      stream.avail_out = 0;
+      continue;
+    }
+
+    if (
+      result != Z_OK
+      and result != Z_STREAM_END
+      and result != Z_BUF_ERROR
+    )
+    {
+      ESP_LOGE(
+        TAG,
+        "Unable to decode response body: %s",
+        stream.msg? stream.msg : "inflate failed"
+      );
+
+      failed = true;
+      return false;
+    }
+
+    const auto decoded_size = (output_buffer.size() - stream.avail_out);
+    if (decoded_size > 0)
+    {
+      decompressed_size += decoded_size;
+
+      auto action = _callback(string_view{output_buffer.data(), decoded_size});
+      if (action == AbortProcessing)
+      {
+        return false;
+      }
+    }
+
+    if (result == Z_STREAM_END)
+    {
+      finished = true;
+      break;
+    }
+  }
+  // Until inflate has no more output for this chunk
+  while (stream.avail_out == 0);
+
+  return true;
+}
+
+auto ContentDecoder::has_failed() const
+  -> bool
+{
+  return failed;
+}
+
+auto ContentDecoder::get_compressed_size() const
+  -> uint64_t
+{
+  return compressed_size;
+}
+
+auto ContentDecoder::get_decompressed_size() const
+  -> uint64_t
+{
+  return decompressed_size;
+}
+
+} // namespace Requests
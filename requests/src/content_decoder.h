@@ -0,0 +1,85 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "delegate.hpp"
+
+#include "zlib.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Requests {
+
+// Decoded bytes are passed on in pieces of up to this size
+constexpr size_t ContentDecoderOutputChunkSize = 1024;
+
+// Inflates a gzip or deflate encoded response body as it arrives, holding
+// an inflate window of 2^window_bits bytes (plus ~7kB of zlib state) for
+// the lifetime of the response
+class ContentDecoder
+{
+public:
+  using string_view = std::string_view;
+  using string = std::string;
+
+  using PostCallbackAction = bool;
+  using Callback = delegate<PostCallbackAction(string_view)>;
+  static constexpr PostCallbackAction AbortProcessing = false;
+  static constexpr PostCallbackAction ContinueProcessing = true;
+
+  // 0 window_bits for REQUESTS_INFLATE_WINDOW_BITS
+  ContentDecoder(const string_view _content_encoding, const int _window_bits);
+  ~ContentDecoder();
+
+  ContentDecoder(const ContentDecoder&) = delete;
+  ContentDecoder& operator= (const ContentDecoder&) = delete;
+
+  // Whether a Content-Encoding header value can be decoded
+  static auto is_supported(const string_view content_encoding)
+    -> bool;
+
+  // Calls _callback with each decoded piece of chunk, false if the body
+  // could not be decoded or _callback aborted processing
+  auto decode(
+    const string_view chunk,
+    Callback&& _callback
+  ) -> bool;
+
+  auto has_failed() const
+    -> bool;
+
+  auto get_compressed_size() const
+    -> uint64_t;
+
+  auto get_decompressed_size() const
+    -> uint64_t;
+
+protected:
+  auto init(const bool raw_deflate)
+    -> bool;
+
+private:
+  z_stream stream{};
+  int window_bits = 0;
+  bool is_deflate = false;
+  bool initialized = false;
+  bool finished = false;
+  bool failed = false;
+
+  string output_buffer;
+
+  uint64_t compressed_size = 0;
+  uint64_t decompressed_size = 0;
+};
+
+} // namespace Requests
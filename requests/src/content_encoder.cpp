@@ -0,0 +1,84 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "content_encoder.h"
+
+#include "zlib.h"
+
+#include <array>
+
+#include "esp_log.h"
+
+namespace Requests {
+
+constexpr char TAG[] = "content_encoder";
+
+// Added to the window bits to write a gzip (rather than zlib) header
+constexpr int DeflateGzipHeader = 16;
+
+auto gzip_encode(
+  const std::string_view body,
+  ContentEncoderCallback&& _callback
+) -> bool
+{
+  z_stream stream{};
+
+  auto result = deflateInit2(
+    &stream,
+    Z_DEFAULT_COMPRESSION,
+    Z_DEFLATED,
+    REQUESTS_DEFLATE_WINDOW_BITS + DeflateGzipHeader,
+    REQUESTS_DEFLATE_MEM_LEVEL,
+    Z_DEFAULT_STRATEGY
+  );
+  if (result != Z_OK)
+  {
+    ESP_LOGE(TAG, "deflateInit2 failed: %d", result);
+    return false;
+  }
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+  stream.avail_in = body.size();
+
+  std::array<char, ContentEncoderOutputChunkSize> output_buffer;
+
+  auto did_encode = true;
+  do
+  {
+    stream.next_out = reinterpret_cast<Bytef*>(output_buffer.data());
+    stream.avail_out = output_buffer.size();
+
+    // All of the input is available, so it is finished in one pass
+    result = deflate(&stream, Z_FINISH);
+    if (result != Z_OK and result != Z_STREAM_END)
+    {
+      ESP_LOGE(TAG, "deflate failed: %d", result);
+      did_encode = false;
+      break;
+    }
+
+    const auto encoded_size = (output_buffer.size() - stream.avail_out);
+    if (
+      encoded_size > 0
+      and not _callback(std::string_view{output_buffer.data(), encoded_size})
+    )
+    {
+      did_encode = false;
+      break;
+    }
+  }
+  while (result != Z_STREAM_END);
+
+  deflateEnd(&stream);
+
+  return did_encode;
+}
+
+} // namespace Requests
@@ -0,0 +1,34 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "delegate.hpp"
+
+#include <string_view>
+
+namespace Requests {
+
+// Encoded bytes are passed on in pieces of up to this size
+constexpr size_t ContentEncoderOutputChunkSize = 1024;
+
+using ContentEncoderCallback = delegate<bool(std::string_view)>;
+
+// Gzip encode body, calling _callback with each encoded piece as it is
+// deflated. The deflate state is held only for the call, with a window of
+// 2^REQUESTS_DEFLATE_WINDOW_BITS bytes and REQUESTS_DEFLATE_MEM_LEVEL
+// (about 2^(window bits + 2) + 2^(mem level + 9) bytes in total).
+// False if it could not be encoded or _callback aborted encoding
+auto gzip_encode(
+  const std::string_view body,
+  ContentEncoderCallback&& _callback
+) -> bool;
+
+} // namespace Requests
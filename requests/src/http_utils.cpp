@@ -11,6 +11,7 @@
 #include "http_utils.h"
 
 #include <algorithm>
+#include <cctype>
 #include <cstdio>
 
 namespace Requests {
@@ -126,4 +127,51 @@ auto urlencode(const string_view raw_str)
   return encoded_str;
 }
 
+auto get_url_host(const string_view url)
+  -> string_view
+{
+  auto authority = url;
+
+  // Skip the scheme, if any
+  const auto scheme_end = authority.find("://");
+  if (scheme_end != string_view::npos)
+  {
+    authority = authority.substr(scheme_end + 3);
+  }
+
+  authority = authority.substr(0, authority.find_first_of("/?#"));
+
+  // Skip the userinfo, if any
+  const auto userinfo_end = authority.rfind('@');
+  if (userinfo_end != string_view::npos)
+  {
+    authority = authority.substr(userinfo_end + 1);
+  }
+
+  // Strip the port, unless it is part of an IPv6 literal
+  const auto port_start = authority.rfind(':');
+  if (
+    port_start != string_view::npos
+    and authority.find(']', port_start) == string_view::npos
+  )
+  {
+    authority = authority.substr(0, port_start);
+  }
+
+  return authority;
+}
+
+auto equals_ignore_case(const string_view a, const string_view b)
+  -> bool
+{
+  return std::equal(
+    a.begin(), a.end(),
+    b.begin(), b.end(),
+    [](const char c1, const char c2) -> bool
+    {
+      return (std::tolower(c1) == std::tolower(c2));
+    }
+  );
+}
+
 } // namespace Requests
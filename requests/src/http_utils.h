@@ -24,4 +24,12 @@ auto is_char_url_safe(const char c)
 auto urlencode(const std::string_view raw_str)
   -> std::string;
 
+// The host part of an absolute URL, without any userinfo or port
+auto get_url_host(const std::string_view url)
+  -> std::string_view;
+
+// For header names and tokens, which are ASCII case-insensitive
+auto equals_ignore_case(const std::string_view a, const std::string_view b)
+  -> bool;
+
 } // namespace Requests
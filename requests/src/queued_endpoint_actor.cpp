@@ -18,8 +18,8 @@
 
 #include <algorithm>
 #include <chrono>
+#include <deque>
 #include <limits>
-#include <queue>
 #include <string_view>
 #include <unordered_map>
 #include <utility>
@@ -115,9 +115,8 @@ struct QueuedEndpointActorState
         if (request_intent)
         {
           // Send the request
-          auto request_manager_actor_pid = *(whereis("request_manager"));
           send(
-            request_manager_actor_pid,
+            request_manager_actor_handle,
             "request",
             request_intent_mutable_buf
           );
@@ -130,13 +129,183 @@ struct QueuedEndpointActorState
     return UUID::NullUUID;
   }
 
+  // Keep the payloads which are yet to be sent successfully, and the
+  // access token, across restarts
+  auto save_state_snapshot()
+    -> bool
+  {
+    if (snapshot_key.empty())
+    {
+      return false;
+    }
+
+    flatbuffers::FlatBufferBuilder fbb;
+
+    std::vector<flatbuffers::Offset<QueuedRequestPayload>> request_payload_offsets;
+    request_payload_offsets.reserve(
+      inflight_requests.size() + pending_request_payloads.size()
+    );
+
+    // Requests which were in flight are resent first
+    for (const auto& inflight_request_iter : inflight_requests)
+    {
+      request_payload_offsets.emplace_back(CreateQueuedRequestPayload(
+        fbb,
+        fbb.CreateVector(inflight_request_iter.second)
+      ));
+    }
+
+    for (const auto& request_payload : pending_request_payloads)
+    {
+      request_payload_offsets.emplace_back(CreateQueuedRequestPayload(
+        fbb,
+        fbb.CreateVector(request_payload)
+      ));
+    }
+
+    fbb.Finish(
+      CreateQueuedEndpointSnapshot(
+        fbb,
+        fbb.CreateString(access_token_str),
+        fbb.CreateVector(request_payload_offsets)
+      )
+    );
+
+    return save_snapshot(
+      snapshot_key,
+      BufferView{fbb.GetBufferPointer(), fbb.GetSize()}
+    );
+  }
+
+  // Snapshots are keyed by the name this process is registered under, known
+  // from its first message, or else by the endpoint uri in the request
+  // template. Empty until either is known
+  auto get_snapshot_key(const Pid& self) const
+    -> string
+  {
+    for (const auto& name_iter : registered())
+    {
+      if (UUID::compare_uuids(name_iter.second, self))
+      {
+        return string{"queued_endpoint:"} + name_iter.first;
+      }
+    }
+
+    if (template_request_intent_mutable_buf.empty())
+    {
+      return {};
+    }
+
+    const auto* request_intent = flatbuffers::GetRoot<RequestIntent>(
+      template_request_intent_mutable_buf.data()
+    );
+
+    if (
+      not request_intent
+      or not request_intent->request()
+      or not request_intent->request()->uri()
+    )
+    {
+      return {};
+    }
+
+    return string{"queued_endpoint:"} + request_intent->request()->uri()->str();
+  }
+
+  // Restore the state saved before a restart, once per process, and save
+  // it along with anything received before the key was known
+  auto resume(const Pid& self)
+    -> bool
+  {
+    if (not snapshot_key.empty())
+    {
+      return false;
+    }
+
+    snapshot_key = get_snapshot_key(self);
+    if (snapshot_key.empty())
+    {
+      return false;
+    }
+
+    const auto had_state = not (
+      pending_request_payloads.empty()
+      and access_token_str.empty()
+    );
+
+    const auto did_restore = restore_state_snapshot();
+    if (had_state)
+    {
+      save_state_snapshot();
+    }
+
+    return did_restore;
+  }
+
+  auto restore_state_snapshot()
+    -> bool
+  {
+    const auto& snapshot_buf = load_snapshot(snapshot_key);
+    if (snapshot_buf.empty())
+    {
+      return false;
+    }
+
+    flatbuffers::Verifier verifier(snapshot_buf.data(), snapshot_buf.size());
+    if (not verifier.VerifyBuffer<QueuedEndpointSnapshot>(nullptr))
+    {
+      ESP_LOGW(TAG, "Ignoring invalid snapshot for '%s'", snapshot_key.c_str());
+      return false;
+    }
+
+    const auto* snapshot = flatbuffers::GetRoot<QueuedEndpointSnapshot>(
+      snapshot_buf.data()
+    );
+
+    // Prefer a token received since spawning
+    if (access_token_str.empty() and snapshot->access_token())
+    {
+      access_token_str = snapshot->access_token()->str();
+    }
+
+    if (snapshot->request_payloads())
+    {
+      // Ahead of any payloads received since spawning
+      auto insert_iter = pending_request_payloads.begin();
+      for (const auto* request_payload : *(snapshot->request_payloads()))
+      {
+        if (request_payload->buf())
+        {
+          insert_iter = std::next(pending_request_payloads.emplace(
+            insert_iter,
+            request_payload->buf()->begin(),
+            request_payload->buf()->end()
+          ));
+        }
+      }
+    }
+
+    ESP_LOGI(
+      TAG,
+      "Restored %zu pending payloads for '%s'",
+      pending_request_payloads.size(),
+      snapshot_key.c_str()
+    );
+
+    return true;
+  }
+
   size_t max_inflight_requests_count = std::numeric_limits<size_t>::max();
   InflightRequestPayloadMap inflight_requests;
   MutableRequestIntentFlatbuffer template_request_intent_mutable_buf;
-  std::queue<MutableRequestPayload> pending_request_payloads;
+  std::deque<MutableRequestPayload> pending_request_payloads;
   TRef tick_timer_ref = NullTRef;
 
   string access_token_str;
+  string snapshot_key;
+
+  NameHandle request_manager_actor_handle{"request_manager"};
+  NameHandle auth_actor_handle{"auth"};
 };
 
 auto queued_endpoint_actor_behaviour(
@@ -153,6 +322,17 @@ auto queued_endpoint_actor_behaviour(
     std::static_pointer_cast<QueuedEndpointActorState>(_state)
   );
 
+  // Resume from before a restart, before handling the first message if
+  // this process is registered by then
+  if (
+    state.resume(self)
+    and not state.pending_request_payloads.empty()
+    and not state.tick_timer_ref
+  )
+  {
+    state.tick_timer_ref = send_interval(100ms, self, "tick");
+  }
+
   // Extract RequestIntent template into state
   if (
     matches(
@@ -162,6 +342,16 @@ auto queued_endpoint_actor_behaviour(
     )
   )
   {
+    // Otherwise keyed by the template's endpoint uri
+    if (
+      state.resume(self)
+      and not state.pending_request_payloads.empty()
+      and not state.tick_timer_ref
+    )
+    {
+      state.tick_timer_ref = send_interval(100ms, self, "tick");
+    }
+
     return {Result::Ok};
   }
 
@@ -170,7 +360,8 @@ auto queued_endpoint_actor_behaviour(
     matches(message, "request_payload", request_payload)
   )
   {
-    state.pending_request_payloads.emplace(request_payload);
+    state.pending_request_payloads.emplace_back(request_payload);
+    state.save_state_snapshot();
 
     if (not state.tick_timer_ref)
     {
@@ -243,6 +434,7 @@ auto queued_endpoint_actor_behaviour(
         ESP_LOGW(TAG, "successfully, will delete");
         // Clear the matching request, it has been completed successfully
         state.inflight_requests.erase(request_payload_iter);
+        state.save_state_snapshot();
       }
       else {
         // Resend a failed request
@@ -297,8 +489,7 @@ auto queued_endpoint_actor_behaviour(
 
     if (response->code() == 401)
     {
-      auto auth_actor_pid = *(whereis("auth"));
-      send(auth_actor_pid, "auth");
+      send(state.auth_actor_handle, "auth");
     }
 
     return {Result::Ok};
@@ -307,6 +498,7 @@ auto queued_endpoint_actor_behaviour(
   // Extract access_token payload into state
   if (matches(message, "access_token", state.access_token_str))
   {
+    state.save_state_snapshot();
     return {Result::Ok, EventTerminationAction::ContinueProcessing};
   }
 
@@ -329,7 +521,7 @@ auto queued_endpoint_actor_behaviour(
           std::move(request_payload)
         );
         // Then pop the (now invalid) front element
-        state.pending_request_payloads.pop();
+        state.pending_request_payloads.pop_front();
       }
     }
     else {
@@ -0,0 +1,171 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "request_benchmarks.h"
+
+#include "requests.h"
+
+#include "actor.h"
+#include "actor_model.h"
+
+#include "timestamp.h"
+
+#include <atomic>
+#include <vector>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace Requests {
+
+using namespace ActorModel;
+
+constexpr char TAG[] = "request_benchmarks";
+
+// Long enough for every response from a local server,
+// a response which has not arrived by then is counted as a failure
+constexpr int64_t BenchmarkResponsesTimeoutMicroseconds = 30000000;
+
+struct ResponseCounts
+{
+  std::atomic<size_t> finished{0};
+  std::atomic<size_t> failed{0};
+};
+
+// Counted by the collector process, read by the benchmarking task
+static ResponseCounts response_counts;
+
+auto response_collector_behaviour(
+  const Pid& self,
+  StatePtr& state,
+  const Message& message
+) -> ResultUnion;
+
+auto response_collector_behaviour(
+  const Pid& self,
+  StatePtr& state,
+  const Message& message
+) -> ResultUnion
+{
+  if (matches(message, "response_error"))
+  {
+    response_counts.failed++;
+
+    return {Result::Ok};
+  }
+
+  if (matches(message, "response_finished"))
+  {
+    response_counts.finished++;
+
+    return {Result::Ok};
+  }
+
+  return {Result::Unhandled};
+}
+
+auto benchmark_concurrent_requests(
+  const std::string_view url,
+  const size_t request_count
+) -> BenchmarkResult
+{
+  using utils::get_elapsed_microseconds;
+
+  BenchmarkResult result;
+
+  const auto request_manager_pid = whereis("request_manager");
+  if (not request_manager_pid)
+  {
+    ESP_LOGE(TAG, "No request_manager process to benchmark");
+    result.failures = request_count;
+    return result;
+  }
+
+  response_counts.finished = 0;
+  response_counts.failed = 0;
+
+  const auto collector_pid = spawn(
+    ActorBehaviour{response_collector_behaviour}
+  );
+
+  // Built before timing starts
+  std::vector<RequestIntentFlatbuffer> request_intents;
+  request_intents.reserve(request_count);
+  for (size_t i = 0; i < request_count; ++i)
+  {
+    request_intents.emplace_back(
+      make_request_intent("GET", url, {}, {}, {}, collector_pid)
+    );
+  }
+
+  size_t sent_count = 0;
+
+  const auto start = get_elapsed_microseconds();
+  for (const auto& request_intent : request_intents)
+  {
+    if (send(*(request_manager_pid), "request", request_intent))
+    {
+      sent_count++;
+    }
+  }
+
+  // Responses are received by the collector process
+  while (
+    response_counts.finished < sent_count
+    and (
+      (get_elapsed_microseconds() - start).count()
+      < BenchmarkResponsesTimeoutMicroseconds
+    )
+  )
+  {
+    vTaskDelay(1);
+  }
+  result.elapsed_microseconds = (get_elapsed_microseconds() - start).count();
+
+  exit(collector_pid, collector_pid, "normal");
+
+  const size_t finished_count = response_counts.finished;
+  const size_t failed_count = response_counts.failed;
+
+  result.iterations = (finished_count - failed_count);
+  result.failures = (request_count - result.iterations);
+
+  return result;
+}
+
+auto benchmark_requests(
+  const std::string_view url,
+  const size_t request_count
+) -> void
+{
+  const auto& result = benchmark_concurrent_requests(url, request_count);
+
+  ESP_LOGI(
+    TAG,
+    "Concurrent GET %.*s: %zu responses in %lld us, %.1f per second, "
+    "%zu failed",
+    url.size(), url.data(),
+    result.iterations,
+    static_cast<long long>(result.elapsed_microseconds),
+    result.get_rate_per_second(),
+    result.failures
+  );
+
+  // Multiplexed requests should have needed one connection (and handshake)
+  const auto request_manager_pid = whereis("request_manager");
+  if (request_manager_pid)
+  {
+    send(*(request_manager_pid), "tls_handshake_stats");
+  }
+}
+
+} // namespace Requests
@@ -0,0 +1,36 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "benchmarks.h"
+
+#include <cstddef>
+#include <string_view>
+
+namespace Requests {
+
+// Send request_count GET requests for url to the "request_manager" process
+// at once, and wait for all their responses. url is expected to be a small
+// resource on a local HTTP/2 server (e.g. nghttpd), whose CA cert has been
+// added to the request manager. Requests are only multiplexed if built
+// with REQUESTS_SUPPORT_HTTP2
+auto benchmark_concurrent_requests(
+  const std::string_view url,
+  const size_t request_count = 16
+) -> ActorModel::BenchmarkResult;
+
+// Log the result, and the request manager's connection/handshake counts
+auto benchmark_requests(
+  const std::string_view url,
+  const size_t request_count = 16
+) -> void;
+
+} // namespace Requests
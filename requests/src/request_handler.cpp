@@ -12,8 +12,10 @@
 
 #include "actor_model.h"
 
+#include "content_encoder.h"
 #include "http_utils.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -25,7 +27,174 @@ using string_view = std::string_view;
 using string = std::string;
 
 using ActorModel::send;
-using ActorModel::whereis;
+
+auto make_request_key(const Request& req, const bool hash_credentials)
+  -> string;
+
+auto is_credential_header(const string_view k)
+  -> bool;
+
+auto get_credential_digest(const string_view v)
+  -> string;
+
+auto is_credential_header(const string_view k)
+  -> bool
+{
+  return (
+    equals_ignore_case(k, "Authorization")
+    or equals_ignore_case(k, "Proxy-Authorization")
+    or equals_ignore_case(k, "Cookie")
+  );
+}
+
+auto get_credential_digest(const string_view v)
+  -> string
+{
+  // FNV-1a, 64-bit so that different credentials practically never match
+  uint64_t hash = 14695981039346656037ull;
+  for (const auto c : v)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+
+  char digest[17];
+  snprintf(
+    digest,
+    sizeof(digest),
+    "%016llx",
+    static_cast<unsigned long long>(hash)
+  );
+
+  return string{digest};
+}
+
+auto make_request_key(const Request& req, const bool hash_credentials)
+  -> string
+{
+  // Only idempotent requests without side effects
+  auto method = (
+    req.method()? req.method()->string_view() : string_view{"GET"}
+  );
+  if (
+    (method != "GET" and method != "HEAD")
+    or (req.body() and req.body()->size() > 0)
+  )
+  {
+    return {};
+  }
+
+  // Requests with different credentials (headers) never match
+  auto key = string{method};
+  key += '\n';
+  key += req.uri()->string_view();
+
+  if (req.query())
+  {
+    for (const auto* query_pair : *(req.query()))
+    {
+      key += '\n';
+      key += query_pair->k()->string_view();
+      key += '=';
+      key += query_pair->v()->string_view();
+    }
+  }
+
+  if (req.headers())
+  {
+    for (const auto* header_pair : *(req.headers()))
+    {
+      key += '\n';
+      key += header_pair->k()->string_view();
+      key += ": ";
+
+      // e.g. a cache key is written to a file, which must not hold tokens
+      if (
+        hash_credentials
+        and is_credential_header(header_pair->k()->string_view())
+      )
+      {
+        key += get_credential_digest(header_pair->v()->string_view());
+      }
+      else {
+        key += header_pair->v()->string_view();
+      }
+    }
+  }
+
+  return key;
+}
+
+auto make_coalescing_key(const RequestIntent& request_intent)
+  -> string
+{
+  if (
+    not request_intent.coalesce()
+    or request_intent.streaming()
+    or not request_intent.to_pid()
+    or not request_intent.request()
+    or (
+      request_intent.sink()
+      and request_intent.sink()->type() != ResponseSinkType::None
+    )
+  )
+  {
+    return {};
+  }
+
+  auto hash_credentials = false;
+  auto key = make_request_key(*(request_intent.request()), hash_credentials);
+  if (key.empty())
+  {
+    return {};
+  }
+
+  // The response messages also depend on how the body is parsed
+  key += '\n';
+  key += std::to_string(static_cast<int>(request_intent.desired_format()));
+  key += (request_intent.include_headers()? "+headers" : "");
+
+  if (request_intent.object_path())
+  {
+    key += '\n';
+    key += request_intent.object_path()->string_view();
+  }
+
+  if (request_intent.root_type())
+  {
+    key += '\n';
+    key += request_intent.root_type()->string_view();
+  }
+
+  return key;
+}
+
+auto make_cache_key(const RequestIntent& request_intent)
+  -> string
+{
+  // A cached body is replayed through the same response filters, but not
+  // into a sink (which may need the transfer to be paused)
+  if (
+    request_intent.streaming()
+    or not request_intent.to_pid()
+    or not request_intent.request()
+    or (
+      request_intent.sink()
+      and request_intent.sink()->type() != ResponseSinkType::None
+    )
+    or (
+      request_intent.request()->method()
+      and request_intent.request()->method()->string_view() != "GET"
+    )
+  )
+  {
+    return {};
+  }
+
+  // Stored in the cached response's file, unlike a coalescing key
+  auto hash_credentials = true;
+  return make_request_key(*(request_intent.request()), hash_credentials);
+}
 
 RequestHandler::RequestHandler(
   const RequestIntentFlatbufferRef& _request_intent_buf_ref
@@ -41,6 +210,17 @@ RequestHandler::RequestHandler(
     request_intent_mutable_buf.data()
   );
 
+  // The body is written to the sink, instead of sent as messages
+  if (
+    request_intent->sink()
+    and request_intent->sink()->type() != ResponseSinkType::None
+  )
+  {
+    sink_writer.reset(new ResponseSinkWriter{*(request_intent->sink())});
+  }
+
+  coalescing_key = make_coalescing_key(*request_intent);
+
   if (request_intent->to_pid())
   {
     switch (request_intent->desired_format())
@@ -117,10 +297,45 @@ RequestHandler::~RequestHandler()
 
 auto RequestHandler::write_callback(const string_view chunk)
   -> size_t
+{
+#ifdef REQUESTS_USE_CURL
+  if (content_decoder)
+  {
+    auto did_decode = content_decoder->decode(chunk,
+      [this]
+      (string_view decoded_chunk) -> ContentDecoder::PostCallbackAction
+      {
+        // A sink which could not write the chunk aborts the transfer
+        auto written_size = write_body(decoded_chunk);
+        return (written_size == decoded_chunk.size())?
+          ContentDecoder::ContinueProcessing : ContentDecoder::AbortProcessing;
+      }
+    );
+
+    // Less than the chunk size aborts the transfer
+    return did_decode? chunk.size() : 0;
+  }
+#endif // REQUESTS_USE_CURL
+
+  return write_body(chunk);
+}
+
+auto RequestHandler::write_body(const string_view chunk)
+  -> size_t
 {
   auto is_success_code = ((response_code > 0) and (response_code < 400));
   const auto& tag = request_intent->request()->uri()->c_str();
 
+  if (sink_writer and is_success_code)
+  {
+    return write_sink(chunk);
+  }
+
+  if (response_cache and response_code == 200 and not is_replaying_cache)
+  {
+    store_cached_chunk(chunk);
+  }
+
   if (uuid_valid(request_intent->to_pid()))
   {
     if (not is_success_code)
@@ -141,8 +356,7 @@ auto RequestHandler::write_callback(const string_view chunk)
       case ResponseFilter::PartialResponseChunks:
       default:
       {
-        auto partial_response = create_partial_response(chunk);
-        send(*(request_intent->to_pid()), "response_chunk", partial_response);
+        send_partial_response("response_chunk", chunk);
 
         break;
       }
@@ -154,10 +368,12 @@ auto RequestHandler::write_callback(const string_view chunk)
           (string_view server_sent_event_str)
             -> ServerSentEventsEmitter::PostCallbackAction
           {
-            send(
-              *(request_intent->to_pid()),
+            send_to_requesters(
               "server_sent_event",
-              server_sent_event_str
+              ActorModel::BufferView{
+                reinterpret_cast<const uint8_t*>(server_sent_event_str.data()),
+                server_sent_event_str.size()
+              }
             );
 
             return ServerSentEventsEmitter::ContinueProcessing;
@@ -195,8 +411,7 @@ auto RequestHandler::write_callback(const string_view chunk)
             [this]
             (string_view parsed_chunk) -> JsonEmitter::PostCallbackAction
             {
-              auto partial_response = create_partial_response(parsed_chunk);
-              send(*(request_intent->to_pid()), "response_chunk", partial_response);
+              send_partial_response("response_chunk", parsed_chunk);
 
               return JsonEmitter::ContinueProcessing;
             },
@@ -204,9 +419,7 @@ auto RequestHandler::write_callback(const string_view chunk)
             [this]
             (string_view parsed_chunk) -> JsonEmitter::PostCallbackAction
             {
-              // Generate flatbuffer for nesting inside the parent Message object
-              auto partial_response = create_partial_response(parsed_chunk);
-              send(*(request_intent->to_pid()), "response_error", partial_response);
+              send_partial_response("response_error", parsed_chunk);
 
               return JsonEmitter::ContinueProcessing;
             }
@@ -244,8 +457,7 @@ auto RequestHandler::write_callback(const string_view chunk)
             [this]
             (string_view parsed_chunk) -> JsonEmitter::PostCallbackAction
             {
-              auto partial_response = create_partial_response(parsed_chunk);
-              send(*(request_intent->to_pid()), "response_chunk", partial_response);
+              send_partial_response("response_chunk", parsed_chunk);
 
               return JsonEmitter::ContinueProcessing;
             },
@@ -253,8 +465,7 @@ auto RequestHandler::write_callback(const string_view chunk)
             [this]
             (string_view parsed_chunk) -> JsonEmitter::PostCallbackAction
             {
-              auto partial_response = create_partial_response(parsed_chunk);
-              send(*(request_intent->to_pid()), "response_error", partial_response);
+              send_partial_response("response_error", parsed_chunk);
 
               return JsonEmitter::ContinueProcessing;
             }
@@ -279,9 +490,34 @@ auto RequestHandler::write_callback(const string_view chunk)
 auto RequestHandler::finish_callback()
   -> void
 {
+  if (response_cache)
+  {
+    finish_cache();
+  }
+
   auto is_success_code = ((response_code > 0) and (response_code < 400));
   auto is_internal_failure = (response_code < 0);
 
+  if (content_decoder and content_decoder->has_failed())
+  {
+    if (is_success_code)
+    {
+      response_buffer = "Unable to decode response body";
+    }
+
+    is_success_code = false;
+  }
+
+  if (sink_writer and not finish_sink(is_success_code))
+  {
+    if (is_success_code and response_buffer.empty())
+    {
+      response_buffer = "Unable to write response body to sink";
+    }
+
+    is_success_code = false;
+  }
+
   if (request_intent->to_pid())
   {
     // Clear the body for the final message
@@ -303,20 +539,25 @@ auto RequestHandler::finish_callback()
       response_buffer = errbuf.data();
     }
 
-    auto partial_response = create_partial_response(response_buffer);
+    const auto response_body = string_view{
+      response_buffer.data(),
+      response_buffer.size()
+    };
+
     // Send an "response_error" message
     if (not is_success_code)
     {
-      send(*(request_intent->to_pid()), "response_error", partial_response);
+      send_partial_response("response_error", response_body);
     }
 
     // Always send a "response_finished" message, no matter what the response code/state
-    send(*(request_intent->to_pid()), "response_finished", partial_response);
+    send_partial_response("response_finished", response_body);
 
     if (is_internal_failure)
     {
-      auto request_manager_actor_pid = *(whereis("request_manager"));
-      send(request_manager_actor_pid, "exit", errbuf);
+      // Only called from the request manager task
+      static ActorModel::NameHandle request_manager_actor_handle{"request_manager"};
+      send(request_manager_actor_handle, "exit", errbuf);
     }
   }
 
@@ -329,14 +570,13 @@ auto RequestHandler::finish_callback()
 auto RequestHandler::read_callback(const size_t max_chunk_size)
   -> string_view
 {
-  const auto& req = request_intent->request();
-  const auto* req_body = req->body()->data();
+  const auto req_body = get_request_body();
 
-  auto byte_count_remaining = (req->body()->size() - body_sent_byte_count);
-  auto send_chunk = string_view{
-    reinterpret_cast<const char*>(req_body + body_sent_byte_count),
+  auto byte_count_remaining = (req_body.size() - body_sent_byte_count);
+  auto send_chunk = req_body.substr(
+    body_sent_byte_count,
     std::min(byte_count_remaining, max_chunk_size)
-  };
+  );
 
   body_sent_byte_count += send_chunk.size();
 
@@ -380,7 +620,11 @@ auto RequestHandler::header_callback(const string_view k, const string_view v)
       )
     );
 
-    send(*(request_intent->to_pid()), "headers", fbb.Release());
+    const auto header_pair_buf = fbb.Release();
+    send_to_requesters(
+      "headers",
+      ActorModel::BufferView{header_pair_buf.data(), header_pair_buf.size()}
+    );
   }
 
   return 0;
@@ -415,8 +659,13 @@ auto RequestHandler::header_callback(const string_view chunk)
     }
   }
 
-  // Only parse response headers if they were requested
-  if (request_intent->include_headers())
+  // Only parse response headers if they were requested, may be cached, or
+  // may name a content encoding
+  if (
+    request_intent->include_headers()
+    or response_cache
+    or accepts_content_encoding()
+  )
   {
     // Detect trailing CR and/or LF (popped in reverse-order)
     auto len = chunk.size();
@@ -440,16 +689,40 @@ auto RequestHandler::header_callback(const string_view chunk)
       auto k = hdr.substr(0, delim_pos);
       auto v = hdr.substr(delim_pos + delim.size());
 
-      flatbuffers::FlatBufferBuilder fbb;
-      fbb.Finish(
-        CreateHeaderPair(
-          fbb,
-          fbb.CreateString(k),
-          fbb.CreateString(v)
-        )
-      );
+      if (response_cache)
+      {
+        parse_cache_control_header(k, v, response_cache_control);
+      }
+
+      if (
+        not content_decoder
+        and accepts_content_encoding()
+        and equals_ignore_case(k, "Content-Encoding")
+        and ContentDecoder::is_supported(v)
+      )
+      {
+        content_decoder.reset(
+          new ContentDecoder{v, request_intent->inflate_window_bits()}
+        );
+      }
 
-      send(*(request_intent->to_pid()), "headers", fbb.Release());
+      if (request_intent->include_headers())
+      {
+        flatbuffers::FlatBufferBuilder fbb;
+        fbb.Finish(
+          CreateHeaderPair(
+            fbb,
+            fbb.CreateString(k),
+            fbb.CreateString(v)
+          )
+        );
+
+        const auto header_pair_buf = fbb.Release();
+        send_to_requesters(
+          "headers",
+          ActorModel::BufferView{header_pair_buf.data(), header_pair_buf.size()}
+        );
+      }
     }
   }
 
@@ -457,26 +730,390 @@ auto RequestHandler::header_callback(const string_view chunk)
 }
 #endif // REQUESTS_USE_CURL
 
-auto RequestHandler::create_partial_response(const string_view chunk)
-  -> ResponseFlatbuffer
+auto RequestHandler::reset_response()
+  -> void
 {
+  // The response body is written from the start
+  if (sink_writer)
+  {
+    sink_writer->discard();
+    sink_paused = false;
+  }
+
+  cache_store.reset();
+  cache_store_failed = false;
+  response_cache_control = ResponseCacheControl{};
+  content_decoder.reset();
+
+  // Nor is the previous response's code or body kept
+  response_code = -1;
+  response_buffer.clear();
+  errbuf[0] = 0;
+}
+
+auto RequestHandler::store_cached_chunk(const string_view chunk)
+  -> void
+{
+  if (not cache_store and not cache_store_failed)
+  {
+    cache_store = response_cache->begin_store(cache_key, response_cache_control);
+    cache_store_failed = not cache_store;
+  }
+
+  if (cache_store and not response_cache->write_store(*cache_store, chunk))
+  {
+    cache_store.reset();
+    cache_store_failed = true;
+  }
+}
+
+auto RequestHandler::finish_cache()
+  -> void
+{
+  if (response_code == 304)
+  {
+    // Not Modified, so the cached response is sent as if it were received
+    auto* entry = response_cache->find(cache_key);
+    if (entry)
+    {
+      response_cache->refresh(*entry, response_cache_control);
+      replay_cached_response(*entry);
+    }
+  }
+  else if (
+    cache_store
+    and response_code == 200
+    and not (content_decoder and content_decoder->has_failed())
+  )
+  {
+    response_cache->commit_store(std::move(cache_store));
+  }
+
+  cache_store.reset();
+  cache_store_failed = false;
+  response_cache_control = ResponseCacheControl{};
+}
+
+auto RequestHandler::replay_cached_response(ResponseCache::Entry& entry)
+  -> bool
+{
+  auto* file = response_cache->open_body(entry);
+  if (not file)
+  {
+    return false;
+  }
+
+  response_code = 200;
+  is_replaying_cache = true;
+
+  string chunk_buf(ResponseCacheReplayChunkSize, '\0');
+  auto remaining = entry.body_size;
+  while (remaining > 0)
+  {
+    const auto chunk_size = fread(
+      chunk_buf.data(),
+      1,
+      std::min(chunk_buf.size(), remaining),
+      file
+    );
+
+    if (chunk_size == 0)
+    {
+      break;
+    }
+
+    // Stored decoded, whatever the encoding of a 304 response
+    write_body(string_view{chunk_buf.data(), chunk_size});
+    remaining -= chunk_size;
+  }
+
+  is_replaying_cache = false;
+  fclose(file);
+
+  // Part of the body may have been sent already, so fail the response
+  if (remaining > 0)
+  {
+    const auto& tag = request_intent->request()->uri()->c_str();
+    ESP_LOGE(tag, "Unable to read cached response body");
+
+    response_code = 500;
+    response_buffer = "Unable to read cached response body";
+  }
+
+  return true;
+}
+
+auto RequestHandler::write_sink(const string_view chunk)
+  -> size_t
+{
+  const auto result = sink_writer->write(chunk);
+
+  if (
+    result == ResponseSinkWriter::WriteResult::Written
+    and sink_writer->take_progress()
+  )
+  {
+    send_progress();
+  }
+
+#ifdef REQUESTS_USE_CURL
+  if (result == ResponseSinkWriter::WriteResult::Full)
+  {
+    // curl delivers this chunk again once the transfer is unpaused
+    sink_paused = true;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+
+  // Less than the chunk size aborts the transfer
+  return (result == ResponseSinkWriter::WriteResult::Written)? chunk.size() : 0;
+#endif // REQUESTS_USE_CURL
+#ifdef REQUESTS_USE_SH2LIB
+  // A failed write is reported when the response is finished
+  return 0;
+#endif // REQUESTS_USE_SH2LIB
+}
+
+auto RequestHandler::finish_sink(const bool is_success_code)
+  -> bool
+{
+  sink_paused = false;
+
+  if (is_success_code and sink_writer->commit())
+  {
+    // The final progress is always sent, with the full body size
+    send_progress();
+    return true;
+  }
+
+  sink_writer->discard();
+  return false;
+}
+
+auto RequestHandler::send_progress()
+  -> bool
+{
+  if (not uuid_valid(request_intent->to_pid()))
+  {
+    return false;
+  }
+
   flatbuffers::FlatBufferBuilder fbb;
   fbb.Finish(
-    CreateResponse(
+    CreateResponseProgress(
       fbb,
+      request_intent->id(),
+      sink_writer->get_bytes_written()
+    ),
+    RequestIntentIdentifier()
+  );
+
+  return send(*(request_intent->to_pid()), "response_progress", fbb.Release());
+}
+
+auto RequestHandler::encode_request_body()
+  -> bool
+{
+  if (not encoded_request_body.empty())
+  {
+    return true;
+  }
+
+  const auto min_size = request_intent->compress_body_min_bytes();
+  const auto body = get_request_body();
+  if (min_size == 0 or body.empty() or body.size() < min_size)
+  {
+    return false;
+  }
+
+  auto did_encode = gzip_encode(body,
+    [this, &body](string_view encoded_chunk) -> bool
+    {
+      // Not worth sending encoded once it is no smaller
+      if (encoded_request_body.size() + encoded_chunk.size() >= body.size())
+      {
+        return false;
+      }
+
+      encoded_request_body.append(encoded_chunk.data(), encoded_chunk.size());
+      return true;
+    }
+  );
+
+  const auto& tag = request_intent->request()->uri()->c_str();
+  if (not did_encode)
+  {
+    ESP_LOGI(tag, "Sending %zu byte request body unencoded", body.size());
+
+    encoded_request_body.clear();
+    encoded_request_body.shrink_to_fit();
+    return false;
+  }
+
+  ESP_LOGI(
+    tag,
+    "Sending %zu byte request body gzip encoded as %zu bytes",
+    body.size(),
+    encoded_request_body.size()
+  );
+
+  return true;
+}
+
+auto RequestHandler::get_request_body() const
+  -> string_view
+{
+  if (not encoded_request_body.empty())
+  {
+    return string_view{encoded_request_body.data(), encoded_request_body.size()};
+  }
+
+  const auto* req_body = request_intent->request()->body();
+  if (not req_body)
+  {
+    return {};
+  }
+
+  return string_view{
+    reinterpret_cast<const char*>(req_body->data()),
+    req_body->size()
+  };
+}
+
+auto RequestHandler::accepts_content_encoding() const
+  -> bool
+{
+  // A paused transfer delivers the same chunk again, which has already been
+  // inflated, so a Channel sink is sent the body unencoded
+  const auto* sink = request_intent->sink();
+  return (
+    request_intent->decode_content()
+    and not (sink and sink->type() == ResponseSinkType::Channel)
+  );
+}
+
+auto RequestHandler::can_coalesce() const
+  -> bool
+{
+  if (coalescing_key.empty())
+  {
+    return false;
+  }
+
+  // A full response body is only sent once finished, anything else is sent
+  // as it arrives so it is too late once the response has started
+  auto is_buffered = (
+    request_intent->desired_format() == ResponseFilter::FullResponseBody
+    and not request_intent->include_headers()
+  );
+
+  return (is_buffered or response_code < 0);
+}
+
+auto RequestHandler::add_coalesced_requester(
+  const RequestIntent& coalesced_request_intent
+) -> void
+{
+  coalesced_requesters.emplace_back(CoalescedRequester{
+    *(coalesced_request_intent.to_pid()),
+    *(coalesced_request_intent.id())
+  });
+}
+
+auto RequestHandler::send_to_requesters(
+  const string_view type,
+  const ActorModel::BufferView payload
+) -> bool
+{
+  auto did_send = send(*(request_intent->to_pid()), type, payload);
+
+  for (const auto& coalesced_requester : coalesced_requesters)
+  {
+    did_send = (send(coalesced_requester.to_pid, type, payload) and did_send);
+  }
+
+  return did_send;
+}
+
+auto RequestHandler::send_partial_response(
+  const string_view type,
+  const string_view chunk
+) -> bool
+{
+  auto did_send = send_partial_response(
+    *(request_intent->to_pid()),
+    *(request_intent->id()),
+    type,
+    chunk
+  );
+
+  // Each with its own request id, which the requester matches on
+  for (const auto& coalesced_requester : coalesced_requesters)
+  {
+    did_send = (
+      send_partial_response(
+        coalesced_requester.to_pid,
+        coalesced_requester.request_id,
+        type,
+        chunk
+      )
+      and did_send
+    );
+  }
+
+  return did_send;
+}
+
+auto RequestHandler::send_partial_response(
+  const ActorModel::Pid& to_pid,
+  const UUID::UUID& request_id,
+  const string_view type,
+  const string_view chunk
+) -> bool
+{
+  // Only the Response table around the body is serialized (into a builder
+  // re-used for every chunk), the chunk itself is gathered straight into the
+  // recipient's mailbox
+  partial_response_fbb.Clear();
+
+  uint8_t* body_data = nullptr;
+  auto body = partial_response_fbb.CreateUninitializedVector(
+    chunk.size(),
+    &body_data
+  );
+
+  // The builder writes back to front, so the body offset from the end of
+  // the buffer is already final
+  const auto body_offset_from_end = (
+    partial_response_fbb.GetSize()
+    - (body_data - partial_response_fbb.GetCurrentBufferPointer())
+  );
+
+  partial_response_fbb.Finish(
+    CreateResponse(
+      partial_response_fbb,
       response_code,
       0, // headers
-      fbb.CreateVector(
-        reinterpret_cast<const uint8_t*>(chunk.data()),
-        chunk.size()
-      ), // body
+      body,
       0, // errbuf
-      request_intent->id()
+      &request_id
     ),
     RequestIntentIdentifier()
   );
 
-  return fbb.Release();
+  const auto* response_data = partial_response_fbb.GetBufferPointer();
+  const auto response_size = partial_response_fbb.GetSize();
+  const auto body_offset = (response_size - body_offset_from_end);
+
+  const ActorModel::BufferView pieces[] = {
+    {response_data, body_offset},
+    {reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size()},
+    {
+      response_data + body_offset + chunk.size(),
+      response_size - body_offset - chunk.size()
+    }
+  };
+
+  return send(to_pid, type, ActorModel::BufferViews{pieces});
 }
 
 } // namespace Requests
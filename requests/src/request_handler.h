@@ -12,8 +12,13 @@
 
 #include "requests.h"
 
+#include "content_decoder.h"
+#include "response_cache.h"
+#include "response_sink_writer.h"
 #include "server_sent_events_emitter.h"
 
+#include "memory_placement.h"
+
 #if REQUESTS_SUPPORT_JSON
 #include "json_emitter.h"
 
@@ -36,8 +41,43 @@ namespace Requests {
 using ResponseFlatbuffer = flatbuffers::DetachedBuffer;
 using ServerSentEventFlatbuffer = flatbuffers::DetachedBuffer;
 
+// Response bodies can be large and are not latency-critical
+#ifdef REQUESTS_RESPONSE_BUFFER_SPIRAM
+constexpr auto ResponseBufferPlacement = ActorModel::MemoryPlacement::spiram;
+#else
+constexpr auto ResponseBufferPlacement = ActorModel::MemoryPlacement::any;
+#endif // REQUESTS_RESPONSE_BUFFER_SPIRAM
+
+using ResponseBuffer = std::basic_string<
+  char,
+  std::char_traits<char>,
+  ActorModel::PlacementStdAllocator<char, ResponseBufferPlacement>
+>;
+
 class RequestManager;
 
+// The requester of an identical request, which shares the transfer of
+// the first one (see RequestIntent.coalesce)
+struct CoalescedRequester
+{
+  ActorModel::Pid to_pid;
+  UUID::UUID request_id;
+};
+
+using CoalescedRequesters = std::vector<CoalescedRequester>;
+
+// Identifies identical requests, empty if the request is not eligible to
+// share a transfer
+auto make_coalescing_key(const RequestIntent& request_intent)
+  -> std::string;
+
+// Identifies a cached response, empty if the request is not eligible
+auto make_cache_key(const RequestIntent& request_intent)
+  -> std::string;
+
+// A cached body is sent through write_callback in chunks of this size
+constexpr size_t ResponseCacheReplayChunkSize = 1024;
+
 struct RequestHandler
 {
   friend class RequestManager;
@@ -63,7 +103,7 @@ struct RequestHandler
 
   string errbuf;
   short response_code = -1;
-  string response_buffer;
+  ResponseBuffer response_buffer;
 
 #ifdef REQUESTS_USE_CURL
   curl_slist *slist = nullptr;
@@ -93,9 +133,105 @@ struct RequestHandler
   auto finish_callback()
     -> void;
 
+  // Whether to ask for a gzip or deflate encoded body, which is decoded
+  // before it is written to the sink or filtered
+  auto accepts_content_encoding() const
+    -> bool;
+
+  // Gzip encode the request body (once), if RequestIntent.compress_body_min_bytes
+  // asks for it and that makes it smaller. Whether it is sent encoded
+  auto encode_request_body()
+    -> bool;
+
+  // The body to send, encoded or not
+  auto get_request_body() const
+    -> string_view;
+
+  // Set once a response header names an encoding which can be decoded
+  std::unique_ptr<ContentDecoder> content_decoder;
+
+  // Discard the response received so far, before the request is sent again
+  auto reset_response()
+    -> void;
+
+  // Whether a requester joining now still receives the whole response
+  auto can_coalesce() const
+    -> bool;
+
+  auto add_coalesced_requester(const RequestIntent& coalesced_request_intent)
+    -> void;
+
+  // Empty unless identical requests may share this one's transfer
+  string coalescing_key;
+
+  // Send the cached body (of a fresh or Not Modified response) to the
+  // requester, as if it had just been received. False if it can not be
+  // opened, otherwise a body which can not be read fails the response
+  auto replay_cached_response(ResponseCache::Entry& entry)
+    -> bool;
+
+  // Set by the request manager if the response may be cached
+  ResponseCache* response_cache = nullptr;
+  string cache_key;
+
 private:
-  auto create_partial_response(const string_view chunk)
-    -> ResponseFlatbuffer;
+  // Send the same payload to the requester, and any coalesced requesters
+  auto send_to_requesters(
+    const string_view type,
+    const ActorModel::BufferView payload
+  ) -> bool;
+
+  auto send_partial_response(
+    const ActorModel::Pid& to_pid,
+    const UUID::UUID& request_id,
+    const string_view type,
+    const string_view chunk
+  ) -> bool;
+
+  // Send a Response message with chunk as its body, copied once (for each
+  // of the requesters)
+  auto send_partial_response(const string_view type, const string_view chunk)
+    -> bool;
+
+  // Write a chunk of the (decoded) body to the sink, cache and requesters
+  auto write_body(const string_view chunk)
+    -> size_t;
+
+  auto store_cached_chunk(const string_view chunk)
+    -> void;
+
+  // Store a 200 response, or send the cached response for a 304
+  auto finish_cache()
+    -> void;
+
+  // Write a chunk of a successful response body to the sink
+  auto write_sink(const string_view chunk)
+    -> size_t;
+
+  // Commit the body written to the sink, false if it could not be written
+  auto finish_sink(const bool is_success_code)
+    -> bool;
+
+  auto send_progress()
+    -> bool;
+
+  // Re-used for each Response sent, which only serializes the envelope
+  flatbuffers::FlatBufferBuilder partial_response_fbb{128};
+
+  CoalescedRequesters coalesced_requesters;
+
+  // Empty unless the request body is sent gzip encoded
+  ResponseBuffer encoded_request_body;
+
+  ResponseCacheControl response_cache_control;
+  ResponseCache::StorePtr cache_store;
+  bool cache_store_failed = false;
+  bool is_replaying_cache = false;
+
+  std::unique_ptr<ResponseSinkWriter> sink_writer;
+
+  // Until the sink (a full channel) can accept the chunk again
+  bool sink_paused = false;
 
   std::unique_ptr<ServerSentEventsEmitter> server_sent_events_emitter;
 
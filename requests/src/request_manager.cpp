@@ -10,6 +10,7 @@
 
 #include "request_manager.h"
 
+#include "actor_model.h"
 #include "http_utils.h"
 
 #include <algorithm>
@@ -49,6 +50,25 @@ auto writefunction(char *buf, size_t size, size_t nmemb, void* userdata)
 auto sslctx_function(CURL* curl, void* ssl_ctx, void* userdata)
   -> CURLcode;
 
+auto prereq_function(
+  void* clientp,
+  char* conn_primary_ip,
+  char* conn_local_ip,
+  int conn_primary_port,
+  int conn_local_port
+) -> int;
+
+auto socketfunction(
+  CURL* curl,
+  curl_socket_t fd,
+  int what,
+  void* userdata,
+  void* socketdata
+) -> int;
+
+auto timerfunction(CURLM* multi, long timeout_ms, void* userdata)
+  -> int;
+
 // Implementation:
 auto header_callback(char* buf, size_t size, size_t nitems, void* userdata)
   -> size_t
@@ -70,6 +90,34 @@ auto sslctx_function(CURL* curl, void* ssl_ctx, void* userdata)
   auto* conf = static_cast<mbedtls_ssl_config*>(ssl_ctx);
   return static_cast<RequestManager*>(userdata)->sslctx_callback(curl, conf);
 }
+
+auto prereq_function(
+  void* clientp,
+  char* conn_primary_ip,
+  char* conn_local_ip,
+  int conn_primary_port,
+  int conn_local_port
+) -> int
+{
+  return static_cast<RequestManager*>(clientp)->prereq_callback();
+}
+
+auto socketfunction(
+  CURL* curl,
+  curl_socket_t fd,
+  int what,
+  void* userdata,
+  void* socketdata
+) -> int
+{
+  return static_cast<RequestManager*>(userdata)->socket_callback(fd, what);
+}
+
+auto timerfunction(CURLM* multi, long timeout_ms, void* userdata)
+  -> int
+{
+  return static_cast<RequestManager*>(userdata)->timer_callback(timeout_ms);
+}
 #endif // REQUESTS_USE_CURL
 
 #ifdef REQUESTS_USE_SH2LIB
@@ -143,10 +191,12 @@ auto header_recv_cb(
 
 #endif // REQUESTS_USE_SH2LIB
 
-RequestManager::RequestManager()
+RequestManager::RequestManager(const ActorModel::Pid& _owner_pid)
 #ifdef REQUESTS_USE_CURL
 : multi_handle(curl_multi_init(), curl_multi_cleanup)
+, share_handle(nullptr, curl_share_cleanup)
 , requests{}
+, owner_pid(_owner_pid)
 #else
 : requests{}
 #endif // REQUESTS_USE_CURL
@@ -156,6 +206,24 @@ RequestManager::RequestManager()
 
   auto m = multi_handle.get();
 
+  // curl asks for sockets to be watched, and for a timeout, which are then
+  // reported back to socket_action() by the owner process
+  curl_multi_setopt(m, CURLMOPT_SOCKETFUNCTION, socketfunction);
+  curl_multi_setopt(m, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(m, CURLMOPT_TIMERFUNCTION, timerfunction);
+  curl_multi_setopt(m, CURLMOPT_TIMERDATA, this);
+
+  share_handle.reset(curl_share_init());
+  if (share_handle)
+  {
+    // Only used from the request manager's task, so no lock callbacks
+    auto* sh = share_handle.get();
+    curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  }
+  else {
+    ESP_LOGW(TAG, "Unable to create share handle, DNS cache not shared");
+  }
+
 #ifdef REQUESTS_MAX_CONNECTIONS
   // Set the maximum number of connections to keep in the cache
   curl_multi_setopt(m, CURLMOPT_MAXCONNECTS, REQUESTS_MAX_CONNECTIONS);
@@ -164,8 +232,24 @@ RequestManager::RequestManager()
   curl_multi_setopt(m, CURLMOPT_MAX_TOTAL_CONNECTIONS, REQUESTS_MAX_CONNECTIONS);
 #endif
 
-  // Attempt to pipeline and/or multiplex requests if possible
-  // curl_multi_setopt(m, CURLMOPT_PIPELINING, CURLPIPE_HTTP1|CURLPIPE_MULTIPLEX);
+  // One connection per origin, requests to it are multiplexed as streams
+  curl_multi_setopt(
+    m,
+    CURLMOPT_MAX_HOST_CONNECTIONS,
+    REQUESTS_MAX_HOST_CONNECTIONS
+  );
+
+#if REQUESTS_SUPPORT_HTTP2
+  // Multiplex requests to the same host over one HTTP/2 connection
+  curl_multi_setopt(m, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+  // Upper bound for every host, see set_max_concurrent_streams
+  curl_multi_setopt(
+    m,
+    CURLMOPT_MAX_CONCURRENT_STREAMS,
+    REQUESTS_MAX_CONCURRENT_STREAMS
+  );
+#endif // REQUESTS_SUPPORT_HTTP2
 
   // Initialize (empty) CA certificate chain
   mbedtls_x509_crt_init(&curl_cacerts);
@@ -187,6 +271,30 @@ RequestManager::RequestManager()
 RequestManager::~RequestManager()
 {
 #ifdef REQUESTS_USE_CURL
+  // Members are destroyed before the multi handle, which still calls back
+  // while closing its connections
+  curl_multi_setopt(multi_handle.get(), CURLMOPT_SOCKETFUNCTION, nullptr);
+  curl_multi_setopt(multi_handle.get(), CURLMOPT_TIMERFUNCTION, nullptr);
+
+  if (timeout_tref != ActorModel::NullTRef)
+  {
+    ActorModel::cancel(timeout_tref);
+  }
+
+  if (sink_resume_tref != ActorModel::NullTRef)
+  {
+    ActorModel::cancel(sink_resume_tref);
+  }
+
+  for (const auto& watched_socket : watched_sockets)
+  {
+    ActorModel::unwatch_socket(watched_socket.first);
+  }
+
+  // Waiting handles are owned by requests, and were never added to the
+  // multi handle
+  host_streams.clear();
+
   for (const auto& req : requests)
   {
     auto& handle = req.first;
@@ -209,25 +317,48 @@ auto RequestManager::fetch(
   // Only create a new request intent if an old one is not found
   if (existing_handler == requests.end())
   {
-#ifdef REQUESTS_USE_SH2LIB
-    HandleImpl* _handle = new HandleImpl;
-    _handle->hd = static_cast<sh2lib_handle*>(malloc(sizeof(sh2lib_handle)));
-#endif
-    const auto& inserted = requests.emplace(
-      std::move(HandleImplPtr{
+    // Share the transfer of an identical request, if it is still early
+    // enough to receive its whole response
+    auto coalescing_key = make_coalescing_key(*_request_intent);
+    if (not coalescing_key.empty())
+    {
+      auto coalesced_request = coalesced_requests.find(coalescing_key);
+      if (
+        coalesced_request != coalesced_requests.end()
+        and coalesced_request->second->can_coalesce()
+      )
+      {
+        const auto& tag = _request_intent->request()->uri()->c_str();
+        ESP_LOGI(tag, "Sharing identical request which is in flight");
+
+        coalesced_request->second->add_coalesced_requester(*_request_intent);
+        return true;
+      }
+    }
+
 #ifdef REQUESTS_USE_CURL
-        curl_easy_init(),
-        curl_easy_cleanup
+    auto handle_ptr = acquire_handle();
+    if (not handle_ptr)
+    {
+      ESP_LOGE(TAG, "Unable to create request handle");
+      return false;
+    }
 #endif // REQUESTS_USE_CURL
 #ifdef REQUESTS_USE_SH2LIB
-        _handle,
-        [](HandleImpl* handle)
-        {
-          sh2lib_free(handle->hd);
-          delete handle;
-        }
+    HandleImpl* _handle = new HandleImpl;
+    _handle->hd = static_cast<sh2lib_handle*>(malloc(sizeof(sh2lib_handle)));
+
+    auto handle_ptr = HandleImplPtr{
+      _handle,
+      [](HandleImpl* handle)
+      {
+        sh2lib_free(handle->hd);
+        delete handle;
+      }
+    };
 #endif // REQUESTS_USE_SH2LIB
-      }),
+    const auto& inserted = requests.emplace(
+      std::move(handle_ptr),
       std::move(RequestHandler{
         _request_intent_buf_ref
       })
@@ -238,6 +369,20 @@ auto RequestManager::fetch(
       auto& handle = inserted.first->first;
       auto& handler = inserted.first->second;
 
+#ifdef REQUESTS_USE_CURL
+      if (serve_cached_response(handler))
+      {
+        remove_request(inserted.first);
+        return true;
+      }
+#endif // REQUESTS_USE_CURL
+
+      // Replaces one which has started too long ago to be shared
+      if (not handler.coalescing_key.empty())
+      {
+        coalesced_requests[handler.coalescing_key] = &handler;
+      }
+
       return send(handle.get(), handler);
     }
   }
@@ -288,59 +433,38 @@ auto RequestManager::send(
     // Reset the c-string contents to zero-length, null-terminated
     handler.errbuf[0] = 0;
 
+    // Common options were set when the handle was created or reset
     auto* curl = handle;
     curl_easy_setopt(curl, CURLOPT_URL, handler._req_url.c_str());
 
-    // Do not print out any updates to stdout
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-    // Do not install signal handlers
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-
     // Set user data pointer attached to this request
     curl_easy_setopt(curl, CURLOPT_PRIVATE, &handler);
 
     // Provide a buffer for curl to store error strings in
     curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, handler.errbuf.data());
 
-    // Follow redirects (3xx responses) until the actual URL is found
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-
-    // Attempt HTTP/2 for HTTPS URLs, fallback to HTTP/1.1 otherwise
-#if REQUESTS_SUPPORT_HTTP2
-    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
-#else
-    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
-#endif
-
-    // Waiting for pending connections to be established,
-    // to multiplex if possible
-    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
-
-    // Do not include headers in the response stream
-    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
-    // Parse headers with a separate callback
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
     // Set user data pointer attached to the header function for this request
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &handler);
 
-    // Body data incremental callback
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunction);
     // Set user data pointer attached to the write function for this request
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &handler);
 
-    // Verify SSL certificates with CA cert(s)
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    // Expect PEM formatted CA cert(s)
-    // curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
-    // Use a function to supply PEM contents of CA cert(s) in memory buffer
-    curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, sslctx_function);
-    // Set user data pointer attached to the sslctx function for this request
-    curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, this);
-
-    // Turn off the default CA locations, so no attempts are made to load them
-    curl_easy_setopt(curl, CURLOPT_CAINFO, NULL);
-    curl_easy_setopt(curl, CURLOPT_CAPATH, NULL);
+    // Re-use a cached connection to the same host (skipping the TLS
+    // handshake) only if it has been idle for less than the host's policy
+    const auto keepalive = get_keepalive(handler._req_url);
+    if (keepalive.max_idle_seconds > 0)
+    {
+      curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, keepalive.max_idle_seconds);
+      curl_easy_setopt(
+        curl,
+        CURLOPT_MAXLIFETIME_CONN,
+        keepalive.max_lifetime_seconds
+      );
+    }
+    else {
+      // Close the connection once this request is done
+      curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+    }
 
     if (handler.slist != nullptr)
     {
@@ -349,13 +473,69 @@ auto RequestManager::send(
       handler.slist = nullptr;
     }
 
+    auto has_accept_encoding = false;
+    auto has_content_encoding = false;
     if (req->headers() and req->headers()->size() > 0)
     {
       for (const auto* hdr : *(req->headers()))
       {
         string hdr_str(hdr->k()->str() + string(": ") + hdr->v()->str());
         handler.slist = curl_slist_append(handler.slist, hdr_str.c_str());
+
+        if (equals_ignore_case(hdr->k()->string_view(), "Accept-Encoding"))
+        {
+          has_accept_encoding = true;
+        }
+        else if (equals_ignore_case(hdr->k()->string_view(), "Content-Encoding"))
+        {
+          has_content_encoding = true;
+        }
+      }
+    }
+
+    // A body which is already encoded is sent as it is
+    if (not has_content_encoding and handler.encode_request_body())
+    {
+      handler.slist = curl_slist_append(
+        handler.slist,
+        "Content-Encoding: gzip"
+      );
+    }
+
+    // Decoded by the handler rather than by curl (which is not given
+    // CURLOPT_ACCEPT_ENCODING), to bound the inflate window per request
+    if (handler.accepts_content_encoding() and not has_accept_encoding)
+    {
+      handler.slist = curl_slist_append(
+        handler.slist,
+        "Accept-Encoding: gzip, deflate"
+      );
+    }
+
+    // Revalidate a stale cached response, which is sent if it is unchanged
+    auto* cached_response = (
+      handler.response_cache?
+        handler.response_cache->find(handler.cache_key) : nullptr
+    );
+    if (cached_response)
+    {
+      if (not cached_response->etag.empty())
+      {
+        auto hdr_str = string{"If-None-Match: "} + cached_response->etag;
+        handler.slist = curl_slist_append(handler.slist, hdr_str.c_str());
       }
+
+      if (not cached_response->last_modified.empty())
+      {
+        auto hdr_str = (
+          string{"If-Modified-Since: "} + cached_response->last_modified
+        );
+        handler.slist = curl_slist_append(handler.slist, hdr_str.c_str());
+      }
+    }
+
+    if (handler.slist)
+    {
       curl_easy_setopt(curl, CURLOPT_HTTPHEADER, handler.slist);
     }
 
@@ -374,12 +554,17 @@ auto RequestManager::send(
     }
 
     // Set the POST body data, if the request specifies a body
-    if (req->body() and req->body()->size() > 0)
+    const auto req_body = handler.get_request_body();
+    if (not req_body.empty())
     {
       // Specify the length of the post body
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, req->body()->size());
+      curl_easy_setopt(
+        curl,
+        CURLOPT_POSTFIELDSIZE,
+        static_cast<long>(req_body.size())
+      );
       // Specify a pointer to the data of the post body, do not delete it
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req->body()->data());
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req_body.data());
     }
 
     // Specify the maximum request time in milliseconds (abort after this)
@@ -395,9 +580,8 @@ auto RequestManager::send(
 
     const auto& tag = handler.request_intent->request()->uri()->c_str();
     ESP_LOGI(tag, "%s", req->method()->c_str());
-    curl_multi_add_handle(multi_handle.get(), curl);
 
-    return true;
+    return start_stream(curl, handler._req_url);
 #endif // REQUESTS_USE_CURL
 
 #ifdef REQUESTS_USE_SH2LIB
@@ -520,8 +704,19 @@ auto RequestManager::send(
         return retval;
       }
       else {
+        if (handler.encode_request_body())
+        {
+          nva_vec.emplace_back(nghttp2_nv{
+            (uint8_t*)("Content-Encoding"),
+            (uint8_t*)("gzip"),
+            strlen("Content-Encoding"),
+            strlen("gzip"),
+            flags
+          });
+        }
+
         // Add content length header with request body size
-        auto content_length = std::to_string(req->body()->size());
+        auto content_length = std::to_string(handler.get_request_body().size());
 
         nva_vec.emplace_back(nghttp2_nv{
           (uint8_t*)("Content-Length"),
@@ -555,130 +750,326 @@ auto RequestManager::send(
   return false;
 }
 
-auto RequestManager::wait_any()
+#ifdef REQUESTS_USE_CURL
+auto RequestManager::socket_action(const curl_socket_t fd, const int events)
   -> size_t
 {
-#ifdef REQUESTS_USE_CURL
-  int inflight_count;
-  int MAX_WAIT_MSECS = (5*1000);
-
-  // Do a bit of work, if any, before waiting
-  curl_multi_perform(multi_handle.get(), &inflight_count);
-
-  int numfds = 0;
-  int ret = curl_multi_wait(
-    multi_handle.get(),
-    nullptr,
-    0,
-    MAX_WAIT_MSECS,
-    &numfds
+  int running_count = 0;
+  curl_multi_socket_action(multi_handle.get(), fd, events, &running_count);
+
+  // Interest is one-shot, watch again unless curl removed the socket
+  if (fd != CURL_SOCKET_TIMEOUT)
+  {
+    auto watched_socket_iter = watched_sockets.find(fd);
+    if (watched_socket_iter != watched_sockets.end())
+    {
+      watch(fd, watched_socket_iter->second);
+    }
+  }
+
+  process_completions();
+  schedule_sink_resume();
+
+  return requests.size();
+}
+
+auto RequestManager::resume_sinks()
+  -> size_t
+{
+  sink_resume_tref = ActorModel::NullTRef;
+
+  for (auto& req : requests)
+  {
+    auto& handle = req.first;
+    auto& handler = req.second;
+
+    if (handler.sink_paused)
+    {
+      // The paused chunk is delivered again from within curl_easy_pause
+      handler.sink_paused = false;
+      curl_easy_pause(handle.get(), CURLPAUSE_CONT);
+    }
+  }
+
+  process_completions();
+  schedule_sink_resume();
+
+  return requests.size();
+}
+
+auto RequestManager::schedule_sink_resume()
+  -> void
+{
+  if (sink_resume_tref != ActorModel::NullTRef)
+  {
+    return;
+  }
+
+  const auto is_any_sink_paused = std::any_of(
+    requests.begin(),
+    requests.end(),
+    [](const auto& req) -> bool
+    {
+      return req.second.sink_paused;
+    }
   );
 
-  if (ret != CURLM_OK)
+  // Nothing wakes a paused transfer, so poll until the channel has room
+  if (is_any_sink_paused)
+  {
+    sink_resume_tref = ActorModel::send_after(
+      ActorModel::Time{REQUESTS_SINK_RESUME_INTERVAL_MS},
+      owner_pid,
+      "sink_resume"
+    );
+  }
+}
+
+auto RequestManager::timeout_action()
+  -> size_t
+{
+  timeout_tref = ActorModel::NullTRef;
+
+  return socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+auto RequestManager::socket_callback(const curl_socket_t fd, const int what)
+  -> int
+{
+  if (what == CURL_POLL_REMOVE)
+  {
+    watched_sockets.erase(fd);
+    ActorModel::unwatch_socket(fd);
+
+    return 0;
+  }
+
+  auto& interests = watched_sockets[fd];
+  if (interests != what)
+  {
+    // Drop any interest curl no longer has, e.g. writable once connected
+    if (interests)
+    {
+      ActorModel::unwatch_socket(fd);
+    }
+
+    interests = what;
+    watch(fd, interests);
+  }
+
+  return 0;
+}
+
+auto RequestManager::timer_callback(const long timeout_ms)
+  -> int
+{
+  if (timeout_tref != ActorModel::NullTRef)
+  {
+    ActorModel::cancel(timeout_tref);
+    timeout_tref = ActorModel::NullTRef;
+  }
+
+  // -1 to stop the timer
+  if (timeout_ms < 0)
+  {
+    return 0;
+  }
+
+  // Too soon for a timer tick, must not call curl from this callback though
+  if (timeout_ms < static_cast<long>(portTICK_PERIOD_MS))
   {
-    ESP_LOGE(TAG, "error: curl_multi_wait() returned %d", ret);
+    ActorModel::send(owner_pid, "socket_timeout");
+  }
+  else {
+    timeout_tref = ActorModel::send_after(
+      ActorModel::Time{timeout_ms},
+      owner_pid,
+      "socket_timeout"
+    );
+  }
+
+  return 0;
+}
+
+auto RequestManager::watch(const curl_socket_t fd, const int what)
+  -> bool
+{
+  uint8_t interests = 0;
+  if (what & CURL_POLL_IN)
+  {
+    interests |= ActorModel::SocketInterestReadable;
+  }
+
+  if (what & CURL_POLL_OUT)
+  {
+    interests |= ActorModel::SocketInterestWritable;
+  }
+
+  if (not ActorModel::watch_socket(owner_pid, fd, interests))
+  {
+    ESP_LOGE(TAG, "Unable to watch socket %d", fd);
     return false;
   }
 
-  // Perform the work that after waiting
-  curl_multi_perform(multi_handle.get(), &inflight_count);
+  return true;
+}
 
+auto RequestManager::process_completions()
+  -> void
+{
   int msgs_left;
   CURLMsg* msg = nullptr;
   // Check for any messages, from any transfers
   while ((msg = curl_multi_info_read(multi_handle.get(), &msgs_left)))
   {
-    // If a request has finished, find it and execute relevant callbacks
-    if (msg->msg == CURLMSG_DONE)
+    // If a request has finished, execute relevant callbacks
+    if (msg->msg != CURLMSG_DONE)
     {
-      auto& done_handle = msg->easy_handle;
+      continue;
+    }
 
-      // Search for the matching handle
-      auto done_req = std::find_if(requests.begin(), requests.end(),
-        [done_handle]
-        (const auto& handler_iter) -> bool
-        {
-          return (handler_iter.first.get() == done_handle);
-        }
+    auto* done_handle = msg->easy_handle;
+
+    // Set by send() to the handler of this request
+    char* handler_ptr = nullptr;
+    curl_easy_getinfo(done_handle, CURLINFO_PRIVATE, &handler_ptr);
+    if (handler_ptr == nullptr)
+    {
+      continue;
+    }
+
+    auto& handler = *(reinterpret_cast<RequestHandler*>(handler_ptr));
+    const auto& tag = handler.request_intent->request()->uri()->c_str();
+    auto response_code = handler.response_code;
+
+    record_tls_handshake(done_handle, tag);
+    tls_handshakes.erase(done_handle);
+
+    if (handler.request_intent->streaming())
+    {
+      ESP_LOGI(
+        tag,
+        "Leaving completed request connection open for streaming"
       );
 
-      // If a matching request handle was found
-      if (done_req != requests.end())
+      // The transfer is done, so let the next request to this host (if
+      // any) take the stream, as for a buffered request
+      finish_stream(handler._req_url);
+
+      handler.finish_callback();
+      record_content_decoding(handler, tag);
+      handler.content_decoder.reset();
+
+      // Reset the previous response error code
+      handler.response_code = -1;
+
+      // Reset the c-string contents to zero-length, null-terminated
+      handler.errbuf[0] = 0;
+    }
+    else {
+      // Remove the request handle from the multi handle
+      curl_multi_remove_handle(multi_handle.get(), done_handle);
+
+      // The cached response revalidated by a 304 may have been evicted
+      // since the request was sent, so the body has to be requested again
+      if (
+        response_code == 304
+        and handler.response_cache
+        and not handler.response_cache->find(handler.cache_key)
+        and remove_cache_validators(handler, done_handle)
+      )
       {
-        auto& handle = done_req->first;
-        auto& handler = done_req->second;
-        const auto& tag = handler.request_intent->request()->uri()->c_str();
-        auto response_code = handler.response_code;
+        ESP_LOGW(tag, "Requesting evicted cached response again");
 
-        if (handler.request_intent->streaming())
-        {
-          ESP_LOGI(
-            tag,
-            "Leaving completed request connection open for streaming"
-          );
+        handler.reset_response();
+        curl_multi_add_handle(multi_handle.get(), done_handle);
+      }
+      else if (
+        (response_code < 0 or response_code >= 500)
+        and handler.request_intent->retries() > 0
+      )
+      {
+        ESP_LOGW(tag, "Retrying request with error %d", response_code);
 
-          handler.finish_callback();
+        handler.reset_response();
+        curl_multi_add_handle(multi_handle.get(), done_handle);
 
-          // Reset the previous response error code
-          handler.response_code = -1;
+        // Decrement the remaining retry count
+        handler.request_intent->mutate_retries(
+          handler.request_intent->retries() - 1
+        );
+      }
+      else {
+        // Let the next request to this host (if any) take the stream
+        finish_stream(handler._req_url);
+
+        forget_coalesced_request(handler);
+
+        // Succeeded or no more retries, return the final result
+        handler.finish_callback();
+        record_content_decoding(handler, tag);
+
+        // Reset the previous response error code
+        handler.response_code = -1;
+
+        // Reset the c-string contents to zero-length, null-terminated
+        handler.errbuf[0] = 0;
 
-          // Reset the c-string contents to zero-length, null-terminated
-          handler.errbuf[0] = 0;
+        // Reset request/response state
+        if (handler.slist)
+        {
+          // Free the list of headers used in the request
+          curl_slist_free_all(handler.slist);
+          handler.slist = nullptr;
+        }
+
+        if (response_code > 0)
+        {
+          ESP_LOGI(tag, "Deleting completed request handle");
         }
         else {
-          // Remove the request handle from the multi handle
-          curl_multi_remove_handle(multi_handle.get(), done_handle);
-
-          if (
-            (response_code < 0 or response_code >= 500)
-            and handler.request_intent->retries() > 0
-          )
-          {
-            ESP_LOGW(tag, "Retrying request with error %d", response_code);
-            curl_multi_add_handle(multi_handle.get(), handle.get());
-
-            // Decrement the remaining retry count
-            handler.request_intent->mutate_retries(
-              handler.request_intent->retries() - 1
-            );
-          }
-          else {
-            // Succeeded or no more retries, return the final result
-            handler.finish_callback();
-
-            // Reset the previous response error code
-            handler.response_code = -1;
-
-            // Reset the c-string contents to zero-length, null-terminated
-            handler.errbuf[0] = 0;
-
-            // Reset request/response state
-            if (handler.slist)
-            {
-              // Free the list of headers used in the request
-              curl_slist_free_all(handler.slist);
-              handler.slist = nullptr;
-            }
-
-            if (response_code > 0)
-            {
-              ESP_LOGI(tag, "Deleting completed request handle");
-            }
-            else {
-              ESP_LOGW(tag, "Deleting failed request handle");
-            }
-
-            // Dispose handle (curl_multi may retain it in the connection cache)
-            // Cleanup, free request handle and RequestT/ResponseT objects
-            requests.erase(done_req);
-          }
+          ESP_LOGW(tag, "Deleting failed request handle");
+        }
+
+        // Keep the handle for a later request (its connection is kept
+        // in the multi handle's connection cache either way), then
+        // free the RequestT/ResponseT objects
+        auto done_req = find_request(done_handle);
+        if (done_req != requests.end())
+        {
+          remove_request(done_req);
         }
       }
     }
   }
+}
+
+auto RequestManager::find_request(HandleImpl* handle)
+  -> RequestMap::iterator
+{
+  // Hashed by pointer, so an unowned key finds the owned one
+  auto unowned_handle = HandleImplPtr{handle, [](HandleImpl*){}};
+
+  return requests.find(unowned_handle);
+}
+
+auto RequestManager::remove_request(RequestMap::iterator req_iter)
+  -> void
+{
+  auto& handle = req_iter->first;
+  auto& handler = req_iter->second;
+  remove_waiting_stream(handle.get(), handler._req_url);
+  tls_handshakes.erase(handle.get());
+
+  auto done_node = requests.extract(req_iter);
+  release_handle(std::move(done_node.key()));
+}
 #endif // REQUESTS_USE_CURL
 
 #ifdef REQUESTS_USE_SH2LIB
+auto RequestManager::wait_any()
+  -> size_t
+{
   for (auto req_iter = begin(requests); req_iter != end(requests);)
   {
     auto& handle = req_iter->first;
@@ -692,6 +1083,8 @@ auto RequestManager::wait_any()
 
       if (handler.finished)
       {
+        forget_coalesced_request(handler);
+
         ESP_LOGI(tag, "Deleting completed request handle");
         req_iter = requests.erase(req_iter);
         continue;
@@ -701,7 +1094,6 @@ auto RequestManager::wait_any()
     // Increment unless already handled
     ++req_iter;
   }
-#endif // REQUESTS_USE_SH2LIB
 
   return requests.size();
 }
@@ -714,6 +1106,7 @@ auto RequestManager::wait_all()
 
   return requests.size();
 }
+#endif // REQUESTS_USE_SH2LIB
 
 auto RequestManager::add_cacert_pem(const BufferView cacert_pem)
   -> bool
@@ -801,6 +1194,431 @@ auto RequestManager::add_cacert_der(const BufferView cacert_der)
 }
 
 #ifdef REQUESTS_USE_CURL
+auto RequestManager::set_keepalive(
+  const string_view host,
+  const HostKeepalive& keepalive
+) -> void
+{
+  host_keepalives[string{host}] = keepalive;
+}
+
+auto RequestManager::get_keepalive(const string_view url) const
+  -> HostKeepalive
+{
+  const auto& host_keepalive_iter = host_keepalives.find(
+    string{get_url_host(url)}
+  );
+
+  if (host_keepalive_iter != host_keepalives.end())
+  {
+    return host_keepalive_iter->second;
+  }
+
+  return HostKeepalive{};
+}
+
+auto RequestManager::set_max_concurrent_streams(
+  const string_view host,
+  const size_t max_concurrent_streams
+) -> void
+{
+  auto& streams = host_streams[string{host}];
+  streams.max_concurrent_streams = (
+    max_concurrent_streams > 0
+    ? max_concurrent_streams
+    : REQUESTS_MAX_CONCURRENT_STREAMS
+  );
+
+  // Start any waiting requests which are now within the limit
+  start_waiting_streams(streams);
+}
+
+auto RequestManager::start_stream(HandleImpl* handle, const string_view url)
+  -> bool
+{
+  auto& streams = host_streams[string{get_url_host(url)}];
+
+  if (streams.active_stream_count < streams.max_concurrent_streams)
+  {
+    if (curl_multi_add_handle(multi_handle.get(), handle) != CURLM_OK)
+    {
+      return false;
+    }
+
+    streams.active_stream_count++;
+    return true;
+  }
+
+  // First come, first served, so no request to a busy host is starved
+  streams.waiting_handles.emplace_back(handle);
+  return true;
+}
+
+auto RequestManager::finish_stream(const string_view url)
+  -> void
+{
+  auto host_streams_iter = host_streams.find(string{get_url_host(url)});
+  if (host_streams_iter == host_streams.end())
+  {
+    return;
+  }
+
+  auto& streams = host_streams_iter->second;
+  if (streams.active_stream_count > 0)
+  {
+    streams.active_stream_count--;
+  }
+
+  start_waiting_streams(streams);
+}
+
+auto RequestManager::remove_waiting_stream(
+  HandleImpl* handle,
+  const string_view url
+) -> void
+{
+  auto host_streams_iter = host_streams.find(string{get_url_host(url)});
+  if (host_streams_iter == host_streams.end())
+  {
+    return;
+  }
+
+  auto& waiting_handles = host_streams_iter->second.waiting_handles;
+  waiting_handles.erase(
+    std::remove(waiting_handles.begin(), waiting_handles.end(), handle),
+    waiting_handles.end()
+  );
+}
+
+auto RequestManager::start_waiting_streams(HostStreams& streams)
+  -> void
+{
+  while (
+    not streams.waiting_handles.empty()
+    and streams.active_stream_count < streams.max_concurrent_streams
+  )
+  {
+    auto* handle = streams.waiting_handles.front();
+    streams.waiting_handles.pop_front();
+
+    streams.active_stream_count++;
+    curl_multi_add_handle(multi_handle.get(), handle);
+  }
+}
+
+auto RequestManager::get_tls_handshake_stats() const
+  -> const TlsHandshakeStats&
+{
+  return tls_handshake_stats;
+}
+
+auto RequestManager::log_tls_handshake_stats() const
+  -> void
+{
+  const auto& stats = tls_handshake_stats;
+  const auto handshake_microseconds_mean = (
+    stats.handshake_count > 0
+    ? (stats.handshake_microseconds_total / stats.handshake_count)
+    : 0
+  );
+
+  ESP_LOGI(
+    TAG,
+    "connections: %zu new, %zu reused; "
+    "TLS handshakes: %zu, mean %lldms, max %lldms",
+    stats.connection_count,
+    stats.reused_connection_count,
+    stats.handshake_count,
+    handshake_microseconds_mean / 1000,
+    stats.handshake_microseconds_max / 1000
+  );
+}
+
+auto RequestManager::record_tls_handshake(HandleImpl* handle, const char* tag)
+  -> void
+{
+  auto* curl = handle;
+
+  long num_connects = 0;
+  curl_off_t connect_microseconds = 0;
+  curl_off_t appconnect_microseconds = 0;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &num_connects);
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect_microseconds);
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect_microseconds);
+
+  auto& stats = tls_handshake_stats;
+  if (num_connects == 0)
+  {
+    stats.reused_connection_count++;
+    return;
+  }
+
+  stats.connection_count += num_connects;
+
+  // 0 unless a TLS handshake completed (i.e. not for http:// URLs)
+  if (appconnect_microseconds > 0)
+  {
+    const int64_t handshake_microseconds = (
+      appconnect_microseconds - connect_microseconds
+    );
+
+    stats.handshake_count++;
+    stats.handshake_microseconds_total += handshake_microseconds;
+    stats.handshake_microseconds_max = std::max(
+      stats.handshake_microseconds_max,
+      handshake_microseconds
+    );
+
+    ESP_LOGI(tag, "TLS handshake took %lldms", handshake_microseconds / 1000);
+  }
+}
+
+auto RequestManager::get_content_decoding_stats() const
+  -> const ContentDecodingStats&
+{
+  return content_decoding_stats;
+}
+
+auto RequestManager::log_content_decoding_stats() const
+  -> void
+{
+  const auto& stats = content_decoding_stats;
+
+  ESP_LOGI(
+    TAG,
+    "decoded responses: %zu (%zu failed), %llu bytes from %llu encoded",
+    stats.response_count,
+    stats.failed_count,
+    static_cast<unsigned long long>(stats.decompressed_bytes),
+    static_cast<unsigned long long>(stats.compressed_bytes)
+  );
+}
+
+auto RequestManager::record_content_decoding(
+  const RequestHandler& handler,
+  const char* tag
+) -> void
+{
+  const auto* decoder = handler.content_decoder.get();
+  if (not decoder)
+  {
+    return;
+  }
+
+  auto& stats = content_decoding_stats;
+  stats.response_count++;
+  stats.compressed_bytes += decoder->get_compressed_size();
+  stats.decompressed_bytes += decoder->get_decompressed_size();
+
+  if (decoder->has_failed())
+  {
+    stats.failed_count++;
+  }
+
+  ESP_LOGI(
+    tag,
+    "Decoded %llu bytes from %llu encoded",
+    static_cast<unsigned long long>(decoder->get_decompressed_size()),
+    static_cast<unsigned long long>(decoder->get_compressed_size())
+  );
+}
+
+auto RequestManager::enable_response_cache(
+  const string_view path,
+  const size_t max_size
+) -> bool
+{
+  response_cache.reset(
+    new ResponseCache{
+      path,
+      (max_size > 0)? max_size : REQUESTS_RESPONSE_CACHE_MAX_SIZE
+    }
+  );
+
+  if (not response_cache->is_valid())
+  {
+    response_cache.reset();
+    return false;
+  }
+
+  return true;
+}
+
+auto RequestManager::enable_tls_session_cache(
+  const string_view path,
+  const int64_t lifetime_seconds
+) -> bool
+{
+  return tls_session_cache.persist(path, lifetime_seconds);
+}
+
+auto RequestManager::serve_cached_response(RequestHandler& handler)
+  -> bool
+{
+  if (not response_cache)
+  {
+    return false;
+  }
+
+  handler.cache_key = make_cache_key(*(handler.request_intent));
+  if (handler.cache_key.empty())
+  {
+    return false;
+  }
+
+  handler.response_cache = response_cache.get();
+
+  // A stale response is revalidated by send() instead
+  auto* cached_response = response_cache->find(handler.cache_key);
+  if (not cached_response or not response_cache->is_fresh(*cached_response))
+  {
+    return false;
+  }
+
+  if (not handler.replay_cached_response(*cached_response))
+  {
+    return false;
+  }
+
+  const auto& tag = handler.request_intent->request()->uri()->c_str();
+  ESP_LOGI(tag, "Sent fresh cached response");
+
+  handler.finish_callback();
+  return true;
+}
+
+auto RequestManager::remove_cache_validators(
+  RequestHandler& handler,
+  HandleImpl* handle
+) -> bool
+{
+  auto did_remove = false;
+  curl_slist* slist = nullptr;
+
+  for (auto* item = handler.slist; item != nullptr; item = item->next)
+  {
+    const auto hdr = string_view{item->data};
+    const auto k = hdr.substr(0, hdr.find(':'));
+    if (
+      equals_ignore_case(k, "If-None-Match")
+      or equals_ignore_case(k, "If-Modified-Since")
+    )
+    {
+      did_remove = true;
+      continue;
+    }
+
+    slist = curl_slist_append(slist, item->data);
+  }
+
+  if (not did_remove)
+  {
+    curl_slist_free_all(slist);
+    return false;
+  }
+
+  curl_slist_free_all(handler.slist);
+  handler.slist = slist;
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, handler.slist);
+
+  return true;
+}
+
+auto RequestManager::acquire_handle()
+  -> HandleImplPtr
+{
+  if (not idle_handles.empty())
+  {
+    auto handle = std::move(idle_handles.back());
+    idle_handles.pop_back();
+
+    return handle;
+  }
+
+  auto handle = HandleImplPtr{curl_easy_init(), curl_easy_cleanup};
+  if (handle)
+  {
+    set_common_options(handle.get());
+  }
+
+  return handle;
+}
+
+auto RequestManager::release_handle(HandleImplPtr&& handle)
+  -> void
+{
+  if (not handle or idle_handles.size() >= REQUESTS_MAX_IDLE_HANDLES)
+  {
+    // Cleanup when handle goes out of scope
+    return;
+  }
+
+  // Clears all options, but keeps the DNS and TLS session caches
+  curl_easy_reset(handle.get());
+  set_common_options(handle.get());
+
+  idle_handles.emplace_back(std::move(handle));
+}
+
+auto RequestManager::set_common_options(HandleImpl* handle)
+  -> void
+{
+  auto* curl = handle;
+
+  // Do not print out any updates to stdout
+  curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+  // Do not install signal handlers
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+  // Follow redirects (3xx responses) until the actual URL is found
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+  // Attempt HTTP/2 for HTTPS URLs, fallback to HTTP/1.1 otherwise
+#if REQUESTS_SUPPORT_HTTP2
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#else
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+#endif
+
+  // Waiting for pending connections to be established,
+  // to multiplex if possible
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+  // Do not include headers in the response stream
+  curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+  // Parse headers with a separate callback
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+
+  // Body data incremental callback
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunction);
+
+  // Verify SSL certificates with CA cert(s)
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+  // Expect PEM formatted CA cert(s)
+  // curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
+  // Use a function to supply PEM contents of CA cert(s) in memory buffer
+  curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, sslctx_function);
+  // Set user data pointer attached to the sslctx function for this request
+  curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, this);
+
+  // Turn off the default CA locations, so no attempts are made to load them
+  curl_easy_setopt(curl, CURLOPT_CAINFO, NULL);
+  curl_easy_setopt(curl, CURLOPT_CAPATH, NULL);
+
+  // TLS sessions are resumed (by ticket or by session ID) from
+  // tls_session_cache, which sslctx_callback() sets them from and
+  // prereq_callback() saves them to. curl's own cache would export each
+  // session first, and mbedtls only allows a session to be exported once
+  curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 0L);
+  curl_easy_setopt(curl, CURLOPT_PREREQFUNCTION, prereq_function);
+  curl_easy_setopt(curl, CURLOPT_PREREQDATA, this);
+  if (share_handle)
+  {
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle.get());
+  }
+}
+
 auto RequestManager::sslctx_callback(CURL* curl, mbedtls_ssl_config* ssl_ctx)
   -> CURLcode
 {
@@ -813,6 +1631,27 @@ auto RequestManager::sslctx_callback(CURL* curl, mbedtls_ssl_config* ssl_ctx)
     // Update the curl handle's cacert chain
     mbedtls_ssl_conf_ca_chain(ssl_ctx, &curl_cacerts, nullptr);
 
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    // curl's mbedtls backend disables session tickets, re-enable them so
+    // servers without a session ID cache can resume too
+    mbedtls_ssl_conf_session_tickets(
+      ssl_ctx,
+      MBEDTLS_SSL_SESSION_TICKETS_ENABLED
+    );
+#endif // MBEDTLS_SSL_SESSION_TICKETS
+
+    // The connection's context is set up, but its handshake not yet started
+    struct curl_tlssessioninfo* tls_info = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_TLS_SSL_PTR, &tls_info);
+    if (tls_info and tls_info->internals)
+    {
+      auto* ssl = static_cast<mbedtls_ssl_context*>(tls_info->internals);
+      auto key = get_tls_session_key(curl);
+
+      tls_session_cache.resume(key, *ssl);
+      tls_handshakes[curl] = std::move(key);
+    }
+
     // Mark the callback as successfully passed
     rv = CURLE_OK;
   }
@@ -823,8 +1662,87 @@ auto RequestManager::sslctx_callback(CURL* curl, mbedtls_ssl_config* ssl_ctx)
 
   return rv;
 }
+
+auto RequestManager::prereq_callback()
+  -> int
+{
+  // Connections are only handed to a request once their handshake is done,
+  // and the handles of the others are still attached to them
+  save_tls_sessions();
+
+  return CURL_PREREQFUNC_OK;
+}
+
+auto RequestManager::get_tls_session_key(HandleImpl* handle) const
+  -> string
+{
+  auto* curl = handle;
+
+  char* url = nullptr;
+  long port = 0;
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_PRIMARY_PORT, &port);
+
+  auto key = string{get_url_host(url? string_view{url} : string_view{})};
+  key += ':';
+  key += std::to_string(port);
+
+  return key;
+}
+
+auto RequestManager::save_tls_sessions()
+  -> void
+{
+  for (
+    auto i = tls_handshakes.begin(), end = tls_handshakes.end();
+    i != end;
+  )
+  {
+    auto* curl = i->first;
+
+    // 0 until the TLS handshake has completed
+    curl_off_t appconnect_microseconds = 0;
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect_microseconds);
+
+    struct curl_tlssessioninfo* tls_info = nullptr;
+    if (appconnect_microseconds > 0)
+    {
+      curl_easy_getinfo(curl, CURLINFO_TLS_SSL_PTR, &tls_info);
+    }
+
+    if (tls_info and tls_info->internals)
+    {
+      const auto* ssl = static_cast<mbedtls_ssl_context*>(tls_info->internals);
+      tls_session_cache.save(i->second, *ssl);
+
+      i = tls_handshakes.erase(i);
+      end = tls_handshakes.end();
+    }
+    else {
+      ++i;
+    }
+  }
+}
 #endif // REQUESTS_USE_CURL
 
+auto RequestManager::forget_coalesced_request(const RequestHandler& handler)
+  -> void
+{
+  if (handler.coalescing_key.empty())
+  {
+    return;
+  }
+
+  auto coalesced_request = coalesced_requests.find(handler.coalescing_key);
+  if (
+    coalesced_request != coalesced_requests.end()
+    and coalesced_request->second == &handler
+  )
+  {
+    coalesced_requests.erase(coalesced_request);
+  }
+}
+
 auto RequestManager::get_existing_request_handler(const UUID* request_intent_id)
   -> RequestMap::const_iterator
 {
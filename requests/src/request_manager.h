@@ -11,6 +11,7 @@
 #pragma once
 
 #include "request_handler.h"
+#include "tls_session_cache.h"
 
 #include "uuid.h"
 
@@ -25,10 +26,14 @@ extern "C" {
 }
 #endif // REQUESTS_USE_SH2LIB
 
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "mbedtls/ssl.h"
 #include "mbedtls/x509_crt.h"
@@ -43,6 +48,10 @@ private:
   // Destruct the members in the reverse order
   // Create the curl_multi_handle first, then the handle map
   std::unique_ptr<CURLM, CURLMcode(*)(CURLM*)> multi_handle;
+
+  // DNS shared by every easy handle (TLS sessions are resumed from
+  // tls_session_cache instead). Must outlive the easy handles which use it
+  std::unique_ptr<CURLSH, CURLSHcode(*)(CURLSH*)> share_handle;
 #endif // REQUESTS_USE_CURL
 
 public:
@@ -59,7 +68,57 @@ public:
 
   using BufferView = std::span<const uint8_t>;
 
-  RequestManager();
+#ifdef REQUESTS_USE_CURL
+  // How long an idle connection to a host is kept for re-use,
+  // 0 max_idle_seconds to close it after each request
+  struct HostKeepalive
+  {
+    long max_idle_seconds = REQUESTS_KEEPALIVE_MAX_IDLE_SECONDS;
+    // 0 for no limit
+    long max_lifetime_seconds = REQUESTS_KEEPALIVE_MAX_LIFETIME_SECONDS;
+  };
+
+  using HostKeepalives = std::unordered_map<std::string, HostKeepalive>;
+  using HandlePool = std::vector<HandleImplPtr>;
+
+  // Requests to one host which are in flight, and those waiting (in order)
+  // for one of them to finish
+  struct HostStreams
+  {
+    size_t max_concurrent_streams = REQUESTS_MAX_CONCURRENT_STREAMS;
+    size_t active_stream_count = 0;
+    std::deque<HandleImpl*> waiting_handles;
+  };
+
+  using HostStreamsMap = std::unordered_map<std::string, HostStreams>;
+
+  using WatchedSockets = std::unordered_map<curl_socket_t, int>;
+
+  // Connections made for completed requests, and the time spent on their
+  // TLS handshakes (abbreviated if a session was resumed)
+  struct TlsHandshakeStats
+  {
+    size_t connection_count = 0;
+    size_t reused_connection_count = 0;
+    size_t handshake_count = 0;
+    int64_t handshake_microseconds_total = 0;
+    int64_t handshake_microseconds_max = 0;
+  };
+
+  // Completed responses which were decoded (see RequestIntent.decode_content),
+  // and their body sizes as received and once decoded
+  struct ContentDecodingStats
+  {
+    size_t response_count = 0;
+    size_t failed_count = 0;
+    uint64_t compressed_bytes = 0;
+    uint64_t decompressed_bytes = 0;
+  };
+#endif // REQUESTS_USE_CURL
+
+  // Socket readiness and timeouts are sent to owner_pid as "readable",
+  // "writable" and "socket_timeout" messages
+  explicit RequestManager(const ActorModel::Pid& _owner_pid);
   ~RequestManager();
 
   auto fetch(
@@ -71,11 +130,36 @@ public:
     RequestHandler& handler
   ) -> bool;
 
+#ifdef REQUESTS_USE_CURL
+  // Perform transfers on fd after the events (CURL_CSELECT_*) were reported,
+  // returns the number of requests remaining
+  auto socket_action(const curl_socket_t fd, const int events)
+    -> size_t;
+
+  // Perform transfers which were waiting for the timeout set by curl
+  auto timeout_action()
+    -> size_t;
+
+  // Retry writing to the sinks of paused transfers (see ResponseSinkWriter)
+  auto resume_sinks()
+    -> size_t;
+
+  // Called by curl, to (un)watch a socket (CURL_POLL_*)
+  auto socket_callback(const curl_socket_t fd, const int what)
+    -> int;
+
+  // Called by curl, -1 timeout_ms to stop the timer
+  auto timer_callback(const long timeout_ms)
+    -> int;
+#endif // REQUESTS_USE_CURL
+
+#ifdef REQUESTS_USE_SH2LIB
   auto wait_any()
     -> size_t;
 
   auto wait_all()
     -> size_t;
+#endif // REQUESTS_USE_SH2LIB
 
   auto add_cacert_pem(const BufferView cacert_pem)
     -> bool;
@@ -85,12 +169,148 @@ public:
 #ifdef REQUESTS_USE_CURL
   auto sslctx_callback(CURL* curl, mbedtls_ssl_config* ssl_ctx)
     -> CURLcode;
+
+  // Once a connection is ready, before each request is sent on it
+  auto prereq_callback()
+    -> int;
+
+  auto set_keepalive(const std::string_view host, const HostKeepalive& keepalive)
+    -> void;
+
+  // 0 max_concurrent_streams for the default
+  auto set_max_concurrent_streams(
+    const std::string_view host,
+    const size_t max_concurrent_streams
+  ) -> void;
+
+  auto get_tls_handshake_stats() const
+    -> const TlsHandshakeStats&;
+
+  // Cache GET responses in files under path, 0 max_size for the default
+  auto enable_response_cache(const std::string_view path, const size_t max_size)
+    -> bool;
+
+  // Persist TLS sessions in files under path, restoring those of previous
+  // boots, 0 lifetime_seconds for the default
+  auto enable_tls_session_cache(
+    const std::string_view path,
+    const int64_t lifetime_seconds
+  ) -> bool;
+
+  auto log_tls_handshake_stats() const
+    -> void;
+
+  auto get_content_decoding_stats() const
+    -> const ContentDecodingStats&;
+
+  auto log_content_decoding_stats() const
+    -> void;
 #endif // REQUESTS_USE_CURL
 
 protected:
   using RequestMap = std::unordered_map<HandleImplPtr, RequestHandler>;
   RequestMap requests;
 
+  // In-flight requests which identical requests can share, by coalescing key
+  using CoalescedRequests = std::unordered_map<std::string, RequestHandler*>;
+  CoalescedRequests coalesced_requests;
+
+  // Once finished, a later identical request starts a new transfer
+  auto forget_coalesced_request(const RequestHandler& handler)
+    -> void;
+
+#ifdef REQUESTS_USE_CURL
+  auto watch(const curl_socket_t fd, const int what)
+    -> bool;
+
+  // Finish (or retry) requests which curl reports as done
+  auto process_completions()
+    -> void;
+
+  auto find_request(HandleImpl* handle)
+    -> RequestMap::iterator;
+
+  // Stop waiting for a stream, then keep or free the request's handle
+  auto remove_request(RequestMap::iterator req_iter)
+    -> void;
+
+  auto schedule_sink_resume()
+    -> void;
+
+  // Reset, pre-configured easy handles of completed requests
+  auto acquire_handle()
+    -> HandleImplPtr;
+
+  auto release_handle(HandleImplPtr&& handle)
+    -> void;
+
+  // Options which are the same for every request
+  auto set_common_options(HandleImpl* handle)
+    -> void;
+
+  auto get_keepalive(const std::string_view url) const
+    -> HostKeepalive;
+
+  auto record_tls_handshake(HandleImpl* handle, const char* tag)
+    -> void;
+
+  // "host:port" of the connection a handle is making
+  auto get_tls_session_key(HandleImpl* handle) const
+    -> std::string;
+
+  // Save the sessions of handshakes which have completed
+  auto save_tls_sessions()
+    -> void;
+
+  auto record_content_decoding(const RequestHandler& handler, const char* tag)
+    -> void;
+
+  // Send a fresh cached response without a request, false if there is none
+  auto serve_cached_response(RequestHandler& handler)
+    -> bool;
+
+  // Remove the If-None-Match and If-Modified-Since headers of a request,
+  // false if it had none
+  auto remove_cache_validators(RequestHandler& handler, HandleImpl* handle)
+    -> bool;
+
+  // Start the request now if its host has a free stream, or once one of
+  // the host's requests finishes
+  auto start_stream(HandleImpl* handle, const std::string_view url)
+    -> bool;
+
+  auto finish_stream(const std::string_view url)
+    -> void;
+
+  // Forget a request which is waiting for a stream, if it is
+  auto remove_waiting_stream(HandleImpl* handle, const std::string_view url)
+    -> void;
+
+  auto start_waiting_streams(HostStreams& streams)
+    -> void;
+
+  const ActorModel::Pid owner_pid;
+
+  // Sockets curl is waiting on, by their interests (CURL_POLL_*)
+  WatchedSockets watched_sockets;
+  ActorModel::TRef timeout_tref = ActorModel::NullTRef;
+  ActorModel::TRef sink_resume_tref = ActorModel::NullTRef;
+
+  HandlePool idle_handles;
+  HostKeepalives host_keepalives;
+  HostStreamsMap host_streams;
+  TlsHandshakeStats tls_handshake_stats;
+  ContentDecodingStats content_decoding_stats;
+
+  std::unique_ptr<ResponseCache> response_cache;
+
+  // Handles whose TLS handshake has started, by their session key, until
+  // the session is saved
+  using TlsHandshakes = std::unordered_map<HandleImpl*, std::string>;
+  TlsHandshakes tls_handshakes;
+  TlsSessionCache tls_session_cache{REQUESTS_TLS_SESSION_CACHE_SIZE};
+#endif // REQUESTS_USE_CURL
+
   auto get_existing_request_handler(const UUID::UUID* request_intent_id)
     -> RequestMap::const_iterator;
 };
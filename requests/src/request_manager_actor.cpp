@@ -34,7 +34,16 @@ auto request_manager_actor_behaviour(
 {
   if (not state)
   {
-    state = std::make_shared<RequestManager>();
+    state = std::make_shared<RequestManager>(self);
+
+#ifdef REQUESTS_USE_CURL
+    // A pending timeout already covers all in-flight requests
+    coalesce(self, "socket_timeout");
+#endif // REQUESTS_USE_CURL
+#ifdef REQUESTS_USE_SH2LIB
+    // A pending "tick" already covers all in-flight requests
+    coalesce(self, "tick");
+#endif // REQUESTS_USE_SH2LIB
   }
 
   auto& requests = *(std::static_pointer_cast<RequestManager>(state));
@@ -59,6 +68,77 @@ auto request_manager_actor_behaviour(
     return {Result::Ok};
   }
 
+#ifdef REQUESTS_USE_CURL
+  if (
+    const KeepalivePolicy* keepalive_policy = nullptr;
+    matches(message, "keepalive_policy", keepalive_policy)
+  )
+  {
+    requests.set_keepalive(
+      keepalive_policy->host()->string_view(),
+      RequestManager::HostKeepalive{
+        static_cast<long>(keepalive_policy->max_idle_seconds()),
+        static_cast<long>(keepalive_policy->max_lifetime_seconds())
+      }
+    );
+
+    return {Result::Ok};
+  }
+
+  if (
+    const StreamPolicy* stream_policy = nullptr;
+    matches(message, "stream_policy", stream_policy)
+  )
+  {
+    requests.set_max_concurrent_streams(
+      stream_policy->host()->string_view(),
+      stream_policy->max_concurrent_streams()
+    );
+
+    return {Result::Ok};
+  }
+
+  if (
+    const ResponseCachePolicy* response_cache_policy = nullptr;
+    matches(message, "response_cache", response_cache_policy)
+  )
+  {
+    requests.enable_response_cache(
+      response_cache_policy->path()->string_view(),
+      response_cache_policy->max_size_bytes()
+    );
+
+    return {Result::Ok};
+  }
+
+  if (
+    const TlsSessionCachePolicy* tls_session_cache_policy = nullptr;
+    matches(message, "tls_session_cache", tls_session_cache_policy)
+  )
+  {
+    requests.enable_tls_session_cache(
+      tls_session_cache_policy->path()->string_view(),
+      tls_session_cache_policy->lifetime_seconds()
+    );
+
+    return {Result::Ok};
+  }
+
+  if (matches(message, "tls_handshake_stats"))
+  {
+    requests.log_tls_handshake_stats();
+
+    return {Result::Ok};
+  }
+
+  if (matches(message, "content_decoding_stats"))
+  {
+    requests.log_content_decoding_stats();
+
+    return {Result::Ok};
+  }
+#endif // REQUESTS_USE_CURL
+
   if (
     const RequestIntent* request_intent = nullptr;
     matches(message, "request", request_intent))
@@ -73,14 +153,55 @@ auto request_manager_actor_behaviour(
         };
         requests.fetch(request_intent_buf_ref);
 
+#ifdef REQUESTS_USE_SH2LIB
         // Re-trigger ourselves immediately with an arbitrary message
         send(self, "tick");
+#endif // REQUESTS_USE_SH2LIB
       }
     }
 
     return {Result::Ok};
   }
 
+#ifdef REQUESTS_USE_CURL
+  // Only woken by curl's sockets becoming ready, or its timeout expiring,
+  // so new requests are accepted while others are in flight
+  if (
+    SocketReadable readable;
+    matches(message, readable)
+  )
+  {
+    requests.socket_action(readable.fd, CURL_CSELECT_IN);
+
+    return {Result::Ok, EventTerminationAction::ContinueProcessing};
+  }
+
+  if (
+    SocketWritable writable;
+    matches(message, writable)
+  )
+  {
+    requests.socket_action(writable.fd, CURL_CSELECT_OUT);
+
+    return {Result::Ok, EventTerminationAction::ContinueProcessing};
+  }
+
+  if (matches(message, "socket_timeout"))
+  {
+    requests.timeout_action();
+
+    return {Result::Ok, EventTerminationAction::ContinueProcessing};
+  }
+
+  if (matches(message, "sink_resume"))
+  {
+    requests.resume_sinks();
+
+    return {Result::Ok, EventTerminationAction::ContinueProcessing};
+  }
+#endif // REQUESTS_USE_CURL
+
+#ifdef REQUESTS_USE_SH2LIB
   if (matches(message, "tick"))
   {
     auto requests_remaining = requests.wait_any();
@@ -93,6 +214,7 @@ auto request_manager_actor_behaviour(
 
     return {Result::Ok, EventTerminationAction::ContinueProcessing};
   }
+#endif // REQUESTS_USE_SH2LIB
 
   if (
     Reason exit_reason;
@@ -150,7 +150,15 @@ auto make_request_intent(
   const string_view root_type,
   const string_view schema_text,
   const bool include_headers,
-  const bool streaming
+  const bool streaming,
+  const ResponseSinkType sink_type,
+  const string_view sink_path,
+  const uint32_t sink_channel_id,
+  const uint32_t sink_progress_interval_bytes,
+  const bool coalesce,
+  const bool decode_content,
+  const uint8_t inflate_window_bits,
+  const uint32_t compress_body_min_bytes
 ) -> RequestIntentFlatbuffer
 {
   flatbuffers::FlatBufferBuilder fbb;
@@ -203,6 +211,18 @@ auto make_request_intent(
     headers.empty()? 0 : headers_vec
   );
 
+  flatbuffers::Offset<ResponseSink> sink;
+  if (sink_type != ResponseSinkType::None)
+  {
+    sink = CreateResponseSink(
+      fbb,
+      sink_type,
+      sink_path.empty()? 0 : fbb.CreateString(sink_path),
+      sink_channel_id,
+      sink_progress_interval_bytes
+    );
+  }
+
   fbb.Finish(
     CreateRequestIntent(
       fbb,
@@ -214,7 +234,14 @@ auto make_request_intent(
       root_type.empty()? 0 : fbb.CreateString(root_type),
       schema_text.empty()? 0 : fbb.CreateString(schema_text),
       include_headers,
-      streaming
+      streaming,
+      0, // timeout_microseconds
+      0, // retries
+      sink,
+      coalesce,
+      decode_content,
+      inflate_window_bits,
+      compress_body_min_bytes
     )
   );
 
@@ -75,7 +75,15 @@ auto make_request_intent(
   const string_view root_type = "",
   const string_view schema_text = "",
   const bool include_headers = false,
-  const bool streaming = false
+  const bool streaming = false,
+  const ResponseSinkType sink_type = ResponseSinkType::None,
+  const string_view sink_path = "",
+  const uint32_t sink_channel_id = 0,
+  const uint32_t sink_progress_interval_bytes = 0,
+  const bool coalesce = false,
+  const bool decode_content = true,
+  const uint8_t inflate_window_bits = 0,
+  const uint32_t compress_body_min_bytes = 0
 ) -> RequestIntentFlatbuffer;
 
 // Update method:
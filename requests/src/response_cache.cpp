@@ -0,0 +1,592 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "response_cache.h"
+
+#include "http_utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <utility>
+#include <vector>
+
+#ifdef REQUESTS_USE_CURL
+#include "curl/curl.h"
+#endif // REQUESTS_USE_CURL
+
+#include "esp_log.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+namespace Requests {
+
+constexpr char TAG[] = "response_cache";
+
+// File names are 8.3, as FATFS may be built without long file name support
+constexpr char ResponseFileExtension[] = ".rsp";
+constexpr char TmpFileExtension[] = ".tmp";
+
+// Before this (2020-01-01), the system time has not been set yet
+constexpr int64_t MinValidUnixTime = 1577836800;
+
+auto get_unix_time()
+  -> int64_t;
+
+auto get_unix_time()
+  -> int64_t
+{
+  return static_cast<int64_t>(time(nullptr));
+}
+
+auto parse_cache_control_header(
+  const std::string_view k,
+  const std::string_view v,
+  ResponseCacheControl& cache_control
+) -> bool
+{
+  if (equals_ignore_case(k, "ETag"))
+  {
+    cache_control.etag.assign(v.begin(), v.end());
+    return true;
+  }
+
+  if (equals_ignore_case(k, "Last-Modified"))
+  {
+    cache_control.last_modified.assign(v.begin(), v.end());
+    return true;
+  }
+
+  if (equals_ignore_case(k, "Cache-Control"))
+  {
+    // Comma-separated directives, of which max-age takes precedence over
+    // an Expires header
+    auto directives = v;
+    while (not directives.empty())
+    {
+      auto end = directives.find(',');
+      auto directive = directives.substr(0, end);
+      directives = (
+        (end == std::string_view::npos)? std::string_view{} : directives.substr(end + 1)
+      );
+
+      while (not directive.empty() and directive.front() == ' ')
+      {
+        directive.remove_prefix(1);
+      }
+
+      if (equals_ignore_case(directive, "no-store"))
+      {
+        cache_control.no_store = true;
+      }
+      else if (equals_ignore_case(directive, "no-cache"))
+      {
+        cache_control.expires = 0;
+        cache_control.has_expires = true;
+      }
+      else if (equals_ignore_case(directive.substr(0, 8), "max-age="))
+      {
+        auto max_age = std::string{directive.substr(8)};
+        cache_control.expires = get_unix_time() + strtol(max_age.c_str(), nullptr, 10);
+        cache_control.has_expires = true;
+      }
+    }
+
+    return true;
+  }
+
+  if (equals_ignore_case(k, "Expires"))
+  {
+#ifdef REQUESTS_USE_CURL
+    if (not cache_control.has_expires)
+    {
+      auto expires_str = std::string{v};
+      auto expires = curl_getdate(expires_str.c_str(), nullptr);
+
+      // An invalid date means already expired
+      cache_control.expires = (expires > 0)? expires : 0;
+      cache_control.has_expires = true;
+    }
+#endif // REQUESTS_USE_CURL
+    return true;
+  }
+
+  return false;
+}
+
+ResponseCache::Store::~Store()
+{
+  if (file)
+  {
+    fclose(file);
+    remove(tmp_path.c_str());
+  }
+}
+
+ResponseCache::ResponseCache(
+  const std::string_view _path,
+  const size_t _max_size
+)
+: path(_path)
+, max_size(_max_size)
+{
+  if (mkdir(path.c_str(), 0755) != 0 and errno != EEXIST)
+  {
+    ESP_LOGE(TAG, "Unable to create response cache directory '%s'", path.c_str());
+    return;
+  }
+
+  valid = true;
+  restore();
+}
+
+auto ResponseCache::is_valid() const
+  -> bool
+{
+  return valid;
+}
+
+auto ResponseCache::find(const std::string_view key)
+  -> Entry*
+{
+  auto entry_iter = entries.find(std::string{key});
+  if (entry_iter == entries.end())
+  {
+    return nullptr;
+  }
+
+  entry_iter->second.last_used = ++use_count;
+  return &(entry_iter->second);
+}
+
+auto ResponseCache::is_fresh(const Entry& entry) const
+  -> bool
+{
+  const auto now = get_unix_time();
+  return (now >= MinValidUnixTime and now < entry.expires);
+}
+
+auto ResponseCache::refresh(
+  Entry& entry,
+  const ResponseCacheControl& cache_control
+) -> bool
+{
+  if (not cache_control.has_expires)
+  {
+    return false;
+  }
+
+  entry.expires = cache_control.expires;
+
+  // Only the fixed-size header is rewritten in place
+  auto* file = fopen(entry.file_path.c_str(), "r+b");
+  if (not file)
+  {
+    return false;
+  }
+
+  ResponseCacheHeader header;
+  auto did_write = (
+    fread(&header, sizeof(header), 1, file) == 1
+    and fseek(file, 0, SEEK_SET) == 0
+  );
+
+  if (did_write)
+  {
+    header.expires = entry.expires;
+    did_write = (fwrite(&header, sizeof(header), 1, file) == 1);
+  }
+
+  return ((fclose(file) == 0) and did_write);
+}
+
+auto ResponseCache::open_body(Entry& entry)
+  -> FILE*
+{
+  // Restored as the least recently used order by the next boot
+  utime(entry.file_path.c_str(), nullptr);
+
+  auto* file = fopen(entry.file_path.c_str(), "rb");
+  if (file and fseek(file, entry.body_offset, SEEK_SET) != 0)
+  {
+    fclose(file);
+    file = nullptr;
+  }
+
+  return file;
+}
+
+auto ResponseCache::begin_store(
+  const std::string_view key,
+  const ResponseCacheControl& cache_control
+) -> StorePtr
+{
+  // Without validators or a freshness lifetime, a stored response could
+  // never be used
+  if (
+    not valid
+    or cache_control.no_store
+    or (
+      cache_control.etag.empty()
+      and cache_control.last_modified.empty()
+      and cache_control.expires == 0
+    )
+  )
+  {
+    return nullptr;
+  }
+
+  auto store = StorePtr{new Store};
+  store->key.assign(key.begin(), key.end());
+  store->cache_control = cache_control;
+  store->tmp_path = get_file_path(key, TmpFileExtension);
+
+  store->file = fopen(store->tmp_path.c_str(), "wb");
+  if (not store->file)
+  {
+    ESP_LOGW(TAG, "Unable to open '%s'", store->tmp_path.c_str());
+    return nullptr;
+  }
+
+  // The header is written again with the body size once committed
+  ResponseCacheHeader header{};
+  auto did_write = (
+    fwrite(&header, sizeof(header), 1, store->file) == 1
+    and fwrite(key.data(), 1, key.size(), store->file) == key.size()
+    and fwrite(
+      cache_control.etag.data(),
+      1,
+      cache_control.etag.size(),
+      store->file
+    ) == cache_control.etag.size()
+    and fwrite(
+      cache_control.last_modified.data(),
+      1,
+      cache_control.last_modified.size(),
+      store->file
+    ) == cache_control.last_modified.size()
+  );
+
+  if (not did_write)
+  {
+    return nullptr;
+  }
+
+  return store;
+}
+
+auto ResponseCache::write_store(Store& store, const std::string_view chunk)
+  -> bool
+{
+  store.body_size += chunk.size();
+
+  // Too large to ever fit, give up on it early
+  if (store.body_size > max_size)
+  {
+    return false;
+  }
+
+  return (fwrite(chunk.data(), 1, chunk.size(), store.file) == chunk.size());
+}
+
+auto ResponseCache::commit_store(StorePtr&& store)
+  -> bool
+{
+  const auto& cache_control = store->cache_control;
+
+  ResponseCacheHeader header;
+  memcpy(header.identifier, ResponseCacheIdentifier, sizeof(header.identifier));
+  header.version = ResponseCacheVersion;
+  header.expires = cache_control.expires;
+  header.key_size = store->key.size();
+  header.body_size = store->body_size;
+  header.etag_size = cache_control.etag.size();
+  header.last_modified_size = cache_control.last_modified.size();
+  header.reserved = 0;
+
+  auto did_write = (
+    fseek(store->file, 0, SEEK_SET) == 0
+    and fwrite(&header, sizeof(header), 1, store->file) == 1
+  );
+  did_write = ((fclose(store->file) == 0) and did_write);
+  store->file = nullptr;
+
+  const auto body_offset = (
+    sizeof(header)
+    + header.key_size
+    + header.etag_size
+    + header.last_modified_size
+  );
+  const auto file_size = (body_offset + header.body_size);
+
+  // Also replaces a response with a colliding file name
+  const auto file_path = get_file_path(store->key, ResponseFileExtension);
+  auto existing_entry = std::find_if(
+    entries.begin(),
+    entries.end(),
+    [&file_path](const auto& entry_iter) -> bool
+    {
+      return (entry_iter.second.file_path == file_path);
+    }
+  );
+
+  // The existing response is kept unless this one was stored completely
+  if (not did_write)
+  {
+    remove(store->tmp_path.c_str());
+    return false;
+  }
+
+  if (existing_entry != entries.end())
+  {
+    erase(existing_entry);
+  }
+
+  if (not evict(file_size))
+  {
+    remove(store->tmp_path.c_str());
+    return false;
+  }
+
+  // FATFS cannot rename over an existing file
+  remove(file_path.c_str());
+  if (rename(store->tmp_path.c_str(), file_path.c_str()) != 0)
+  {
+    ESP_LOGW(TAG, "Unable to replace '%s'", file_path.c_str());
+    remove(store->tmp_path.c_str());
+    return false;
+  }
+
+  auto& entry = entries[store->key];
+  entry.file_path = file_path;
+  entry.etag = cache_control.etag;
+  entry.last_modified = cache_control.last_modified;
+  entry.expires = cache_control.expires;
+  entry.body_offset = body_offset;
+  entry.body_size = header.body_size;
+  entry.last_used = ++use_count;
+
+  total_size += file_size;
+
+  return true;
+}
+
+auto ResponseCache::restore()
+  -> void
+{
+  auto* dir = opendir(path.c_str());
+  if (not dir)
+  {
+    return;
+  }
+
+  // By modification time, then by key
+  std::vector<std::pair<time_t, std::string>> restored_files;
+
+  while (const auto* dirent = readdir(dir))
+  {
+    const auto name = std::string_view{dirent->d_name};
+    if (name.size() < 4)
+    {
+      continue;
+    }
+
+    const auto file_path = path + "/" + std::string{name};
+    const auto extension = name.substr(name.size() - 4);
+
+    // Left behind by a reset while storing a response
+    if (equals_ignore_case(extension, TmpFileExtension))
+    {
+      remove(file_path.c_str());
+      continue;
+    }
+
+    if (not equals_ignore_case(extension, ResponseFileExtension))
+    {
+      continue;
+    }
+
+    auto* file = fopen(file_path.c_str(), "rb");
+    if (not file)
+    {
+      continue;
+    }
+
+    ResponseCacheHeader header;
+    std::string key;
+    Entry entry;
+
+    auto is_valid_file = (
+      fread(&header, sizeof(header), 1, file) == 1
+      and memcmp(
+        header.identifier,
+        ResponseCacheIdentifier,
+        sizeof(header.identifier)
+      ) == 0
+      and header.version == ResponseCacheVersion
+    );
+
+    // The sizes are checked against the file before anything is allocated
+    // for them, so a corrupt header is not a huge allocation. A truncated
+    // body is not a valid response either
+    const auto persisted_size = (
+      uint64_t{sizeof(header)}
+      + header.key_size
+      + header.etag_size
+      + header.last_modified_size
+      + header.body_size
+    );
+
+    is_valid_file = (
+      is_valid_file
+      and fseek(file, 0, SEEK_END) == 0
+      and static_cast<uint64_t>(ftell(file)) == persisted_size
+      and fseek(file, sizeof(header), SEEK_SET) == 0
+    );
+
+    if (is_valid_file)
+    {
+      key.resize(header.key_size);
+      entry.etag.resize(header.etag_size);
+      entry.last_modified.resize(header.last_modified_size);
+
+      is_valid_file = (
+        fread(key.data(), 1, key.size(), file) == key.size()
+        and fread(
+          entry.etag.data(),
+          1,
+          entry.etag.size(),
+          file
+        ) == entry.etag.size()
+        and fread(
+          entry.last_modified.data(),
+          1,
+          entry.last_modified.size(),
+          file
+        ) == entry.last_modified.size()
+      );
+    }
+    fclose(file);
+
+    if (not is_valid_file)
+    {
+      ESP_LOGW(TAG, "Removing invalid cached response '%s'", file_path.c_str());
+      remove(file_path.c_str());
+      continue;
+    }
+
+    entry.body_offset = (
+      sizeof(header)
+      + header.key_size
+      + header.etag_size
+      + header.last_modified_size
+    );
+    entry.body_size = header.body_size;
+
+    // Touched whenever the body is used, see open_body()
+    struct stat file_stat;
+    const auto last_used_time = (
+      (stat(file_path.c_str(), &file_stat) == 0)? file_stat.st_mtime : 0
+    );
+    restored_files.emplace_back(last_used_time, key);
+
+    entry.file_path = file_path;
+    entry.expires = header.expires;
+
+    total_size += (entry.body_offset + entry.body_size);
+    entries.emplace(std::move(key), std::move(entry));
+  }
+
+  closedir(dir);
+
+  // The least recently used order of the previous boot
+  std::sort(restored_files.begin(), restored_files.end());
+  for (const auto& restored_file : restored_files)
+  {
+    entries[restored_file.second].last_used = ++use_count;
+  }
+
+  // e.g. if max_size was reduced since
+  evict(0);
+
+  ESP_LOGI(
+    TAG,
+    "Restored %zu cached responses (%zu bytes)",
+    entries.size(),
+    total_size
+  );
+}
+
+auto ResponseCache::get_file_path(
+  const std::string_view key,
+  const char* extension
+) const
+  -> std::string
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (const auto c : key)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+
+  char name[9];
+  snprintf(name, sizeof(name), "%08lx", static_cast<unsigned long>(hash));
+
+  return path + "/" + name + extension;
+}
+
+auto ResponseCache::erase(Entries::iterator entry_iter)
+  -> void
+{
+  const auto& entry = entry_iter->second;
+
+  remove(entry.file_path.c_str());
+  total_size -= (entry.body_offset + entry.body_size);
+
+  entries.erase(entry_iter);
+}
+
+auto ResponseCache::evict(const size_t size)
+  -> bool
+{
+  if (size > max_size)
+  {
+    return false;
+  }
+
+  while (total_size + size > max_size and not entries.empty())
+  {
+    auto least_recently_used = std::min_element(
+      entries.begin(),
+      entries.end(),
+      [](const auto& a, const auto& b) -> bool
+      {
+        return (a.second.last_used < b.second.last_used);
+      }
+    );
+
+    ESP_LOGI(
+      TAG,
+      "Evicting cached response '%s'",
+      least_recently_used->second.file_path.c_str()
+    );
+    erase(least_recently_used);
+  }
+
+  return true;
+}
+
+} // namespace Requests
@@ -0,0 +1,157 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace Requests {
+
+constexpr char ResponseCacheIdentifier[4] = {'R', 's', 'p', '$'};
+constexpr uint32_t ResponseCacheVersion = 1;
+
+// Each cached response is a file of a ResponseCacheHeader, followed by the
+// request key, ETag and Last-Modified strings, and then the body
+struct ResponseCacheHeader
+{
+  char identifier[4];
+  uint32_t version;
+  // Unix time until which the response is fresh, 0 to always revalidate it
+  int64_t expires;
+  uint32_t key_size;
+  uint32_t body_size;
+  uint16_t etag_size;
+  uint16_t last_modified_size;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(ResponseCacheHeader) == 32);
+
+// Parsed from the Cache-Control, Expires, ETag and Last-Modified headers
+struct ResponseCacheControl
+{
+  std::string etag;
+  std::string last_modified;
+  int64_t expires = 0;
+  bool has_expires = false;
+  bool no_store = false;
+};
+
+// Update cache_control from a response header, false if it is not relevant
+auto parse_cache_control_header(
+  const std::string_view k,
+  const std::string_view v,
+  ResponseCacheControl& cache_control
+) -> bool;
+
+// Keeps successful GET response bodies in files under path (e.g. on FATFS),
+// so an unchanged resource is revalidated with If-None-Match or
+// If-Modified-Since (or not requested at all while it is fresh) instead of
+// downloaded again. The least recently used responses (across boots, by
+// file modification time) are removed to keep the files under max_size
+// bytes in total
+class ResponseCache
+{
+public:
+  struct Entry
+  {
+    std::string file_path;
+    std::string etag;
+    std::string last_modified;
+    int64_t expires = 0;
+    size_t body_offset = 0;
+    size_t body_size = 0;
+    uint32_t last_used = 0;
+  };
+
+  using Entries = std::unordered_map<std::string, Entry>;
+
+  // A response body being stored as it arrives, into a temporary file which
+  // is removed unless the store is committed
+  struct Store
+  {
+    ~Store();
+
+    std::string key;
+    ResponseCacheControl cache_control;
+    std::string tmp_path;
+    FILE* file = nullptr;
+    size_t body_size = 0;
+  };
+
+  using StorePtr = std::unique_ptr<Store>;
+
+  // Responses cached by a previous boot are restored
+  ResponseCache(const std::string_view _path, const size_t _max_size);
+
+  // False if the cache directory could not be created
+  auto is_valid() const
+    -> bool;
+
+  // nullptr if there is no response for key
+  auto find(const std::string_view key)
+    -> Entry*;
+
+  // Whether the response can be used without revalidating it,
+  // never before the system time has been set
+  auto is_fresh(const Entry& entry) const
+    -> bool;
+
+  // After a 304 Not Modified response
+  auto refresh(Entry& entry, const ResponseCacheControl& cache_control)
+    -> bool;
+
+  // Positioned at the start of the body, nullptr if it can not be read
+  auto open_body(Entry& entry)
+    -> FILE*;
+
+  // nullptr if the response must not (or can not usefully) be stored
+  auto begin_store(
+    const std::string_view key,
+    const ResponseCacheControl& cache_control
+  ) -> StorePtr;
+
+  auto write_store(Store& store, const std::string_view chunk)
+    -> bool;
+
+  // Replaces any response cached for the same key
+  auto commit_store(StorePtr&& store)
+    -> bool;
+
+protected:
+  auto restore()
+    -> void;
+
+  auto get_file_path(const std::string_view key, const char* extension) const
+    -> std::string;
+
+  auto erase(Entries::iterator entry_iter)
+    -> void;
+
+  // Remove the least recently used responses until size more bytes fit
+  auto evict(const size_t size)
+    -> bool;
+
+private:
+  const std::string path;
+  const size_t max_size;
+  bool valid = false;
+
+  Entries entries;
+  size_t total_size = 0;
+  uint32_t use_count = 0;
+};
+
+} // namespace Requests
@@ -0,0 +1,305 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "response_sink_writer.h"
+
+#include "actor_model.h"
+
+#include <algorithm>
+
+#include "esp_log.h"
+
+namespace Requests {
+
+constexpr char TAG[] = "response_sink";
+
+ResponseSinkWriter::ResponseSinkWriter(const ResponseSink& sink)
+: type(sink.type())
+, path(sink.path()? sink.path()->str() : "")
+, channel_id(sink.channel_id())
+, progress_interval_bytes(sink.progress_interval_bytes())
+, next_progress_bytes(sink.progress_interval_bytes())
+{
+}
+
+ResponseSinkWriter::~ResponseSinkWriter()
+{
+  if (is_open)
+  {
+    discard();
+  }
+}
+
+auto ResponseSinkWriter::write(const std::string_view chunk)
+  -> WriteResult
+{
+  if (failed or not (is_open or open()))
+  {
+    return WriteResult::Failed;
+  }
+
+  auto ok = false;
+  switch (type)
+  {
+    case ResponseSinkType::File:
+    {
+      ok = (fwrite(chunk.data(), sizeof(char), chunk.size(), fp) == chunk.size());
+      break;
+    }
+
+    case ResponseSinkType::OtaPartition:
+    {
+      ok = (esp_ota_write(ota_handle, chunk.data(), chunk.size()) == ESP_OK);
+      break;
+    }
+
+    case ResponseSinkType::Channel:
+    {
+      const auto max_record_size = channel->get_max_record_size();
+      if (max_record_size == 0)
+      {
+        break;
+      }
+
+      // A chunk written again after Full continues after the records which
+      // were already pushed
+      auto offset = std::min(channel_chunk_offset, chunk.size());
+      while (offset < chunk.size())
+      {
+        const auto record = ActorModel::BufferView{
+          reinterpret_cast<const uint8_t*>(chunk.data() + offset),
+          std::min(max_record_size, chunk.size() - offset)
+        };
+
+        if (not channel->push(record))
+        {
+          break;
+        }
+
+        offset += record.size();
+      }
+
+      if (offset < chunk.size() and channel->is_open())
+      {
+        channel_chunk_offset = offset;
+        return WriteResult::Full;
+      }
+
+      channel_chunk_offset = 0;
+      ok = (offset == chunk.size());
+      break;
+    }
+
+    case ResponseSinkType::None:
+    default:
+    {
+      break;
+    }
+  }
+
+  if (not ok)
+  {
+    ESP_LOGE(TAG, "Unable to write %zu bytes of response body", chunk.size());
+    failed = true;
+    return WriteResult::Failed;
+  }
+
+  bytes_written += chunk.size();
+  return WriteResult::Written;
+}
+
+auto ResponseSinkWriter::commit()
+  -> bool
+{
+  if (failed)
+  {
+    return false;
+  }
+
+  // Nothing was written, e.g. an empty 200 or 204 response
+  if (not is_open)
+  {
+    // Which still replaces the file, but an empty image is not an update
+    if (type == ResponseSinkType::File)
+    {
+      if (not open())
+      {
+        return false;
+      }
+    }
+    else {
+      return (type != ResponseSinkType::OtaPartition);
+    }
+  }
+
+  auto ok = true;
+  switch (type)
+  {
+    case ResponseSinkType::File:
+    {
+      ok = (fclose(fp) == 0);
+      fp = nullptr;
+      break;
+    }
+
+    case ResponseSinkType::OtaPartition:
+    {
+      ok = (esp_ota_end(ota_handle) == ESP_OK);
+      ota_handle = 0;
+      break;
+    }
+
+    case ResponseSinkType::Channel:
+    case ResponseSinkType::None:
+    default:
+    {
+      channel.reset();
+      break;
+    }
+  }
+
+  is_open = false;
+  failed = not ok;
+
+  return ok;
+}
+
+auto ResponseSinkWriter::discard()
+  -> void
+{
+  const auto was_written = (is_open or bytes_written > 0);
+  close();
+
+  if (type == ResponseSinkType::File and was_written)
+  {
+    if (remove(path.c_str()) != 0)
+    {
+      ESP_LOGW(TAG, "Could not delete (possibly) corrupt file %s", path.c_str());
+    }
+  }
+
+  // Records already pushed to a channel cannot be taken back
+  failed = false;
+  bytes_written = 0;
+  channel_chunk_offset = 0;
+  next_progress_bytes = progress_interval_bytes;
+}
+
+auto ResponseSinkWriter::get_bytes_written() const
+  -> uint64_t
+{
+  return bytes_written;
+}
+
+auto ResponseSinkWriter::take_progress()
+  -> bool
+{
+  if (progress_interval_bytes == 0 or bytes_written < next_progress_bytes)
+  {
+    return false;
+  }
+
+  // Once, even if a chunk spans several intervals
+  while (next_progress_bytes <= bytes_written)
+  {
+    next_progress_bytes += progress_interval_bytes;
+  }
+
+  return true;
+}
+
+auto ResponseSinkWriter::open()
+  -> bool
+{
+  switch (type)
+  {
+    case ResponseSinkType::File:
+    {
+      fp = fopen(path.c_str(), "w");
+      if (fp == nullptr)
+      {
+        ESP_LOGE(TAG, "Could not open file for writing: %s", path.c_str());
+      }
+
+      is_open = (fp != nullptr);
+      break;
+    }
+
+    case ResponseSinkType::OtaPartition:
+    {
+      ota_partition = (
+        path.empty()
+        ? esp_ota_get_next_update_partition(nullptr)
+        : esp_partition_find_first(
+            ESP_PARTITION_TYPE_APP,
+            ESP_PARTITION_SUBTYPE_ANY,
+            path.c_str()
+          )
+      );
+
+      if (ota_partition == nullptr)
+      {
+        ESP_LOGE(TAG, "No OTA partition '%s'", path.c_str());
+      }
+      else if (
+        esp_ota_begin(ota_partition, OTA_SIZE_UNKNOWN, &ota_handle) != ESP_OK
+      )
+      {
+        ESP_LOGE(TAG, "esp_ota_begin failed for '%s'", ota_partition->label);
+        ota_handle = 0;
+      }
+
+      is_open = (ota_handle != 0);
+      break;
+    }
+
+    case ResponseSinkType::Channel:
+    {
+      channel = ActorModel::get_channel(channel_id);
+      if (not channel)
+      {
+        ESP_LOGE(TAG, "No channel %lu", static_cast<unsigned long>(channel_id));
+      }
+
+      is_open = static_cast<bool>(channel);
+      break;
+    }
+
+    case ResponseSinkType::None:
+    default:
+    {
+      break;
+    }
+  }
+
+  failed = not is_open;
+  return is_open;
+}
+
+auto ResponseSinkWriter::close()
+  -> void
+{
+  if (fp != nullptr)
+  {
+    fclose(fp);
+    fp = nullptr;
+  }
+
+  if (ota_handle != 0)
+  {
+    esp_ota_abort(ota_handle);
+    ota_handle = 0;
+  }
+
+  channel.reset();
+  is_open = false;
+}
+
+} // namespace Requests
@@ -0,0 +1,95 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include "requests_generated.h"
+
+#include "channel.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+namespace Requests {
+
+// Writes a response body straight to a file, an OTA partition or a channel,
+// from the request manager task, as it is received.
+// The destination is opened on the first write, so a discarded body
+// (e.g. before a retry) is written again from the start
+class ResponseSinkWriter
+{
+public:
+  enum class WriteResult : uint8_t
+  {
+    Written,
+    // Only for a channel, try again once the consumer has popped
+    Full,
+    Failed,
+  };
+
+  explicit ResponseSinkWriter(const ResponseSink& sink);
+  ~ResponseSinkWriter();
+
+  ResponseSinkWriter(const ResponseSinkWriter&) = delete;
+  ResponseSinkWriter& operator=(const ResponseSinkWriter&) = delete;
+
+  // A chunk larger than a channel record is pushed as several records,
+  // after Full the same chunk must be written again
+  auto write(const std::string_view chunk)
+    -> WriteResult;
+
+  // Finish writing the body (e.g. esp_ota_end), false if any write failed.
+  // An empty body still creates an empty file, but fails for OTA
+  auto commit()
+    -> bool;
+
+  // Close the destination, and remove what was written to a file
+  auto discard()
+    -> void;
+
+  auto get_bytes_written() const
+    -> uint64_t;
+
+  // True once for every progress_interval_bytes written
+  auto take_progress()
+    -> bool;
+
+private:
+  auto open()
+    -> bool;
+
+  auto close()
+    -> void;
+
+  const ResponseSinkType type;
+  const std::string path;
+  const ActorModel::ChannelId channel_id;
+  const uint32_t progress_interval_bytes;
+
+  FILE* fp = nullptr;
+
+  const esp_partition_t* ota_partition = nullptr;
+  esp_ota_handle_t ota_handle = 0;
+
+  ActorModel::ChannelPtr channel;
+  size_t channel_chunk_offset = 0;
+
+  bool is_open = false;
+  bool failed = false;
+  uint64_t bytes_written = 0;
+  uint64_t next_progress_bytes = 0;
+};
+
+} // namespace Requests
@@ -0,0 +1,454 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#include "tls_session_cache.h"
+
+#include "http_utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+#include "esp_log.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace Requests {
+
+constexpr char TAG[] = "tls_session_cache";
+
+// File names are 8.3, as FATFS may be built without long file name support
+constexpr char SessionFileExtension[] = ".tls";
+constexpr char TmpFileExtension[] = ".tmp";
+
+// Before this (2020-01-01), the system time has not been set yet
+constexpr int64_t MinValidUnixTime = 1577836800;
+
+TlsSessionCache::TlsSessionCache(const size_t _max_count)
+: max_count(_max_count)
+{
+}
+
+auto TlsSessionCache::persist(
+  const std::string_view _path,
+  const int64_t _lifetime_seconds
+) -> bool
+{
+  path.assign(_path.begin(), _path.end());
+  if (_lifetime_seconds > 0)
+  {
+    lifetime_seconds = _lifetime_seconds;
+  }
+
+  if (mkdir(path.c_str(), 0755) != 0 and errno != EEXIST)
+  {
+    ESP_LOGE(TAG, "Unable to create TLS session directory '%s'", path.c_str());
+    path.clear();
+    return false;
+  }
+
+  restore();
+
+  // Sessions of this boot which can now be persisted
+  const auto now = static_cast<int64_t>(time(nullptr));
+  for (auto& entry_iter : entries)
+  {
+    auto& entry = entry_iter.second;
+    if (now >= MinValidUnixTime and entry.expires > now)
+    {
+      if (write(entry_iter.first, entry))
+      {
+        entry.persisted_expires = entry.expires;
+      }
+    }
+  }
+
+  return true;
+}
+
+auto TlsSessionCache::resume(
+  const std::string_view key,
+  mbedtls_ssl_context& ssl
+) -> bool
+{
+  auto entry_iter = entries.find(std::string{key});
+  if (entry_iter == entries.end())
+  {
+    return false;
+  }
+
+  auto& entry = entry_iter->second;
+
+  // A persisted session can only be checked once the system time is set
+  const auto now = static_cast<int64_t>(time(nullptr));
+  if (entry.expires != 0)
+  {
+    if (now < MinValidUnixTime)
+    {
+      return false;
+    }
+
+    if (now >= entry.expires)
+    {
+      erase(entry_iter);
+      return false;
+    }
+  }
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+
+  auto ret = mbedtls_ssl_session_load(
+    &session,
+    entry.session.data(),
+    entry.session.size()
+  );
+
+  if (ret == 0)
+  {
+    ret = mbedtls_ssl_set_session(&ssl, &session);
+  }
+
+  mbedtls_ssl_session_free(&session);
+
+  // e.g. persisted by a different mbedtls configuration
+  if (ret != 0)
+  {
+    ESP_LOGW(
+      TAG,
+      "Unable to resume TLS session with %.*s (%d)",
+      static_cast<int>(key.size()),
+      key.data(),
+      ret
+    );
+    erase(entry_iter);
+    return false;
+  }
+
+  entry.last_used = ++use_count;
+  return true;
+}
+
+auto TlsSessionCache::save(
+  const std::string_view key,
+  const mbedtls_ssl_context& ssl
+) -> bool
+{
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+
+  std::vector<uint8_t> session_buf;
+  auto ret = mbedtls_ssl_get_session(&ssl, &session);
+  if (ret == 0)
+  {
+    // Sized by a first call without a buffer
+    auto session_size = size_t{0};
+    ret = mbedtls_ssl_session_save(&session, nullptr, 0, &session_size);
+    if (ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL)
+    {
+      session_buf.resize(session_size);
+      ret = mbedtls_ssl_session_save(
+        &session,
+        session_buf.data(),
+        session_buf.size(),
+        &session_size
+      );
+    }
+  }
+
+  mbedtls_ssl_session_free(&session);
+
+  if (ret != 0)
+  {
+    ESP_LOGW(
+      TAG,
+      "Unable to save TLS session with %.*s (%d)",
+      static_cast<int>(key.size()),
+      key.data(),
+      ret
+    );
+    return false;
+  }
+
+  auto entry_iter = entries.find(std::string{key});
+  if (entry_iter == entries.end())
+  {
+    evict(1);
+    entry_iter = entries.emplace(std::string{key}, Entry{}).first;
+  }
+
+  const auto now = static_cast<int64_t>(time(nullptr));
+  const auto is_time_set = (now >= MinValidUnixTime);
+
+  auto& entry = entry_iter->second;
+  entry.session = std::move(session_buf);
+  entry.expires = is_time_set? (now + lifetime_seconds) : 0;
+  entry.last_used = ++use_count;
+
+  // A resumed (or renewed) session is only rewritten once the persisted one
+  // is past half its lifetime, to spare the flash
+  if (
+    path.empty()
+    or not is_time_set
+    or (entry.persisted_expires - now) > (lifetime_seconds / 2)
+  )
+  {
+    return true;
+  }
+
+  if (not write(key, entry))
+  {
+    return false;
+  }
+
+  entry.persisted_expires = entry.expires;
+  return true;
+}
+
+auto TlsSessionCache::restore()
+  -> void
+{
+  auto* dir = opendir(path.c_str());
+  if (not dir)
+  {
+    return;
+  }
+
+  const auto now = static_cast<int64_t>(time(nullptr));
+
+  // By expiry, then by key
+  std::vector<std::pair<int64_t, std::string>> restored_files;
+
+  while (const auto* dirent = readdir(dir))
+  {
+    const auto name = std::string_view{dirent->d_name};
+    if (name.size() < 4)
+    {
+      continue;
+    }
+
+    const auto file_path = path + "/" + std::string{name};
+    const auto extension = name.substr(name.size() - 4);
+
+    // Left behind by a reset while persisting a session
+    if (equals_ignore_case(extension, TmpFileExtension))
+    {
+      remove(file_path.c_str());
+      continue;
+    }
+
+    if (not equals_ignore_case(extension, SessionFileExtension))
+    {
+      continue;
+    }
+
+    auto* file = fopen(file_path.c_str(), "rb");
+    if (not file)
+    {
+      continue;
+    }
+
+    TlsSessionCacheHeader header;
+    std::string key;
+    Entry entry;
+
+    auto is_valid_file = (
+      fread(&header, sizeof(header), 1, file) == 1
+      and memcmp(
+        header.identifier,
+        TlsSessionCacheIdentifier,
+        sizeof(header.identifier)
+      ) == 0
+      and header.version == TlsSessionCacheVersion
+    );
+
+    // The sizes are checked against the file before anything is allocated
+    // for them, so a corrupt header is not a huge allocation
+    const auto persisted_size = (
+      uint64_t{sizeof(header)}
+      + header.key_size
+      + header.session_size
+    );
+
+    is_valid_file = (
+      is_valid_file
+      and fseek(file, 0, SEEK_END) == 0
+      and static_cast<uint64_t>(ftell(file)) == persisted_size
+      and fseek(file, sizeof(header), SEEK_SET) == 0
+    );
+
+    if (is_valid_file)
+    {
+      key.resize(header.key_size);
+      entry.session.resize(header.session_size);
+
+      is_valid_file = (
+        fread(key.data(), 1, key.size(), file) == key.size()
+        and fread(
+          entry.session.data(),
+          1,
+          entry.session.size(),
+          file
+        ) == entry.session.size()
+      );
+    }
+    fclose(file);
+
+    if (not is_valid_file)
+    {
+      ESP_LOGW(TAG, "Removing invalid TLS session '%s'", file_path.c_str());
+      remove(file_path.c_str());
+      continue;
+    }
+
+    // Expired sessions are only known to be expired once the time is set
+    if (now >= MinValidUnixTime and now >= header.expires)
+    {
+      remove(file_path.c_str());
+      continue;
+    }
+
+    // A session established this boot is newer
+    if (entries.find(key) != entries.end())
+    {
+      continue;
+    }
+
+    entry.expires = header.expires;
+    entry.persisted_expires = header.expires;
+
+    restored_files.emplace_back(header.expires, key);
+    entries.emplace(std::move(key), std::move(entry));
+  }
+
+  closedir(dir);
+
+  // Sessions which expire last were established last
+  std::sort(restored_files.begin(), restored_files.end());
+  for (const auto& restored_file : restored_files)
+  {
+    entries[restored_file.second].last_used = ++use_count;
+  }
+
+  // e.g. if the cache size was reduced since
+  evict(0);
+
+  ESP_LOGI(TAG, "Restored %zu TLS sessions", restored_files.size());
+}
+
+auto TlsSessionCache::write(const std::string_view key, const Entry& entry)
+  -> bool
+{
+  TlsSessionCacheHeader header;
+  memcpy(
+    header.identifier,
+    TlsSessionCacheIdentifier,
+    sizeof(header.identifier)
+  );
+  header.version = TlsSessionCacheVersion;
+  header.expires = entry.expires;
+  header.key_size = key.size();
+  header.session_size = entry.session.size();
+
+  const auto tmp_path = get_file_path(key, TmpFileExtension);
+  const auto file_path = get_file_path(key, SessionFileExtension);
+
+  auto* file = fopen(tmp_path.c_str(), "wb");
+  if (not file)
+  {
+    ESP_LOGW(TAG, "Unable to open '%s'", tmp_path.c_str());
+    return false;
+  }
+
+  auto did_write = (
+    fwrite(&header, sizeof(header), 1, file) == 1
+    and fwrite(key.data(), 1, key.size(), file) == key.size()
+    and fwrite(
+      entry.session.data(),
+      1,
+      entry.session.size(),
+      file
+    ) == entry.session.size()
+  );
+  did_write = ((fclose(file) == 0) and did_write);
+
+  if (not did_write)
+  {
+    remove(tmp_path.c_str());
+    return false;
+  }
+
+  // FATFS cannot rename over an existing file
+  remove(file_path.c_str());
+  if (rename(tmp_path.c_str(), file_path.c_str()) != 0)
+  {
+    ESP_LOGW(TAG, "Unable to replace '%s'", file_path.c_str());
+    remove(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+auto TlsSessionCache::get_file_path(
+  const std::string_view key,
+  const char* extension
+) const
+  -> std::string
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (const auto c : key)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+
+  char name[9];
+  snprintf(name, sizeof(name), "%08lx", static_cast<unsigned long>(hash));
+
+  return path + "/" + name + extension;
+}
+
+auto TlsSessionCache::erase(Entries::iterator entry_iter)
+  -> void
+{
+  if (not path.empty() and entry_iter->second.persisted_expires != 0)
+  {
+    const auto file_path = get_file_path(entry_iter->first, SessionFileExtension);
+    remove(file_path.c_str());
+  }
+
+  entries.erase(entry_iter);
+}
+
+auto TlsSessionCache::evict(const size_t count)
+  -> void
+{
+  while (entries.size() + count > max_count and not entries.empty())
+  {
+    auto least_recently_used = std::min_element(
+      entries.begin(),
+      entries.end(),
+      [](const auto& a, const auto& b) -> bool
+      {
+        return (a.second.last_used < b.second.last_used);
+      }
+    );
+
+    erase(least_recently_used);
+  }
+}
+
+} // namespace Requests
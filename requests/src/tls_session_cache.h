@@ -0,0 +1,101 @@
+/*
+ * Copyright Paul Reimer, 2018
+ *
+ * This work is licensed under the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 Unported License.
+ * To view a copy of this license, visit
+ * https://creativecommons.org/licenses/by-nc-sa/4.0/
+ * or send a letter to
+ * Creative Commons, 444 Castro Street, Suite 900, Mountain View, California, 94041, USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mbedtls/ssl.h"
+
+namespace Requests {
+
+constexpr char TlsSessionCacheIdentifier[4] = {'T', 'l', 's', '$'};
+constexpr uint32_t TlsSessionCacheVersion = 1;
+
+// Each persisted session is a file of a TlsSessionCacheHeader, followed by
+// the host key and the session as serialized by mbedtls_ssl_session_save()
+struct TlsSessionCacheHeader
+{
+  char identifier[4];
+  uint32_t version;
+  // Unix time after which the session is not resumed
+  int64_t expires;
+  uint32_t key_size;
+  uint32_t session_size;
+};
+
+static_assert(sizeof(TlsSessionCacheHeader) == 24);
+
+// The last TLS session with each host (by "host:port"), which the next
+// connection to it resumes instead of a full handshake. Once persisted to
+// files under path (e.g. on FATFS), sessions are restored by the next boot
+// until lifetime_seconds after the handshake which established them.
+// Sessions established before the system time is set are never persisted
+class TlsSessionCache
+{
+public:
+  struct Entry
+  {
+    std::vector<uint8_t> session;
+    // 0 if the system time was not set, the session is then only resumed
+    // until the next boot
+    int64_t expires = 0;
+    int64_t persisted_expires = 0;
+    uint32_t last_used = 0;
+  };
+
+  using Entries = std::unordered_map<std::string, Entry>;
+
+  explicit TlsSessionCache(const size_t _max_count);
+
+  // Restore the sessions persisted by a previous boot, and persist new ones,
+  // false if the directory could not be created
+  auto persist(const std::string_view _path, const int64_t _lifetime_seconds)
+    -> bool;
+
+  // Before the handshake, false if there is no session to resume
+  auto resume(const std::string_view key, mbedtls_ssl_context& ssl)
+    -> bool;
+
+  // Once the handshake is complete
+  auto save(const std::string_view key, const mbedtls_ssl_context& ssl)
+    -> bool;
+
+protected:
+  auto restore()
+    -> void;
+
+  auto write(const std::string_view key, const Entry& entry)
+    -> bool;
+
+  auto get_file_path(const std::string_view key, const char* extension) const
+    -> std::string;
+
+  auto erase(Entries::iterator entry_iter)
+    -> void;
+
+  // Remove the least recently used sessions until count more fit
+  auto evict(const size_t count)
+    -> void;
+
+private:
+  const size_t max_count;
+  std::string path;
+  int64_t lifetime_seconds = REQUESTS_TLS_SESSION_LIFETIME_SECONDS;
+
+  Entries entries;
+  uint32_t use_count = 0;
+};
+
+} // namespace Requests
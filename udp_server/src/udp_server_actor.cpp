@@ -55,7 +55,6 @@ struct UDPServerActorState
   struct sockaddr_in sock_addr = {0};
 
   uint8_t recv_buf[UDP_SERVER_RECV_BUF_LEN];
-  TRef tick_timer_ref = NullTRef;
 
   MutableUDPConfigurationFlatbuffer udp_server_config_mutable_buf;
 };
@@ -107,11 +106,8 @@ auto udp_server_actor_behaviour(
             {
               ESP_LOGI(TAG, "OK");
 
-              if (not state.tick_timer_ref)
-              {
-                // Re-trigger ourselves periodically (timer will be cancelled later)
-                state.tick_timer_ref = send_interval(200ms, self, "tick");
-              }
+              // Wait for the first datagram
+              watch_socket(self, state.sockfd, SocketInterestReadable);
 
               return {Result::Ok};
             }
@@ -134,14 +130,9 @@ auto udp_server_actor_behaviour(
 
   if (matches(message, "udp_server_stop"))
   {
-    if (state.tick_timer_ref)
-    {
-      cancel(state.tick_timer_ref);
-      state.tick_timer_ref = NullTRef;
-    }
-
     if (state.sockfd > 0)
     {
+      unwatch_socket(state.sockfd);
       close(state.sockfd);
       state.sockfd = -1;
     }
@@ -149,78 +140,72 @@ auto udp_server_actor_behaviour(
     return {Result::Ok};
   }
 
-  if (matches(message, "tick"))
+  if (
+    SocketReadable readable;
+    matches(message, readable)
+    and readable.fd == state.sockfd
+  )
   {
-    if (state.tick_timer_ref)
-    {
-      // Check for received datagrams
-      if (state.sockfd > -1)
-      {
-        memset(state.recv_buf, 0, UDP_SERVER_RECV_BUF_LEN);
-
-        struct sockaddr_in clientaddr;
-        socklen_t clientlen = 0;
-        ssize_t bytes_read = 0;
+    // Drain all received datagrams, then wait for more
+    struct sockaddr_in clientaddr;
+    socklen_t clientlen = sizeof(clientaddr);
+    ssize_t bytes_read = 0;
+
+    do {
+      memset(state.recv_buf, 0, UDP_SERVER_RECV_BUF_LEN);
+
+      clientlen = sizeof(clientaddr);
+      bytes_read = recvfrom(
+        state.sockfd,
+        state.recv_buf,
+        UDP_SERVER_RECV_BUF_LEN - 1,
+        0,
+        (struct sockaddr*)&clientaddr,
+        &clientlen
+      );
 
-        do {
-          bytes_read = recvfrom(
-            state.sockfd,
-            state.recv_buf,
-            UDP_SERVER_RECV_BUF_LEN - 1,
-            0,
-            (struct sockaddr*)&clientaddr,
-            &clientlen
+      if (bytes_read > 0)
+      {
+        if (not state.udp_server_config_mutable_buf.empty())
+        {
+          const auto* udp_server_config = flatbuffers::GetRoot<UDPServerConfiguration>(
+            state.udp_server_config_mutable_buf.data()
           );
-
-          if (bytes_read > 0)
-          {
-            if (not state.udp_server_config_mutable_buf.empty())
-            {
-              const auto* udp_server_config = flatbuffers::GetRoot<UDPServerConfiguration>(
-                state.udp_server_config_mutable_buf.data()
-              );
-              if (
-                udp_server_config
-                and udp_server_config->to_pid()
-                and not compare_uuids(*(udp_server_config->to_pid()), NullUUID)
-              )
-              {
-                auto packet_bytes = BufferView{
-                  state.recv_buf,
-                  static_cast<size_t>(bytes_read)
-                };
-                send(*(udp_server_config->to_pid()), "packet", packet_bytes);
-              }
-            }
-          }
-          else if ((bytes_read == -1) and (errno == EWOULDBLOCK))
+          if (
+            udp_server_config
+            and udp_server_config->to_pid()
+            and not compare_uuids(*(udp_server_config->to_pid()), NullUUID)
+          )
           {
-            // This is OK, no connections to service
-            return {Result::Ok, EventTerminationAction::ContinueProcessing};
-          }
-          else {
-            // Close the socket, if no data could be received
-            if (state.sockfd > -1)
-            {
-              close(state.sockfd);
-              state.sockfd = -1;
-            }
-
-            ESP_LOGE(TAG, "UDP server encountered unexpected error %d", errno);
-            return {Result::Ok, EventTerminationAction::ContinueProcessing};
+            auto packet_bytes = BufferView{
+              state.recv_buf,
+              static_cast<size_t>(bytes_read)
+            };
+            send(*(udp_server_config->to_pid()), "packet", packet_bytes);
           }
         }
-        while (bytes_read > 0);
-
+      }
+      else if ((bytes_read == -1) and (errno == EWOULDBLOCK))
+      {
+        // Drained, re-arm for the next datagram
+        watch_socket(self, state.sockfd, SocketInterestReadable);
         return {Result::Ok};
       }
       else {
-        ESP_LOGE(TAG, "UDP server socket not connected");
-      }
+        // Close the socket, if no data could be received
+        ESP_LOGE(TAG, "UDP server encountered unexpected error %d", errno);
+
+        unwatch_socket(state.sockfd);
+        close(state.sockfd);
+        state.sockfd = -1;
 
-      printf("error in tick\n");
-      return {Result::Error};
+        return {Result::Ok, EventTerminationAction::ContinueProcessing};
+      }
     }
+    while (bytes_read > 0);
+
+    watch_socket(self, state.sockfd, SocketInterestReadable);
+    return {Result::Ok};
   }
 
   return {Result::Unhandled};